@@ -467,22 +467,52 @@ enum EThingSpecialActivationType
 	THINGSPEC_Switch			= 1<<10,	// The thing is alternatively activated and deactivated when triggered
 };
 
-// [RH] Like msecnode_t, but for the blockmap
-struct FBlockNode
+// Number of FBlockThingsIterators that can be active at the same time and
+// use AActor::BlockStamps to skip actors they have already returned. Any
+// further ones fall back to a hash table of their own.
+enum { MAX_BLOCKTHINGSSTAMPS = 4 };
+
+// Number of blocks for which AActor::BlockSlots remembers the actor's slot
+// in FBlockThings::Actors. This covers every actor that spans no more than
+// 3x3 blocks. Removing larger ones from the blocks past that has to search.
+enum { MAX_BLOCKSLOTS = 9 };
+
+// The TID hash. Every actor with a TID is in the chain of all actors
+// with that TID (linked through AActor::inext) and in the chain of actors
+// with that TID and class (linked through AActor::cnext). The heads of
+// both chains are kept in the same open addressing table; the first kind
+// is keyed with a NULL class. New actors are added to the front.
+class FTIDHash
 {
-	AActor *Me;						// actor this node references
-	int BlockIndex;					// index into blocklinks for the block this node is in
-	FBlockNode **PrevActor;			// previous actor in this block
-	FBlockNode *NextActor;			// next actor in this block
-	FBlockNode **PrevBlock;			// previous block this actor is in
-	FBlockNode *NextBlock;			// next block this actor is in
+public:
+	FTIDHash ();
+	~FTIDHash ();
+
+	AActor *Find (int tid, const PClass *type) const;
+	AActor **Insert (int tid, const PClass *type);
+	void Clear ();
+
+private:
+	struct Entry
+	{
+		int TID;			// 0 if unused
+		const PClass *Type;
+		AActor *Head;		// NULL if the chain became empty
+	};
 
-	static FBlockNode *Create (AActor *who, int x, int y);
-	void Release ();
+	static unsigned int Hash (int tid, const PClass *type)
+	{
+		return (unsigned int)tid * 2654435761u ^ (unsigned int)((size_t)type >> 4);
+	}
+	void Rehash ();
 
-	static FBlockNode *FreeBlocks;
+	Entry *Entries;
+	unsigned int Size;		// always a power of 2
+	unsigned int Used;
 };
 
+bool P_IsLeafClass (const PClass *type);
+
 class FDecalBase;
 class AInventory;
 
@@ -813,7 +843,10 @@ public:
 
 // interaction info
 	fixed_t			pitch, roll;
-	FBlockNode		*BlockNode;			// links in blocks (if needed)
+	int				BlockX, BlockY;		// first block this actor is linked into
+	int				BlockW, BlockH;		// number of blocks linked into (0 if not in the blockmap)
+	int				BlockStamps[MAX_BLOCKTHINGSSTAMPS];	// for FBlockThingsIterator
+	int				BlockSlots[MAX_BLOCKSLOTS];	// slot in each block, row by row from BlockX/BlockY
 	struct sector_t	*Sector;
 	subsector_t *		subsector;
 	fixed_t			floorz, ceilingz;	// closest together of contacted secs
@@ -873,7 +906,8 @@ public:
 
 	int		accuracy, stamina;		// [RH] Strife stats -- [XA] moved here for DECORATE/ACS access.
 
-	AActor			*inext, **iprev;// Links to other mobjs in same bucket
+	AActor			*inext, **iprev;// Links to other mobjs with the same TID
+	AActor			*cnext, **cprev;// Links to other mobjs with the same TID and class
 	TObjPtr<AActor> goal;			// Monster's goal if not chasing anything
 	int				waterlevel;		// 0=none, 1=feet, 2=waist, 3=eyes
 	BYTE			boomwaterlevel;	// splash information for non-swimmable water sectors
@@ -973,8 +1007,8 @@ public:
 	void RemoveFromHash ();
 
 private:
-	static AActor *TIDHash[128];
-	static inline int TIDHASH (int key) { return key & 127; }
+	static FTIDHash TIDHash;
+	friend class FTIDHash;
 	static FSharedStringArena mStringPropertyData;
 
 	friend class FActorIterator;
@@ -1024,36 +1058,56 @@ public:
 class FActorIterator
 {
 public:
-	FActorIterator (int i) : base (NULL), id (i)
+	FActorIterator (int i) : base (NULL), id (i), exact (NULL)
 	{
 	}
-	FActorIterator (int i, AActor *start) : base (start), id (i)
+	FActorIterator (int i, AActor *start) : base (start), id (i), exact (NULL)
 	{
 	}
 	AActor *Next ()
 	{
 		if (id == 0)
 			return NULL;
-		if (!base)
-			base = AActor::TIDHash[id & 127];
-		else
-			base = base->inext;
+		if (exact != NULL)
+		{
+			if (!base)
+				base = AActor::TIDHash.Find (id, exact);
+			else
+				base = base->cnext;
 
-		while (base && base->tid != id)
-			base = base->inext;
+			while (base && base->tid != id)
+				base = base->cnext;
+		}
+		else
+		{
+			if (!base)
+				base = AActor::TIDHash.Find (id, NULL);
+			else
+				base = base->inext;
 
+			while (base && base->tid != id)
+				base = base->inext;
+		}
 		return base;
 	}
+protected:
+	// Only returns actors of exactly this class, which is faster but only
+	// equivalent to an IsKindOf check if the class has no descendants.
+	FActorIterator (int i, const PClass *type) : base (NULL), id (i)
+	{
+		exact = (type != NULL && P_IsLeafClass (type)) ? type : NULL;
+	}
 private:
 	AActor *base;
 	int id;
+	const PClass *exact;
 };
 
 template<class T>
 class TActorIterator : public FActorIterator
 {
 public:
-	TActorIterator (int id) : FActorIterator (id) {}
+	TActorIterator (int id) : FActorIterator (id, RUNTIME_CLASS(T)) {}
 	T *Next ()
 	{
 		AActor *actor;
@@ -1069,9 +1123,9 @@ class NActorIterator : public FActorIterator
 {
 	const PClass *type;
 public:
-	NActorIterator (const PClass *cls, int id) : FActorIterator (id) { type = cls; }
-	NActorIterator (FName cls, int id) : FActorIterator (id) { type = PClass::FindClass(cls); }
-	NActorIterator (const char *cls, int id) : FActorIterator (id) { type = PClass::FindClass(cls); }
+	NActorIterator (const PClass *cls, int id) : FActorIterator (id, cls) { type = cls; }
+	NActorIterator (FName cls, int id) : FActorIterator (id, PClass::FindClass(cls)) { type = PClass::FindClass(cls); }
+	NActorIterator (const char *cls, int id) : FActorIterator (id, PClass::FindClass(cls)) { type = PClass::FindClass(cls); }
 	AActor *Next ()
 	{
 		AActor *actor;
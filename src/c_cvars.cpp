@@ -51,6 +51,12 @@
 #include "v_palette.h"
 #include "v_video.h"
 #include "colormatcher.h"
+#include "gameconfigfile.h"
+#include "stats.h"
+
+// Buckets for FindCVar. This is a plain array so that it is already set up
+// when the cvars defined at file scope are constructed.
+#define CVAR_HASH_SIZE	1021
 
 struct FLatchedValue
 {
@@ -65,6 +71,7 @@ bool FBaseCVar::m_DoNoSet = false;
 bool FBaseCVar::m_UseCallback = false;
 
 FBaseCVar *CVars = NULL;
+static FBaseCVar *CVarHash[CVAR_HASH_SIZE];
 
 int cvar_defflags;
 
@@ -89,6 +96,10 @@ FBaseCVar::FBaseCVar (const char *var_name, DWORD flags, void (*callback)(FBaseC
 		Name = copystring (var_name);
 		m_Next = CVars;
 		CVars = this;
+
+		FBaseCVar **bucket = &CVarHash[MakeKey (var_name) % CVAR_HASH_SIZE];
+		m_HashNext = *bucket;
+		*bucket = this;
 	}
 
 	if (var)
@@ -116,16 +127,25 @@ FBaseCVar::~FBaseCVar ()
 {
 	if (Name)
 	{
-		FBaseCVar *var, *prev;
-
-		var = FindCVar (Name, &prev);
+		FBaseCVar **link;
 
-		if (var == this)
+		// Unlink this cvar and not just the first one with its name. When a
+		// cvar replaces an autocvar, the replacement is already linked in.
+		for (link = &CVarHash[MakeKey (Name) % CVAR_HASH_SIZE]; *link != NULL; link = &(*link)->m_HashNext)
 		{
-			if (prev)
-				prev->m_Next = m_Next;
-			else
-				CVars = m_Next;
+			if (*link == this)
+			{
+				*link = m_HashNext;
+				break;
+			}
+		}
+		for (link = &CVars; *link != NULL; link = &(*link)->m_Next)
+		{
+			if (*link == this)
+			{
+				*link = m_Next;
+				break;
+			}
 		}
 		C_RemoveTabCommand(Name);
 		delete[] Name;
@@ -1441,14 +1461,22 @@ FBaseCVar *FindCVar (const char *var_name, FBaseCVar **prev)
 	if (prev == NULL)
 		prev = &dummy;
 
-	var = CVars;
-	*prev = NULL;
+	var = CVarHash[MakeKey (var_name) % CVAR_HASH_SIZE];
 	while (var)
 	{
 		if (stricmp (var->GetName (), var_name) == 0)
 			break;
-		*prev = var;
-		var = var->m_Next;
+		var = var->m_HashNext;
+	}
+
+	// The previous cvar in the global list can only be found by walking it.
+	*prev = NULL;
+	if (prev != &dummy && var != NULL)
+	{
+		for (FBaseCVar *probe = CVars; probe != var; probe = probe->m_Next)
+		{
+			*prev = probe;
+		}
 	}
 	return var;
 }
@@ -1460,7 +1488,7 @@ FBaseCVar *FindCVarSub (const char *var_name, int namelen)
 	if (var_name == NULL)
 		return NULL;
 
-	var = CVars;
+	var = CVarHash[MakeKey (var_name, namelen) % CVAR_HASH_SIZE];
 	while (var)
 	{
 		const char *probename = var->GetName ();
@@ -1470,7 +1498,7 @@ FBaseCVar *FindCVarSub (const char *var_name, int namelen)
 		{
 			break;
 		}
-		var = var->m_Next;
+		var = var->m_HashNext;
 	}
 	return var;
 }
@@ -1706,6 +1734,64 @@ CCMD (cvarlistplain)
 	FBaseCVar::ListVars (NULL, true);
 }
 
+//===========================================================================
+//
+// CCMD cvarbench
+//
+// Times looking up every cvar by name, which is what ACS scripts that poll
+// cvars do every tic, and looking up every key of the config file, which is
+// what loading it does.
+//
+//===========================================================================
+
+CCMD (cvarbench)
+{
+	int passes = argv.argc() > 1 ? MAX(1, atoi (argv[1])) : 100;
+	TArray<const char *> names;
+	cycle_t cycles;
+	int found = 0;
+
+	for (FBaseCVar *var = CVars; var != NULL; var = var->GetNext())
+	{
+		names.Push (var->GetName());
+	}
+	cycles.Reset();
+	cycles.Clock();
+	for (int i = 0; i < passes; ++i)
+	{
+		for (unsigned int j = 0; j < names.Size(); ++j)
+		{
+			found += FindCVar (names[j], NULL) != NULL;
+		}
+	}
+	cycles.Unclock();
+	Printf ("%u cvars: %d lookups in %.3f ms, %.1f ns each\n", names.Size(), found,
+		cycles.TimeMS(), cycles.TimeMS() * 1e6 / MAX(1, found));
+
+	if (GameConfig != NULL)
+	{
+		FConfigFile config (GameConfig->GetPathName());
+		const char *key, *value;
+		int keys = 0;
+
+		cycles.Reset();
+		cycles.Clock();
+		if (config.SetFirstSection())
+		{
+			do
+			{
+				while (config.NextInSection (key, value))
+				{
+					FindCVar (key, NULL);
+					keys++;
+				}
+			} while (config.SetNextSection());
+		}
+		cycles.Unclock();
+		Printf ("%s: %d keys looked up in %.3f ms\n", GameConfig->GetPathName(), keys, cycles.TimeMS());
+	}
+}
+
 CCMD (archivecvar)
 {
 
@@ -757,6 +757,17 @@ void SetDehParams(FState * state, int codepointer)
 		// This simply should not happen.
 		Printf("Unmanaged dehacked codepointer alias num %i\n", codepointer);
 	}
+
+	// Everything was resolved before DEHACKED ran, so the parameters are
+	// only evaluated if they got compiled when they were set.
+	for (int i = 0; i < MBFCodePointers[codepointer].params; i++)
+	{
+		if (StateParams.Get(ParamIndex+i) != NULL && StateParams.GetProgram(ParamIndex+i) == NULL)
+		{
+			Printf("Dehacked codepointer %s: parameter %d cannot be evaluated\n",
+				MBFCodePointers[codepointer].alias, i);
+		}
+	}
 }
 
 static int PatchThing (int thingy)
@@ -3051,7 +3062,7 @@ void ADehackedPickup::DoPickupSpecial (AActor *toucher)
 	Super::DoPickupSpecial (toucher);
 	// If the real pickup hasn't joined the toucher's inventory, make sure it
 	// doesn't stick around.
-	if (RealPickup->Owner != toucher)
+	if (RealPickup != NULL && RealPickup->Owner != toucher)
 	{
 		RealPickup->Destroy ();
 	}
@@ -51,7 +51,7 @@ public:
 	void Serialize(FArchive &arc);
 private:
 	const PClass *DetermineType ();
-	AInventory *RealPickup;
+	TObjPtr<AInventory> RealPickup;
 public:
 	bool droppedbymonster;
 };
@@ -107,6 +107,7 @@
 #include "resourcefiles/resourcefile.h"
 #include "r_renderer.h"
 #include "p_local.h"
+#include "profiler.h"
 
 #ifdef USE_POLYMOST
 #include "r_polymost.h"
@@ -936,6 +937,10 @@ void D_Display ()
 
 void D_ErrorCleanup ()
 {
+	if (benchmarking || nodebenchmarking)
+	{
+		I_FatalError ("Benchmark aborted.\n");
+	}
 	savegamerestore = false;
 	screen->Unlock ();
 	bglobal.RemoveAllBots (true);
@@ -979,6 +984,8 @@ void D_DoomLoop ()
 	{
 		try
 		{
+			Profile_StartFrame ();
+
 			// frame syncronous IO operations
 			if (gametic > lasttic)
 			{
@@ -1015,12 +1022,15 @@ void D_DoomLoop ()
 					D_DoAdvanceDemo ();
 				C_Ticker ();
 				M_Ticker ();
+				G_BenchmarkStartTic ();
 				G_Ticker ();
 				// [RH] Use the consoleplayer's camera to update sounds
 				S_UpdateSounds (players[consoleplayer].camera);	// move positional sounds
 				gametic++;
 				maketic++;
 				GC::CheckGC ();
+				G_BenchmarkEndTic ();
+				G_NodeBenchmarkTic ();
 				Net_NewMakeTic ();
 			}
 			else
@@ -2516,6 +2526,21 @@ void D_DoomMain (void)
 				D_DoomLoop ();	// never returns
 			}
 
+			FString *benchdemos;
+			int numbench = Args->CheckParmList ("-bench", &benchdemos);
+			if (numbench > 0)
+			{
+				G_StartBenchmark (numbench, benchdemos, Args->CheckValue ("-benchout"));
+				D_DoomLoop ();	// never returns
+			}
+
+			if (Args->CheckParm ("-nodebench"))
+			{
+				v = Args->CheckValue ("-nodebench");
+				G_StartNodeBenchmark (v != NULL ? atoi (v) : 3);
+				D_DoomLoop ();	// never returns
+			}
+
 			if (gameaction != ga_loadgame && gameaction != ga_loadgamehidecon)
 			{
 				if (autostart || netgame)
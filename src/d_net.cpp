@@ -62,6 +62,7 @@
 #include "p_spec.h"
 #include "hardware.h"
 #include "intermission/intermission.h"
+#include "profiler.h"
 
 EXTERN_CVAR (Int, disableautosave)
 EXTERN_CVAR (Int, autosavecount)
@@ -1692,6 +1693,7 @@ void D_QuitNetGame (void)
 //
 void TryRunTics (void)
 {
+	PROFILE_ZONE("TryRunTics");
 	int 		i;
 	int 		lowtic;
 	int 		realtics;
@@ -372,19 +372,31 @@ void DObject::InPlaceConstructor (void *mem)
 }
 
 DObject::DObject ()
-: Class(0), ObjectFlags(0)
+: Class(0), ObjectFlags(0), NurseryAge(0)
 {
 	ObjectFlags = GC::CurrentWhite & OF_WhiteBits;
 	ObjNext = GC::Root;
 	GC::Root = this;
+	// New objects go to the nursery unless a full collection is in progress.
+	if (GC::NurseryLimit != 0 && GC::State == GC::GCS_Pause)
+	{
+		ObjectFlags |= OF_Young;
+		GC::NurseryCount++;
+	}
 }
 
 DObject::DObject (PClass *inClass)
-: Class(inClass), ObjectFlags(0)
+: Class(inClass), ObjectFlags(0), NurseryAge(0)
 {
 	ObjectFlags = GC::CurrentWhite & OF_WhiteBits;
 	ObjNext = GC::Root;
 	GC::Root = this;
+	// New objects go to the nursery unless a full collection is in progress.
+	if (GC::NurseryLimit != 0 && GC::State == GC::GCS_Pause)
+	{
+		ObjectFlags |= OF_Young;
+		GC::NurseryCount++;
+	}
 }
 
 DObject::~DObject ()
@@ -486,6 +498,9 @@ size_t DObject::StaticPointerSubstitution (DObject *old, DObject *notOld)
 	size_t changed = 0;
 	int i;
 
+	// The pointers are changed without going through TObjPtr.
+	GC::EscapeBarrier(notOld);
+
 	// Go through all objects.
 	for (probe = GC::Root; probe != NULL; probe = probe->ObjNext)
 	{
@@ -222,6 +222,10 @@ enum EObjectFlags
 	OF_JustSpawned		= 1 << 8,		// Thinker was spawned this tic
 	OF_SerialSuccess	= 1 << 9,		// For debugging Serialize() calls
 	OF_Sentinel			= 1 << 10,		// Object is serving as the sentinel in a ring list
+
+	// Generational GC flags
+	OF_Young			= 1 << 11,		// Object is in the nursery
+	OF_Escaped			= 1 << 12,		// Object is young and something the nursery collection does not look at points to it
 };
 
 template<class T> class TObjPtr;
@@ -236,7 +240,8 @@ namespace GC
 		GCS_Finalize
 	};
 
-	// Number of bytes currently allocated through M_Malloc/M_Realloc.
+	// Number of bytes currently allocated through M_Malloc/M_Realloc and
+	// M_AllocObject.
 	extern size_t AllocBytes;
 
 	// Amount of memory to allocate before triggering a collection.
@@ -263,6 +268,11 @@ namespace GC
 	// Size of GC steps.
 	extern int StepMul;
 
+	// Number of young objects and how many there may be before the nursery
+	// is collected. A limit of 0 disables the nursery.
+	extern int NurseryCount;
+	extern int NurseryLimit;
+
 	// Current white value for known-dead objects.
 	static inline uint32 OtherWhite()
 	{
@@ -287,6 +297,17 @@ namespace GC
 	// Handles a write barrier for a pointer that isn't inside an object.
 	static inline void WriteBarrier(DObject *pointed);
 
+	// Handles the write barrier for the nursery. Anything stored in a TObjPtr
+	// may only be freed by a full collection, which NULLs the pointer first.
+	static inline void EscapeBarrier(DObject *pointed);
+
+	// Frees the dead young objects and promotes the old enough survivors.
+	void CollectNursery();
+
+	// Checks that the nursery keeps young objects held through
+	// DECLARE_POINTER fields. Returns true on success.
+	bool TestNursery();
+
 	// Handles a read barrier.
 	template<class T> inline T *ReadBarrier(T *&obj)
 	{
@@ -302,6 +323,8 @@ namespace GC
 	{
 		if (AllocBytes >= Threshold)
 			Step();
+		else if (NurseryLimit != 0 && NurseryCount >= NurseryLimit)
+			CollectNursery();
 	}
 
 	// Forces a collection to start now.
@@ -337,6 +360,13 @@ namespace GC
 	template<class T> void Mark(TObjPtr<T> &obj);
 }
 
+// Memory for DObjects comes from size-class slabs (see dobjslab.cpp).
+void *M_AllocObject(size_t size);
+void M_FreeObject(void *mem);
+
+// Releases slabs that no longer hold any objects.
+void M_TrimObjectSlabs();
+
 // A template class to help with handling read barriers. It does not
 // handle write barriers, because those can be handled more efficiently
 // with knowledge of the object that holds the pointer.
@@ -355,16 +385,26 @@ public:
 	TObjPtr(T *q) throw()
 		: p(q)
 	{
+		GC::EscapeBarrier(o);
 	}
 	TObjPtr(const TObjPtr<T> &q) throw()
 		: p(q.p)
 	{
+		GC::EscapeBarrier(o);
 	}
 	T *operator=(T *q) throw()
 	{
-		return p = q;
+		p = q;
+		GC::EscapeBarrier(o);
+		return q;
 		// The caller must now perform a write barrier.
 	}
+	TObjPtr<T> &operator=(const TObjPtr<T> &q) throw()
+	{
+		p = q.p;
+		GC::EscapeBarrier(o);
+		return *this;
+	}
 	operator T*() throw()
 	{
 		return GC::ReadBarrier(p);
@@ -418,7 +458,9 @@ public:
 
 template<class T> inline FArchive &operator<<(FArchive &arc, TObjPtr<T> &o)
 {
-	return arc << o.p;
+	arc << o.p;
+	GC::EscapeBarrier(o.o);
+	return arc;
 }
 
 // Use barrier_cast instead of static_cast when you need to cast
@@ -443,13 +485,14 @@ public:
 private:
 	typedef DObject ThisClass;
 
-	// Per-instance variables. There are four.
+	// Per-instance variables. There are five.
 private:
 	PClass *Class;				// This object's type
 public:
 	DObject *ObjNext;			// Keep track of all allocated objects
 	DObject *GCNext;			// Next object in this collection list
 	uint32 ObjectFlags;			// Flags for this object
+	BYTE NurseryAge;			// Nursery collections survived while young
 
 public:
 	DObject ();
@@ -492,12 +535,12 @@ public:
 
 	void *operator new(size_t len)
 	{
-		return M_Malloc(len);
+		return M_AllocObject(len);
 	}
 
 	void operator delete (void *mem)
 	{
-		M_Free(mem);
+		M_FreeObject(mem);
 	}
 
 	// GC fiddling
@@ -564,7 +607,7 @@ protected:
 
 	void operator delete (void *mem, EInPlace *)
 	{
-		M_Free (mem);
+		M_FreeObject (mem);
 	}
 };
 
@@ -584,6 +627,14 @@ static inline void GC::WriteBarrier(DObject *pointed)
 	}
 }
 
+static inline void GC::EscapeBarrier(DObject *pointed)
+{
+	if (NurseryLimit != 0 && pointed != NULL && (pointed->ObjectFlags & OF_Young))
+	{
+		pointed->ObjectFlags |= OF_Escaped;
+	}
+}
+
 #include "dobjtype.h"
 
 inline bool DObject::IsKindOf (const PClass *base) const
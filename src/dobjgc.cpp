@@ -65,6 +65,7 @@
 #include "sbar.h"
 #include "stats.h"
 #include "c_dispatch.h"
+#include "c_cvars.h"
 #include "p_acs.h"
 #include "s_sndseq.h"
 #include "r_data/r_interpolate.h"
@@ -101,6 +102,9 @@
 #define POLYSTEPSIZE 120
 #define SIDEDEFSTEPSIZE 240
 
+// Upper bounds of the pause time histogram buckets, in milliseconds.
+#define GCHISTOGRAM		0.05, 0.1, 0.25, 0.5, 1, 2, 5
+
 #define GCSTEPSIZE		1024u
 #define GCSWEEPMAX		40
 #define GCSWEEPCOST		10
@@ -108,6 +112,18 @@
 
 // TYPES -------------------------------------------------------------------
 
+// Counts how many collector pauses fell into each time range.
+struct FPauseHistogram
+{
+	enum { NUM_BUCKETS = 8 };
+
+	int Buckets[NUM_BUCKETS];
+	double Max;
+
+	void Add(double ms);
+	void Format(FString &out, const char *name) const;
+};
+
 // This object is responsible for marking sectors during the propagate
 // stage. In case there are many, many sectors, it lets us break them
 // up instead of marking them all at once.
@@ -123,18 +139,70 @@ public:
 };
 IMPLEMENT_CLASS(DSectorMarker)
 
+// Holds an object through a DECLARE_POINTER field. Used by
+// "gc nurserytest".
+class DNurseryTestHolder : public DObject
+{
+	DECLARE_CLASS(DNurseryTestHolder, DObject)
+	HAS_OBJECT_POINTERS
+public:
+	DNurseryTestHolder() : Held(NULL) {}
+	TObjPtr<DObject> Held;
+};
+IMPLEMENT_POINTY_CLASS(DNurseryTestHolder)
+ DECLARE_POINTER(Held)
+END_POINTERS
+
 // EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
 
 // PUBLIC FUNCTION PROTOTYPES ----------------------------------------------
 
 // PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
 
+namespace GC
+{
+static void EmptyNursery();
+}
+
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
 
 extern DThinker *NextToThink;
 
 // PUBLIC DATA DEFINITIONS -------------------------------------------------
 
+// Number of young objects that trigger a nursery collection. 0 disables the
+// nursery, so only full collections are done.
+CUSTOM_CVAR (Int, gc_nurserysize, 0, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0)
+	{
+		self = 0;
+	}
+	else
+	{
+		// Stores are not watched while the nursery is disabled, so any
+		// young objects left over must be treated as old ones.
+		if (self == 0)
+		{
+			GC::EmptyNursery();
+		}
+		GC::NurseryLimit = self;
+	}
+}
+
+// Number of nursery collections a young object must survive to be promoted.
+CUSTOM_CVAR (Int, gc_promoteage, 2, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 1)
+	{
+		self = 1;
+	}
+	else if (self > 255)
+	{
+		self = 255;
+	}
+}
+
 namespace GC
 {
 size_t AllocBytes;
@@ -150,11 +218,22 @@ int Pause = DEFAULT_GCPAUSE;
 int StepMul = DEFAULT_GCMUL;
 int StepCount;
 size_t Dept;
+int NurseryCount;
+int NurseryLimit;
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
 static DSectorMarker *SectorMarker;
 
+// Set while the roots are scanned for a nursery collection.
+static bool MarkingNursery;
+
+static int NurseryCollections;
+static int NurseryFreed;
+static int NurseryPromoted;
+static FPauseHistogram StepPauses;
+static FPauseHistogram NurseryPauses;
+
 // CODE --------------------------------------------------------------------
 
 //==========================================================================
@@ -228,6 +307,7 @@ static DObject **SweepList(DObject **p, size_t count, size_t *finalize_count)
 		{
 			assert(!curr->IsDead() || (curr->ObjectFlags & OF_Fixed));
 			curr->MakeWhite();	// make it white (for next cycle)
+			curr->ObjectFlags &= ~(OF_Young | OF_Escaped);	// in case it was cut off from the nursery
 			p = &curr->ObjNext;
 		}
 		else	// must erase 'curr'
@@ -273,7 +353,13 @@ void Mark(DObject **obj)
 	DObject *lobj = *obj;
 	if (lobj != NULL)
 	{
-		if (lobj->ObjectFlags & OF_EuthanizeMe)
+		if (MarkingNursery)
+		{
+			// Root pointers are not necessarily TObjPtrs, and only a full
+			// collection may NULL them.
+			EscapeBarrier(lobj);
+		}
+		else if (lobj->ObjectFlags & OF_EuthanizeMe)
 		{
 			*obj = (DObject *)NULL;
 		}
@@ -288,17 +374,35 @@ void Mark(DObject **obj)
 
 //==========================================================================
 //
-// MarkRoot
+// EmptyNursery
 //
-// Mark the root set of objects.
+// Turns all young objects into old ones. The nursery is always the head of
+// the object list, since new objects are put in front of it.
 //
 //==========================================================================
 
-static void MarkRoot()
+static void EmptyNursery()
+{
+	for (DObject *probe = Root; probe != NULL && (probe->ObjectFlags & OF_Young); probe = probe->ObjNext)
+	{
+		probe->ObjectFlags &= ~(OF_Young | OF_Escaped);
+	}
+	NurseryCount = 0;
+}
+
+//==========================================================================
+//
+// MarkRootPointers
+//
+// Marks the objects that are directly referenced by the root set. A nursery
+// collection uses this as well, to find the young objects it must keep.
+//
+//==========================================================================
+
+static void MarkRootPointers()
 {
 	int i;
 
-	Gray = NULL;
 	Mark(Args);
 	Mark(screen);
 	Mark(StatusBar);
@@ -321,6 +425,29 @@ static void MarkRoot()
 	}
 	// Mark sound sequences.
 	DSeqNode::StaticMarkHead();
+	// Mark bot stuff.
+	Mark(bglobal.firstthing);
+	Mark(bglobal.body1);
+	Mark(bglobal.body2);
+	// NextToThink must not be freed while thinkers are ticking.
+	Mark(NextToThink);
+}
+
+//==========================================================================
+//
+// MarkRoot
+//
+// Mark the root set of objects.
+//
+//==========================================================================
+
+static void MarkRoot()
+{
+	Gray = NULL;
+	// A full collection looks at every object, so the nursery is not needed
+	// until it is done.
+	EmptyNursery();
+	MarkRootPointers();
 	// Mark sectors.
 	if (SectorMarker == NULL && sectors != NULL)
 	{
@@ -335,12 +462,6 @@ static void MarkRoot()
 		SectorMarker->SecNum = 0;
 	}
 	Mark(SectorMarker);
-	// Mark bot stuff.
-	Mark(bglobal.firstthing);
-	Mark(bglobal.body1);
-	Mark(bglobal.body2);
-	// NextToThink must not be freed while thinkers are ticking.
-	Mark(NextToThink);
 	// Mark soft roots.
 	if (SoftRoots != NULL)
 	{
@@ -421,6 +542,7 @@ static size_t SingleStep()
 	case GCS_Finalize:
 		State = GCS_Pause;		// end collection
 		Dept = 0;
+		M_TrimObjectSlabs();
 		return 0;
 
 	default:
@@ -442,6 +564,10 @@ void Step()
 {
 	size_t lim = (GCSTEPSIZE/100) * StepMul;
 	size_t olim;
+	cycle_t clock;
+
+	clock.Reset();
+	clock.Clock();
 	if (lim == 0)
 	{
 		lim = (~(size_t)0) / 2;		// no limit
@@ -470,6 +596,8 @@ void Step()
 		SetThreshold();
 	}
 	StepCount++;
+	clock.Unclock();
+	StepPauses.Add(clock.TimeMS());
 }
 
 //==========================================================================
@@ -503,6 +631,129 @@ void FullGC()
 	SetThreshold();
 }
 
+//==========================================================================
+//
+// CollectNursery
+//
+// Frees the young objects that have been destroyed, as long as nothing the
+// collector is responsible for NULLing can point to them. Nothing is
+// traced: storing an object in a DECLARE_POINTER field escapes it, either
+// through TObjPtr or through an explicit EscapeBarrier where the field is a
+// plain pointer, and the roots are scanned here. A destroyed object that
+// was stored in any of these is promoted right away and left to the next
+// full collection.
+//
+// Survivors are moved behind the nursery once they are old enough.
+//
+//==========================================================================
+
+void CollectNursery()
+{
+	DObject **p = &Root, *curr;
+	DObject *promoted = NULL, **promotedtail = &promoted;
+	int young = 0;
+	cycle_t clock;
+
+	if (State != GCS_Pause)
+	{
+		return;
+	}
+	clock.Reset();
+	clock.Clock();
+
+	MarkingNursery = true;
+	MarkRootPointers();
+	MarkingNursery = false;
+
+	while ((curr = *p) != NULL && (curr->ObjectFlags & OF_Young))
+	{
+		if ((curr->ObjectFlags & (OF_EuthanizeMe | OF_Escaped | OF_Rooted)) == OF_EuthanizeMe)
+		{
+			*p = curr->ObjNext;
+			curr->ObjectFlags |= OF_Cleanup;
+			delete curr;
+			NurseryFreed++;
+		}
+		else if ((curr->ObjectFlags & OF_Escaped) || ++curr->NurseryAge >= gc_promoteage)
+		{
+			*p = curr->ObjNext;
+			curr->ObjectFlags &= ~(OF_Young | OF_Escaped);
+			*promotedtail = curr;
+			promotedtail = &curr->ObjNext;
+			NurseryPromoted++;
+		}
+		else
+		{
+			p = &curr->ObjNext;
+			young++;
+		}
+	}
+	*promotedtail = *p;
+	*p = promoted;
+	NurseryCount = young;
+	NurseryCollections++;
+
+	clock.Unclock();
+	NurseryPauses.Add(clock.TimeMS());
+}
+
+//==========================================================================
+//
+// TestNursery
+//
+// Destroys a young object that an old one still holds through a
+// DECLARE_POINTER field. A nursery collection must keep it, and the next
+// full collection must NULL the field before freeing it.
+//
+//==========================================================================
+
+bool TestNursery()
+{
+	int savedlimit = NurseryLimit;
+	DNurseryTestHolder *holder;
+	DObject *young, *probe;
+	bool passed = false;
+
+	FullGC();		// leaves the collector paused, so new objects are young
+	if (NurseryLimit == 0)
+	{
+		NurseryLimit = 1;
+	}
+	holder = new DNurseryTestHolder;
+	AddSoftRoot(holder);
+	EmptyNursery();	// the holder must be old
+	young = new DObject;
+	holder->Held = young;
+	young->Destroy();
+	CollectNursery();
+
+	for (probe = Root; probe != NULL; probe = probe->ObjNext)
+	{
+		if (probe == young)
+		{
+			passed = true;
+			break;
+		}
+	}
+	if (passed)
+	{
+		FullGC();
+		passed = holder->Held == NULL;
+	}
+	else
+	{
+		holder->Held = NULL;	// it is gone already
+	}
+	DelSoftRoot(holder);
+	holder->Destroy();
+	if (savedlimit == 0)
+	{
+		EmptyNursery();
+	}
+	NurseryLimit = savedlimit;
+	return passed;
+}
+
 //==========================================================================
 //
 // Barrier
@@ -582,7 +833,7 @@ void AddSoftRoot(DObject *obj)
 	*probe = (*probe)->ObjNext;
 	obj->ObjNext = SoftRoots->ObjNext;
 	SoftRoots->ObjNext = obj;
-	obj->ObjectFlags |= OF_Rooted;
+	obj->ObjectFlags = (obj->ObjectFlags & ~(OF_Young | OF_Escaped)) | OF_Rooted;
 	WriteBarrier(obj);
 }
 
@@ -693,6 +944,45 @@ size_t DSectorMarker::PropagateMark()
 	return marked;
 }
 
+//==========================================================================
+//
+// FPauseHistogram :: Add
+//
+//==========================================================================
+
+void FPauseHistogram::Add(double ms)
+{
+	static const double Limits[NUM_BUCKETS - 1] = { GCHISTOGRAM };
+	int i;
+
+	for (i = 0; i < NUM_BUCKETS - 1 && ms >= Limits[i]; ++i)
+	{
+	}
+	Buckets[i]++;
+	if (ms > Max)
+	{
+		Max = ms;
+	}
+}
+
+//==========================================================================
+//
+// FPauseHistogram :: Format
+//
+//==========================================================================
+
+void FPauseHistogram::Format(FString &out, const char *name) const
+{
+	static const char *Labels[NUM_BUCKETS] = { "<.05", "<.1", "<.25", "<.5", "<1", "<2", "<5", ">=5" };
+
+	out.AppendFormat("\n%-8s ms", name);
+	for (int i = 0; i < NUM_BUCKETS; ++i)
+	{
+		out.AppendFormat(" %s:%d", Labels[i], Buckets[i]);
+	}
+	out.AppendFormat("  Max:%.2f", Max);
+}
+
 //==========================================================================
 //
 // STAT gc
@@ -719,6 +1009,14 @@ ADD_STAT(gc)
 	{
 		out.AppendFormat("  %zuK", (GC::Dept + 1023) >> 10);
 	}
+	if (GC::NurseryLimit != 0)
+	{
+		out.AppendFormat("\nNursery: %d/%d  Collections: %d  Freed: %d  Promoted: %d",
+			GC::NurseryCount, GC::NurseryLimit, GC::NurseryCollections,
+			GC::NurseryFreed, GC::NurseryPromoted);
+	}
+	GC::StepPauses.Format(out, "Step");
+	GC::NurseryPauses.Format(out, "Nursery");
 	return out;
 }
 
@@ -734,7 +1032,7 @@ CCMD(gc)
 {
 	if (argv.argc() == 1)
 	{
-		Printf ("Usage: gc stop|now|full|pause [size]|stepmul [size]\n");
+		Printf ("Usage: gc stop|now|full|pause [size]|stepmul [size]|nurserytest\n");
 		return;
 	}
 	if (stricmp(argv[1], "stop") == 0)
@@ -749,6 +1047,10 @@ CCMD(gc)
 	{
 		GC::FullGC();
 	}
+	else if (stricmp(argv[1], "nurserytest") == 0)
+	{
+		Printf ("Nursery test %s\n", GC::TestNursery() ? "passed" : "FAILED");
+	}
 	else if (stricmp(argv[1], "pause") == 0)
 	{
 		if (argv.argc() == 2)
@@ -0,0 +1,331 @@
+/*
+** dobjslab.cpp
+** Size-class slab allocator for DObjects
+**
+**---------------------------------------------------------------------------
+**
+** Every object gets a small header in front of it that points back at the
+** slab it lives in. Objects are grouped by size into pools with a
+** granularity of SLAB_GRANULARITY bytes, and every pool carves its objects
+** out of large blocks (slabs) so that actors and the like end up packed
+** together instead of being scattered over the whole heap. Objects that are
+** too large for any pool go straight to M_Malloc with a NULL slab pointer.
+**
+** Freed slots are returned to their slab when the collector deletes the
+** object. Slabs that have become completely empty are kept around until the
+** end of the next collection cycle, when all but one per pool are released.
+**
+** GC::AllocBytes is charged for every live slot instead of the slabs
+** themselves, so the collector's pacing still follows the number of objects
+** alive and not how well they happen to be packed.
+**
+*/
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "doomtype.h"
+#include "templates.h"
+#include "i_system.h"
+#include "dobject.h"
+#include "stats.h"
+#include "c_dispatch.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define SLAB_GRANULARITY	32
+#define SLAB_MAXOBJECT		4096
+#define SLAB_NUMPOOLS		(SLAB_MAXOBJECT / SLAB_GRANULARITY)
+#define SLAB_BYTES			65536
+#define SLAB_MINSLOTS		16
+
+// TYPES -------------------------------------------------------------------
+
+struct FObjSlab;
+
+// Sits in front of every object. The padding keeps the object itself at
+// the same alignment malloc would give it.
+union FObjHeader
+{
+	FObjSlab *Slab;
+	double Align[2];
+};
+
+struct FObjPool
+{
+	FObjSlab *Partial;		// slabs that still have room, most recently freed into first
+	size_t SlotSize;
+	int SlotsPerSlab;
+	int NumSlabs;
+	int NumEmpty;
+	int Live;
+	int PeakLive;
+};
+
+struct FObjSlab
+{
+	FObjPool *Pool;
+	FObjSlab *Next, *Prev;	// only valid while in the pool's partial list
+	BYTE *FreeList;
+	BYTE *Unused;			// slots from here on have never been handed out
+	BYTE *End;
+	int Live;
+	bool InPartial;
+};
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static FObjPool Pools[SLAB_NUMPOOLS];
+
+//==========================================================================
+//
+// GetPool
+//
+// Returns the pool for objects of the given size, or NULL if they are too
+// big to be pooled. The pools are set up lazily, since objects can be
+// created by static initializers.
+//
+//==========================================================================
+
+static FObjPool *GetPool(size_t size)
+{
+	size_t slot = (size + sizeof(FObjHeader) + SLAB_GRANULARITY - 1) & ~(size_t)(SLAB_GRANULARITY - 1);
+
+	if (slot > SLAB_MAXOBJECT)
+	{
+		return NULL;
+	}
+	FObjPool *pool = &Pools[slot / SLAB_GRANULARITY - 1];
+	if (pool->SlotSize == 0)
+	{
+		pool->SlotSize = slot;
+		pool->SlotsPerSlab = MAX<int>(SLAB_MINSLOTS, int(SLAB_BYTES / slot));
+	}
+	return pool;
+}
+
+//==========================================================================
+//
+// LinkPartial / UnlinkPartial
+//
+//==========================================================================
+
+static void LinkPartial(FObjPool *pool, FObjSlab *slab)
+{
+	slab->Prev = NULL;
+	slab->Next = pool->Partial;
+	if (pool->Partial != NULL)
+	{
+		pool->Partial->Prev = slab;
+	}
+	pool->Partial = slab;
+	slab->InPartial = true;
+}
+
+static void UnlinkPartial(FObjPool *pool, FObjSlab *slab)
+{
+	if (slab->Prev != NULL)
+	{
+		slab->Prev->Next = slab->Next;
+	}
+	else
+	{
+		pool->Partial = slab->Next;
+	}
+	if (slab->Next != NULL)
+	{
+		slab->Next->Prev = slab->Prev;
+	}
+	slab->InPartial = false;
+}
+
+//==========================================================================
+//
+// NewSlab
+//
+// The slab bookkeeping is stored in the same block as its slots. It does
+// not go through M_Malloc because the slots are accounted individually.
+//
+//==========================================================================
+
+static FObjSlab *NewSlab(FObjPool *pool)
+{
+	size_t headsize = (sizeof(FObjSlab) + SLAB_GRANULARITY - 1) & ~(size_t)(SLAB_GRANULARITY - 1);
+	size_t size = headsize + pool->SlotSize * pool->SlotsPerSlab;
+	BYTE *block = (BYTE *)malloc(size);
+
+	if (block == NULL)
+	{
+		I_FatalError("Could not allocate a %zu byte object slab", size);
+	}
+	FObjSlab *slab = (FObjSlab *)block;
+	slab->Pool = pool;
+	slab->FreeList = NULL;
+	slab->Unused = block + headsize;
+	slab->End = block + size;
+	slab->Live = 0;
+	LinkPartial(pool, slab);
+	pool->NumSlabs++;
+	pool->NumEmpty++;
+	return slab;
+}
+
+//==========================================================================
+//
+// M_AllocObject
+//
+//==========================================================================
+
+void *M_AllocObject(size_t size)
+{
+	FObjPool *pool = GetPool(size);
+	FObjHeader *head;
+
+	if (pool == NULL)
+	{
+		head = (FObjHeader *)M_Malloc(size + sizeof(FObjHeader));
+		head->Slab = NULL;
+		return head + 1;
+	}
+
+	FObjSlab *slab = pool->Partial;
+	if (slab == NULL)
+	{
+		slab = NewSlab(pool);
+	}
+	if (slab->FreeList != NULL)
+	{
+		head = (FObjHeader *)slab->FreeList;
+		slab->FreeList = *(BYTE **)slab->FreeList;
+	}
+	else
+	{
+		head = (FObjHeader *)slab->Unused;
+		slab->Unused += pool->SlotSize;
+	}
+	if (slab->Live++ == 0)
+	{
+		pool->NumEmpty--;
+	}
+	if (slab->FreeList == NULL && slab->Unused >= slab->End)
+	{
+		UnlinkPartial(pool, slab);
+	}
+	if (++pool->Live > pool->PeakLive)
+	{
+		pool->PeakLive = pool->Live;
+	}
+	GC::AllocBytes += pool->SlotSize;
+
+	head->Slab = slab;
+	return head + 1;
+}
+
+//==========================================================================
+//
+// M_FreeObject
+//
+//==========================================================================
+
+void M_FreeObject(void *mem)
+{
+	if (mem == NULL)
+	{
+		return;
+	}
+	FObjHeader *head = (FObjHeader *)mem - 1;
+	FObjSlab *slab = head->Slab;
+
+	if (slab == NULL)
+	{
+		M_Free(head);
+		return;
+	}
+
+	FObjPool *pool = slab->Pool;
+	assert(slab->Live > 0);
+
+	*(BYTE **)head = slab->FreeList;
+	slab->FreeList = (BYTE *)head;
+	if (!slab->InPartial)
+	{
+		LinkPartial(pool, slab);
+	}
+	if (--slab->Live == 0)
+	{
+		pool->NumEmpty++;
+	}
+	pool->Live--;
+	GC::AllocBytes -= pool->SlotSize;
+}
+
+//==========================================================================
+//
+// M_TrimObjectSlabs
+//
+// Releases the empty slabs, keeping one per pool so that a pool that sees
+// a single object come and go does not allocate a new slab every time.
+// Called by the collector once a sweep is complete.
+//
+//==========================================================================
+
+void M_TrimObjectSlabs()
+{
+	for (int i = 0; i < SLAB_NUMPOOLS; ++i)
+	{
+		FObjPool *pool = &Pools[i];
+		FObjSlab *slab, *next;
+
+		if (pool->NumEmpty <= 1)
+		{
+			continue;
+		}
+		for (slab = pool->Partial; slab != NULL && pool->NumEmpty > 1; slab = next)
+		{
+			next = slab->Next;
+			if (slab->Live == 0)
+			{
+				UnlinkPartial(pool, slab);
+				free(slab);
+				pool->NumSlabs--;
+				pool->NumEmpty--;
+			}
+		}
+	}
+}
+
+//==========================================================================
+//
+// STAT slabs
+//
+// Lists every pool that currently has any slabs. Fragmentation is the
+// share of slots in the pool's slabs that are not occupied.
+//
+//==========================================================================
+
+ADD_STAT(slabs)
+{
+	FString out;
+	size_t totalslots = 0, totallive = 0, totalbytes = 0;
+
+	for (int i = 0; i < SLAB_NUMPOOLS; ++i)
+	{
+		const FObjPool *pool = &Pools[i];
+
+		if (pool->NumSlabs == 0)
+		{
+			continue;
+		}
+		int slots = pool->NumSlabs * pool->SlotsPerSlab;
+		out.AppendFormat("%4zu: Live:%6d  Free:%6d  Peak:%6d  Slabs:%4d (%d empty)  Frag:%3d%%\n",
+			pool->SlotSize, pool->Live, slots - pool->Live, pool->PeakLive,
+			pool->NumSlabs, pool->NumEmpty, (slots - pool->Live) * 100 / slots);
+		totalslots += slots;
+		totallive += pool->Live;
+		totalbytes += pool->NumSlabs * pool->SlotsPerSlab * pool->SlotSize;
+	}
+	out.AppendFormat("Total: %zu/%zu slots used  %zuK in slabs  Frag:%3d%%",
+		totallive, totalslots, (totalbytes + 1023) >> 10,
+		totalslots == 0 ? 0 : int((totalslots - totallive) * 100 / totalslots));
+	return out;
+}
@@ -39,6 +39,8 @@
 #include "i_system.h"
 #include "doomerrors.h"
 #include "farchive.h"
+#include "profiler.h"
+#include "p_profile.h"
 
 
 static cycle_t ThinkCycles;
@@ -405,6 +407,7 @@ void DThinker::DestroyMostThinkersInList (FThinkerList &list, int stat)
 
 void DThinker::RunThinkers ()
 {
+	PROFILE_ZONE("RunThinkers");
 	int i, count;
 
 	ThinkCycles.Reset();
@@ -416,6 +419,10 @@ void DThinker::RunThinkers ()
 	// Tick every thinker left from last time
 	for (i = STAT_FIRST_THINKING; i <= MAX_STATNUM; ++i)
 	{
+		if (i == STAT_DEFAULT)
+		{
+			P_PrefetchSight ();
+		}
 		TickThinkers (&Thinkers[i], NULL);
 	}
 
@@ -463,8 +470,19 @@ int DThinker::TickThinkers (FThinkerList *list, FThinkerList *dest)
 
 		if (!(node->ObjectFlags & OF_EuthanizeMe))
 		{ // Only tick thinkers not scheduled for destruction
-			node->Tick();
+			if (ActorProfiling)
+			{
+				P_ProfileTick(node);
+			}
+			else
+			{
+				node->Tick();
+			}
 			node->ObjectFlags &= ~OF_JustSpawned;
+			if (!node->IsKindOf (RUNTIME_CLASS(AActor)))
+			{ // Movers and polyobjects change the level geometry.
+				P_InvalidateSightCache ();
+			}
 			GC::CheckGC();
 		}
 		node = NextToThink;
@@ -56,6 +56,7 @@
 #include "d_player.h"
 #include "m_misc.h"
 #include "dobject.h"
+#include "files.h"
 
 // These are special tokens found in the data stream of an archive.
 // Whenever a new object is encountered, it gets created using new and
@@ -423,6 +424,7 @@ void FCompressedFile::Explode ()
 FCompressedMemFile::FCompressedMemFile ()
 {
 	m_SourceFromMem = false;
+	m_DeferCompression = false;
 	m_ImplodedBuffer = NULL;
 }
 
@@ -518,7 +520,7 @@ bool FCompressedMemFile::Reopen ()
 
 void FCompressedMemFile::Close ()
 {
-	if (m_Mode == EWriting)
+	if (m_Mode == EWriting && !m_DeferCompression)
 	{
 		Implode ();
 		m_ImplodedBuffer = m_Buffer;
@@ -526,6 +528,41 @@ void FCompressedMemFile::Close ()
 	}
 }
 
+// Closing the file leaves the data uncompressed. It can only be stored
+// with CompressDeferred then.
+void FCompressedMemFile::DeferCompression ()
+{
+	m_DeferCompression = true;
+}
+
+// Compresses the data of a closed file that deferred its compression and
+// returns it laid out the way Serialize stores it, in a buffer allocated
+// with new[]. Unlike Implode, this does not use M_Malloc or print anything,
+// so it can be called by another thread.
+BYTE *FCompressedMemFile::CompressDeferred (unsigned int &size) const
+{
+	uLong len = m_BufferSize;
+	uLong outlen = OUT_LEN(len);
+	BYTE *out = new BYTE[12 + outlen];
+	int r = Z_DATA_ERROR;
+
+	if (!nofilecompression && !m_NoCompress)
+	{
+		r = compress (out + 12, &outlen, m_Buffer, len);
+	}
+	// If the data could not be compressed, store it as-is.
+	if (r != Z_OK || outlen >= len)
+	{
+		outlen = 0;
+		memcpy (out + 12, m_Buffer, len);
+	}
+	memcpy (out, ZSig, 4);
+	((DWORD *)out)[1] = BigLong((unsigned int)outlen);
+	((DWORD *)out)[2] = BigLong((unsigned int)len);
+	size = 12 + (unsigned int)(outlen == 0 ? len : outlen);
+	return out;
+}
+
 void FCompressedMemFile::Serialize (FArchive &arc)
 {
 	if (arc.IsStoring ())
@@ -586,28 +623,28 @@ void FCompressedMemFile::GetSizes(unsigned int &compressed, unsigned int &uncomp
 	}
 }
 
-FPNGChunkFile::FPNGChunkFile (FILE *file, DWORD id)
-	: FCompressedFile (file, EWriting, true, false), m_ChunkID (id)
+FPNGChunkFile::FPNGChunkFile (FileWriter *file, DWORD id)
+	: FCompressedFile (NULL, EWriting, true, false), m_ChunkID (id), m_Writer (file)
 {
 }
 
-FPNGChunkFile::FPNGChunkFile (FILE *file, DWORD id, size_t chunklen)
-	: FCompressedFile (file, EReading, true, false), m_ChunkID (id)
+FPNGChunkFile::FPNGChunkFile (FileReader *file, DWORD id, size_t chunklen)
+	: FCompressedFile (NULL, EReading, true, false), m_ChunkID (id), m_Writer (NULL)
 {
 	m_Buffer = (BYTE *)M_Malloc (chunklen);
 	m_BufferSize = (unsigned int)chunklen;
-	fread (m_Buffer, chunklen, 1, m_File);
+	file->Read (m_Buffer, (long)chunklen);
 	// Skip the CRC for now. Maybe later it will be used.
-	fseek (m_File, 4, SEEK_CUR);
+	file->Seek (4, SEEK_CUR);
 }
 
-// Unlike FCompressedFile::Close, m_File is left open
+// Unlike FCompressedFile::Close, the file is left open
 void FPNGChunkFile::Close ()
 {
 	DWORD data[2];
 	DWORD crc;
 
-	if (m_File)
+	if (m_Writer)
 	{
 		if (m_Mode == EWriting)
 		{
@@ -616,23 +653,23 @@ void FPNGChunkFile::Close ()
 
 			data[0] = BigLong(m_BufferSize);
 			data[1] = m_ChunkID;
-			fwrite (data, 8, 1, m_File);
-			fwrite (m_Buffer, m_BufferSize, 1, m_File);
+			m_Writer->Write (data, 8);
+			m_Writer->Write (m_Buffer, m_BufferSize);
 			crc = SWAP_DWORD (crc);
-			fwrite (&crc, 4, 1, m_File);
+			m_Writer->Write (&crc, 4);
 		}
-		m_File = NULL;
+		m_Writer = NULL;
 	}
 	FCompressedFile::Close ();
 }
 
-FPNGChunkArchive::FPNGChunkArchive (FILE *file, DWORD id)
+FPNGChunkArchive::FPNGChunkArchive (FileWriter *file, DWORD id)
 	: FArchive (), Chunk (file, id)
 {
 	AttachToFile (Chunk);
 }
 
-FPNGChunkArchive::FPNGChunkArchive (FILE *file, DWORD id, size_t len)
+FPNGChunkArchive::FPNGChunkArchive (FileReader *file, DWORD id, size_t len)
 	: FArchive (), Chunk (file, id, len)
 {
 	AttachToFile (Chunk);
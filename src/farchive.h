@@ -38,6 +38,9 @@
 #include "dobject.h"
 #include "r_state.h"
 
+class FileReader;
+class FileWriter;
+
 class FFile
 {
 public:
@@ -123,6 +126,8 @@ public:
 	bool Open ();	// Open for writing only
 	bool Reopen ();	// Re-opens imploded file for reading only
 	void Close ();
+	void DeferCompression ();	// Close leaves the data uncompressed
+	BYTE *CompressDeferred (unsigned int &size) const;	// Returns what Serialize would store
 	bool IsOpen () const;
 	void GetSizes(unsigned int &one, unsigned int &two) const;
 
@@ -133,19 +138,21 @@ protected:
 
 private:
 	bool m_SourceFromMem;
+	bool m_DeferCompression;
 	unsigned char *m_ImplodedBuffer;
 };
 
 class FPNGChunkFile : public FCompressedFile
 {
 public:
-	FPNGChunkFile (FILE *file, DWORD id);					// Create for writing
-	FPNGChunkFile (FILE *file, DWORD id, size_t chunklen);	// Create for reading
+	FPNGChunkFile (FileWriter *file, DWORD id);				// Create for writing
+	FPNGChunkFile (FileReader *file, DWORD id, size_t chunklen);	// Create for reading
 
 	void Close ();
 
 private:
 	DWORD m_ChunkID;
+	FileWriter *m_Writer;
 };
 
 class FArchive
@@ -266,8 +273,8 @@ private:
 class FPNGChunkArchive : public FArchive
 {
 public:
-	FPNGChunkArchive (FILE *file, DWORD chunkid);
-	FPNGChunkArchive (FILE *file, DWORD chunkid, size_t chunklen);
+	FPNGChunkArchive (FileWriter *file, DWORD chunkid);
+	FPNGChunkArchive (FileReader *file, DWORD chunkid, size_t chunklen);
 	~FPNGChunkArchive ();
 	FPNGChunkFile Chunk;
 };
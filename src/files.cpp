@@ -33,6 +33,14 @@
 **
 */
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
 #include "files.h"
 #include "i_system.h"
 #include "templates.h"
@@ -527,3 +535,92 @@ char *MemoryReader::Gets(char *strbuf, int len)
 {
 	return GetsFromBuffer(bufptr, strbuf, len);
 }
+
+//==========================================================================
+//
+// MappedFileReader
+//
+// The mapping is copy-on-write, because some lump loaders modify the data
+// they get from the cache in place. The file itself is never written.
+//
+//==========================================================================
+
+int MappedFileReader::NumMapped;
+size_t MappedFileReader::MappedBytes;
+
+MappedFileReader::MappedFileReader (const char *filename)
+: FileReader(filename), MapData(NULL), MapHandle(NULL)
+{
+	if (Length <= 0)
+	{
+		return;
+	}
+#ifdef _WIN32
+	HANDLE mapping = CreateFileMapping((HANDLE)_get_osfhandle(_fileno(File)), NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+	if (mapping != NULL)
+	{
+		MapData = (char *)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		if (MapData == NULL)
+		{
+			CloseHandle(mapping);
+			return;
+		}
+		MapHandle = mapping;
+	}
+#else
+	void *data = mmap(NULL, Length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(File), 0);
+
+	if (data != MAP_FAILED)
+	{
+		MapData = (char *)data;
+	}
+#endif
+	if (MapData != NULL)
+	{
+		NumMapped++;
+		MappedBytes += Length;
+	}
+}
+
+MappedFileReader::~MappedFileReader ()
+{
+	if (MapData != NULL)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(MapData);
+		CloseHandle((HANDLE)MapHandle);
+#else
+		munmap(MapData, Length);
+#endif
+		NumMapped--;
+		MappedBytes -= Length;
+	}
+}
+
+//==========================================================================
+//
+// FileWriter
+//
+//==========================================================================
+
+size_t FileWriter::Write (const void *buffer, size_t len)
+{
+	return fwrite (buffer, 1, len, File);
+}
+
+//==========================================================================
+//
+// BufferWriter
+//
+//==========================================================================
+
+size_t BufferWriter::Write (const void *buffer, size_t len)
+{
+	unsigned int pos = Buffer.Reserve ((unsigned int)len);
+	if (len != 0)
+	{
+		memcpy (&Buffer[pos], buffer, len);
+	}
+	return len;
+}
@@ -7,6 +7,7 @@
 #include "LzmaDec.h"
 #include "doomtype.h"
 #include "m_swap.h"
+#include "tarray.h"
 
 class FileReaderBase
 {
@@ -335,6 +336,50 @@ protected:
 	const char * bufptr;
 };
 
+// Reads a file like FileReader and also maps all of it into memory, so that
+// GetBuffer() works like it does for a MemoryReader. If the file cannot be
+// mapped, GetBuffer() returns NULL and this is just a FileReader.
+class MappedFileReader : public FileReader
+{
+public:
+	MappedFileReader (const char *filename);
+	~MappedFileReader ();
+
+	virtual const char *GetBuffer() const { return MapData; }
+
+	static int NumMapped;
+	static size_t MappedBytes;
+
+protected:
+	char *MapData;
+	void *MapHandle;
+};
+
+// Writes to a FILE. The file is not closed when the writer is destroyed.
+class FileWriter
+{
+public:
+	FileWriter (FILE *file = NULL) : File(file) {}
+	virtual ~FileWriter () {}
+
+	virtual size_t Write (const void *buffer, size_t len);
+
+protected:
+	FILE *File;
+};
+
+// Collects everything written to it in memory.
+class BufferWriter : public FileWriter
+{
+public:
+	BufferWriter () {}
+
+	virtual size_t Write (const void *buffer, size_t len);
+	TArray<BYTE> &GetBuffer () { return Buffer; }
+
+protected:
+	TArray<BYTE> Buffer;
+};
 
 
 #endif
@@ -0,0 +1,312 @@
+/*
+** g_bench.cpp
+** Plays a list of demos as fast as possible and writes the timings as JSON
+**
+**---------------------------------------------------------------------------
+**
+** Started with -bench <demo> [<demo> ...] [-benchout <file>]. This works
+** like -timedemo -nodraw, except that sound and music are disabled, the
+** software renderer is used (the SDL version also uses SDL's dummy video
+** driver, so no window is opened), several demos can be played in a row
+** and nothing but the result file is written. It is meant to be run
+** unattended to catch regressions in the play simulation.
+**
+** For every demo the output contains the wall time and the text of every
+** registered stat for each tic, and the highest values of GC::AllocBytes
+** and of the process's resident set size. The first tic of each demo
+** includes loading its level.
+**
+** The results are written to the file as the tics are run instead of being
+** kept in memory, so that recording them does not add to GC::AllocBytes
+** (which would change when the collector runs) or to the resident set
+** size. Writing a tic's results is not included in its time.
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "doomtype.h"
+#include "doomstat.h"
+#include "zstring.h"
+#include "stats.h"
+#include "v_text.h"
+#include "i_system.h"
+#include "dobject.h"
+#include "g_game.h"
+#include "g_level.h"
+#include "version.h"
+
+extern bool timingdemo;
+
+bool benchmarking;
+
+static const FString *BenchDemos;
+static int NumBenchDemos;
+static int CurrentDemo;
+static FString BenchOutput;
+static FILE *BenchFile;
+static cycle_t TicCycles;
+
+// For the demo that is playing
+static bool DemoStarted;
+static unsigned int DemoTics;
+static size_t PeakAlloc;
+static double TotalTime;
+
+//==========================================================================
+//
+// GetPeakRSS
+//
+// Returns the highest resident set size of the process so far, in bytes,
+// or 0 if it cannot be determined.
+//
+//==========================================================================
+
+static size_t GetPeakRSS()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+	{
+		return pmc.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return 0;
+	}
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+//==========================================================================
+//
+// WriteString
+//
+// Writes a string as a JSON string literal.
+//
+//==========================================================================
+
+static void WriteString(FILE *f, const char *str)
+{
+	fputc('"', f);
+	for (; *str != 0; ++str)
+	{
+		unsigned char c = *str;
+
+		if (c == TEXTCOLOR_ESCAPE)
+		{ // Color codes mean nothing outside the game.
+			if (str[1] == '[')
+			{
+				while (str[1] != 0 && str[1] != ']') ++str;
+			}
+			if (str[1] != 0) ++str;
+		}
+		else if (c == '"' || c == '\\')
+		{
+			fputc('\\', f);
+			fputc(c, f);
+		}
+		else if (c == '\n')
+		{
+			fputs("\\n", f);
+		}
+		else if (c < 32)
+		{
+			fprintf(f, "\\u%04x", c);
+		}
+		else
+		{
+			fputc(c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+//==========================================================================
+//
+// WriteDemoStart
+//
+// Writes everything that comes before the first tic of the current demo.
+//
+//==========================================================================
+
+static void WriteDemoStart()
+{
+	FILE *f = BenchFile;
+
+	fprintf(f, "%s\n\t\t{\n\t\t\t\"name\": ", CurrentDemo > 0 ? "," : "");
+	WriteString(f, BenchDemos[CurrentDemo]);
+	fprintf(f, ",\n\t\t\t\"ticdata\": [");
+	DemoStarted = true;
+}
+
+//==========================================================================
+//
+// WriteDemoEnd
+//
+// Writes what is only known once the current demo has ended.
+//
+//==========================================================================
+
+static void WriteDemoEnd()
+{
+	FILE *f = BenchFile;
+
+	if (!DemoStarted)
+	{
+		WriteDemoStart();
+	}
+	fprintf(f, "\n\t\t\t],\n\t\t\t\"map\": ");
+	WriteString(f, level.mapname);
+	fprintf(f, ",\n\t\t\t\"tics\": %u,\n\t\t\t\"totalms\": %.3f,\n", DemoTics, TotalTime);
+	fprintf(f, "\t\t\t\"peakallocbytes\": %llu,\n\t\t\t\"peakrssbytes\": %llu\n\t\t}",
+		(unsigned long long)PeakAlloc, (unsigned long long)GetPeakRSS());
+}
+
+//==========================================================================
+//
+// G_StartBenchmark
+//
+//==========================================================================
+
+void G_StartBenchmark (int numdemos, const FString *demos, const char *output)
+{
+	BenchDemos = demos;
+	NumBenchDemos = numdemos;
+	BenchOutput = output != NULL ? output : "benchmark.json";
+	BenchFile = fopen(BenchOutput, "w");
+	if (BenchFile == NULL)
+	{
+		I_FatalError ("Could not write benchmark results to %s", BenchOutput.GetChars());
+	}
+
+	// Stats are registered when the program starts, so the same names are
+	// used for every tic of every demo.
+	fprintf(BenchFile, "{\n\t\"version\": ");
+	WriteString(BenchFile, DOTVERSIONSTR);
+	fprintf(BenchFile, ",\n\t\"statnames\": [");
+	for (FStat *stat = FStat::GetFirstStat(); stat != NULL; stat = stat->GetNext())
+	{
+		fprintf(BenchFile, "%s\n\t\t", stat != FStat::GetFirstStat() ? "," : "");
+		WriteString(BenchFile, stat->GetName());
+	}
+	fprintf(BenchFile, "\n\t],\n\t\"demos\": [");
+
+	CurrentDemo = 0;
+	DemoStarted = false;
+	DemoTics = 0;
+	PeakAlloc = 0;
+	TotalTime = 0;
+	benchmarking = true;
+
+	nodrawers = true;
+	noblit = true;
+	timingdemo = true;
+	singletics = true;
+	G_DeferedPlayDemo (BenchDemos[0]);
+}
+
+//==========================================================================
+//
+// G_BenchmarkStartTic / G_BenchmarkEndTic
+//
+// Called by D_DoomLoop around every tic it runs.
+//
+//==========================================================================
+
+void G_BenchmarkStartTic ()
+{
+	if (benchmarking)
+	{
+		TicCycles.Reset();
+		TicCycles.Clock();
+	}
+}
+
+void G_BenchmarkEndTic ()
+{
+	if (benchmarking && CurrentDemo < NumBenchDemos)
+	{
+		FILE *f = BenchFile;
+
+		TicCycles.Unclock();
+		TotalTime += TicCycles.TimeMS();
+		if (GC::AllocBytes > PeakAlloc)
+		{
+			PeakAlloc = GC::AllocBytes;
+		}
+
+		if (!DemoStarted)
+		{
+			WriteDemoStart();
+		}
+		fprintf(f, "%s\n\t\t\t\t{ \"ms\": %.4f, \"stats\": [", DemoTics > 0 ? "," : "", TicCycles.TimeMS());
+		DemoTics++;
+
+		// Most stats only show what happened during the last tic.
+		for (FStat *stat = FStat::GetFirstStat(); stat != NULL; stat = stat->GetNext())
+		{
+			fprintf(f, "%s\n\t\t\t\t\t", stat != FStat::GetFirstStat() ? "," : "");
+			WriteString(f, stat->GetStats());
+		}
+		fprintf(f, "\n\t\t\t\t] }");
+	}
+}
+
+//==========================================================================
+//
+// G_BenchmarkNextDemo
+//
+// Called by G_CheckDemoStatus when a demo has ended. Writes what is only
+// looked at once per demo and starts the next one. After the last demo,
+// the file is closed and the program exits.
+//
+//==========================================================================
+
+void G_BenchmarkNextDemo ()
+{
+	WriteDemoEnd();
+
+	if (++CurrentDemo < NumBenchDemos)
+	{
+		DemoStarted = false;
+		DemoTics = 0;
+		PeakAlloc = 0;
+		TotalTime = 0;
+		singletics = true;
+		G_DeferedPlayDemo (BenchDemos[CurrentDemo]);
+		return;
+	}
+
+	fprintf(BenchFile, "\n\t]\n}\n");
+	bool failed = ferror(BenchFile) != 0;
+	if (fclose(BenchFile) != 0 || failed)
+	{
+		I_FatalError ("Could not write benchmark results to %s", BenchOutput.GetChars());
+	}
+	BenchFile = NULL;
+	printf ("Benchmark results written to %s\n", BenchOutput.GetChars());
+	exit (0);
+}
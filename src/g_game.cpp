@@ -80,6 +80,10 @@
 #include "farchive.h"
 #include "r_renderer.h"
 #include "r_data/colormaps.h"
+#include "files.h"
+#include "critsec.h"
+#include "workerpool.h"
+#include "profiler.h"
 
 #include <zlib.h>
 
@@ -105,8 +109,10 @@ void	G_DoVictory (void);
 void	G_DoWorldDone (void);
 void	G_DoSaveGame (bool okForQuicksave, FString filename, const char *description);
 void	G_DoAutoSave ();
+static void G_PollSaveGames ();
+static void G_WaitForSaveGame (const char *filename);
 
-void STAT_Write(FILE *file);
+void STAT_Write(FileWriter *file);
 void STAT_Read(PNGHandle *png);
 
 FIntCVar gameskill ("skill", 2, CVAR_SERVERINFO|CVAR_LATCH);
@@ -115,6 +121,7 @@ CVAR (Bool, chasedemo, false, 0);
 CVAR (Bool, storesavepic, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 CVAR (Bool, longsavemessages, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 CVAR (String, save_dir, "", CVAR_ARCHIVE|CVAR_GLOBALCONFIG);
+CVAR (Bool, backgroundsaves, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 EXTERN_CVAR (Float, con_midtime);
 
 //==========================================================================
@@ -1008,6 +1015,9 @@ void G_Ticker ()
 		AddCommandString (toggle_fullscreen);
 	}
 
+	// report savegames that have been written
+	G_PollSaveGames ();
+
 	// do things to change the game state
 	oldgamestate = gamestate;
 	while (gameaction != ga_nothing)
@@ -1075,6 +1085,12 @@ void G_Ticker ()
 		C_AdjustBottom ();
 	}
 
+	// seek in the demo and take keyframes for seeking
+	if (demoplayback && paused >= 0)
+	{
+		G_DemoKeyframeTicker ();
+	}
+
 	if (oldgamestate != gamestate)
 	{
 		if (oldgamestate == GS_DEMOSCREEN && Page != NULL)
@@ -1711,10 +1727,77 @@ bool G_CheckSaveGameWads (PNGHandle *png, bool printwarn)
 }
 
 
+//==========================================================================
+//
+// G_ReadSaveData
+//
+// Reads what G_WriteSaveData wrote and loads the saved level.
+//
+//==========================================================================
+
+void G_ReadSaveData (PNGHandle *png, const char *map)
+{
+	char *text;
+
+	// Read intermission data for hubs
+	G_ReadHubInfo(png);
+
+	bglobal.RemoveAllBots (true);
+
+	text = M_GetPNGText (png, "Important CVARs");
+	if (text != NULL)
+	{
+		BYTE *vars_p = (BYTE *)text;
+		C_ReadCVars (&vars_p);
+		delete[] text;
+	}
+
+	// dearchive all the modifications
+	if (M_FindPNGChunk (png, MAKE_ID('p','t','I','c')) == 8)
+	{
+		DWORD time[2];
+		png->File->Read (&time, 8);
+		time[0] = BigLong((unsigned int)time[0]);
+		time[1] = BigLong((unsigned int)time[1]);
+		level.time = Scale (time[1], TICRATE, time[0]);
+	}
+	else
+	{ // No ptIc chunk so we don't know how long the user was playing
+		level.time = 0;
+	}
+
+	G_ReadSnapshots (png);
+	STAT_Read(png);
+	FRandom::StaticReadRNGState (png);
+	P_ReadACSDefereds (png);
+
+	// load a base level
+	savegamerestore = true;		// Use the player actors in the savegame
+	bool demoplaybacksave = demoplayback;
+	G_InitNew (map, false);
+	demoplayback = demoplaybacksave;
+	savegamerestore = false;
+
+	P_ReadACSVars(png);
+
+	NextSkill = -1;
+	if (M_FindPNGChunk (png, MAKE_ID('s','n','X','t')) == 1)
+	{
+		BYTE next;
+		png->File->Read (&next, 1);
+		NextSkill = next;
+	}
+
+	if (level.info->snapshot != NULL)
+	{
+		delete level.info->snapshot;
+		level.info->snapshot = NULL;
+	}
+}
+
 void G_DoLoadGame ()
 {
 	char sigcheck[20];
-	char *text = NULL;
 	char *map;
 	bool hidecon;
 
@@ -1725,6 +1808,8 @@ void G_DoLoadGame ()
 	hidecon = gameaction == ga_loadgamehidecon;
 	gameaction = ga_nothing;
 
+	G_WaitForSaveGame (savename.GetChars());
+
 	FILE *stdfile = fopen (savename.GetChars(), "rb");
 	if (stdfile == NULL)
 	{
@@ -1805,61 +1890,8 @@ void G_DoLoadGame ()
 		gamestate = GS_HIDECONSOLE;
 	}
 
-	// Read intermission data for hubs
-	G_ReadHubInfo(png);
-
-	bglobal.RemoveAllBots (true);
-
-	text = M_GetPNGText (png, "Important CVARs");
-	if (text != NULL)
-	{
-		BYTE *vars_p = (BYTE *)text;
-		C_ReadCVars (&vars_p);
-		delete[] text;
-	}
-
-	// dearchive all the modifications
-	if (M_FindPNGChunk (png, MAKE_ID('p','t','I','c')) == 8)
-	{
-		DWORD time[2];
-		fread (&time, 8, 1, stdfile);
-		time[0] = BigLong((unsigned int)time[0]);
-		time[1] = BigLong((unsigned int)time[1]);
-		level.time = Scale (time[1], TICRATE, time[0]);
-	}
-	else
-	{ // No ptIc chunk so we don't know how long the user was playing
-		level.time = 0;
-	}
-
-	G_ReadSnapshots (png);
-	STAT_Read(png);
-	FRandom::StaticReadRNGState (png);
-	P_ReadACSDefereds (png);
-
-	// load a base level
-	savegamerestore = true;		// Use the player actors in the savegame
-	bool demoplaybacksave = demoplayback;
-	G_InitNew (map, false);
-	demoplayback = demoplaybacksave;
+	G_ReadSaveData (png, map);
 	delete[] map;
-	savegamerestore = false;
-
-	P_ReadACSVars(png);
-
-	NextSkill = -1;
-	if (M_FindPNGChunk (png, MAKE_ID('s','n','X','t')) == 1)
-	{
-		BYTE next;
-		fread (&next, 1, 1, stdfile);
-		NextSkill = next;
-	}
-
-	if (level.info->snapshot != NULL)
-	{
-		delete level.info->snapshot;
-		level.info->snapshot = NULL;
-	}
 
 	BackupSaveName = savename;
 
@@ -1995,7 +2027,7 @@ void G_DoAutoSave ()
 }
 
 
-static void PutSaveWads (FILE *file)
+static void PutSaveWads (FileWriter *file)
 {
 	const char *name;
 
@@ -2011,7 +2043,7 @@ static void PutSaveWads (FILE *file)
 	}
 }
 
-static void PutSaveComment (FILE *file)
+static void PutSaveComment (FileWriter *file)
 {
 	char comment[256];
 	const char *readableTime;
@@ -2044,7 +2076,7 @@ static void PutSaveComment (FILE *file)
 	M_AppendPNGText (file, "Comment", comment);
 }
 
-static void PutSavePic (FILE *file, int width, int height)
+static void PutSavePic (FileWriter *file, int width, int height)
 {
 	if (width <= 0 || height <= 0 || !storesavepic)
 	{
@@ -2056,42 +2088,229 @@ static void PutSavePic (FILE *file, int width, int height)
 	}
 }
 
-void G_DoSaveGame (bool okForQuicksave, FString filename, const char *description)
+//==========================================================================
+//
+// FSaveGameJob
+//
+// Writes a savegame to disk. G_DoSaveGame puts everything but the current
+// level's snapshot and the IEND chunk into Data. The job compresses the
+// snapshot, which is by far the slowest part, and writes the file on a
+// thread of its own. G_FinishSaveGame reports the result on the game
+// thread afterwards.
+//
+//==========================================================================
+
+class FSaveGameJob : public FBackgroundJob
 {
-	// Do not even try, if we're not in a level. (Can happen after
-	// a demo finishes playback.)
-	if (lines == NULL || sectors == NULL)
+public:
+	FSaveGameJob () : FBackgroundJob("SaveGame"), Snapshot(NULL), Finished(false), Opened(false), Written(false) {}
+	~FSaveGameJob () { if (Snapshot != NULL) delete Snapshot; }
+
+	void Run ();
+	void Write ();
+
+	FString Filename;
+	FString Description;
+	bool OkForQuicksave;
+	BufferWriter Data;
+	FCompressedMemFile *Snapshot;	// uncompressed; NULL if there is none
+	DWORD SnapshotVer;
+	FString SnapshotMap;
+
+	bool Finished;		// guarded by SaveGameLock
+	bool Opened;
+	bool Written;
+};
+
+static FCriticalSection SaveGameLock;
+static TArray<FSaveGameJob *> SaveGameJobs;
+
+//==========================================================================
+//
+// FSaveGameJob :: Run
+//
+//==========================================================================
+
+void FSaveGameJob::Run ()
+{
+	Write ();
+	SaveGameLock.Enter ();
+	Finished = true;
+	SaveGameLock.Leave ();
+}
+
+//==========================================================================
+//
+// FSaveGameJob :: Write
+//
+// Nothing in here may use M_Malloc or print anything, because it normally
+// runs on another thread.
+//
+//==========================================================================
+
+void FSaveGameJob::Write ()
+{
+	PROFILE_ZONE("WriteSaveGame");
+	FILE *file = fopen (Filename.GetChars(), "wb");
+
+	if (file == NULL)
 	{
 		return;
 	}
 
-	if (demoplayback)
+	FileWriter writer (file);
+	TArray<BYTE> &data = Data.GetBuffer();
+
+	Opened = true;
+	Written = writer.Write (&data[0], data.Size()) == data.Size();
+	if (Written && Snapshot != NULL)
 	{
-		filename = G_BuildSaveName ("demosave.zds", -1);
+		Written = G_WriteDeferredSnapshot (&writer, Snapshot, SnapshotVer, SnapshotMap.GetChars());
 	}
+	if (Written)
+	{
+		Written = M_FinishPNG (&writer);
+	}
+	if (fclose (file) != 0)
+	{
+		Written = false;
+	}
+}
 
-	insave = true;
-	G_SnapshotLevel ();
-
-	FILE *stdfile = fopen (filename, "wb");
+//==========================================================================
+//
+// G_FinishSaveGame
+//
+// Waits for a savegame to be written, reports the result and deletes the
+// job. The job must have been removed from SaveGameJobs.
+//
+//==========================================================================
 
-	if (stdfile == NULL)
+static void G_FinishSaveGame (FSaveGameJob *job)
+{
+	if (job->IsStarted())
+	{
+		job->Wait ();
+	}
+	if (!job->Opened)
 	{
-		Printf ("Could not create savegame '%s'\n", filename.GetChars());
-		insave = false;
+		Printf ("Could not create savegame '%s'\n", job->Filename.GetChars());
+		delete job;
 		return;
 	}
 
-	SaveVersion = SAVEVER;
-	PutSavePic (stdfile, SAVEPICWIDTH, SAVEPICHEIGHT);
-	M_AppendPNGText (stdfile, "Software", "ZDoom " DOTVERSIONSTR);
-	M_AppendPNGText (stdfile, "Engine", GAMESIG);
-	M_AppendPNGText (stdfile, "ZDoom Save Version", SAVESIG);
-	M_AppendPNGText (stdfile, "Title", description);
-	M_AppendPNGText (stdfile, "Current Map", level.mapname);
-	PutSaveWads (stdfile);
-	PutSaveComment (stdfile);
+	M_NotifyNewSave (job->Filename.GetChars(), job->Description.GetChars(), job->OkForQuicksave);
+
+	// Check whether the file is ok.
+	bool success = false;
+	FILE *stdfile = job->Written ? fopen (job->Filename.GetChars(), "rb") : NULL;
+	if (stdfile != NULL)
+	{
+		PNGHandle *pngh = M_VerifyPNG(stdfile);
+		if (pngh != NULL)
+		{
+			success = true;
+			delete pngh;
+		}
+		fclose(stdfile);
+	}
+	if (success) 
+	{
+		if (longsavemessages) Printf ("%s (%s)\n", GStrings("GGSAVED"), job->Filename.GetChars());
+		else Printf ("%s\n", GStrings("GGSAVED"));
+	}
+	else Printf(PRINT_HIGH, "Save failed\n");
+
+	BackupSaveName = job->Filename;
+	delete job;
+}
+
+//==========================================================================
+//
+// G_PollSaveGames
+//
+// Reports every savegame that has been written since the last call.
+//
+//==========================================================================
+
+static void G_PollSaveGames ()
+{
+	for (unsigned int i = 0; i < SaveGameJobs.Size(); )
+	{
+		FSaveGameJob *job = SaveGameJobs[i];
+
+		SaveGameLock.Enter ();
+		bool finished = job->Finished;
+		SaveGameLock.Leave ();
+		if (finished)
+		{
+			SaveGameJobs.Delete (i);
+			G_FinishSaveGame (job);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+//==========================================================================
+//
+// G_WaitForSaveGame
+//
+// Finishes the savegames that are being written to a file, before it is
+// loaded or saved again. Savegames for other files keep going.
+//
+//==========================================================================
+
+static void G_WaitForSaveGame (const char *filename)
+{
+	for (unsigned int i = 0; i < SaveGameJobs.Size(); )
+	{
+		FSaveGameJob *job = SaveGameJobs[i];
+
+		if (job->Filename.CompareNoCase (filename) == 0)
+		{
+			PROFILE_ZONE("SaveGameWait");
+			SaveGameJobs.Delete (i);
+			G_FinishSaveGame (job);
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
 
+//==========================================================================
+//
+// G_ShutdownSaveGames
+//
+// Makes sure no savegame is cut short when the game exits.
+//
+//==========================================================================
+
+static void G_ShutdownSaveGames ()
+{
+	for (unsigned int i = 0; i < SaveGameJobs.Size(); ++i)
+	{
+		SaveGameJobs[i]->Wait ();
+		delete SaveGameJobs[i];
+	}
+	SaveGameJobs.Clear ();
+}
+
+//==========================================================================
+//
+// G_WriteSaveData
+//
+// Writes the chunks that hold the game state. Used for savegames and for
+// demo keyframes.
+//
+//==========================================================================
+
+void G_WriteSaveData (FileWriter *stdfile)
+{
 	// Intermission stats for hubs
 	G_WriteHubInfo(stdfile);
 
@@ -2118,42 +2337,84 @@ void G_DoSaveGame (bool okForQuicksave, FString filename, const char *descriptio
 		BYTE next = NextSkill;
 		M_AppendPNGChunk (stdfile, MAKE_ID('s','n','X','t'), &next, 1);
 	}
+}
 
-	M_FinishPNG (stdfile);
-	fclose (stdfile);
+//==========================================================================
+//
+// G_DoSaveGame
+//
+// Everything that needs the game state is done right here, with the
+// savegame going into memory. The file itself is written by an
+// FSaveGameJob, on another thread if backgroundsaves is on.
+//
+//==========================================================================
 
-	M_NotifyNewSave (filename.GetChars(), description, okForQuicksave);
+void G_DoSaveGame (bool okForQuicksave, FString filename, const char *description)
+{
+	static bool atermed;
 
-	// Check whether the file is ok.
-	bool success = false;
-	stdfile = fopen (filename.GetChars(), "rb");
-	if (stdfile != NULL)
+	// Do not even try, if we're not in a level. (Can happen after
+	// a demo finishes playback.)
+	if (lines == NULL || sectors == NULL)
 	{
-		PNGHandle *pngh = M_VerifyPNG(stdfile);
-		if (pngh != NULL)
-		{
-			success = true;
-			delete pngh;
-		}
-		fclose(stdfile);
+		return;
 	}
-	if (success) 
+
+	if (demoplayback)
 	{
-		if (longsavemessages) Printf ("%s (%s)\n", GStrings("GGSAVED"), filename.GetChars());
-		else Printf ("%s\n", GStrings("GGSAVED"));
+		filename = G_BuildSaveName ("demosave.zds", -1);
 	}
-	else Printf(PRINT_HIGH, "Save failed\n");
 
-	BackupSaveName = filename;
+	G_WaitForSaveGame (filename.GetChars());
+
+	insave = true;
+	G_SnapshotLevel (true);
 
-	// We don't need the snapshot any longer.
+	FSaveGameJob *job = new FSaveGameJob;
+	FileWriter *stdfile = &job->Data;
+
+	job->Filename = filename;
+	job->Description = description;
+	job->OkForQuicksave = okForQuicksave;
+
+	// The job compresses and writes the current level's snapshot. It is
+	// not needed any longer after that.
 	if (level.info->snapshot != NULL)
 	{
-		delete level.info->snapshot;
+		job->Snapshot = level.info->snapshot;
+		job->SnapshotVer = level.info->snapshotVer;
+		job->SnapshotMap = level.info->mapname;
 		level.info->snapshot = NULL;
 	}
-		
+
+	SaveVersion = SAVEVER;
+	PutSavePic (stdfile, SAVEPICWIDTH, SAVEPICHEIGHT);
+	M_AppendPNGText (stdfile, "Software", "ZDoom " DOTVERSIONSTR);
+	M_AppendPNGText (stdfile, "Engine", GAMESIG);
+	M_AppendPNGText (stdfile, "ZDoom Save Version", SAVESIG);
+	M_AppendPNGText (stdfile, "Title", description);
+	M_AppendPNGText (stdfile, "Current Map", level.mapname);
+	PutSaveWads (stdfile);
+	PutSaveComment (stdfile);
+	G_WriteSaveData (stdfile);
+
 	insave = false;
+
+	if (backgroundsaves)
+	{
+		if (!atermed)
+		{
+			atterm (G_ShutdownSaveGames);
+			atermed = true;
+		}
+		job->Start ();
+		SaveGameJobs.Push (job);
+	}
+	else
+	{
+		job->Write ();
+		G_FinishSaveGame (job);
+	}
 }
 
 
@@ -2529,6 +2790,7 @@ void G_DoPlayDemo (void)
 	int demolump;
 
 	gameaction = ga_nothing;
+	G_ClearDemoKeyframes ();
 
 	// [RH] Allow for demos not loaded as lumps
 	demolump = Wads.CheckNumForFullName (defdemoname, true);
@@ -2557,7 +2819,7 @@ void G_DoPlayDemo (void)
 		C_ForgetCVars();
 		M_Free(demobuffer);
 		demo_p = demobuffer = NULL;
-		if (singledemo)
+		if (singledemo || benchmarking)
 		{
 			I_Error ("%s", eek);
 		}
@@ -2572,6 +2834,10 @@ void G_DoPlayDemo (void)
 		C_RestoreCVars();
 		gameaction = ga_nothing;
 		demoplayback = false;
+		if (benchmarking)
+		{
+			I_Error ("Cannot play demo %s\n", defdemoname.GetChars());
+		}
 	}
 	else
 	{
@@ -2638,6 +2904,7 @@ bool G_CheckDemoStatus (void)
 		C_RestoreCVars ();		// [RH] Restore cvars demo might have changed
 		M_Free (demobuffer);
 		demobuffer = NULL;
+		G_ClearDemoKeyframes ();
 
 		P_SetupWeapons_ntohton();
 		demoplayback = false;
@@ -2652,6 +2919,11 @@ bool G_CheckDemoStatus (void)
 		{
 			StatusBar->AttachToPlayer (&players[0]);
 		}
+		if (benchmarking)
+		{
+			G_BenchmarkNextDemo ();
+			return true;
+		}
 		if (singledemo || timingdemo)
 		{
 			if (timingdemo)
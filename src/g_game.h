@@ -25,6 +25,7 @@
 
 struct event_t;
 struct PNGHandle;
+class FString;
 
 
 //
@@ -59,6 +60,18 @@ void G_PlayDemo (char* name);
 void G_TimeDemo (const char* name);
 bool G_CheckDemoStatus (void);
 
+// Headless demo benchmark (-bench), see g_bench.cpp.
+extern bool benchmarking;
+void G_StartBenchmark (int numdemos, const FString *demos, const char *output);
+void G_BenchmarkStartTic ();
+void G_BenchmarkEndTic ();
+void G_BenchmarkNextDemo ();
+
+// Node builder benchmark (-nodebench), see g_nodebench.cpp.
+extern bool nodebenchmarking;
+void G_StartNodeBenchmark (int runs);
+void G_NodeBenchmarkTic ();
+
 void G_WorldDone (void);
 
 void G_Ticker (void);
@@ -66,6 +79,16 @@ bool G_Responder (event_t*	ev);
 
 void G_ScreenShot (char *filename);
 
+// The game state chunks of a savegame, also used for demo keyframes.
+class FileWriter;
+void G_WriteSaveData (FileWriter *stdfile);
+void G_ReadSaveData (PNGHandle *png, const char *map);
+
+// Keyframed demo seeking, see g_rewind.cpp.
+extern int DemoTic;
+void G_DemoKeyframeTicker ();
+void G_ClearDemoKeyframes ();
+
 FString G_BuildSaveName (const char *prefix, int slot);
 
 struct PNGHandle;
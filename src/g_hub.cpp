@@ -166,7 +166,7 @@ static void G_SerializeHub(FArchive & arc)
 	else hubdata.Clear();
 }
 
-void G_WriteHubInfo (FILE *file)
+void G_WriteHubInfo (FileWriter *file)
 {
 	FPNGChunkArchive arc(file, HUBS_ID);
 	G_SerializeHub(arc);
@@ -178,7 +178,7 @@ void G_ReadHubInfo (PNGHandle *png)
 
 	if ((chunklen = M_FindPNGChunk (png, HUBS_ID)) != 0)
 	{
-		FPNGChunkArchive arc (png->File->GetFile(), HUBS_ID, chunklen);
+		FPNGChunkArchive arc (png->File, HUBS_ID, chunklen);
 		G_SerializeHub(arc);
 	}
 }
@@ -4,10 +4,11 @@
 #include <stdio.h>
 
 struct PNGHandle;
+class FileWriter;
 struct cluster_info_t;
 struct wbstartstruct_t;
 
-void G_WriteHubInfo (FILE *file);
+void G_WriteHubInfo (FileWriter *file);
 void G_ReadHubInfo (PNGHandle *png);
 void G_LeavingHub(int mode, cluster_info_t * cluster, struct wbstartstruct_t * wbs);
 
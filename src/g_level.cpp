@@ -81,11 +81,14 @@
 #include "a_strifeglobal.h"
 #include "r_data/colormaps.h"
 #include "farchive.h"
+#include "files.h"
+#include "m_crc32.h"
 #include "r_renderer.h"
 
 #include "gi.h"
 
 #include "g_hub.h"
+#include "profiler.h"
 
 void STAT_StartNewGame(const char *lev);
 void STAT_ChangeLevel(const char *newl);
@@ -807,6 +810,7 @@ extern gamestate_t 	wipegamestate;
  
 void G_DoLoadLevel (int position, bool autosave)
 { 
+	PROFILE_ZONE("G_DoLoadLevel");
 	static int lastposition = 0;
 	gamestate_t oldgs = gamestate;
 	int i;
@@ -1507,9 +1511,12 @@ void G_SerializeLevel (FArchive &arc, bool hubLoad)
 //
 // Archives the current level
 //
+// If defercompression is true, the snapshot is left uncompressed, and only
+// G_WriteDeferredSnapshot can write it out.
+//
 //==========================================================================
 
-void G_SnapshotLevel ()
+void G_SnapshotLevel (bool defercompression)
 {
 	if (level.info->snapshot)
 		delete level.info->snapshot;
@@ -1519,6 +1526,10 @@ void G_SnapshotLevel ()
 		level.info->snapshotVer = SAVEVER;
 		level.info->snapshot = new FCompressedMemFile;
 		level.info->snapshot->Open ();
+		if (defercompression)
+		{
+			level.info->snapshot->DeferCompression ();
+		}
 
 		FArchive arc (*level.info->snapshot);
 
@@ -1617,12 +1628,61 @@ static void writeSnapShot (FArchive &arc, level_info_t *i)
 	i->snapshot->Serialize (arc);
 }
 
+//==========================================================================
+//
+// G_WriteDeferredSnapshot
+//
+// Compresses a snapshot that was taken with deferred compression and
+// writes the same chunk G_WriteSnapshots would write for it. This is done
+// by the thread that writes a savegame, so everything it needs from the
+// level info is passed in, and nothing may be allocated with M_Malloc.
+// Only TheDefaultLevelInfo has no map name.
+//
+//==========================================================================
+
+bool G_WriteDeferredSnapshot (FileWriter *file, const FCompressedMemFile *snapshot,
+	DWORD version, const char *mapname)
+{
+	BYTE head[4 + 1 + 8];
+	DWORD chunk[2];
+	DWORD crc;
+	unsigned int headlen, size;
+	BYTE *data;
+	bool ok;
+
+	// This is what writeSnapShot puts in front of the snapshot.
+	version = BigLong((unsigned int)version);
+	memcpy (head, &version, 4);
+	head[4] = (BYTE)strlen (mapname);
+	if (head[4] > 8)
+	{
+		head[4] = 8;
+	}
+	memcpy (head + 5, mapname, head[4]);
+	headlen = 5 + head[4];
+
+	data = snapshot->CompressDeferred (size);
+	chunk[0] = BigLong(headlen + size);
+	chunk[1] = mapname[0] == 0 ? DSNP_ID : SNAP_ID;
+	crc = CalcCRC32 ((BYTE *)&chunk[1], 4);
+	crc = AddCRC32 (crc, head, headlen);
+	crc = AddCRC32 (crc, data, size);
+	crc = BigLong((unsigned int)crc);
+
+	ok = file->Write (chunk, 8) == 8 &&
+		file->Write (head, headlen) == headlen &&
+		file->Write (data, size) == size &&
+		file->Write (&crc, 4) == 4;
+	delete[] data;
+	return ok;
+}
+
 //==========================================================================
 //
 //
 //==========================================================================
 
-void G_WriteSnapshots (FILE *file)
+void G_WriteSnapshots (FileWriter *file)
 {
 	unsigned int i;
 
@@ -1706,7 +1766,7 @@ void G_ReadSnapshots (PNGHandle *png)
 	chunkLen = (DWORD)M_FindPNGChunk (png, SNAP_ID);
 	while (chunkLen != 0)
 	{
-		FPNGChunkArchive arc (png->File->GetFile(), SNAP_ID, chunkLen);
+		FPNGChunkArchive arc (png->File, SNAP_ID, chunkLen);
 		DWORD snapver;
 
 		arc << snapver;
@@ -1723,7 +1783,7 @@ void G_ReadSnapshots (PNGHandle *png)
 	chunkLen = (DWORD)M_FindPNGChunk (png, DSNP_ID);
 	if (chunkLen != 0)
 	{
-		FPNGChunkArchive arc (png->File->GetFile(), DSNP_ID, chunkLen);
+		FPNGChunkArchive arc (png->File, DSNP_ID, chunkLen);
 		DWORD snapver;
 
 		arc << snapver;
@@ -1737,7 +1797,7 @@ void G_ReadSnapshots (PNGHandle *png)
 	chunkLen = (DWORD)M_FindPNGChunk (png, VIST_ID);
 	if (chunkLen != 0)
 	{
-		FPNGChunkArchive arc (png->File->GetFile(), VIST_ID, chunkLen);
+		FPNGChunkArchive arc (png->File, VIST_ID, chunkLen);
 
 		arc << namelen;
 		while (namelen != 0)
@@ -1753,7 +1813,7 @@ void G_ReadSnapshots (PNGHandle *png)
 	chunkLen = (DWORD)M_FindPNGChunk (png, RCLS_ID);
 	if (chunkLen != 0)
 	{
-		FPNGChunkArchive arc (png->File->GetFile(), PCLS_ID, chunkLen);
+		FPNGChunkArchive arc (png->File, PCLS_ID, chunkLen);
 		SBYTE cnum;
 
 		for (DWORD j = 0; j < chunkLen; ++j)
@@ -1766,7 +1826,7 @@ void G_ReadSnapshots (PNGHandle *png)
 	chunkLen = (DWORD)M_FindPNGChunk (png, PCLS_ID);
 	if (chunkLen != 0)
 	{
-		FPNGChunkArchive arc (png->File->GetFile(), RCLS_ID, chunkLen);
+		FPNGChunkArchive arc (png->File, RCLS_ID, chunkLen);
 		BYTE pnum;
 
 		arc << pnum;
@@ -1811,7 +1871,7 @@ static void writeDefereds (FArchive &arc, level_info_t *i)
 //
 //==========================================================================
 
-void P_WriteACSDefereds (FILE *file)
+void P_WriteACSDefereds (FileWriter *file)
 {
 	FPNGChunkArchive *arc = NULL;
 
@@ -1851,7 +1911,7 @@ void P_ReadACSDefereds (PNGHandle *png)
 
 	if ((chunklen = M_FindPNGChunk (png, ACSD_ID)) != 0)
 	{
-		FPNGChunkArchive arc (png->File->GetFile(), ACSD_ID, chunklen);
+		FPNGChunkArchive arc (png->File, ACSD_ID, chunklen);
 
 		arc << namelen;
 		while (namelen)
@@ -227,6 +227,7 @@ struct FSpecialAction
 };
 
 class FCompressedMemFile;
+class FileWriter;
 class DScroller;
 
 class FScanner;
@@ -527,11 +528,12 @@ void G_ParseMapInfo (const char *basemapinfo);
 
 void G_ClearSnapshots (void);
 void P_RemoveDefereds ();
-void G_SnapshotLevel (void);
+void G_SnapshotLevel (bool defercompression = false);
 void G_UnSnapshotLevel (bool keepPlayers);
 struct PNGHandle;
 void G_ReadSnapshots (PNGHandle *png);
-void G_WriteSnapshots (FILE *file);
+void G_WriteSnapshots (FileWriter *file);
+bool G_WriteDeferredSnapshot (FileWriter *file, const FCompressedMemFile *snapshot, DWORD version, const char *mapname);
 void G_ClearHubInfo();
 
 enum ESkillProperty
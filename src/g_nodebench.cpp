@@ -0,0 +1,270 @@
+/*
+** g_nodebench.cpp
+** Builds the nodes of every map in a WAD and prints how long it took
+**
+**---------------------------------------------------------------------------
+**
+** Started with -nodebench [<runs>]. The maps are taken from the last loaded
+** file that has any. Each map is loaded with gennodes on. Before its nodes
+** are built for real, they are built <runs> times (default 3) with the
+** splitter search on one thread and <runs> times with it on the worker
+** pool. The fastest time of each is printed, and the two trees are compared
+** to make sure they are the same. The program exits after the last map.
+**
+** Like -bench, this does not draw anything and runs without sound.
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "doomtype.h"
+#include "doomstat.h"
+#include "d_event.h"
+#include "tarray.h"
+#include "zstring.h"
+#include "stats.h"
+#include "c_cvars.h"
+#include "i_system.h"
+#include "w_wad.h"
+#include "nodebuild.h"
+#include "p_setup.h"
+#include "g_game.h"
+#include "g_level.h"
+
+// TYPES -------------------------------------------------------------------
+
+struct FNodeBenchMap
+{
+	FString Name;
+	int NumLines;
+	double SerialTime;		// in milliseconds
+	double ParallelTime;
+	bool Built;
+	bool Same;
+};
+
+// EXTERNAL DATA DECLARATIONS ----------------------------------------------
+
+EXTERN_CVAR (Bool, gennodes)
+EXTERN_CVAR (Bool, parallelnodes)
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+bool nodebenchmarking;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static TArray<FNodeBenchMap> BenchMaps;
+static unsigned int CurrentMap;
+static int BenchRuns;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// FindMaps
+//
+// Lists the maps of the last file that has any.
+//
+//==========================================================================
+
+static void FindMaps ()
+{
+	int numlumps = Wads.GetNumLumps();
+	int mapfile = -1;
+	char name[9];
+
+	for (int i = 0; i < numlumps; ++i)
+	{
+		const char *fullname = Wads.GetLumpFullName(i);
+		int file = Wads.GetLumpFile(i);
+		bool marker;
+
+		// A map is either a marker followed by its lumps or a WAD in the
+		// maps/ directory of an archive.
+		if (i + 1 < numlumps && Wads.GetLumpFile(i + 1) == file)
+		{
+			Wads.GetLumpName(name, i + 1);
+			name[8] = 0;
+			marker = !strcmp(name, "THINGS") || !strcmp(name, "TEXTMAP");
+		}
+		else
+		{
+			marker = false;
+		}
+		if (!marker && strnicmp(fullname, "maps/", 5) != 0)
+		{
+			continue;
+		}
+		Wads.GetLumpName(name, i);
+		name[8] = 0;
+		if (file < mapfile || !P_CheckMapData(name))
+		{
+			continue;
+		}
+		if (file > mapfile)
+		{
+			BenchMaps.Clear();
+			mapfile = file;
+		}
+		unsigned int j;
+		for (j = 0; j < BenchMaps.Size(); ++j)
+		{
+			if (BenchMaps[j].Name.CompareNoCase(name) == 0)
+			{
+				break;
+			}
+		}
+		if (j == BenchMaps.Size())
+		{
+			FNodeBenchMap &map = BenchMaps[BenchMaps.Reserve(1)];
+			map.Name = name;
+			map.NumLines = 0;
+			map.SerialTime = map.ParallelTime = 0;
+			map.Built = map.Same = false;
+		}
+	}
+}
+
+//==========================================================================
+//
+// G_StartNodeBenchmark
+//
+//==========================================================================
+
+void G_StartNodeBenchmark (int runs)
+{
+	FindMaps ();
+	if (BenchMaps.Size() == 0)
+	{
+		I_FatalError ("No maps to build nodes for");
+	}
+	BenchRuns = MAX(runs, 1);
+	CurrentMap = 0;
+	nodebenchmarking = true;
+	gennodes = true;
+
+	nodrawers = true;
+	noblit = true;
+	singletics = true;
+	printf ("%-8s %7s %12s %12s\n", "Map", "Lines", "Serial ms", "Parallel ms");
+	G_DeferedInitNew (BenchMaps[0].Name);
+}
+
+//==========================================================================
+//
+// BuildTime
+//
+// Builds the nodes <runs> times and returns the fastest time. The last
+// builder is returned in <builder>.
+//
+//==========================================================================
+
+static double BuildTime (FNodeBuilder::FLevel &leveldata, TArray<FNodeBuilder::FPolyStart> &polyspots,
+	TArray<FNodeBuilder::FPolyStart> &anchors, bool buildGLNodes, FNodeBuilder *&builder)
+{
+	double best = 0;
+
+	builder = NULL;
+	for (int i = 0; i < BenchRuns; ++i)
+	{
+		cycle_t time;
+
+		delete builder;
+		time.Reset();
+		time.Clock();
+		builder = new FNodeBuilder (leveldata, polyspots, anchors, buildGLNodes);
+		time.Unclock();
+		if (i == 0 || time.TimeMS() < best)
+		{
+			best = time.TimeMS();
+		}
+	}
+	return best;
+}
+
+//==========================================================================
+//
+// G_NodeBenchmarkLevel
+//
+// Called by P_SetupLevel before it builds the nodes.
+//
+//==========================================================================
+
+void G_NodeBenchmarkLevel (FNodeBuilder::FLevel &leveldata, TArray<FNodeBuilder::FPolyStart> &polyspots,
+	TArray<FNodeBuilder::FPolyStart> &anchors, bool buildGLNodes)
+{
+	if (CurrentMap >= BenchMaps.Size())
+	{
+		return;
+	}
+
+	FNodeBenchMap &map = BenchMaps[CurrentMap];
+	bool oldparallel = parallelnodes;
+	FNodeBuilder *serial, *parallel;
+
+	parallelnodes = false;
+	map.SerialTime = BuildTime (leveldata, polyspots, anchors, buildGLNodes, serial);
+	parallelnodes = true;
+	map.ParallelTime = BuildTime (leveldata, polyspots, anchors, buildGLNodes, parallel);
+	parallelnodes = oldparallel;
+
+	map.NumLines = leveldata.NumLines;
+	map.Same = serial->IsSameTree (*parallel);
+	map.Built = true;
+	delete serial;
+	delete parallel;
+}
+
+//==========================================================================
+//
+// G_NodeBenchmarkTic
+//
+// Called by D_DoomLoop after every tic. Moves on to the next map once the
+// current one has been loaded.
+//
+//==========================================================================
+
+void G_NodeBenchmarkTic ()
+{
+	if (!nodebenchmarking || gamestate != GS_LEVEL || gameaction != ga_nothing)
+	{
+		return;
+	}
+
+	const FNodeBenchMap &map = BenchMaps[CurrentMap];
+
+	if (!map.Built)
+	{
+		printf ("%-8s not built\n", map.Name.GetChars());
+	}
+	else
+	{
+		printf ("%-8s %7d %12.2f %12.2f%s\n", map.Name.GetChars(), map.NumLines,
+			map.SerialTime, map.ParallelTime, map.Same ? "" : "  DIFFERENT TREES");
+	}
+
+	if (++CurrentMap < BenchMaps.Size())
+	{
+		G_DeferedInitNew (BenchMaps[CurrentMap].Name);
+		return;
+	}
+
+	double serial = 0, parallel = 0;
+	int different = 0;
+
+	for (unsigned int i = 0; i < BenchMaps.Size(); ++i)
+	{
+		serial += BenchMaps[i].SerialTime;
+		parallel += BenchMaps[i].ParallelTime;
+		different += BenchMaps[i].Built && !BenchMaps[i].Same;
+	}
+	printf ("%-8s %7s %12.2f %12.2f\n", "Total", "", serial, parallel);
+	if (different > 0)
+	{
+		printf ("%d maps were built differently with parallelnodes on\n", different);
+		exit (1);
+	}
+	exit (0);
+}
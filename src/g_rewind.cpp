@@ -0,0 +1,343 @@
+/*
+** g_rewind.cpp
+** Takes keyframes during demo playback so that the demo can be seeked
+**
+**---------------------------------------------------------------------------
+**
+** While a demo is played, the complete game state is saved to memory every
+** demo_keyframetics tics. A keyframe is a savegame without the picture and
+** the header texts, plus the position in the demo and the last command of
+** every player. The level snapshots in it are compressed the same way they
+** are in savegames.
+**
+** The keyframes are kept in order. When they use more than demo_keyframemem
+** megabytes, the oldest are dropped, except for the very first one, so the
+** start of the demo can always be reached.
+**
+** The demoseek and demoskip commands restore the newest keyframe at or
+** before the requested tic (if it is not faster to just keep playing) and
+** run the remaining tics without drawing anything. All of this happens
+** inside G_Ticker, with gametic standing still, because the network code
+** does not allow gametic to jump. Restoring a keyframe goes through the
+** same code as loading a savegame, so the map is set up again each time.
+**
+*/
+
+#include <stdlib.h>
+
+#include "templates.h"
+#include "doomtype.h"
+#include "doomstat.h"
+#include "d_event.h"
+#include "d_player.h"
+#include "tarray.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "stats.h"
+#include "files.h"
+#include "m_png.h"
+#include "s_sound.h"
+#include "dobject.h"
+#include "g_game.h"
+#include "g_level.h"
+#include "version.h"
+
+// TYPES -------------------------------------------------------------------
+
+struct FDemoKeyframe
+{
+	int Tic;
+	size_t DemoPos;				// offset of the tic's commands in demobuffer
+	ticcmd_t Cmds[MAXPLAYERS];	// commands are stored as deltas to these
+	bool InGame[MAXPLAYERS];
+	BufferWriter Data;			// the game state, as a savegame
+};
+
+// EXTERNAL DATA DECLARATIONS ----------------------------------------------
+
+extern BYTE *demobuffer;
+extern BYTE *demo_p;
+extern bool timingdemo;
+extern bool precache;
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+CVAR (Int, demo_keyframetics, 350, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+CVAR (Int, demo_keyframemem, 64, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
+int DemoTic;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static TArray<FDemoKeyframe *> Keyframes;
+static size_t KeyframeMem;
+static int SeekTarget = -1;
+static bool Seeking;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// G_ClearDemoKeyframes
+//
+// Called when a demo starts or ends.
+//
+//==========================================================================
+
+void G_ClearDemoKeyframes ()
+{
+	for (unsigned int i = 0; i < Keyframes.Size(); ++i)
+	{
+		delete Keyframes[i];
+	}
+	Keyframes.Clear();
+	KeyframeMem = 0;
+	SeekTarget = -1;
+	DemoTic = 0;
+}
+
+//==========================================================================
+//
+// DropOldKeyframes
+//
+// Frees the oldest keyframes after the first one until the rest fit into
+// demo_keyframemem. The newest one is always kept.
+//
+//==========================================================================
+
+static void DropOldKeyframes ()
+{
+	size_t budget = (size_t)MAX<int>(demo_keyframemem, 0) << 20;
+
+	while (KeyframeMem > budget && Keyframes.Size() > 2)
+	{
+		KeyframeMem -= Keyframes[1]->Data.GetBuffer().Size();
+		delete Keyframes[1];
+		Keyframes.Delete(1);
+	}
+}
+
+//==========================================================================
+//
+// CaptureKeyframe
+//
+// Saves the game state as it is before the current tic is run.
+//
+//==========================================================================
+
+static void CaptureKeyframe ()
+{
+	FDemoKeyframe *key = new FDemoKeyframe;
+	FileWriter *file = &key->Data;
+
+	key->Tic = DemoTic;
+	key->DemoPos = demo_p - demobuffer;
+	for (int i = 0; i < MAXPLAYERS; ++i)
+	{
+		key->Cmds[i] = players[i].cmd;
+		key->InGame[i] = playeringame[i];
+	}
+
+	G_SnapshotLevel ();
+	SaveVersion = SAVEVER;
+	M_CreateDummyPNG (file);
+	M_AppendPNGText (file, "Current Map", level.mapname);
+	G_WriteSaveData (file);
+	M_FinishPNG (file);
+
+	// The snapshot is in the keyframe now.
+	delete level.info->snapshot;
+	level.info->snapshot = NULL;
+
+	key->Data.GetBuffer().ShrinkToFit();
+	KeyframeMem += key->Data.GetBuffer().Size();
+	Keyframes.Push (key);
+	DropOldKeyframes ();
+}
+
+//==========================================================================
+//
+// RestoreKeyframe
+//
+//==========================================================================
+
+static bool RestoreKeyframe (FDemoKeyframe *key)
+{
+	TArray<BYTE> &data = key->Data.GetBuffer();
+	MemoryReader reader ((const char *)&data[0], data.Size());
+	PNGHandle *png;
+	char *map;
+
+	png = M_VerifyPNG (&reader);
+	if (png == NULL)
+	{
+		return false;
+	}
+	map = M_GetPNGText (png, "Current Map");
+	if (map == NULL)
+	{
+		delete png;
+		return false;
+	}
+
+	for (int i = 0; i < MAXPLAYERS; ++i)
+	{
+		playeringame[i] = key->InGame[i];
+	}
+	SaveVersion = SAVEVER;
+	precache = false;
+	G_ReadSaveData (png, map);
+	precache = true;
+	delete[] map;
+	delete png;
+
+	demo_p = demobuffer + key->DemoPos;
+	DemoTic = key->Tic;
+	for (int i = 0; i < MAXPLAYERS; ++i)
+	{
+		players[i].cmd = key->Cmds[i];
+	}
+	usergame = false;
+	return true;
+}
+
+//==========================================================================
+//
+// SeekDemo
+//
+// Restores a keyframe if needed and plays the demo up to the target tic.
+//
+//==========================================================================
+
+static void SeekDemo (int target)
+{
+	int key;
+
+	for (key = Keyframes.Size() - 1; key >= 0; --key)
+	{
+		if (Keyframes[key]->Tic <= target)
+		{
+			break;
+		}
+	}
+	if (target < DemoTic && key < 0)
+	{
+		Printf ("No keyframe before tic %d\n", target);
+		return;
+	}
+
+	Seeking = true;
+	paused = 0;
+	if (key >= 0 && (target < DemoTic || Keyframes[key]->Tic > DemoTic))
+	{
+		if (!RestoreKeyframe (Keyframes[key]))
+		{
+			Printf ("Could not restore the keyframe at tic %d\n", Keyframes[key]->Tic);
+			Seeking = false;
+			return;
+		}
+	}
+	while (demoplayback && DemoTic < target)
+	{
+		G_Ticker ();
+		GC::CheckGC ();
+	}
+	Seeking = false;
+	S_StopAllChannels ();
+}
+
+//==========================================================================
+//
+// G_DemoKeyframeTicker
+//
+// Called by G_Ticker before every tic of a demo is read.
+//
+//==========================================================================
+
+void G_DemoKeyframeTicker ()
+{
+	if (!Seeking && SeekTarget >= 0)
+	{
+		int target = SeekTarget;
+
+		SeekTarget = -1;
+		SeekDemo (target);
+		if (!demoplayback)
+		{
+			return;
+		}
+	}
+	if (demo_keyframetics > 0 && !timingdemo && gamestate == GS_LEVEL && gameaction == ga_nothing &&
+		(Keyframes.Size() == 0 || DemoTic >= Keyframes.Last()->Tic + demo_keyframetics))
+	{
+		CaptureKeyframe ();
+	}
+	DemoTic++;
+}
+
+//==========================================================================
+//
+// CCMD demoseek
+//
+//==========================================================================
+
+CCMD (demoseek)
+{
+	if (argv.argc() < 2)
+	{
+		Printf ("Usage: demoseek <tic>\n");
+		return;
+	}
+	if (!demoplayback)
+	{
+		Printf ("No demo is playing\n");
+		return;
+	}
+	SeekTarget = MAX(atoi (argv[1]), 0);
+}
+
+//==========================================================================
+//
+// CCMD demoskip
+//
+// Seeks forward or, with a negative value, backward by some seconds.
+//
+//==========================================================================
+
+CCMD (demoskip)
+{
+	if (argv.argc() < 2)
+	{
+		Printf ("Usage: demoskip <seconds>\n");
+		return;
+	}
+	if (!demoplayback)
+	{
+		Printf ("No demo is playing\n");
+		return;
+	}
+	SeekTarget = MAX(DemoTic + int(atof (argv[1]) * TICRATE), 0);
+}
+
+//==========================================================================
+//
+// STAT demokeys
+//
+//==========================================================================
+
+ADD_STAT (demokeys)
+{
+	FString out;
+
+	if (!demoplayback)
+	{
+		out = "No demo is playing";
+		return out;
+	}
+	out.Format ("Tic %d, %u keyframes, %u KB", DemoTic, Keyframes.Size(), unsigned(KeyframeMem >> 10));
+	if (Keyframes.Size() > 0)
+	{
+		out.AppendFormat (", first at %d, last at %d", Keyframes[0]->Tic, Keyframes.Last()->Tic);
+	}
+	return out;
+}
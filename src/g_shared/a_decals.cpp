@@ -150,6 +150,7 @@ void DBaseDecal::SerializeChain (FArchive &arc, DBaseDecal **first)
 		{
 			arc << fresh;
 			*firstptr = fresh;
+			GC::EscapeBarrier(fresh);
 			fresh->WallPrev = firstptr;
 			firstptr = &fresh->WallNext;
 		}
@@ -223,6 +224,7 @@ FTextureID DBaseDecal::StickToWall (side_t *wall, fixed_t x, fixed_t y, F3DFloor
 	*prev = this;
 	WallNext = NULL;
 	WallPrev = prev;
+	GC::EscapeBarrier(this);	// WallNext is a plain pointer
 /*
 	WallNext = wall->AttachedDecals;
 	WallPrev = &wall->AttachedDecals;
@@ -1040,6 +1040,9 @@ public:
 		//prepare ammo counts
 		GetCurrentAmmo(ammo1, ammo2, ammocount1, ammocount2);
 		armor = CPlayer->mo->FindInventory<ABasicArmor>();
+		GC::EscapeBarrier(ammo1);
+		GC::EscapeBarrier(ammo2);
+		GC::EscapeBarrier(armor);
 
 		if(state != HUD_AltHud)
 		{
@@ -961,7 +961,7 @@ void FGLRenderer::RenderView (player_t* player)
 //
 //===========================================================================
 
-void FGLRenderer::WriteSavePic (player_t *player, FILE *file, int width, int height)
+void FGLRenderer::WriteSavePic (player_t *player, FileWriter *file, int width, int height)
 {
 	GL_IRECT bounds;
 
@@ -1001,7 +1001,7 @@ struct FGLInterface : public FRenderer
 	bool UsesColormap() const;
 	void PrecacheTexture(FTexture *tex, int cache);
 	void RenderView(player_t *player);
-	void WriteSavePic (player_t *player, FILE *file, int width, int height);
+	void WriteSavePic (player_t *player, FileWriter *file, int width, int height);
 	void StateChanged(AActor *actor);
 	void StartSerialize(FArchive &arc);
 	void EndSerialize(FArchive &arc);
@@ -1111,7 +1111,7 @@ void FGLInterface::ClearBuffer(int color)
 //
 //===========================================================================
 
-void FGLInterface::WriteSavePic (player_t *player, FILE *file, int width, int height)
+void FGLInterface::WriteSavePic (player_t *player, FileWriter *file, int width, int height)
 {
 	GLRenderer->WriteSavePic(player, file, width, height);
 }
@@ -46,6 +46,7 @@
 
 #include "m_fixed.h"
 #include "m_random.h"
+#include "p_profile.h"
 
 struct Baggage;
 class FScanner;
@@ -135,7 +136,14 @@ struct FState
 	{
 		if (ActionFunc != NULL)
 		{
-			ActionFunc(self, stateowner, this, ParameterIndex-1, statecall);
+			if (ActorProfiling)
+			{
+				P_ProfileAction(this, self, stateowner, statecall);
+			}
+			else
+			{
+				ActionFunc(self, stateowner, this, ParameterIndex-1, statecall);
+			}
 			return true;
 		}
 		else
@@ -44,6 +44,35 @@
 
 #include "i_system.h"
 #include "dobject.h"
+#include "m_alloc.h"
+
+#ifdef _MSC_VER
+#define THREADLOCAL __declspec(thread)
+#else
+#define THREADLOCAL __thread
+#endif
+
+// Nesting depth of M_BeginUncounted for the calling thread.
+static THREADLOCAL int Uncounted;
+
+#define COUNT_ALLOC(x)		do { if (Uncounted == 0) GC::AllocBytes += (x); } while (0)
+#define COUNT_FREE(x)		do { if (Uncounted == 0) GC::AllocBytes -= (x); } while (0)
+
+//==========================================================================
+//
+// M_BeginUncounted / M_EndUncounted
+//
+//==========================================================================
+
+void M_BeginUncounted ()
+{
+	Uncounted++;
+}
+
+void M_EndUncounted ()
+{
+	Uncounted--;
+}
 
 #ifndef _MSC_VER
 #define _NORMAL_BLOCK			0
@@ -67,7 +96,7 @@ void *M_Malloc(size_t size)
 	if (block == NULL)
 		I_FatalError("Could not malloc %zu bytes", size);
 
-	GC::AllocBytes += _msize(block);
+	COUNT_ALLOC(_msize(block));
 	return block;
 }
 
@@ -75,14 +104,14 @@ void *M_Realloc(void *memblock, size_t size)
 {
 	if (memblock != NULL)
 	{
-		GC::AllocBytes -= _msize(memblock);
+		COUNT_FREE(_msize(memblock));
 	}
 	void *block = realloc(memblock, size);
 	if (block == NULL)
 	{
 		I_FatalError("Could not realloc %zu bytes", size);
 	}
-	GC::AllocBytes += _msize(block);
+	COUNT_ALLOC(_msize(block));
 	return block;
 }
 #else
@@ -97,7 +126,7 @@ void *M_Malloc(size_t size)
 	*sizeStore = size;
 	block = sizeStore+1;
 
-	GC::AllocBytes += _msize(block);
+	COUNT_ALLOC(_msize(block));
 	return block;
 }
 
@@ -108,7 +137,7 @@ void *M_Realloc(void *memblock, size_t size)
 
 	if (memblock != NULL)
 	{
-		GC::AllocBytes -= _msize(memblock);
+		COUNT_FREE(_msize(memblock));
 	}
 	void *block = realloc(((size_t*) memblock)-1, size+sizeof(size_t));
 	if (block == NULL)
@@ -120,7 +149,7 @@ void *M_Realloc(void *memblock, size_t size)
 	*sizeStore = size;
 	block = sizeStore+1;
 
-	GC::AllocBytes += _msize(block);
+	COUNT_ALLOC(_msize(block));
 	return block;
 }
 #endif
@@ -137,7 +166,7 @@ void *M_Malloc_Dbg(size_t size, const char *file, int lineno)
 	if (block == NULL)
 		I_FatalError("Could not malloc %zu bytes", size);
 
-	GC::AllocBytes += _msize(block);
+	COUNT_ALLOC(_msize(block));
 	return block;
 }
 
@@ -145,14 +174,14 @@ void *M_Realloc_Dbg(void *memblock, size_t size, const char *file, int lineno)
 {
 	if (memblock != NULL)
 	{
-		GC::AllocBytes -= _msize(memblock);
+		COUNT_FREE(_msize(memblock));
 	}
 	void *block = _realloc_dbg(memblock, size, _NORMAL_BLOCK, file, lineno);
 	if (block == NULL)
 	{
 		I_FatalError("Could not realloc %zu bytes", size);
 	}
-	GC::AllocBytes += _msize(block);
+	COUNT_ALLOC(_msize(block));
 	return block;
 }
 #else
@@ -167,7 +196,7 @@ void *M_Malloc_Dbg(size_t size, const char *file, int lineno)
 	*sizeStore = size;
 	block = sizeStore+1;
 
-	GC::AllocBytes += _msize(block);
+	COUNT_ALLOC(_msize(block));
 	return block;
 }
 
@@ -178,7 +207,7 @@ void *M_Realloc_Dbg(void *memblock, size_t size, const char *file, int lineno)
 
 	if (memblock != NULL)
 	{
-		GC::AllocBytes -= _msize(memblock);
+		COUNT_FREE(_msize(memblock));
 	}
 	void *block = _realloc_dbg(((size_t*) memblock)-1, size+sizeof(size_t), _NORMAL_BLOCK, file, lineno);
 
@@ -191,7 +220,7 @@ void *M_Realloc_Dbg(void *memblock, size_t size, const char *file, int lineno)
 	*sizeStore = size;
 	block = sizeStore+1;
 
-	GC::AllocBytes += _msize(block);
+	COUNT_ALLOC(_msize(block));
 	return block;
 }
 #endif
@@ -202,7 +231,7 @@ void M_Free (void *block)
 {
 	if (block != NULL)
 	{
-		GC::AllocBytes -= _msize(block);
+		COUNT_FREE(_msize(block));
 		free(block);
 	}
 }
@@ -211,7 +240,7 @@ void M_Free (void *block)
 {
 	if(block != NULL)
 	{
-		GC::AllocBytes -= _msize(block);
+		COUNT_FREE(_msize(block));
 		free(((size_t*) block)-1);
 	}
 }
@@ -53,4 +53,11 @@ void *M_Realloc (void *memblock, size_t size);
 
 void M_Free (void *memblock);
 
+// GC::AllocBytes may only be changed by the main thread. Another thread
+// that has to use these functions (for example through TArray) calls
+// M_BeginUncounted first, and M_EndUncounted when it is done. Everything
+// it allocates in between must also be freed in between.
+void M_BeginUncounted ();
+void M_EndUncounted ();
+
 #endif //__M_ALLOC_H__
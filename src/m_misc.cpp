@@ -632,9 +632,11 @@ void WritePCXfile (FILE *file, const BYTE *buffer, const PalEntry *palette,
 void WritePNGfile (FILE *file, const BYTE *buffer, const PalEntry *palette,
 				   ESSType color_type, int width, int height, int pitch)
 {
-	if (!M_CreatePNG (file, buffer, palette, color_type, width, height, pitch) ||
-		!M_AppendPNGText (file, "Software", GAMENAME DOTVERSIONSTR) ||
-		!M_FinishPNG (file))
+	FileWriter writer (file);
+
+	if (!M_CreatePNG (&writer, buffer, palette, color_type, width, height, pitch) ||
+		!M_AppendPNGText (&writer, "Software", GAMENAME DOTVERSIONSTR) ||
+		!M_FinishPNG (&writer))
 	{
 		Printf ("Could not create screenshot.\n");
 	}
@@ -62,6 +62,13 @@
 // determine, so that's why this is 0 here.
 #define USE_FILTER_HEURISTIC 0
 
+// x86_64 CPUs always have SSE2, which is used to unfilter rows of RGB and
+// RGBA images.
+#if defined(__amd64__) || defined(_M_X64)
+#define SSE2_UNFILTER
+#include <emmintrin.h>
+#endif
+
 // TYPES -------------------------------------------------------------------
 
 struct IHDR
@@ -101,7 +108,7 @@ PNGHandle::~PNGHandle ()
 
 static inline void MakeChunk (void *where, DWORD type, size_t len);
 static inline void StuffPalette (const PalEntry *from, BYTE *to);
-static bool WriteIDAT (FILE *file, const BYTE *data, int len);
+static bool WriteIDAT (FileWriter *file, const BYTE *data, int len);
 static void UnfilterRow (int width, BYTE *dest, BYTE *stream, BYTE *prev, int bpp);
 static void UnpackPixels (int width, int bytesPerRow, int bitdepth, const BYTE *rowin, BYTE *rowout, bool grayscale);
 
@@ -131,7 +138,7 @@ CVAR(Float, png_gamma, 0.f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 //
 //==========================================================================
 
-bool M_CreatePNG (FILE *file, const BYTE *buffer, const PalEntry *palette,
+bool M_CreatePNG (FileWriter *file, const BYTE *buffer, const PalEntry *palette,
 				  ESSType color_type, int width, int height, int pitch)
 {
 	BYTE work[8 +				// signature
@@ -171,7 +178,7 @@ bool M_CreatePNG (FILE *file, const BYTE *buffer, const PalEntry *palette,
 		work_len = sizeof(work) - (12+256*3);
 	}
 
-	if (fwrite (work, 1, work_len, file) != work_len)
+	if (file->Write (work, work_len) != work_len)
 		return false;
 
 	return M_SaveBitmap (buffer, color_type, width, height, pitch, file);
@@ -185,7 +192,7 @@ bool M_CreatePNG (FILE *file, const BYTE *buffer, const PalEntry *palette,
 //
 //==========================================================================
 
-bool M_CreateDummyPNG (FILE *file)
+bool M_CreateDummyPNG (FileWriter *file)
 {
 	static const BYTE dummyPNG[] =
 	{
@@ -195,7 +202,7 @@ bool M_CreateDummyPNG (FILE *file)
 		0,0,0,10,'I','D','A','T',
 		104,222,99,96,0,0,0,2,0,1,0x9f,0x65,0x0e,0x18
 	};
-	return fwrite (dummyPNG, 1, sizeof(dummyPNG), file) == sizeof(dummyPNG);
+	return file->Write (dummyPNG, sizeof(dummyPNG)) == sizeof(dummyPNG);
 }
 
 
@@ -207,10 +214,10 @@ bool M_CreateDummyPNG (FILE *file)
 //
 //==========================================================================
 
-bool M_FinishPNG (FILE *file)
+bool M_FinishPNG (FileWriter *file)
 {
 	static const BYTE iend[12] = { 0,0,0,0,73,69,78,68,174,66,96,130 };
-	return fwrite (iend, 1, 12, file) == 12;
+	return file->Write (iend, 12) == 12;
 }
 
 //==========================================================================
@@ -221,13 +228,13 @@ bool M_FinishPNG (FILE *file)
 //
 //==========================================================================
 
-bool M_AppendPNGChunk (FILE *file, DWORD chunkID, const BYTE *chunkData, DWORD len)
+bool M_AppendPNGChunk (FileWriter *file, DWORD chunkID, const BYTE *chunkData, DWORD len)
 {
 	DWORD head[2] = { BigLong((unsigned int)len), chunkID };
 	DWORD crc;
 
-	if (fwrite (head, 1, 8, file) == 8 &&
-		(len == 0 || fwrite (chunkData, 1, len, file) == len))
+	if (file->Write (head, 8) == 8 &&
+		(len == 0 || file->Write (chunkData, len) == len))
 	{
 		crc = CalcCRC32 ((BYTE *)&head[1], 4);
 		if (len != 0)
@@ -235,7 +242,7 @@ bool M_AppendPNGChunk (FILE *file, DWORD chunkID, const BYTE *chunkData, DWORD l
 			crc = AddCRC32 (crc, chunkData, len);
 		}
 		crc = BigLong((unsigned int)crc);
-		return fwrite (&crc, 1, 4, file) == 4;
+		return file->Write (&crc, 4) == 4;
 	}
 	return false;
 }
@@ -248,7 +255,7 @@ bool M_AppendPNGChunk (FILE *file, DWORD chunkID, const BYTE *chunkData, DWORD l
 //
 //==========================================================================
 
-bool M_AppendPNGText (FILE *file, const char *keyword, const char *text)
+bool M_AppendPNGText (FileWriter *file, const char *keyword, const char *text)
 {
 	struct { DWORD len, id; char key[80]; } head;
 	int len = (int)strlen (text);
@@ -261,8 +268,8 @@ bool M_AppendPNGText (FILE *file, const char *keyword, const char *text)
 	strncpy (head.key, keyword, keylen);
 	head.key[keylen] = 0;
 
-	if ((int)fwrite (&head, 1, keylen + 9, file) == keylen + 9 &&
-		(int)fwrite (text, 1, len, file) == len)
+	if ((int)file->Write (&head, keylen + 9) == keylen + 9 &&
+		(int)file->Write (text, len) == len)
 	{
 		crc = CalcCRC32 ((BYTE *)&head+4, keylen + 5);
 		if (len != 0)
@@ -270,7 +277,7 @@ bool M_AppendPNGText (FILE *file, const char *keyword, const char *text)
 			crc = AddCRC32 (crc, (BYTE *)text, len);
 		}
 		crc = BigLong((unsigned int)crc);
-		return fwrite (&crc, 1, 4, file) == 4;
+		return file->Write (&crc, 4) == 4;
 	}
 	return false;
 }
@@ -374,13 +381,11 @@ bool M_GetPNGText (PNGHandle *png, const char *keyword, char *buffer, size_t buf
 //
 //==========================================================================
 
+static PNGHandle *ReadPNGChunks (PNGHandle *png, DWORD ihdrsize);
+
 PNGHandle *M_VerifyPNG (FILE *file)
 {
-	PNGHandle::Chunk chunk;
-	FileReader *filer;
-	PNGHandle *png;
 	DWORD data[2];
-	bool sawIDAT = false;
 
 	if (fread (&data, 1, 8, file) != 8)
 	{
@@ -400,11 +405,54 @@ PNGHandle *M_VerifyPNG (FILE *file)
 	}
 
 	// It looks like a PNG so far, so start creating a PNGHandle for it
-	png = new PNGHandle (file);
-	filer = png->File;
-	chunk.ID = data[1];
+	return ReadPNGChunks (new PNGHandle (file), data[0]);
+}
+
+// This version reads from a FileReader, which is not deleted with the
+// PNGHandle.
+
+PNGHandle *M_VerifyPNG (FileReader *filer)
+{
+	DWORD data[2];
+
+	if (filer->Read (&data, 8) != 8)
+	{
+		return NULL;
+	}
+	if (data[0] != MAKE_ID(137,'P','N','G') || data[1] != MAKE_ID(13,10,26,10))
+	{ // Does not have PNG signature
+		return NULL;
+	}
+	if (filer->Read (&data, 8) != 8)
+	{
+		return NULL;
+	}
+	if (data[1] != MAKE_ID('I','H','D','R'))
+	{ // IHDR must be the first chunk
+		return NULL;
+	}
+	return ReadPNGChunks (new PNGHandle (filer), data[0]);
+}
+
+//==========================================================================
+//
+// ReadPNGChunks
+//
+// Builds the chunk list for M_VerifyPNG, starting at the IHDR chunk.
+// Deletes the PNGHandle and returns NULL if the file is not a valid PNG.
+//
+//==========================================================================
+
+static PNGHandle *ReadPNGChunks (PNGHandle *png, DWORD ihdrsize)
+{
+	PNGHandle::Chunk chunk;
+	FileReader *filer = png->File;
+	DWORD data[2];
+	bool sawIDAT = false;
+
+	chunk.ID = MAKE_ID('I','H','D','R');
 	chunk.Offset = 16;
-	chunk.Size = BigLong((unsigned int)data[0]);
+	chunk.Size = BigLong((unsigned int)ihdrsize);
 	png->Chunks.Push (chunk);
 	filer->Seek (16, SEEK_SET);
 
@@ -430,7 +478,7 @@ PNGHandle *M_VerifyPNG (FILE *file)
 			sawIDAT = true;
 		}
 		chunk.ID = data[1];
-		chunk.Offset = ftell (file);
+		chunk.Offset = filer->Tell ();
 		chunk.Size = BigLong((unsigned int)data[0]);
 		png->Chunks.Push (chunk);
 
@@ -571,8 +619,19 @@ bool M_ReadIDAT (FileReader *file, BYTE *buffer, int width, int height, int pitc
 		}
 		if (stream.avail_in == 0 && chunklen > 0)
 		{
-			stream.next_in = chunkbuffer;
-			stream.avail_in = (uInt)file->Read (chunkbuffer, MIN<long>(chunklen,sizeof(chunkbuffer)));
+			const char *filebuffer = file->GetBuffer();
+			if (filebuffer != NULL)
+			{ // The whole file is in memory, so zlib can read the chunk from there.
+				long pos = file->Tell();
+				stream.next_in = (Bytef *)(filebuffer + pos);
+				stream.avail_in = (uInt)MIN<long>(chunklen, file->GetLength() - pos);
+				file->Seek (stream.avail_in, SEEK_CUR);
+			}
+			else
+			{
+				stream.next_in = chunkbuffer;
+				stream.avail_in = (uInt)file->Read (chunkbuffer, MIN<long>(chunklen,sizeof(chunkbuffer)));
+			}
 			chunklen -= stream.avail_in;
 		}
 
@@ -900,7 +959,7 @@ static int SelectFilter(Byte row[5][1 + MAXWIDTH*3], Byte prior[MAXWIDTH*3], int
 //
 //==========================================================================
 
-bool M_SaveBitmap(const BYTE *from, ESSType color_type, int width, int height, int pitch, FILE *file)
+bool M_SaveBitmap(const BYTE *from, ESSType color_type, int width, int height, int pitch, FileWriter *file)
 {
 #if USE_FILTER_HEURISTIC
 	Byte prior[MAXWIDTH*3];
@@ -1041,7 +1100,7 @@ bool M_SaveBitmap(const BYTE *from, ESSType color_type, int width, int height, i
 //
 //==========================================================================
 
-static bool WriteIDAT (FILE *file, const BYTE *data, int len)
+static bool WriteIDAT (FileWriter *file, const BYTE *data, int len)
 {
 	DWORD foo[2], crc;
 
@@ -1050,15 +1109,172 @@ static bool WriteIDAT (FILE *file, const BYTE *data, int len)
 	crc = CalcCRC32 ((BYTE *)&foo[1], 4);
 	crc = BigLong ((unsigned int)AddCRC32 (crc, data, len));
 
-	if (fwrite (foo, 1, 8, file) != 8 ||
-		fwrite (data, 1, len, file) != (size_t)len ||
-		fwrite (&crc, 1, 4, file) != 4)
+	if (file->Write (foo, 8) != 8 ||
+		file->Write (data, len) != (size_t)len ||
+		file->Write (&crc, 4) != 4)
 	{
 		return false;
 	}
 	return true;
 }
 
+#ifdef SSE2_UNFILTER
+
+//==========================================================================
+//
+// SSE2 unfilters
+//
+// Sub, Average and Paeth depend on the pixel to the left, so these work
+// on one pixel at a time, but on all its bytes at once. Up works on 16
+// bytes at a time.
+//
+//==========================================================================
+
+template<int bpp> static inline __m128i LoadPixel (const BYTE *p)
+{
+	DWORD v = 0;
+	memcpy (&v, p, bpp);
+	return _mm_cvtsi32_si128 (v);
+}
+
+template<int bpp> static inline void StorePixel (BYTE *p, __m128i v)
+{
+	DWORD d = _mm_cvtsi128_si32 (v);
+	memcpy (p, &d, bpp);
+}
+
+static inline __m128i Abs16 (__m128i v)
+{
+	return _mm_max_epi16 (v, _mm_sub_epi16 (_mm_setzero_si128(), v));
+}
+
+static inline __m128i Select (__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128 (_mm_and_si128 (mask, a), _mm_andnot_si128 (mask, b));
+}
+
+static void UnfilterUp_SSE2 (int width, BYTE *dest, const BYTE *row, const BYTE *prev)
+{
+	for (; width >= 16; width -= 16)
+	{
+		__m128i x = _mm_loadu_si128 ((const __m128i *)row);
+		__m128i b = _mm_loadu_si128 ((const __m128i *)prev);
+		_mm_storeu_si128 ((__m128i *)dest, _mm_add_epi8 (x, b));
+		dest += 16;
+		row += 16;
+		prev += 16;
+	}
+	for (; width > 0; --width)
+	{
+		*dest++ = *row++ + *prev++;
+	}
+}
+
+template<int bpp>
+static void UnfilterSub_SSE2 (int width, BYTE *dest, const BYTE *row)
+{
+	__m128i a = _mm_setzero_si128();
+
+	for (; width > 0; width -= bpp)
+	{
+		a = _mm_add_epi8 (a, LoadPixel<bpp>(row));
+		StorePixel<bpp>(dest, a);
+		dest += bpp;
+		row += bpp;
+	}
+}
+
+template<int bpp>
+static void UnfilterAverage_SSE2 (int width, BYTE *dest, const BYTE *row, const BYTE *prev)
+{
+	const __m128i one = _mm_set1_epi8 (1);
+	__m128i a = _mm_setzero_si128();
+
+	for (; width > 0; width -= bpp)
+	{
+		__m128i b = LoadPixel<bpp>(prev);
+		// _mm_avg_epu8 rounds up, but the filter rounds down.
+		__m128i avg = _mm_sub_epi8 (_mm_avg_epu8 (a, b), _mm_and_si128 (_mm_xor_si128 (a, b), one));
+		a = _mm_add_epi8 (avg, LoadPixel<bpp>(row));
+		StorePixel<bpp>(dest, a);
+		dest += bpp;
+		row += bpp;
+		prev += bpp;
+	}
+}
+
+template<int bpp>
+static void UnfilterPaeth_SSE2 (int width, BYTE *dest, const BYTE *row, const BYTE *prev)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lowbyte = _mm_set1_epi16 (0xff);
+	__m128i a = zero, c = zero;
+
+	// With a and c 0 for the first pixel, the predictor picks b, like the
+	// scalar version does.
+	for (; width > 0; width -= bpp)
+	{
+		__m128i b = _mm_unpacklo_epi8 (LoadPixel<bpp>(prev), zero);
+		__m128i pa = _mm_sub_epi16 (b, c);
+		__m128i pb = _mm_sub_epi16 (a, c);
+		__m128i pc = Abs16 (_mm_add_epi16 (pa, pb));
+		pa = Abs16 (pa);
+		pb = Abs16 (pb);
+
+		// Ties go to a, then b, then c.
+		__m128i smallest = _mm_min_epi16 (pc, _mm_min_epi16 (pa, pb));
+		__m128i pred = Select (_mm_cmpeq_epi16 (smallest, pb), b, c);
+		pred = Select (_mm_cmpeq_epi16 (smallest, pa), a, pred);
+
+		a = _mm_and_si128 (_mm_add_epi16 (pred, _mm_unpacklo_epi8 (LoadPixel<bpp>(row), zero)), lowbyte);
+		StorePixel<bpp>(dest, _mm_packus_epi16 (a, a));
+		c = b;
+		dest += bpp;
+		row += bpp;
+		prev += bpp;
+	}
+}
+
+//==========================================================================
+//
+// UnfilterRow_SSE2
+//
+// Returns false if the scalar version has to do this row.
+//
+//==========================================================================
+
+static bool UnfilterRow_SSE2 (int width, BYTE *dest, const BYTE *row, const BYTE *prev, int bpp)
+{
+	int filter = *row++;
+
+	if (filter == 2)
+	{
+		UnfilterUp_SSE2 (width, dest, row, prev);
+		return true;
+	}
+	if (bpp == 4)
+	{
+		switch (filter)
+		{
+		case 1:		UnfilterSub_SSE2<4> (width, dest, row);				return true;
+		case 3:		UnfilterAverage_SSE2<4> (width, dest, row, prev);	return true;
+		case 4:		UnfilterPaeth_SSE2<4> (width, dest, row, prev);		return true;
+		}
+	}
+	else if (bpp == 3)
+	{
+		switch (filter)
+		{
+		case 1:		UnfilterSub_SSE2<3> (width, dest, row);				return true;
+		case 3:		UnfilterAverage_SSE2<3> (width, dest, row, prev);	return true;
+		case 4:		UnfilterPaeth_SSE2<3> (width, dest, row, prev);		return true;
+		}
+	}
+	return false;
+}
+
+#endif
+
 //==========================================================================
 //
 // UnfilterRow
@@ -1073,6 +1289,12 @@ void UnfilterRow (int width, BYTE *dest, BYTE *row, BYTE *prev, int bpp)
 {
 	int x;
 
+#ifdef SSE2_UNFILTER
+	if (UnfilterRow_SSE2 (width, dest, row, prev, bpp))
+	{
+		return;
+	}
+#endif
 	switch (*row++)
 	{
 	case 1:		// Sub
@@ -255,7 +255,7 @@ DWORD FRandom::StaticSumSeeds ()
 //
 //==========================================================================
 
-void FRandom::StaticWriteRNGState (FILE *file)
+void FRandom::StaticWriteRNGState (FileWriter *file)
 {
 	FRandom *rng;
 	FPNGChunkArchive arc (file, RAND_ID);
@@ -298,7 +298,7 @@ void FRandom::StaticReadRNGState (PNGHandle *png)
 		int i;
 		DWORD crc;
 
-		FPNGChunkArchive arc (png->File->GetFile(), RAND_ID, len);
+		FPNGChunkArchive arc (png->File, RAND_ID, len);
 
 		arc << rngseed;
 		FRandom::StaticClearRandom ();
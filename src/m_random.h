@@ -40,6 +40,7 @@
 #include "sfmt/SFMT.h"
 
 struct PNGHandle;
+class FileWriter;
 
 class FRandom
 {
@@ -173,7 +174,7 @@ public:
 	static void StaticClearRandom ();
 	static DWORD StaticSumSeeds ();
 	static void StaticReadRNGState (PNGHandle *png);
-	static void StaticWriteRNGState (FILE *file);
+	static void StaticWriteRNGState (FileWriter *file);
 	static FRandom *StaticFindRNG(const char *name);
 
 #ifndef NDEBUG
@@ -50,12 +50,19 @@
 #include "tarray.h"
 #include "m_bbox.h"
 #include "c_console.h"
+#include "c_cvars.h"
 #include "r_state.h"
 
 const int MaxSegs = 64;
 const int SplitCost = 8;
 const int AAPreference = 16;
 
+// Splitters are only scored in parallel when this many segs have to be
+// classified. Below that, waking the worker threads costs more than it saves.
+const unsigned int MinParallelWork = 65536;
+
+CVAR (Bool, parallelnodes, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
 #if 0
 #define D(x) x
 #else
@@ -63,7 +70,7 @@ const int AAPreference = 16;
 #endif
 
 FNodeBuilder::FNodeBuilder(FLevel &level)
-: Level(level), GLNodes(false), SegsStuffed(0)
+: NumLoops(0), Level(level), GLNodes(false), Background(false), SegsStuffed(0)
 {
 	VertexMap = NULL;
 	OldVertexTable = NULL;
@@ -71,8 +78,8 @@ FNodeBuilder::FNodeBuilder(FLevel &level)
 
 FNodeBuilder::FNodeBuilder (FLevel &level,
 							TArray<FPolyStart> &polyspots, TArray<FPolyStart> &anchors,
-							bool makeGLNodes)
-	: Level(level), GLNodes(makeGLNodes), SegsStuffed(0)
+							bool makeGLNodes, bool background)
+	: NumLoops(0), Level(level), GLNodes(makeGLNodes), Background(background), SegsStuffed(0)
 {
 	VertexMap = new FVertexMap (*this, Level.MinX, Level.MinY, Level.MaxX, Level.MaxY);
 	FindUsedVertices (Level.Vertices, Level.NumVertices);
@@ -112,9 +119,15 @@ void FNodeBuilder::Clear()
 	SegList.Clear();
 	PlaneChecked.Clear();
 	Planes.Clear();
-	Touched.Clear();
-	Colinear.Clear();
+	for (int i = 0; i < MAX_WORKER_THREADS; ++i)
+	{
+		Scratch[i].Touched.Clear();
+		Scratch[i].Colinear.Clear();
+	}
+	Candidates.Clear();
+	CandidateScores.Clear();
 	SplitSharers.Clear();
+	NumLoops = 0;
 	if (VertexMap == NULL)
 	{
 		VertexMap = new FVertexMapSimple(*this);
@@ -158,6 +171,11 @@ int FNodeBuilder::CreateNode (DWORD set, unsigned int count, fixed_t bbox[4])
 		D(PrintSet (1, set1));
 		D(Printf (PRINT_LOG, "(%d,%d) delta (%d,%d) from seg %d\n", node.x>>16, node.y>>16, node.dx>>16, node.dy>>16, splitseg));
 		D(PrintSet (2, set2));
+		// The children cannot be built at the same time. Splitting a seg
+		// also splits its partner, which may be in the other child's set,
+		// and that changes the splitters the other child picks. New
+		// vertices are also shared through VertexMap, so a vertex made in
+		// one child can be reused by the other.
 		node.intchildren[0] = CreateNode (set1, count1, node.bbox[0]);
 		node.intchildren[1] = CreateNode (set2, count2, node.bbox[1]);
 		bbox[BOXTOP] = MAX (node.bbox[0][BOXTOP], node.bbox[1][BOXTOP]);
@@ -199,7 +217,7 @@ int FNodeBuilder::CreateSubsector (DWORD set, fixed_t bbox[4])
 	}
 
 	SegsStuffed += count;
-	if ((SegsStuffed & ~127) != ((SegsStuffed - count) & ~127))
+	if ((SegsStuffed & ~127) != ((SegsStuffed - count) & ~127) && !Background)
 	{
 		C_SetTicker (MulScale16 (SegsStuffed, (SDWORD)Segs.Size()));
 	}
@@ -452,12 +470,17 @@ bool FNodeBuilder::ShoveSegBehind (DWORD set, node_t &node, DWORD seg, DWORD mat
 // each unique plane needs to be considered as a splitter. A result of 0 means
 // this set is a convex region. A result of -1 means that there were possible
 // splitters, but they all split segs we want to keep intact.
+//
+// The candidates are collected first and scored by ScoreCandidates, which may
+// use several threads. The best one is then picked in the order the segs are
+// in, so the same splitter is chosen no matter how many threads were used.
 int FNodeBuilder::SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int step, bool nosplit)
 {
 	int stepleft;
 	int bestvalue;
 	DWORD bestseg;
 	DWORD seg;
+	unsigned int setsize;
 	bool nosplitters = false;
 
 	bestvalue = 0;
@@ -465,11 +488,13 @@ int FNodeBuilder::SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int
 
 	seg = set;
 	stepleft = 0;
+	setsize = 0;
 
 	memset (&PlaneChecked[0], 0, PlaneChecked.Size());
 
 	D(Printf (PRINT_LOG, "Processing set %d\n", set));
 
+	Candidates.Clear ();
 	while (seg != DWORD_MAX)
 	{
 		FPrivSeg *pseg = &Segs[seg];
@@ -487,32 +512,33 @@ int FNodeBuilder::SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int
 				}
 
 				stepleft = step;
-				SetNodeFromSeg (node, pseg);
-
-				int value = Heuristic (node, set, nosplit);
-
-				D(Printf (PRINT_LOG, "Seg %5d, ld %d (%5d,%5d)-(%5d,%5d) scores %d\n", seg, Segs[seg].linedef, node.x>>16, node.y>>16,
-					(node.x+node.dx)>>16, (node.y+node.dy)>>16, value));
-
-				if (value > bestvalue)
-				{
-					bestvalue = value;
-					bestseg = seg;
-				}
-				else if (value < 0)
-				{
-					nosplitters = true;
-				}
-			}
-			else
-			{
-				pseg = pseg;
+				Candidates.Push (seg);
 			}
 		}
 
+		setsize++;
 		seg = pseg->next;
 	}
 
+	ScoreCandidates (set, setsize, nosplit);
+
+	for (unsigned int i = 0; i < Candidates.Size(); ++i)
+	{
+		int value = CandidateScores[i];
+
+		D(Printf (PRINT_LOG, "Seg %5d, ld %d scores %d\n", Candidates[i], Segs[Candidates[i]].linedef, value));
+
+		if (value > bestvalue)
+		{
+			bestvalue = value;
+			bestseg = Candidates[i];
+		}
+		else if (value < 0)
+		{
+			nosplitters = true;
+		}
+	}
+
 	if (bestseg == DWORD_MAX)
 	{ // No lines split any others into two sets, so this is a convex region.
 	D(Printf (PRINT_LOG, "set %d, step %d, nosplit %d has no good splitter (%d)\n", set, step, nosplit, nosplitters));
@@ -526,14 +552,78 @@ int FNodeBuilder::SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int
 	return 1;
 }
 
+// Each item of the batch scores one of the candidates SelectSplitter found.
+
+class FSplitterBatch : public FWorkerBatch
+{
+public:
+	FSplitterBatch (FNodeBuilder &builder, DWORD set, bool nosplit)
+		: Builder(builder), Set(set), NoSplit(nosplit)
+	{
+	}
+
+	void Execute (int index, int thread)
+	{
+		node_t node;
+
+		Builder.SetNodeFromSeg (node, &Builder.Segs[Builder.Candidates[index]]);
+		Builder.CandidateScores[index] = Builder.Heuristic (node, Set, NoSplit, thread);
+	}
+
+private:
+	FNodeBuilder &Builder;
+	DWORD Set;
+	bool NoSplit;
+
+	FSplitterBatch &operator= (const FSplitterBatch &) { return *this; }
+};
+
+void FNodeBuilder::ScoreCandidates (DWORD set, unsigned int setsize, bool nosplit)
+{
+	FSplitterBatch batch (*this, set, nosplit);
+	unsigned int count = Candidates.Size();
+	int numthreads = 1;
+
+	CandidateScores.Resize (count);
+
+	// The back-patching version of ClassifyLine rewrites the code that calls
+	// it, which must not happen on several threads at once.
+#ifndef BACKPATCH
+	if (!Background && parallelnodes && count > 1 && count * setsize >= MinParallelWork)
+	{
+		numthreads = WorkerPool.GetNumThreads ();
+	}
+#endif
+	if (numthreads > 1)
+	{
+		// Heuristic must not allocate memory on the worker threads, so make
+		// room for every loop it could find first.
+		for (int i = 1; i < numthreads; ++i)
+		{
+			Scratch[i].Touched.Grow (NumLoops);
+			Scratch[i].Colinear.Grow (NumLoops);
+		}
+		WorkerPool.Run (&batch, count);
+	}
+	else
+	{
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			batch.Execute (i, 0);
+		}
+	}
+}
+
 // Given a splitter (node), returns a score based on how "good" the resulting
 // split in a set of segs is. Higher scores are better. -1 means this splitter
 // splits something it shouldn't and will only be returned if honorNoSplit is
 // true. A score of 0 means that the splitter does not split any of the segs
 // in the set.
 
-int FNodeBuilder::Heuristic (node_t &node, DWORD set, bool honorNoSplit)
+int FNodeBuilder::Heuristic (node_t &node, DWORD set, bool honorNoSplit, int thread)
 {
+	TArray<int> &Touched = Scratch[thread].Touched;
+	TArray<int> &Colinear = Scratch[thread].Colinear;
 	// Set the initial score above 0 so that near vertex anti-weighting is less likely to produce a negative score.
 	int score = 1000000;
 	int segsInSet = 0;
@@ -821,7 +911,7 @@ void FNodeBuilder::SplitSegs (DWORD set, node_t &node, DWORD splitseg, DWORD &ou
 			unsigned int vertnum;
 			int seg2;
 
-			if (seg->loopnum)
+			if (seg->loopnum && !Background)
 			{
 				Printf ("   Split seg %u (%d,%d)-(%d,%d) of sector %td in loop %d\n",
 					set,
@@ -837,7 +927,7 @@ void FNodeBuilder::SplitSegs (DWORD set, node_t &node, DWORD splitseg, DWORD &ou
 			newvert.y += fixed_t(frac * double(Vertices[seg->v2].y - newvert.y));
 			vertnum = VertexMap->SelectVertexClose (newvert);
 
-			if (vertnum == (unsigned int)seg->v1 || vertnum == (unsigned int)seg->v2)
+			if ((vertnum == (unsigned int)seg->v1 || vertnum == (unsigned int)seg->v2) && !Background)
 			{
 				Printf("SelectVertexClose selected endpoint of seg %u\n", set);
 			}
@@ -1082,6 +1172,66 @@ void FNodeBuilder::PrintSet (int l, DWORD set)
 	Printf (PRINT_LOG, "*\n");
 }
 
+// Compares everything Extract uses to create the level's nodes.
+
+bool FNodeBuilder::IsSameTree (const FNodeBuilder &other) const
+{
+	unsigned int i;
+
+	if (Nodes.Size() != other.Nodes.Size() ||
+		Segs.Size() != other.Segs.Size() ||
+		Vertices.Size() != other.Vertices.Size() ||
+		SegList.Size() != other.SegList.Size() ||
+		Subsectors.Size() != other.Subsectors.Size())
+	{
+		return false;
+	}
+	for (i = 0; i < Nodes.Size(); ++i)
+	{
+		const node_t &a = Nodes[i], &b = other.Nodes[i];
+
+		if (a.x != b.x || a.y != b.y || a.dx != b.dx || a.dy != b.dy ||
+			a.intchildren[0] != b.intchildren[0] || a.intchildren[1] != b.intchildren[1] ||
+			memcmp (a.bbox, b.bbox, sizeof(a.bbox)) != 0)
+		{
+			return false;
+		}
+	}
+	for (i = 0; i < Segs.Size(); ++i)
+	{
+		const FPrivSeg &a = Segs[i], &b = other.Segs[i];
+
+		if (a.v1 != b.v1 || a.v2 != b.v2 || a.linedef != b.linedef ||
+			a.sidedef != b.sidedef || a.partner != b.partner)
+		{
+			return false;
+		}
+	}
+	for (i = 0; i < Vertices.Size(); ++i)
+	{
+		if (Vertices[i].x != other.Vertices[i].x || Vertices[i].y != other.Vertices[i].y)
+		{
+			return false;
+		}
+	}
+	for (i = 0; i < SegList.Size(); ++i)
+	{
+		if (SegList[i].SegNum != other.SegList[i].SegNum)
+		{
+			return false;
+		}
+	}
+	for (i = 0; i < Subsectors.Size(); ++i)
+	{
+		if (Subsectors[i].firstline != other.Subsectors[i].firstline ||
+			Subsectors[i].numlines != other.Subsectors[i].numlines)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 
 
 #ifdef BACKPATCH
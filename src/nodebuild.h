@@ -2,9 +2,11 @@
 #include "tarray.h"
 #include "r_defs.h"
 #include "x86.h"
+#include "workerpool.h"
 
 struct FPolySeg;
 struct FMiniBSP;
+class FSplitterBatch;
 
 struct FEventInfo
 {
@@ -119,6 +121,11 @@ class FNodeBuilder
 	{
 		DWORD Partner;
 	};
+	struct FSplitterScratch
+	{
+		TArray<int> Touched;	// Loops a splitter touches on a vertex
+		TArray<int> Colinear;	// Loops with edges colinear to a splitter
+	};
 
 
 	// Like a blockmap, but for vertices instead of lines
@@ -177,6 +184,7 @@ class FNodeBuilder
 
 	friend class FVertexMap;
 	friend class FVertexMapSimple;
+	friend class FSplitterBatch;
 
 public:
 	struct FLevel
@@ -206,7 +214,7 @@ public:
 	FNodeBuilder (FLevel &level);
 	FNodeBuilder (FLevel &level,
 		TArray<FPolyStart> &polyspots, TArray<FPolyStart> &anchors,
-		bool makeGLNodes);
+		bool makeGLNodes, bool background = false);
 	~FNodeBuilder ();
 
 	void Extract (node_t *&nodes, int &nodeCount,
@@ -222,6 +230,9 @@ public:
 	void BuildMini(bool makeGLNodes);
 	void ExtractMini(FMiniBSP *bsp);
 
+	// For the node benchmark: Was the same tree built?
+	bool IsSameTree(const FNodeBuilder &other) const;
+
 	static angle_t PointToAngle (fixed_t dx, fixed_t dy);
 
 	//  < 0 : in front of line
@@ -243,16 +254,19 @@ private:
 	TArray<BYTE> PlaneChecked;
 	TArray<FSimpleLine> Planes;
 
-	TArray<int> Touched;	// Loops a splitter touches on a vertex
-	TArray<int> Colinear;	// Loops with edges colinear to a splitter
+	FSplitterScratch Scratch[MAX_WORKER_THREADS];	// for Heuristic, one per worker thread
+	TArray<DWORD> Candidates;		// Segs SelectSplitter scores as splitters...
+	TArray<int> CandidateScores;	// ...and their scores
 	FEventTree Events;		// Vertices intersected by the current splitter
 
 	TArray<FSplitSharer> SplitSharers;	// Segs colinear with the current splitter
 
 	DWORD HackSeg;			// Seg to force to back of splitter
 	DWORD HackMate;			// Seg to use in front of hack seg
+	int NumLoops;			// Highest loop number of polyobject containers
 	FLevel &Level;
 	bool GLNodes;			// Add minisegs to make GL nodes?
+	bool Background;		// In a background job: no worker pool, no console output
 
 	// Progress meter stuff
 	int SegsStuffed;
@@ -272,10 +286,12 @@ private:
 	void CreateSubsectorsForReal ();
 	bool CheckSubsector (DWORD set, node_t &node, DWORD &splitseg);
 	bool CheckSubsectorOverlappingSegs (DWORD set, node_t &node, DWORD &splitseg);
-	bool ShoveSegBehind (DWORD set, node_t &node, DWORD seg, DWORD mate);	int SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int step, bool nosplit);
+	bool ShoveSegBehind (DWORD set, node_t &node, DWORD seg, DWORD mate);
+	int SelectSplitter (DWORD set, node_t &node, DWORD &splitseg, int step, bool nosplit);
+	void ScoreCandidates (DWORD set, unsigned int setsize, bool nosplit);
 	void SplitSegs (DWORD set, node_t &node, DWORD splitseg, DWORD &outset0, DWORD &outset1, unsigned int &count0, unsigned int &count1);
 	DWORD SplitSeg (DWORD segnum, int splitvert, int v1InFront);
-	int Heuristic (node_t &node, DWORD set, bool honorNoSplit);
+	int Heuristic (node_t &node, DWORD set, bool honorNoSplit, int thread = 0);
 
 	// Returns:
 	//	0 = seg is in front
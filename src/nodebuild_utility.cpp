@@ -132,7 +132,7 @@ void FNodeBuilder::MakeSegsFromSides ()
 		{
 			CreateSeg (i, 0);
 		}
-		else
+		else if (!Background)
 		{
 			Printf ("Linedef %d does not have a front side.\n", i);
 		}
@@ -178,7 +178,7 @@ int FNodeBuilder::CreateSeg (int linenum, int sidenum)
 	}
 	seg.linedef = linenum;
 	side_t *sd = Level.Lines[linenum].sidedef[sidenum];
-	seg.sidedef = sd != NULL? int(sd - sides) : int(NO_SIDE);
+	seg.sidedef = sd != NULL? int(sd - Level.Sides) : int(NO_SIDE);
 	seg.nextforvert = Vertices[seg.v1].segs;
 	seg.nextforvert2 = Vertices[seg.v2].segs2;
 
@@ -475,6 +475,7 @@ void FNodeBuilder::FindPolyContainers (TArray<FPolyStart> &spots, TArray<FPolySt
 			}
 		}
 	}
+	NumLoops = loop - 1;
 }
 
 int FNodeBuilder::MarkLoop (DWORD firstseg, int loopnum)
@@ -76,9 +76,14 @@
 #include "decallib.h"
 
 #include "g_shared/a_pickups.h"
+#include "profiler.h"
 
 extern FILE *Logfile;
 
+// Also count time and p-codes for acsprofile. Instructions and runs are
+// always counted.
+CVAR (Bool, acs_profile, false, 0)
+
 FRandom pr_acs ("ACS");
 
 // I imagine this much stack space is probably overkill, but it could
@@ -118,13 +123,14 @@ FRandom pr_acs ("ACS");
 
 struct CallReturn
 {
-	CallReturn(int pc, ScriptFunction *func, FBehavior *module, SDWORD *locals, bool discard, unsigned int runaway)
+	CallReturn(int pc, ScriptFunction *func, FBehavior *module, SDWORD *locals, bool discard, unsigned int runaway, QWORD time)
 		: ReturnFunction(func),
 		  ReturnModule(module),
 		  ReturnLocals(locals),
 		  ReturnAddress(pc),
 		  bDiscardResult(discard),
-		  EntryInstrCount(runaway)
+		  EntryInstrCount(runaway),
+		  EntryTime(time)
 	{}
 
 	ScriptFunction *ReturnFunction;
@@ -133,6 +139,7 @@ struct CallReturn
 	int ReturnAddress;
 	int bDiscardResult;
 	unsigned int EntryInstrCount;
+	QWORD EntryTime;
 };
 
 static DLevelScript *P_GetScriptGoing (AActor *who, line_t *where, int num, const ScriptPtr *code, FBehavior *module,
@@ -601,7 +608,7 @@ void ACSStringPool::ReadStrings(PNGHandle *png, DWORD id)
 	size_t len = M_FindPNGChunk(png, id);
 	if (len != 0)
 	{
-		FPNGChunkArchive arc(png->File->GetFile(), id, len);
+		FPNGChunkArchive arc(png->File, id, len);
 		int32 i, j, poolsize;
 		unsigned int h, bucketnum;
 		char *str = NULL;
@@ -645,7 +652,7 @@ void ACSStringPool::ReadStrings(PNGHandle *png, DWORD id)
 //
 //============================================================================
 
-void ACSStringPool::WriteStrings(FILE *file, DWORD id) const
+void ACSStringPool::WriteStrings(FileWriter *file, DWORD id) const
 {
 	int32 i, poolsize = (int32)Pool.Size();
 	
@@ -815,7 +822,7 @@ void P_ClearACSVars(bool alsoglobal)
 //
 //============================================================================
 
-static void WriteVars (FILE *file, SDWORD *vars, size_t count, DWORD id)
+static void WriteVars (FileWriter *file, SDWORD *vars, size_t count, DWORD id)
 {
 	size_t i, j;
 
@@ -857,7 +864,7 @@ static void ReadVars (PNGHandle *png, SDWORD *vars, size_t count, DWORD id)
 	{
 		DWORD var;
 		size_t i;
-		FPNGChunkArchive arc (png->File->GetFile(), id, len);
+		FPNGChunkArchive arc (png->File, id, len);
 		used = len / 4;
 
 		for (i = 0; i < used; ++i)
@@ -879,7 +886,7 @@ static void ReadVars (PNGHandle *png, SDWORD *vars, size_t count, DWORD id)
 //
 //============================================================================
 
-static void WriteArrayVars (FILE *file, FWorldGlobalArray *vars, unsigned int count, DWORD id)
+static void WriteArrayVars (FileWriter *file, FWorldGlobalArray *vars, unsigned int count, DWORD id)
 {
 	unsigned int i, j;
 
@@ -936,7 +943,7 @@ static void ReadArrayVars (PNGHandle *png, FWorldGlobalArray *vars, size_t count
 	if (len != 0)
 	{
 		DWORD max, size;
-		FPNGChunkArchive arc (png->File->GetFile(), id, len);
+		FPNGChunkArchive arc (png->File, id, len);
 
 		i = arc.ReadCount ();
 		max = arc.ReadCount ();
@@ -978,7 +985,7 @@ void P_ReadACSVars(PNGHandle *png)
 //
 //============================================================================
 
-void P_WriteACSVars(FILE *stdfile)
+void P_WriteACSVars(FileWriter *stdfile)
 {
 	WriteVars (stdfile, ACS_WorldVars, NUM_WORLDVARS, MAKE_ID('w','v','A','r'));
 	WriteVars (stdfile, ACS_GlobalVars, NUM_GLOBALVARS, MAKE_ID('g','v','A','r'));
@@ -1669,6 +1676,8 @@ FBehavior::FBehavior (int lumpnum, FileReader * fr, int len)
 	ArrayStore = NULL;
 	Chunks = NULL;
 	Data = NULL;
+	DataSize = 0;
+	PCodeMap = NULL;
 	Format = ACS_Unknown;
 	LumpNum = lumpnum;
 	memset (MapVarStore, 0, sizeof(MapVarStore));
@@ -1767,6 +1776,9 @@ FBehavior::FBehavior (int lumpnum, FileReader * fr, int len)
 		Chunks = object + LittleLong(((DWORD *)object)[1]);
 	}
 
+	PCodeMap = new WORD[DataSize];
+	memset (PCodeMap, 0, DataSize * sizeof(WORD));
+
 	LoadScriptsDirectory ();
 
 	if (Format == ACS_Old)
@@ -2126,6 +2138,11 @@ FBehavior::~FBehavior ()
 		delete[] Data;
 		Data = NULL;
 	}
+	if (PCodeMap != NULL)
+	{
+		delete[] PCodeMap;
+		PCodeMap = NULL;
+	}
 }
 
 void FBehavior::LoadScriptsDirectory ()
@@ -2859,6 +2876,7 @@ void DLevelScript::Serialize (FArchive &arc)
 
 	Super::Serialize (arc);
 	arc << next << prev;
+	GC::EscapeBarrier(this);	// the list links are plain pointers
 
 	P_SerializeACSScriptNumber(arc, script, false);
 
@@ -2970,6 +2988,7 @@ void DLevelScript::Link ()
 	prev = NULL;
 	controller->Scripts = this;
 	GC::WriteBarrier(controller, this);
+	GC::EscapeBarrier(this);	// the list links are plain pointers
 	if (controller->LastScript == NULL)
 	{
 		controller->LastScript = this;
@@ -4820,6 +4839,9 @@ int DLevelScript::CallFunction(int argCount, int funcIndex, SDWORD *args, const
 
 			int flags = SF_IGNOREVISIBILITY;
 
+			// This script may have changed the level since the last check.
+			P_InvalidateSightCache ();
+
 			if (args[2] & 1) flags |= SF_IGNOREWATERBOUNDARY;
 			if (args[2] & 2) flags |= SF_SEEPASTBLOCKEVERYTHING | SF_SEEPASTSHOOTABLELINES;
 
@@ -5235,6 +5257,126 @@ inline int getshort (int *&pc)
 	return res;
 }
 
+static inline int ReadPCode (int *&pc, ACSFormat fmt)
+{
+	int pcd;
+
+	if (fmt == ACS_LittleEnhanced)
+	{
+		pcd = getbyte(pc);
+		if (pcd >= 256-16)
+		{
+			pcd = (256-16) + ((pcd - (256-16)) << 8) + getbyte(pc);
+		}
+	}
+	else
+	{
+		pcd = NEXTWORD;
+	}
+	return pcd;
+}
+
+//==========================================================================
+//
+// FBehavior :: DecodePCode
+//
+// Decodes the p-code at pc the slow way and remembers the result for
+// FetchPCode. Code is decoded the first time it runs instead of when the
+// module is loaded, because modules do not say where their code is and a
+// sweep over it would need to know the operands of every p-code.
+//
+// Anything that is not a valid p-code inside the module is not remembered,
+// so RunScript sees the same value it always did.
+//
+//==========================================================================
+
+int FBehavior::DecodePCode (int *&pc)
+{
+	DWORD ofs = PC2Ofs(pc);
+	int pcd = ReadPCode(pc, Format);
+
+	if (ofs >= (DWORD)DataSize || pcd < 0 || pcd >= DLevelScript::PCODE_COMMAND_COUNT)
+	{
+		return pcd;
+	}
+	pcd = FusePCode(pcd, pc);
+	PCodeMap[ofs] = WORD(((PC2Ofs(pc) - ofs) << 12) | pcd);
+	return pcd;
+}
+
+//==========================================================================
+//
+// FBehavior :: FusePCode
+//
+// If the p-code whose operands are at pc is followed by one it can be
+// fused with, returns the superinstruction for the pair.
+//
+// A jump into the middle of a pair is still fine, since the second p-code
+// has its own PCodeMap entry.
+//
+//==========================================================================
+
+int FBehavior::FusePCode (int pcd, int *pc) const
+{
+	int next;
+
+	switch (pcd)
+	{
+	case DLevelScript::PCD_EQ:
+	case DLevelScript::PCD_NE:
+	case DLevelScript::PCD_LT:
+	case DLevelScript::PCD_GT:
+	case DLevelScript::PCD_LE:
+	case DLevelScript::PCD_GE:
+		break;
+
+	case DLevelScript::PCD_PUSHSCRIPTVAR:
+		pc = (int *)((BYTE *)pc + (Format == ACS_LittleEnhanced ? 1 : 4));
+		break;
+
+	case DLevelScript::PCD_PUSHBYTE:
+		pc = (int *)((BYTE *)pc + 1);
+		break;
+
+	default:
+		return pcd;
+	}
+	if (PC2Ofs(pc) + 4 > (DWORD)DataSize)
+	{
+		return pcd;
+	}
+	next = ReadPCode(pc, Format);
+
+	switch (pcd)
+	{
+	case DLevelScript::PCD_PUSHSCRIPTVAR:
+		if (next == DLevelScript::PCD_PUSHBYTE)
+		{
+			return DLevelScript::PCD_PUSHSCRIPTVAR_PUSHBYTE;
+		}
+		if (next == DLevelScript::PCD_PUSHSCRIPTVAR)
+		{
+			return DLevelScript::PCD_PUSHSCRIPTVAR_PUSHSCRIPTVAR;
+		}
+		break;
+
+	case DLevelScript::PCD_PUSHBYTE:
+		if (next == DLevelScript::PCD_ASSIGNSCRIPTVAR)
+		{
+			return DLevelScript::PCD_PUSHBYTE_ASSIGNSCRIPTVAR;
+		}
+		break;
+
+	default:
+		if (next == DLevelScript::PCD_IFNOTGOTO)
+		{
+			return DLevelScript::PCD_EQ_IFNOTGOTO + (pcd - DLevelScript::PCD_EQ);
+		}
+		break;
+	}
+	return pcd;
+}
+
 int DLevelScript::RunScript ()
 {
 	DACSThinker *controller = DACSThinker::ActiveThinker;
@@ -5307,6 +5449,17 @@ int DLevelScript::RunScript ()
 	const char *lookup;
 	int optstart = -1;
 	int temp;
+	QWORD starttime = 0;
+	unsigned int *pcodecounts = NULL;
+
+	if (acs_profile)
+	{
+		starttime = Profile_Now();
+		if (InModuleScriptNumber >= 0)
+		{
+			pcodecounts = activeBehavior->GetScriptPtr(InModuleScriptNumber)->ProfileData.GetPCodeCounts();
+		}
+	}
 
 	while (state == SCRIPT_Running)
 	{
@@ -5317,17 +5470,10 @@ int DLevelScript::RunScript ()
 			break;
 		}
 
-		if (fmt == ACS_LittleEnhanced)
+		pcd = activeBehavior->FetchPCode(pc);
+		if (pcodecounts != NULL && (unsigned)pcd < PCODE_TOTAL_COUNT)
 		{
-			pcd = getbyte(pc);
-			if (pcd >= 256-16)
-			{
-				pcd = (256-16) + ((pcd - (256-16)) << 8) + getbyte(pc);
-			}
-		}
-		else
-		{
-			pcd = NEXTWORD;
+			pcodecounts[pcd]++;
 		}
 
 		switch (pcd)
@@ -5606,12 +5752,17 @@ int DLevelScript::RunScript ()
 				}
 				sp += i;
 				::new(&Stack[sp]) CallReturn(activeBehavior->PC2Ofs(pc), activeFunction,
-					activeBehavior, mylocals, pcd == PCD_CALLDISCARD, runaway);
+					activeBehavior, mylocals, pcd == PCD_CALLDISCARD, runaway,
+					starttime != 0 ? Profile_Now() : 0);
 				sp += (sizeof(CallReturn) + sizeof(int) - 1) / sizeof(int);
 				pc = module->Ofs2PC (func->Address);
 				activeFunction = func;
 				activeBehavior = module;
 				fmt = module->GetFormat();
+				if (starttime != 0)
+				{
+					pcodecounts = module->GetFunctionProfileData(func)->GetPCodeCounts();
+				}
 			}
 			break;
 
@@ -5635,12 +5786,28 @@ int DLevelScript::RunScript ()
 				}
 				sp -= sizeof(CallReturn)/sizeof(int);
 				retsp = &Stack[sp];
-				activeBehavior->GetFunctionProfileData(activeFunction)->AddRun(runaway - ret->EntryInstrCount);
+				activeBehavior->GetFunctionProfileData(activeFunction)->AddRun(runaway - ret->EntryInstrCount,
+					ret->EntryTime != 0 ? Profile_Now() - ret->EntryTime : 0);
 				sp = int(locals - Stack);
 				pc = ret->ReturnModule->Ofs2PC(ret->ReturnAddress);
 				activeFunction = ret->ReturnFunction;
 				activeBehavior = ret->ReturnModule;
 				fmt = activeBehavior->GetFormat();
+				if (starttime != 0)
+				{
+					if (activeFunction != NULL)
+					{
+						pcodecounts = activeBehavior->GetFunctionProfileData(activeFunction)->GetPCodeCounts();
+					}
+					else if (InModuleScriptNumber >= 0)
+					{
+						pcodecounts = activeBehavior->GetScriptPtr(InModuleScriptNumber)->ProfileData.GetPCodeCounts();
+					}
+					else
+					{
+						pcodecounts = NULL;
+					}
+				}
 				locals = ret->ReturnLocals;
 				if (!ret->bDiscardResult)
 				{
@@ -6606,6 +6773,70 @@ int DLevelScript::RunScript ()
 			sp--;
 			break;
 
+		// Superinstructions count as two instructions against the runaway
+		// limit, like the p-codes they stand for. SKIPPCODE skips over the
+		// second p-code, which is always one that fits in a single byte.
+#define SKIPPCODE	(pc = (int *)((BYTE *)pc + (fmt == ACS_LittleEnhanced ? 1 : 4)))
+#define CMP_IFNOTGOTO(op) \
+			runaway++; \
+			SKIPPCODE; \
+			if (!(STACK(2) op STACK(1))) \
+				pc = activeBehavior->Ofs2PC (LittleLong(*pc)); \
+			else \
+				pc++; \
+			sp -= 2;
+
+		case PCD_EQ_IFNOTGOTO:
+			CMP_IFNOTGOTO(==)
+			break;
+
+		case PCD_NE_IFNOTGOTO:
+			CMP_IFNOTGOTO(!=)
+			break;
+
+		case PCD_LT_IFNOTGOTO:
+			CMP_IFNOTGOTO(<)
+			break;
+
+		case PCD_GT_IFNOTGOTO:
+			CMP_IFNOTGOTO(>)
+			break;
+
+		case PCD_LE_IFNOTGOTO:
+			CMP_IFNOTGOTO(<=)
+			break;
+
+		case PCD_GE_IFNOTGOTO:
+			CMP_IFNOTGOTO(>=)
+			break;
+
+#undef CMP_IFNOTGOTO
+
+		case PCD_PUSHSCRIPTVAR_PUSHBYTE:
+			runaway++;
+			PushToStack (locals[NEXTBYTE]);
+			SKIPPCODE;
+			PushToStack (*(BYTE *)pc);
+			pc = (int *)((BYTE *)pc + 1);
+			break;
+
+		case PCD_PUSHSCRIPTVAR_PUSHSCRIPTVAR:
+			runaway++;
+			PushToStack (locals[NEXTBYTE]);
+			SKIPPCODE;
+			PushToStack (locals[NEXTBYTE]);
+			break;
+
+		case PCD_PUSHBYTE_ASSIGNSCRIPTVAR:
+			runaway++;
+			temp = *(BYTE *)pc;
+			pc = (int *)((BYTE *)pc + 1);
+			SKIPPCODE;
+			locals[NEXTBYTE] = temp;
+			break;
+
+#undef SKIPPCODE
+
 		case PCD_LINESIDE:
 			PushToStack (backSide);
 			break;
@@ -8542,7 +8773,8 @@ scriptwait:
 
 	if (runaway != 0 && InModuleScriptNumber >= 0)
 	{
-		activeBehavior->GetScriptPtr(InModuleScriptNumber)->ProfileData.AddRun(runaway);
+		activeBehavior->GetScriptPtr(InModuleScriptNumber)->ProfileData.AddRun(runaway,
+			starttime != 0 ? Profile_Now() - starttime : 0);
 	}
 
 	if (state == SCRIPT_DivideBy0)
@@ -8570,6 +8802,7 @@ scriptwait:
 		this->pc = pc;
 		assert (sp == 0);
 	}
+	P_InvalidateSightCache ();
 	return resultValue;
 }
 
@@ -8878,22 +9111,158 @@ void DACSThinker::DumpScriptStatus ()
 
 // Profiling support --------------------------------------------------------
 
+static const char *const PCodeNames[DLevelScript::PCODE_TOTAL_COUNT] =
+{
+/*  0*/	"NOP", "TERMINATE", "SUSPEND", "PUSHNUMBER", "LSPEC1",
+/*  5*/	"LSPEC2", "LSPEC3", "LSPEC4", "LSPEC5", "LSPEC1DIRECT",
+/* 10*/	"LSPEC2DIRECT", "LSPEC3DIRECT", "LSPEC4DIRECT", "LSPEC5DIRECT", "ADD",
+/* 15*/	"SUBTRACT", "MULTIPLY", "DIVIDE", "MODULUS", "EQ",
+/* 20*/	"NE", "LT", "GT", "LE", "GE",
+/* 25*/	"ASSIGNSCRIPTVAR", "ASSIGNMAPVAR", "ASSIGNWORLDVAR", "PUSHSCRIPTVAR", "PUSHMAPVAR",
+/* 30*/	"PUSHWORLDVAR", "ADDSCRIPTVAR", "ADDMAPVAR", "ADDWORLDVAR", "SUBSCRIPTVAR",
+/* 35*/	"SUBMAPVAR", "SUBWORLDVAR", "MULSCRIPTVAR", "MULMAPVAR", "MULWORLDVAR",
+/* 40*/	"DIVSCRIPTVAR", "DIVMAPVAR", "DIVWORLDVAR", "MODSCRIPTVAR", "MODMAPVAR",
+/* 45*/	"MODWORLDVAR", "INCSCRIPTVAR", "INCMAPVAR", "INCWORLDVAR", "DECSCRIPTVAR",
+/* 50*/	"DECMAPVAR", "DECWORLDVAR", "GOTO", "IFGOTO", "DROP",
+/* 55*/	"DELAY", "DELAYDIRECT", "RANDOM", "RANDOMDIRECT", "THINGCOUNT",
+/* 60*/	"THINGCOUNTDIRECT", "TAGWAIT", "TAGWAITDIRECT", "POLYWAIT", "POLYWAITDIRECT",
+/* 65*/	"CHANGEFLOOR", "CHANGEFLOORDIRECT", "CHANGECEILING", "CHANGECEILINGDIRECT", "RESTART",
+/* 70*/	"ANDLOGICAL", "ORLOGICAL", "ANDBITWISE", "ORBITWISE", "EORBITWISE",
+/* 75*/	"NEGATELOGICAL", "LSHIFT", "RSHIFT", "UNARYMINUS", "IFNOTGOTO",
+/* 80*/	"LINESIDE", "SCRIPTWAIT", "SCRIPTWAITDIRECT", "CLEARLINESPECIAL", "CASEGOTO",
+/* 85*/	"BEGINPRINT", "ENDPRINT", "PRINTSTRING", "PRINTNUMBER", "PRINTCHARACTER",
+/* 90*/	"PLAYERCOUNT", "GAMETYPE", "GAMESKILL", "TIMER", "SECTORSOUND",
+/* 95*/	"AMBIENTSOUND", "SOUNDSEQUENCE", "SETLINETEXTURE", "SETLINEBLOCKING", "SETLINESPECIAL",
+/*100*/	"THINGSOUND", "ENDPRINTBOLD", "ACTIVATORSOUND", "LOCALAMBIENTSOUND", "SETLINEMONSTERBLOCKING",
+/*105*/	"PLAYERBLUESKULL", "PLAYERREDSKULL", "PLAYERYELLOWSKULL", "PLAYERMASTERSKULL", "PLAYERBLUECARD",
+/*110*/	"PLAYERREDCARD", "PLAYERYELLOWCARD", "PLAYERMASTERCARD", "PLAYERBLACKSKULL", "PLAYERSILVERSKULL",
+/*115*/	"PLAYERGOLDSKULL", "PLAYERBLACKCARD", "PLAYERSILVERCARD", "PLAYERONTEAM", "PLAYERTEAM",
+/*120*/	"PLAYERHEALTH", "PLAYERARMORPOINTS", "PLAYERFRAGS", "PLAYEREXPERT", "BLUETEAMCOUNT",
+/*125*/	"REDTEAMCOUNT", "BLUETEAMSCORE", "REDTEAMSCORE", "ISONEFLAGCTF", "LSPEC6",
+/*130*/	"LSPEC6DIRECT", "PRINTNAME", "MUSICCHANGE", "TEAM2FRAGPOINTS", "CONSOLECOMMAND",
+/*135*/	"SINGLEPLAYER", "FIXEDMUL", "FIXEDDIV", "SETGRAVITY", "SETGRAVITYDIRECT",
+/*140*/	"SETAIRCONTROL", "SETAIRCONTROLDIRECT", "CLEARINVENTORY", "GIVEINVENTORY", "GIVEINVENTORYDIRECT",
+/*145*/	"TAKEINVENTORY", "TAKEINVENTORYDIRECT", "CHECKINVENTORY", "CHECKINVENTORYDIRECT", "SPAWN",
+/*150*/	"SPAWNDIRECT", "SPAWNSPOT", "SPAWNSPOTDIRECT", "SETMUSIC", "SETMUSICDIRECT",
+/*155*/	"LOCALSETMUSIC", "LOCALSETMUSICDIRECT", "PRINTFIXED", "PRINTLOCALIZED", "MOREHUDMESSAGE",
+/*160*/	"OPTHUDMESSAGE", "ENDHUDMESSAGE", "ENDHUDMESSAGEBOLD", "SETSTYLE", "SETSTYLEDIRECT",
+/*165*/	"SETFONT", "SETFONTDIRECT", "PUSHBYTE", "LSPEC1DIRECTB", "LSPEC2DIRECTB",
+/*170*/	"LSPEC3DIRECTB", "LSPEC4DIRECTB", "LSPEC5DIRECTB", "DELAYDIRECTB", "RANDOMDIRECTB",
+/*175*/	"PUSHBYTES", "PUSH2BYTES", "PUSH3BYTES", "PUSH4BYTES", "PUSH5BYTES",
+/*180*/	"SETTHINGSPECIAL", "ASSIGNGLOBALVAR", "PUSHGLOBALVAR", "ADDGLOBALVAR", "SUBGLOBALVAR",
+/*185*/	"MULGLOBALVAR", "DIVGLOBALVAR", "MODGLOBALVAR", "INCGLOBALVAR", "DECGLOBALVAR",
+/*190*/	"FADETO", "FADERANGE", "CANCELFADE", "PLAYMOVIE", "SETFLOORTRIGGER",
+/*195*/	"SETCEILINGTRIGGER", "GETACTORX", "GETACTORY", "GETACTORZ", "STARTTRANSLATION",
+/*200*/	"TRANSLATIONRANGE1", "TRANSLATIONRANGE2", "ENDTRANSLATION", "CALL", "CALLDISCARD",
+/*205*/	"RETURNVOID", "RETURNVAL", "PUSHMAPARRAY", "ASSIGNMAPARRAY", "ADDMAPARRAY",
+/*210*/	"SUBMAPARRAY", "MULMAPARRAY", "DIVMAPARRAY", "MODMAPARRAY", "INCMAPARRAY",
+/*215*/	"DECMAPARRAY", "DUP", "SWAP", "WRITETOINI", "GETFROMINI",
+/*220*/	"SIN", "COS", "VECTORANGLE", "CHECKWEAPON", "SETWEAPON",
+/*225*/	"TAGSTRING", "PUSHWORLDARRAY", "ASSIGNWORLDARRAY", "ADDWORLDARRAY", "SUBWORLDARRAY",
+/*230*/	"MULWORLDARRAY", "DIVWORLDARRAY", "MODWORLDARRAY", "INCWORLDARRAY", "DECWORLDARRAY",
+/*235*/	"PUSHGLOBALARRAY", "ASSIGNGLOBALARRAY", "ADDGLOBALARRAY", "SUBGLOBALARRAY", "MULGLOBALARRAY",
+/*240*/	"DIVGLOBALARRAY", "MODGLOBALARRAY", "INCGLOBALARRAY", "DECGLOBALARRAY", "SETMARINEWEAPON",
+/*245*/	"SETACTORPROPERTY", "GETACTORPROPERTY", "PLAYERNUMBER", "ACTIVATORTID", "SETMARINESPRITE",
+/*250*/	"GETSCREENWIDTH", "GETSCREENHEIGHT", "THING_PROJECTILE2", "STRLEN", "SETHUDSIZE",
+/*255*/	"GETCVAR", "CASEGOTOSORTED", "SETRESULTVALUE", "GETLINEROWOFFSET", "GETACTORFLOORZ",
+/*260*/	"GETACTORANGLE", "GETSECTORFLOORZ", "GETSECTORCEILINGZ", "LSPEC5RESULT", "GETSIGILPIECES",
+/*265*/	"GETLEVELINFO", "CHANGESKY", "PLAYERINGAME", "PLAYERISBOT", "SETCAMERATOTEXTURE",
+/*270*/	"ENDLOG", "GETAMMOCAPACITY", "SETAMMOCAPACITY", "PRINTMAPCHARARRAY", "PRINTWORLDCHARARRAY",
+/*275*/	"PRINTGLOBALCHARARRAY", "SETACTORANGLE", "GRABINPUT", "SETMOUSEPOINTER", "MOVEMOUSEPOINTER",
+/*280*/	"SPAWNPROJECTILE", "GETSECTORLIGHTLEVEL", "GETACTORCEILINGZ", "SETACTORPOSITION", "CLEARACTORINVENTORY",
+/*285*/	"GIVEACTORINVENTORY", "TAKEACTORINVENTORY", "CHECKACTORINVENTORY", "THINGCOUNTNAME", "SPAWNSPOTFACING",
+/*290*/	"PLAYERCLASS", "ANDSCRIPTVAR", "ANDMAPVAR", "ANDWORLDVAR", "ANDGLOBALVAR",
+/*295*/	"ANDMAPARRAY", "ANDWORLDARRAY", "ANDGLOBALARRAY", "EORSCRIPTVAR", "EORMAPVAR",
+/*300*/	"EORWORLDVAR", "EORGLOBALVAR", "EORMAPARRAY", "EORWORLDARRAY", "EORGLOBALARRAY",
+/*305*/	"ORSCRIPTVAR", "ORMAPVAR", "ORWORLDVAR", "ORGLOBALVAR", "ORMAPARRAY",
+/*310*/	"ORWORLDARRAY", "ORGLOBALARRAY", "LSSCRIPTVAR", "LSMAPVAR", "LSWORLDVAR",
+/*315*/	"LSGLOBALVAR", "LSMAPARRAY", "LSWORLDARRAY", "LSGLOBALARRAY", "RSSCRIPTVAR",
+/*320*/	"RSMAPVAR", "RSWORLDVAR", "RSGLOBALVAR", "RSMAPARRAY", "RSWORLDARRAY",
+/*325*/	"RSGLOBALARRAY", "GETPLAYERINFO", "CHANGELEVEL", "SECTORDAMAGE", "REPLACETEXTURES",
+/*330*/	"NEGATEBINARY", "GETACTORPITCH", "SETACTORPITCH", "PRINTBIND", "SETACTORSTATE",
+/*335*/	"THINGDAMAGE2", "USEINVENTORY", "USEACTORINVENTORY", "CHECKACTORCEILINGTEXTURE", "CHECKACTORFLOORTEXTURE",
+/*340*/	"GETACTORLIGHTLEVEL", "SETMUGSHOTSTATE", "THINGCOUNTSECTOR", "THINGCOUNTNAMESECTOR", "CHECKPLAYERCAMERA",
+/*345*/	"MORPHACTOR", "UNMORPHACTOR", "GETPLAYERINPUT", "CLASSIFYACTOR", "PRINTBINARY",
+/*350*/	"PRINTHEX", "CALLFUNC", "SAVESTRING", "PRINTMAPCHRANGE", "PRINTWORLDCHRANGE",
+/*355*/	"PRINTGLOBALCHRANGE", "STRCPYTOMAPCHRANGE", "STRCPYTOWORLDCHRANGE", "STRCPYTOGLOBALCHRANGE", "PUSHFUNCTION",
+/*360*/	"CALLSTACK", "SCRIPTWAITNAMED", "TRANSLATIONRANGE3", "GOTOSTACK",
+
+	// Superinstructions
+	"EQ+IFNOTGOTO", "NE+IFNOTGOTO", "LT+IFNOTGOTO", "GT+IFNOTGOTO", "LE+IFNOTGOTO",
+	"GE+IFNOTGOTO", "PUSHSCRIPTVAR+PUSHBYTE", "PUSHSCRIPTVAR+PUSHSCRIPTVAR", "PUSHBYTE+ASSIGNSCRIPTVAR",
+};
+
 ACSProfileInfo::ACSProfileInfo()
 {
+	PCodeCounts = NULL;
 	Reset();
 }
 
+ACSProfileInfo::ACSProfileInfo(const ACSProfileInfo &other)
+{
+	PCodeCounts = NULL;
+	*this = other;
+}
+
+ACSProfileInfo::~ACSProfileInfo()
+{
+	if (PCodeCounts != NULL)
+	{
+		delete[] PCodeCounts;
+	}
+}
+
+// Scripts are swapped around while a module is loaded, so each copy needs
+// p-code counts of its own.
+ACSProfileInfo &ACSProfileInfo::operator=(const ACSProfileInfo &other)
+{
+	if (this != &other)
+	{
+		TotalInstr = other.TotalInstr;
+		TotalTime = other.TotalTime;
+		NumRuns = other.NumRuns;
+		MinInstrPerRun = other.MinInstrPerRun;
+		MaxInstrPerRun = other.MaxInstrPerRun;
+		if (other.PCodeCounts != NULL)
+		{
+			memcpy(GetPCodeCounts(), other.PCodeCounts, sizeof(unsigned int) * DLevelScript::PCODE_TOTAL_COUNT);
+		}
+		else if (PCodeCounts != NULL)
+		{
+			delete[] PCodeCounts;
+			PCodeCounts = NULL;
+		}
+	}
+	return *this;
+}
+
 void ACSProfileInfo::Reset()
 {
 	TotalInstr = 0;
+	TotalTime = 0;
 	NumRuns = 0;
 	MinInstrPerRun = UINT_MAX;
 	MaxInstrPerRun = 0;
+	if (PCodeCounts != NULL)
+	{
+		memset(PCodeCounts, 0, sizeof(unsigned int) * DLevelScript::PCODE_TOTAL_COUNT);
+	}
+}
+
+unsigned int *ACSProfileInfo::GetPCodeCounts()
+{
+	if (PCodeCounts == NULL)
+	{
+		PCodeCounts = new unsigned int[DLevelScript::PCODE_TOTAL_COUNT];
+		memset(PCodeCounts, 0, sizeof(unsigned int) * DLevelScript::PCODE_TOTAL_COUNT);
+	}
+	return PCodeCounts;
 }
 
-void ACSProfileInfo::AddRun(unsigned int num_instr)
+void ACSProfileInfo::AddRun(unsigned int num_instr, unsigned long long time)
 {
 	TotalInstr += num_instr;
+	TotalTime += time;
 	NumRuns++;
 	if (num_instr < MinInstrPerRun)
 	{
@@ -8993,6 +9362,149 @@ static int STACK_ARGS sort_by_runs(const void *a_, const void *b_)
 	return b->ProfileData->NumRuns - a->ProfileData->NumRuns;
 }
 
+static int STACK_ARGS sort_by_time(const void *a_, const void *b_)
+{
+	const ProfileCollector *a = (const ProfileCollector *)a_;
+	const ProfileCollector *b = (const ProfileCollector *)b_;
+
+	return a->ProfileData->TotalTime < b->ProfileData->TotalTime ? 1 :
+		a->ProfileData->TotalTime > b->ProfileData->TotalTime ? -1 : 0;
+}
+
+static FString GetProfileName(const ProfileCollector *prof, bool functions)
+{
+	FString name;
+
+	if (functions)
+	{
+		DWORD *fnames = (DWORD *)prof->Module->FindChunk(MAKE_ID('F','N','A','M'));
+		if (fnames != NULL && prof->Index >= 0 && prof->Index < (int)LittleLong(fnames[2]))
+		{
+			name = (char *)(fnames + 2) + LittleLong(fnames[3+prof->Index]);
+		}
+		else
+		{
+			name.Format("Function %d", prof->Index);
+		}
+	}
+	else
+	{
+		name = ScriptPresentation(prof->Module->GetScriptPtr(prof->Index)->Number).GetChars() + 7;
+	}
+	return name;
+}
+
+// Lists the most executed p-codes in counts, most executed first.
+static FString GetTopPCodes(const unsigned int *counts, unsigned int limit, const char *separator)
+{
+	TArray<int> top;
+	FString out;
+
+	for (int i = 0; i < DLevelScript::PCODE_TOTAL_COUNT; ++i)
+	{
+		if (counts[i] == 0)
+		{
+			continue;
+		}
+		unsigned int j = top.Size();
+		while (j > 0 && counts[top[j-1]] < counts[i])
+		{
+			--j;
+		}
+		if (j < limit)
+		{
+			top.Insert(j, i);
+			if (top.Size() > limit)
+			{
+				top.Pop();
+			}
+		}
+	}
+	for (unsigned int i = 0; i < top.Size(); ++i)
+	{
+		out.AppendFormat("%s%s %u", i > 0 ? separator : "", PCodeNames[top[i]], counts[top[i]]);
+	}
+	return out;
+}
+
+// The p-codes of a module are those executed by its scripts and by its
+// functions.
+static void ShowModulePCodes(TArray<ProfileCollector> &scripts, TArray<ProfileCollector> &functions, unsigned int limit)
+{
+	unsigned int counts[DLevelScript::PCODE_TOTAL_COUNT];
+	FBehavior *module;
+	bool any = false;
+
+	for (int lib = 0; (module = FBehavior::StaticGetModule(lib)) != NULL; ++lib)
+	{
+		bool used = false;
+
+		memset(counts, 0, sizeof(counts));
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			TArray<ProfileCollector> &profiles = pass == 0 ? scripts : functions;
+
+			for (unsigned int i = 0; i < profiles.Size(); ++i)
+			{
+				const unsigned int *profcounts = profiles[i].ProfileData->PCodeCounts;
+				if (profiles[i].Module == module && profcounts != NULL)
+				{
+					for (int j = 0; j < DLevelScript::PCODE_TOTAL_COUNT; ++j)
+					{
+						counts[j] += profcounts[j];
+					}
+					used = true;
+				}
+			}
+		}
+		if (used)
+		{
+			Printf(TEXTCOLOR_ORANGE "Most executed p-codes in %s:\n", module->GetModuleName());
+			Printf("%s\n", GetTopPCodes(counts, limit, "\n").GetChars());
+			any = true;
+		}
+	}
+	if (!any)
+	{
+		Printf("No p-codes have been counted. Set acs_profile to true to count them.\n");
+	}
+}
+
+static bool DumpProfileData(const char *filename, TArray<ProfileCollector> &scripts, TArray<ProfileCollector> &functions)
+{
+	FILE *f = fopen(filename, "w");
+
+	if (f == NULL)
+	{
+		return false;
+	}
+	fprintf(f, "kind,module,name,runs,total_instr,min_instr,max_instr,time_ms,top_pcodes\n");
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		TArray<ProfileCollector> &profiles = pass == 0 ? scripts : functions;
+
+		if (profiles.Size() > 0)
+		{
+			qsort(&profiles[0], profiles.Size(), sizeof(ProfileCollector), sort_by_total_instr);
+		}
+		for (unsigned int i = 0; i < profiles.Size(); ++i)
+		{
+			const ACSProfileInfo *data = profiles[i].ProfileData;
+
+			if (data->NumRuns == 0)
+			{
+				continue;
+			}
+			fprintf(f, "%s,%s,\"%s\",%u,%llu,%u,%u,%.3f,\"%s\"\n", pass == 0 ? "script" : "function",
+				profiles[i].Module->GetModuleName(), GetProfileName(&profiles[i], pass == 1).GetChars(),
+				data->NumRuns, data->TotalInstr, data->MinInstrPerRun, data->MaxInstrPerRun,
+				data->TotalTime / 1e6,
+				data->PCodeCounts != NULL ? GetTopPCodes(data->PCodeCounts, 5, " ").GetChars() : "");
+		}
+	}
+	return fclose(f) == 0;
+}
+
 static void ShowProfileData(TArray<ProfileCollector> &profiles, long ilimit,
 	int (STACK_ARGS *sorter)(const void *, const void *), bool functions)
 {
@@ -9005,7 +9517,6 @@ static void ShowProfileData(TArray<ProfileCollector> &profiles, long ilimit,
 
 	unsigned int limit;
 	char modname[13];
-	char scriptname[21];
 
 	qsort(&profiles[0], profiles.Size(), sizeof(ProfileCollector), sorter);
 
@@ -9020,8 +9531,8 @@ static void ShowProfileData(TArray<ProfileCollector> &profiles, long ilimit,
 		limit = UINT_MAX;
 	}
 
-	Printf(TEXTCOLOR_YELLOW "Module       %-20s      Total    Runs     Avg     Min     Max\n", typelabels[functions]);
-	Printf(TEXTCOLOR_YELLOW "------------ -------------------- ---------- ------- ------- ------- -------\n");
+	Printf(TEXTCOLOR_YELLOW "Module       %-20s      Total    Runs     Avg     Min     Max  Time ms\n", typelabels[functions]);
+	Printf(TEXTCOLOR_YELLOW "------------ -------------------- ---------- ------- ------- ------- ------- --------\n");
 	for (unsigned int i = 0; i < limit && i < profiles.Size(); ++i)
 	{
 		ProfileCollector *prof = &profiles[i];
@@ -9033,32 +9544,14 @@ static void ShowProfileData(TArray<ProfileCollector> &profiles, long ilimit,
 		// Module name
 		mysnprintf(modname, sizeof(modname), "%s", prof->Module->GetModuleName());
 
-		// Script/function name
-		if (functions)
-		{
-			DWORD *fnames = (DWORD *)prof->Module->FindChunk(MAKE_ID('F','N','A','M'));
-			if (prof->Index >= 0 && prof->Index < (int)LittleLong(fnames[2]))
-			{
-				mysnprintf(scriptname, sizeof(scriptname), "%s",
-					(char *)(fnames + 2) + LittleLong(fnames[3+prof->Index]));
-			}
-			else
-			{
-				mysnprintf(scriptname, sizeof(scriptname), "Function %d", prof->Index);
-			}
-		}
-		else
-		{
-			mysnprintf(scriptname, sizeof(scriptname), "%s",
-				ScriptPresentation(prof->Module->GetScriptPtr(prof->Index)->Number).GetChars() + 7);
-		}
-		Printf("%-12s %-20s%11llu%8u%8u%8u%8u\n",
-			modname, scriptname,
+		Printf("%-12s %-20.20s%11llu%8u%8u%8u%8u%9.2f\n",
+			modname, GetProfileName(prof, functions).GetChars(),
 			prof->ProfileData->TotalInstr,
 			prof->ProfileData->NumRuns,
 			unsigned(prof->ProfileData->TotalInstr / prof->ProfileData->NumRuns),
 			prof->ProfileData->MinInstrPerRun,
-			prof->ProfileData->MaxInstrPerRun
+			prof->ProfileData->MaxInstrPerRun,
+			prof->ProfileData->TotalTime / 1e6
 			);
 	}
 }
@@ -9071,10 +9564,11 @@ CCMD(acsprofile)
 		sort_by_min,
 		sort_by_max,
 		sort_by_avg,
-		sort_by_runs
+		sort_by_runs,
+		sort_by_time
 	};
-	static const char *sort_names[] = { "total", "min", "max", "avg", "runs" };
-	static const BYTE sort_match_len[] = {   1,     2,     2,     1,      1 };
+	static const char *sort_names[] = { "total", "min", "max", "avg", "runs", "time" };
+	static const BYTE sort_match_len[] = {   1,     2,     2,     1,      1,      2 };
 
 	TArray<ProfileCollector> ScriptProfiles, FuncProfiles;
 	long limit = 10;
@@ -9094,6 +9588,26 @@ CCMD(acsprofile)
 			ClearProfiles(FuncProfiles);
 			return;
 		}
+		// `acsprofile pcodes [<limit>]` lists the most executed p-codes of each module.
+		if (stricmp(argv[1], "pcodes") == 0)
+		{
+			ShowModulePCodes(ScriptProfiles, FuncProfiles, argv.argc() > 2 ? atoi(argv[2]) : 10);
+			return;
+		}
+		// `acsprofile dump [<file>]` writes everything to a CSV file.
+		if (stricmp(argv[1], "dump") == 0)
+		{
+			const char *filename = argv.argc() > 2 ? argv[2] : "acsprofile.csv";
+			if (DumpProfileData(filename, ScriptProfiles, FuncProfiles))
+			{
+				Printf("ACS profile written to %s\n", filename);
+			}
+			else
+			{
+				Printf("Could not write %s\n", filename);
+			}
+			return;
+		}
 		for (int i = 1; i < argv.argc(); ++i)
 		{
 			// If it's a number, set the display limit.
@@ -9124,7 +9638,9 @@ CCMD(acsprofile)
 			{
 				Printf("Unknown option '%s'\n", argv[i]);
 				Printf("acsprofile clear : Reset profiling information\n");
-				Printf("acsprofile [total|min|max|avg|runs] [<limit>]\n");
+				Printf("acsprofile pcodes [<limit>] : Show the most executed p-codes\n");
+				Printf("acsprofile dump [<file>] : Write everything to a CSV file\n");
+				Printf("acsprofile [total|min|max|avg|runs|time] [<limit>]\n");
 				return;
 			}
 		}
@@ -44,6 +44,7 @@
 
 class FFont;
 class FileReader;
+class FileWriter;
 
 
 enum
@@ -95,7 +96,7 @@ public:
 	void Clear();
 	void Dump() const;
 	void ReadStrings(PNGHandle *png, DWORD id);
-	void WriteStrings(FILE *file, DWORD id) const;
+	void WriteStrings(FileWriter *file, DWORD id) const;
 
 private:
 	int FindString(const char *str, size_t len, unsigned int h, unsigned int bucketnum);
@@ -120,20 +121,26 @@ extern ACSStringPool GlobalACSStrings;
 
 void P_CollectACSGlobalStrings(const SDWORD *stack, int stackdepth);
 void P_ReadACSVars(PNGHandle *);
-void P_WriteACSVars(FILE*);
+void P_WriteACSVars(FileWriter*);
 void P_ClearACSVars(bool);
 void P_SerializeACSScriptNumber(FArchive &arc, int &scriptnum, bool was2byte);
 
 struct ACSProfileInfo
 {
 	unsigned long long TotalInstr;
+	unsigned long long TotalTime;	// in nanoseconds, only counted while acs_profile is on
 	unsigned int NumRuns;
 	unsigned int MinInstrPerRun;
 	unsigned int MaxInstrPerRun;
+	unsigned int *PCodeCounts;		// executions of each p-code, allocated when first needed
 
 	ACSProfileInfo();
-	void AddRun(unsigned int num_instr);
+	ACSProfileInfo(const ACSProfileInfo &other);
+	~ACSProfileInfo();
+	ACSProfileInfo &operator=(const ACSProfileInfo &other);
+	void AddRun(unsigned int num_instr, unsigned long long time);
 	void Reset();
+	unsigned int *GetPCodeCounts();
 };
 
 struct ProfileCollector
@@ -238,6 +245,7 @@ public:
 	int *Ofs2PC (DWORD ofs) const {	return (int *)(Data + ofs); }
 	int *Jump2PC (DWORD jumpPoint) const { return Ofs2PC(JumpPoints[jumpPoint]); }
 	ACSFormat GetFormat() const { return Format; }
+	inline int FetchPCode (int *&pc);
 	ScriptFunction *GetFunction (int funcnum, FBehavior *&module) const;
 	int GetArrayVal (int arraynum, int index) const;
 	void SetArrayVal (int arraynum, int index, int value);
@@ -281,6 +289,7 @@ private:
 	int LumpNum;
 	BYTE *Data;
 	int DataSize;
+	WORD *PCodeMap;			// decoded p-code for every offset of Data, or 0 if not decoded yet
 	BYTE *Chunks;
 	ScriptPtr *Scripts;
 	int NumScripts;
@@ -304,6 +313,8 @@ private:
 
 	static int STACK_ARGS SortScripts (const void *a, const void *b);
 	void UnencryptStrings ();
+	int DecodePCode (int *&pc);
+	int FusePCode (int pcd, int *pc) const;
 	void UnescapeStringTable(BYTE *chunkstart, BYTE *datastart, bool haspadding);
 	int FindStringInChunk (DWORD *chunk, const char *varname) const;
 
@@ -318,6 +329,21 @@ private:
 	friend void ArrangeFunctionProfiles(TArray<ProfileCollector> &profiles);
 };
 
+// Returns the p-code at pc and advances pc to its operands. The low 12 bits
+// of a PCodeMap entry are the p-code, the rest is how many bytes it takes.
+inline int FBehavior::FetchPCode (int *&pc)
+{
+	DWORD ofs = PC2Ofs(pc);
+	WORD op;
+
+	if (ofs < (DWORD)DataSize && (op = PCodeMap[ofs]) != 0)
+	{
+		pc = (int *)((BYTE *)pc + (op >> 12));
+		return op & 0xFFF;
+	}
+	return DecodePCode(pc);
+}
+
 class DLevelScript : public DObject
 {
 	DECLARE_CLASS (DLevelScript, DObject)
@@ -694,7 +720,22 @@ public:
 		PCD_TRANSLATIONRANGE3,
 		PCD_GOTOSTACK,
 
-/*363*/	PCODE_COMMAND_COUNT
+/*363*/	PCODE_COMMAND_COUNT,
+
+		// Superinstructions. These never appear in a module. FetchPCode
+		// returns them in place of the first p-code of the sequence they
+		// stand for, and they execute the whole sequence at once.
+		PCD_EQ_IFNOTGOTO = PCODE_COMMAND_COUNT,
+		PCD_NE_IFNOTGOTO,
+		PCD_LT_IFNOTGOTO,
+		PCD_GT_IFNOTGOTO,
+		PCD_LE_IFNOTGOTO,
+		PCD_GE_IFNOTGOTO,
+		PCD_PUSHSCRIPTVAR_PUSHBYTE,
+		PCD_PUSHSCRIPTVAR_PUSHSCRIPTVAR,
+		PCD_PUSHBYTE_ASSIGNSCRIPTVAR,
+
+		PCODE_TOTAL_COUNT
 	};
 
 	// Some constants used by ACS scripts
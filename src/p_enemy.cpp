@@ -1231,13 +1231,14 @@ bool P_LookForMonsters (AActor *actor)
 AActor *LookForTIDInBlock (AActor *lookee, int index, void *extparams)
 {
 	FLookExParams *params = (FLookExParams *)extparams;
-	FBlockNode *block;
+	FBlockThings *block = &blockthings[index];
 	AActor *link;
 	AActor *other;
 	
-	for (block = blocklinks[index]; block != NULL; block = block->NextActor)
+	for (int i = block->Count - 1; i >= 0; --i)
 	{
-		link = block->Me;
+		if ((link = block->Actors[i]) == NULL)
+			continue;			// unlinked
 
         if (!(link->flags & MF_SHOOTABLE))
 			continue;			// not shootable (observer or dead)
@@ -1401,14 +1402,15 @@ bool P_LookForTID (AActor *actor, INTBOOL allaround, FLookExParams *params)
 
 AActor *LookForEnemiesInBlock (AActor *lookee, int index, void *extparam)
 {
-	FBlockNode *block;
+	FBlockThings *block = &blockthings[index];
 	AActor *link;
 	AActor *other;
 	FLookExParams *params = (FLookExParams *)extparam;
 	
-	for (block = blocklinks[index]; block != NULL; block = block->NextActor)
+	for (int i = block->Count - 1; i >= 0; --i)
 	{
-		link = block->Me;
+		if ((link = block->Actors[i]) == NULL)
+			continue;			// unlinked
 
         if (!(link->flags & MF_SHOOTABLE))
 			continue;			// not shootable (observer or dead)
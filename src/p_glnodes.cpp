@@ -35,11 +35,16 @@
 #include <malloc.h>		// for alloca()
 #endif
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #ifndef _WIN32
 #include <unistd.h>
+#include <utime.h>
 
 #else
 #include <direct.h>
+#include <sys/utime.h>
 
 #define rmdir _rmdir
 
@@ -80,9 +85,10 @@ void P_GetPolySpots (MapData * lump, TArray<FNodeBuilder::FPolyStart> &spots, TA
 
 CVAR(Bool, gl_cachenodes, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 CVAR(Float, gl_cachetime, 0.6f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+CVAR(Int, gl_cachesize, 256, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)	// in MB, 0 for no limit
 
 void P_LoadZNodes (FileReader &dalump, DWORD id);
-static bool CheckCachedNodes(MapData *map);
+static bool CheckCachedNodes(MapData *map, const int **oldvertextable);
 static void CreateCachedNodes(MapData *map);
 
 
@@ -889,7 +895,7 @@ bool P_LoadGLNodes(MapData * map)
 		}
 	}
 
-	if (!CheckCachedNodes(map))
+	if (!CheckCachedNodes(map, NULL))
 	{
 		FileReader *gwalumps[4] = { NULL, NULL, NULL, NULL };
 		char path[256];
@@ -965,7 +971,7 @@ bool P_LoadGLNodes(MapData * map)
 //
 //==========================================================================
 
-bool P_CheckNodes(MapData * map, bool rebuilt, int buildtime)
+bool P_CheckNodes(MapData * map, bool rebuilt)
 {
 	bool ret = false;
 
@@ -1011,25 +1017,10 @@ bool P_CheckNodes(MapData * map, bool rebuilt, int buildtime)
 				vertexes, numvertexes);
 			endTime = I_FPSTime ();
 			DPrintf ("BSP generation took %.3f sec (%d segs)\n", (endTime - startTime) * 0.001, numsegs);
-			buildtime = endTime - startTime;
+			P_CacheNodes(map, endTime - startTime);
 		}
 	}
 
-#ifdef DEBUG
-	// Building nodes in debug is much slower so let's cache them only if cachetime is 0
-	buildtime = 0;
-#endif
-	if (gl_cachenodes && buildtime/1000.f >= gl_cachetime)
-	{
-		DPrintf("Caching nodes\n");
-		CreateCachedNodes(map);
-	}
-	else
-	{
-		DPrintf("Not caching nodes (time = %f)\n", buildtime/1000.f);
-	}
-
-
 	if (!gamenodes)
 	{
 		gamenodes = nodes;
@@ -1048,7 +1039,7 @@ bool P_CheckNodes(MapData * map, bool rebuilt, int buildtime)
 
 typedef TArray<BYTE> MemFile;
 
-static FString GetCachePath()
+FString GetCachePath()
 {
 	FString path;
 
@@ -1084,19 +1075,156 @@ static FString GetCachePath()
 	return path;
 }
 
-static FString CreateCacheName(MapData *map, bool create)
+//==========================================================================
+//
+// P_GetCacheFileName
+//
+// Everything in the cache is stored under the checksum of the map it
+// belongs to, so the same map is found again no matter which file it
+// was loaded from.
+//
+//==========================================================================
+
+FString P_GetCacheFileName(const char *dir, const BYTE checksum[16], const char *ext, bool create)
 {
 	FString path = GetCachePath();
-	FString lumpname = Wads.GetLumpFullPath(map->lumpnum);
-	int separator = lumpname.IndexOf(':');
-	path << '/' << lumpname.Left(separator);
-	if (create) CreatePath(path);
 
-	lumpname.ReplaceChars('/', '%');
-	path << '/' << lumpname.Right(lumpname.Len() - separator - 1) << ".gzc";
+	path << '/' << dir;
+	if (create) CreatePath(path);
+	path += '/';
+	for (int i = 0; i < 16; ++i)
+	{
+		path.AppendFormat("%02X", checksum[i]);
+	}
+	path += ext;
 	return path;
 }
 
+//==========================================================================
+//
+// P_OpenCacheFile
+//
+// Maps a file from the cache into memory. Returns NULL if it does not
+// exist or cannot be mapped. Its time is set to now, because that is what
+// P_TrimCache goes by.
+//
+//==========================================================================
+
+MappedFileReader *P_OpenCacheFile(const char *path)
+{
+	MappedFileReader *fr;
+
+	if (!FileExists(path))
+	{
+		return NULL;
+	}
+	try
+	{
+		fr = new MappedFileReader(path);
+	}
+	catch (CRecoverableError &)
+	{
+		return NULL;
+	}
+	if (fr->GetBuffer() == NULL)
+	{
+		delete fr;
+		return NULL;
+	}
+	utime(path, NULL);
+	return fr;
+}
+
+//==========================================================================
+//
+// P_TrimCache
+//
+// Deletes the least recently used files until the cache is no larger
+// than gl_cachesize. The newest file is always kept. Called after
+// something has been written to the cache.
+//
+//==========================================================================
+
+struct FCacheFile
+{
+	FString Path;
+	time_t Time;
+	QWORD Size;
+};
+
+static int STACK_ARGS SortCacheFiles(const void *a, const void *b)
+{
+	const FCacheFile *fa = (const FCacheFile *)a;
+	const FCacheFile *fb = (const FCacheFile *)b;
+
+	if (fa->Time != fb->Time)
+	{
+		return fa->Time < fb->Time ? -1 : 1;
+	}
+	return 0;
+}
+
+void P_TrimCache()
+{
+	TArray<FFileList> list;
+	TArray<FCacheFile> files;
+	FString path = GetCachePath();
+	QWORD total = 0;
+
+	if (gl_cachesize <= 0)
+	{
+		return;
+	}
+	path += "/";
+	try
+	{
+		ScanDirectory(list, path);
+	}
+	catch (CRecoverableError &)
+	{
+		return;
+	}
+
+	for (unsigned int i = 0; i < list.Size(); ++i)
+	{
+		struct stat info;
+
+		if (list[i].isDirectory || stat(list[i].Filename, &info) != 0)
+		{
+			continue;
+		}
+		FCacheFile &file = files[files.Reserve(1)];
+		file.Path = list[i].Filename;
+		file.Time = info.st_mtime;
+		file.Size = info.st_size;
+		total += file.Size;
+	}
+
+	QWORD limit = QWORD(gl_cachesize) << 20;
+
+	if (total <= limit)
+	{
+		return;
+	}
+	qsort(&files[0], files.Size(), sizeof(files[0]), SortCacheFiles);
+	for (unsigned int i = 0; i + 1 < files.Size() && total > limit; ++i)
+	{
+		if (remove(files[i].Path) == 0)
+		{
+			DPrintf("Removed %s from the cache\n", files[i].Path.GetChars());
+			total -= files[i].Size;
+		}
+	}
+}
+
+static FString CreateCacheName(MapData *map, bool create)
+{
+	BYTE checksum[16];
+
+	map->GetChecksum(checksum);
+	return P_GetCacheFileName("nodes", checksum, ".gzc", create);
+}
+
 static void WriteByte(MemFile &f, BYTE b)
 {
 	f.Push(b);
@@ -1153,19 +1281,23 @@ static void CreateCachedNodes(MapData *map)
 		}
 	}
 
+	// The partition lines are stored with full precision (ZGL3), since
+	// these nodes are also used for the game and must put every point into
+	// the same subsector as the nodes just built. The bounding boxes only
+	// have whole units, so they are rounded outward.
 	WriteLong(ZNodes, numnodes);
 	for(int i=0;i<numnodes;i++)
 	{
-		WriteWord(ZNodes, nodes[i].x >> FRACBITS);
-		WriteWord(ZNodes, nodes[i].y >> FRACBITS);
-		WriteWord(ZNodes, nodes[i].dx >> FRACBITS);
-		WriteWord(ZNodes, nodes[i].dy >> FRACBITS);
+		WriteLong(ZNodes, nodes[i].x);
+		WriteLong(ZNodes, nodes[i].y);
+		WriteLong(ZNodes, nodes[i].dx);
+		WriteLong(ZNodes, nodes[i].dy);
 		for (int j = 0; j < 2; ++j)
 		{
-			for (int k = 0; k < 4; ++k)
-			{
-				WriteWord(ZNodes, nodes[i].bbox[j][k] >> FRACBITS);
-			}
+			WriteWord(ZNodes, (nodes[i].bbox[j][BOXTOP] + FRACUNIT - 1) >> FRACBITS);
+			WriteWord(ZNodes, nodes[i].bbox[j][BOXBOTTOM] >> FRACBITS);
+			WriteWord(ZNodes, nodes[i].bbox[j][BOXLEFT] >> FRACBITS);
+			WriteWord(ZNodes, (nodes[i].bbox[j][BOXRIGHT] + FRACUNIT - 1) >> FRACBITS);
 		}
 
 		for (int j = 0; j < 2; ++j)
@@ -1208,52 +1340,79 @@ static void CreateCachedNodes(MapData *map)
 		DWORD ndx[2] = {LittleLong(DWORD(lines[i].v1 - vertexes)), LittleLong(DWORD(lines[i].v2 - vertexes)) };
 		memcpy(compressed+8+16+8*i, ndx, 8);
 	}
-	memcpy(compressed + offset - 4, "ZGL2", 4);
+	memcpy(compressed + offset - 4, "ZGL3", 4);
 
 	FString path = CreateCacheName(map, true);
 	FILE *f = fopen(path, "wb");
-	fwrite(compressed, 1, outlen+offset, f);
-	fclose(f);
+	if (f != NULL)
+	{
+		fwrite(compressed, 1, outlen+offset, f);
+		fclose(f);
+		P_TrimCache();
+	}
 	delete [] compressed;
 }
 
 
-static bool CheckCachedNodes(MapData *map)
+//==========================================================================
+//
+// CheckCachedNodes
+//
+// The file is mapped, so the header and the line table are checked where
+// they are, and the nodes are read straight from memory. If
+// <oldvertextable> is not NULL, it gets the same table
+// FNodeBuilder::GetOldVertexTable would have returned.
+//
+//==========================================================================
+
+static bool CheckCachedNodes(MapData *map, const int **oldvertextable)
 {
-	char magic[4] = {0,0,0,0};
-	BYTE md5[16];
 	BYTE md5map[16];
-	DWORD numlin;
-	DWORD *verts = NULL;
+	MappedFileReader *fr;
+	const BYTE *data;
+	const DWORD *verts;
+	long len, offset = numlines * 8 + 4 + 4 + 16 + 4;
+	int oldnumvertexes = numvertexes;
 
-	FString path = CreateCacheName(map, false);
-	FILE *f = fopen(path, "rb");
-	if (f == NULL) return false;
+	fr = P_OpenCacheFile(CreateCacheName(map, false));
+	if (fr == NULL) return false;
 
-	if (fread(magic, 1, 4, f) != 4) goto errorout;
-	if (memcmp(magic, "CACH", 4))  goto errorout;
-
-	if (fread(&numlin, 4, 1, f) != 1) goto errorout; 
-	numlin = LittleLong(numlin);
-	if ((int)numlin != numlines) goto errorout;
-
-	if (fread(md5, 1, 16, f) != 16) goto errorout;
 	map->GetChecksum(md5map);
-	if (memcmp(md5, md5map, 16)) goto errorout;
-
-	verts = new DWORD[numlin * 8];
-	if (fread(verts, 8, numlin, f) != numlin) goto errorout;
-
-	if (fread(magic, 1, 4, f) != 4) goto errorout;
-	if (memcmp(magic, "ZGL2", 4))  goto errorout;
-
+	data = (const BYTE *)fr->GetBuffer();
+	len = fr->GetLength();
+	if (len < offset ||
+		memcmp(data, "CACH", 4) != 0 ||
+		LittleLong(*(const DWORD *)(data + 4)) != (DWORD)numlines ||
+		memcmp(data + 8, md5map, 16) != 0 ||
+		memcmp(data + offset - 4, "ZGL3", 4) != 0)
+	{
+		delete fr;
+		return false;
+	}
+	verts = (const DWORD *)(data + 24);
 
 	try
 	{
-		long pos = ftell(f);
-		FileReader fr(f);
-		fr.Seek(pos, SEEK_SET);
-		P_LoadZNodes (fr, MAKE_ID('Z','G','L','2'));
+		// P_LoadZNodes replaces the vertexes, so the line table must be
+		// known to be good before it is called. The nodes start with the
+		// number of vertexes they use.
+		{
+			MemoryReader vr((const char *)data + offset, len - offset);
+			FileReaderZ vz(vr);
+			DWORD orgverts, newverts;
+
+			vz >> orgverts >> newverts;
+			for (int i = 0; i < numlines * 2; i++)
+			{
+				if (LittleLong(verts[i]) >= orgverts + newverts)
+				{
+					throw CRecoverableError("A line references a nonexistant vertex.\n");
+				}
+			}
+		}
+
+		MemoryReader mr((const char *)data + offset, len - offset);
+		P_LoadZNodes (mr, MAKE_ID('Z','G','L','3'));
 	}
 	catch (CRecoverableError &error)
 	{
@@ -1274,26 +1433,77 @@ static bool CheckCachedNodes(MapData *map)
 			delete[] nodes;
 			nodes = NULL;
 		}
-		goto errorout;
+		delete fr;
+		return false;
 	}
 
+	// P_LoadZNodes keeps the lines' vertex numbers, so they are still the
+	// ones from the map here.
+	if (oldvertextable != NULL)
+	{
+		int *table = new int[oldnumvertexes];
+
+		memset(table, -1, sizeof(int)*oldnumvertexes);
+		for(int i=0;i<numlines;i++)
+		{
+			table[lines[i].v1 - vertexes] = LittleLong(verts[i*2]);
+			table[lines[i].v2 - vertexes] = LittleLong(verts[i*2+1]);
+		}
+		*oldvertextable = table;
+	}
 	for(int i=0;i<numlines;i++)
 	{
 		lines[i].v1 = &vertexes[LittleLong(verts[i*2])];
 		lines[i].v2 = &vertexes[LittleLong(verts[i*2+1])];
 	}
-	delete [] verts;
 
-	fclose(f);
+	delete fr;
 	return true;
+}
+
+//==========================================================================
+//
+// P_LoadCachedNodes
+//
+// Called by P_SetupLevel before it builds nodes. The cache only has GL
+// nodes, which can be used whether GL nodes were asked for or not.
+//
+//==========================================================================
 
-errorout:
-	if (verts != NULL)
+bool P_LoadCachedNodes(MapData *map, const int **oldvertextable)
+{
+	if (!gl_cachenodes || !CheckCachedNodes(map, oldvertextable))
 	{
-		delete[] verts;
+		return false;
+	}
+	DPrintf("Using cached nodes\n");
+	return true;
+}
+
+//==========================================================================
+//
+// P_CacheNodes
+//
+// Writes GL nodes that were just built to the cache, if building them
+// took long enough for it to be worth it.
+//
+//==========================================================================
+
+void P_CacheNodes(MapData *map, int buildtime)
+{
+#ifdef DEBUG
+	// Building nodes in debug is much slower so let's cache them only if cachetime is 0
+	buildtime = 0;
+#endif
+	if (gl_cachenodes && buildtime/1000.f >= gl_cachetime)
+	{
+		DPrintf("Caching nodes\n");
+		CreateCachedNodes(map);
+	}
+	else
+	{
+		DPrintf("Not caching nodes (time = %f)\n", buildtime/1000.f);
 	}
-	fclose(f);
-	return false;
 }
 
 CCMD(clearnodecache)
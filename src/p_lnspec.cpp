@@ -3474,7 +3474,9 @@ int P_ExecuteSpecial(int			num,
 {
 	if (num >= 0 && num <= 255)
 	{
-		return LineSpecials[num](line, activator, backSide, arg1, arg2, arg3, arg4, arg5);
+		int res = LineSpecials[num](line, activator, backSide, arg1, arg2, arg3, arg4, arg5);
+		P_InvalidateSightCache ();
+		return res;
 	}
 	return 0;
 }
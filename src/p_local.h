@@ -282,6 +282,27 @@ public:
 	void Reset() { StartBlock(minx, miny); }
 };
 
+// Things in one block of the blockmap. Actors are appended when they
+// are linked and their slot is cleared when they are unlinked, so the list
+// can be iterated back to front while actors move around. The holes are
+// removed by P_CompactBlockThings at the start of every tic. Each actor
+// remembers its slots in AActor::BlockSlots, so unlinking does not need
+// to search the block.
+struct FBlockThings
+{
+	AActor **Actors;
+	int Count;				// number of slots used, including holes
+	int Max;
+	int Holes;
+
+	int Add (AActor *actor);
+	int Remove (AActor *actor, int slot = -1);
+};
+
+void P_InitBlockThings ();
+void P_FreeBlockThings ();
+void P_CompactBlockThings ();
+
 class FBlockThingsIterator
 {
 	int minx, maxx;
@@ -289,7 +310,9 @@ class FBlockThingsIterator
 
 	int curx, cury;
 
-	FBlockNode *block;
+	FBlockThings *block;
+	int index;
+	int Slot;				// into AActor::BlockStamps, -1 if the hash is used
 
 	int Buckets[32];
 
@@ -307,6 +330,7 @@ class FBlockThingsIterator
 	void StartBlock(int x, int y);
 	void SwitchBlock(int x, int y);
 	void ClearHash();
+	void AllocStamp();
 
 	// The following is only for use in the path traverser 
 	// and therefore declared private.
@@ -314,9 +338,13 @@ class FBlockThingsIterator
 
 	friend class FPathTraverse;
 
+	FBlockThingsIterator(const FBlockThingsIterator &other);
+	FBlockThingsIterator &operator=(const FBlockThingsIterator &other);
+
 public:
 	FBlockThingsIterator(int minx, int miny, int maxx, int maxy);
 	FBlockThingsIterator(const FBoundingBox &box);
+	~FBlockThingsIterator();
 	AActor *Next(bool centeronly = false);
 	void Reset() { StartBlock(minx, miny); }
 };
@@ -428,6 +456,36 @@ enum ESightFlags
 };
 
 void	P_ResetSightCounters (bool full);
+void	P_PrefetchSight ();
+void	P_InvalidateSightCache ();
+
+// Resolves many sight checks at once on the worker pool. The results are
+// identical to calling P_CheckSight for each query, as long as they are
+// read in the order the queries were added and nothing in the world has
+// changed in between. See p_sight.cpp.
+class FSightBatch
+{
+public:
+	struct FQuery
+	{
+		const AActor *t1, *t2;
+		int flags;
+		int result;
+	};
+
+	FSightBatch() : Resolved(0) {}
+
+	unsigned Add (const AActor *t1, const AActor *t2, int flags=0);
+	void Resolve ();
+	bool Result (unsigned index);
+	void Clear ();
+	unsigned Size () const { return Queries.Size(); }
+	const FQuery &GetQuery (unsigned index) const { return Queries[index]; }
+
+private:
+	TArray<FQuery> Queries;
+	unsigned Resolved;
+};
 bool	P_TalkFacing (AActor *player);
 void	P_UseLines (player_t* player);
 bool	P_UsePuzzleItem (AActor *actor, int itemType);
@@ -525,6 +583,7 @@ inline sector_t *P_PointInSector(fixed_t x, fixed_t y)
 // P_SETUP
 //
 extern BYTE*			rejectmatrix;	// for fast sight rejection
+extern bool				rejectgenerated;	// rejectmatrix was made by P_StartRejectBuilder
 extern int*				blockmaplump;	// offsets in blockmap are from here
 
 extern int*				blockmap;
@@ -532,7 +591,7 @@ extern int				bmapwidth;
 extern int				bmapheight; 	// in mapblocks
 extern fixed_t			bmaporgx;
 extern fixed_t			bmaporgy;		// origin of block map
-extern FBlockNode**		blocklinks; 	// for thing chains
+extern FBlockThings*	blockthings; 	// for thing chains
 
 
 
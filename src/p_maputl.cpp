@@ -40,6 +40,8 @@
 #include "r_state.h"
 #include "templates.h"
 #include "po_man.h"
+#include "c_dispatch.h"
+#include "stats.h"
 
 static AActor *RoughBlockCheck (AActor *mo, int index, void *);
 
@@ -290,20 +292,15 @@ void AActor::UnlinkFromWorld ()
 	if (!(flags & MF_NOBLOCKMAP))
 	{
 		// [RH] Unlink from all blocks this actor uses
-		FBlockNode *block = this->BlockNode;
-
-		while (block != NULL)
+		int slot = 0;
+		for (int y = BlockY; y < BlockY + BlockH; ++y)
 		{
-			if (block->NextActor != NULL)
+			for (int x = BlockX; x < BlockX + BlockW; ++x, ++slot)
 			{
-				block->NextActor->PrevActor = block->PrevActor;
+				blockthings[y*bmapwidth + x].Remove (this, slot < MAX_BLOCKSLOTS ? BlockSlots[slot] : -1);
 			}
-			*(block->PrevActor) = block->NextActor;
-			FBlockNode *next = block->NextBlock;
-			block->Release ();
-			block = next;
 		}
-		BlockNode = NULL;
+		BlockW = BlockH = 0;
 	}
 }
 
@@ -384,35 +381,28 @@ void AActor::LinkToWorld (sector_t *sec)
 
 		if (x1 >= bmapwidth || x2 < 0 || y1 >= bmapheight || y2 < 0)
 		{ // thing is off the map
-			BlockNode = NULL;
+			BlockW = BlockH = 0;
 		}
 		else
         { // [RH] Link into every block this actor touches, not just the center one
-			FBlockNode **alink = &this->BlockNode;
 			x1 = MAX (0, x1);
 			y1 = MAX (0, y1);
 			x2 = MIN (bmapwidth - 1, x2);
 			y2 = MIN (bmapheight - 1, y2);
+			BlockX = x1;
+			BlockY = y1;
+			BlockW = x2 - x1 + 1;
+			BlockH = y2 - y1 + 1;
+			int slot = 0;
 			for (int y = y1; y <= y2; ++y)
 			{
-				for (int x = x1; x <= x2; ++x)
+				for (int x = x1; x <= x2; ++x, ++slot)
 				{
-					FBlockNode **link = &blocklinks[y*bmapwidth + x];
-					FBlockNode *node = FBlockNode::Create (this, x, y);
-
-					// Link in to block
-					if ((node->NextActor = *link) != NULL)
+					int index = blockthings[y*bmapwidth + x].Add (this);
+					if (slot < MAX_BLOCKSLOTS)
 					{
-						(*link)->PrevActor = &node->NextActor;
+						BlockSlots[slot] = index;
 					}
-					node->PrevActor = link;
-					*link = node;
-
-					// Link in to actor
-					node->PrevBlock = alink;
-					node->NextBlock = NULL;
-					(*alink) = node;
-					alink = &node->NextBlock;
 				}
 			}
 		}
@@ -593,34 +583,139 @@ void AActor::SetOrigin (fixed_t ix, fixed_t iy, fixed_t iz)
 	P_FindFloorCeiling(this, FFCF_ONLYSPAWNPOS);
 }
 
-FBlockNode *FBlockNode::FreeBlocks = NULL;
+//==========================================================================
+//
+// FBlockThings :: Add
+//
+//==========================================================================
+
+static TArray<int> DirtyBlocks;		// blocks with holes
 
-FBlockNode *FBlockNode::Create (AActor *who, int x, int y)
+int FBlockThings::Add (AActor *actor)
 {
-	FBlockNode *block;
+	if (Count == Max)
+	{
+		Max = Max == 0 ? 8 : Max * 2;
+		Actors = (AActor **)M_Realloc (Actors, Max * sizeof(AActor *));
+	}
+	Actors[Count] = actor;
+	return Count++;
+}
 
-	if (FreeBlocks != NULL)
+//==========================================================================
+//
+// FBlockThings :: Remove
+//
+// Leaves a hole where the actor was, so iterators working on this block
+// are not disturbed. Returns the slot the actor was in. If the caller
+// knows the slot, only that one is checked. The actors are deliberately
+// not moved around to fill the hole: That would change the order in which
+// iterators return them, and with it the outcome of a demo.
+//
+//==========================================================================
+
+int FBlockThings::Remove (AActor *actor, int slot)
+{
+	if (slot < 0 || slot >= Count || Actors[slot] != actor)
 	{
-		block = FreeBlocks;
-		FreeBlocks = block->NextBlock;
+		for (slot = Count - 1; slot >= 0; --slot)
+		{
+			if (Actors[slot] == actor)
+			{
+				break;
+			}
+		}
+		if (slot < 0)
+		{
+			return -1;
+		}
 	}
-	else
+	Actors[slot] = NULL;
+	if (Holes++ == 0)
 	{
-		block = new FBlockNode;
+		DirtyBlocks.Push (int(this - blockthings));
 	}
-	block->BlockIndex = x + y*bmapwidth;
-	block->Me = who;
-	block->NextActor = NULL;
-	block->PrevActor = NULL;
-	block->PrevBlock = NULL;
-	block->NextBlock = NULL;
-	return block;
+	return slot;
 }
 
-void FBlockNode::Release ()
+//==========================================================================
+//
+// P_InitBlockThings
+//
+//==========================================================================
+
+void P_InitBlockThings ()
 {
-	NextBlock = FreeBlocks;
-	FreeBlocks = this;
+	int count = bmapwidth*bmapheight;
+
+	blockthings = new FBlockThings[count];
+	memset (blockthings, 0, count*sizeof(*blockthings));
+	DirtyBlocks.Clear();
+}
+
+//==========================================================================
+//
+// P_FreeBlockThings
+//
+//==========================================================================
+
+void P_FreeBlockThings ()
+{
+	if (blockthings != NULL)
+	{
+		for (int i = bmapwidth*bmapheight-1; i >= 0; --i)
+		{
+			if (blockthings[i].Actors != NULL)
+			{
+				M_Free (blockthings[i].Actors);
+			}
+		}
+		delete[] blockthings;
+		blockthings = NULL;
+	}
+	DirtyBlocks.Clear();
+}
+
+//==========================================================================
+//
+// P_CompactBlockThings
+//
+// Removes the holes left by unlinked actors. The order of the remaining
+// actors is kept and their BlockSlots are updated to match. This must not
+// be called while anything is iterating over the blockmap or while the
+// console player is being predicted.
+//
+//==========================================================================
+
+void P_CompactBlockThings ()
+{
+	for (unsigned i = 0; i < DirtyBlocks.Size(); ++i)
+	{
+		FBlockThings *block = &blockthings[DirtyBlocks[i]];
+		int bx = DirtyBlocks[i] % bmapwidth;
+		int by = DirtyBlocks[i] / bmapwidth;
+		int j, k;
+
+		for (j = k = 0; j < block->Count; ++j)
+		{
+			AActor *actor = block->Actors[j];
+			if (actor != NULL)
+			{
+				if (j != k)
+				{
+					int slot = (by - actor->BlockY) * actor->BlockW + (bx - actor->BlockX);
+					if (slot < MAX_BLOCKSLOTS)
+					{
+						actor->BlockSlots[slot] = k;
+					}
+				}
+				block->Actors[k++] = actor;
+			}
+		}
+		block->Count = k;
+		block->Holes = 0;
+	}
+	DirtyBlocks.Clear();
 }
 
 //
@@ -764,13 +859,18 @@ line_t *FBlockLinesIterator::Next()
 //
 //===========================================================================
 
+static int UsedStampSlots;
+static int SlotStamps[MAX_BLOCKTHINGSSTAMPS];
+static int LastStamp;
+
 FBlockThingsIterator::FBlockThingsIterator()
 : DynHash(0)
 {
 	minx = maxx = 0;
 	miny = maxy = 0;
-	ClearHash();
+	AllocStamp();
 	block = NULL;
+	index = 0;
 }
 
 FBlockThingsIterator::FBlockThingsIterator(int _minx, int _miny, int _maxx, int _maxy)
@@ -780,7 +880,7 @@ FBlockThingsIterator::FBlockThingsIterator(int _minx, int _miny, int _maxx, int
 	maxx = _maxx;
 	miny = _miny;
 	maxy = _maxy;
-	ClearHash();
+	AllocStamp();
 	Reset();
 }
 
@@ -791,10 +891,66 @@ FBlockThingsIterator::FBlockThingsIterator(const FBoundingBox &box)
 	miny = GetSafeBlockY(box.Bottom() - bmaporgy);
 	maxx = GetSafeBlockX(box.Right() - bmaporgx);
 	minx = GetSafeBlockX(box.Left() - bmaporgx);
-	ClearHash();
+	AllocStamp();
 	Reset();
 }
 
+FBlockThingsIterator::~FBlockThingsIterator()
+{
+	if (Slot >= 0)
+	{
+		UsedStampSlots &= ~(1 << Slot);
+	}
+}
+
+//===========================================================================
+//
+// FBlockThingsIterator :: AllocStamp
+//
+// Every active iterator gets a slot in AActor::BlockStamps and a unique
+// stamp for it, so marking an actor as checked is a single store.
+//
+//===========================================================================
+
+void FBlockThingsIterator::AllocStamp()
+{
+	for (Slot = 0; Slot < MAX_BLOCKTHINGSSTAMPS; ++Slot)
+	{
+		if (!(UsedStampSlots & (1 << Slot)))
+		{
+			break;
+		}
+	}
+	if (Slot == MAX_BLOCKTHINGSSTAMPS)
+	{ // Too deeply nested.
+		Slot = -1;
+		ClearHash();
+		return;
+	}
+	UsedStampSlots |= 1 << Slot;
+
+	if (LastStamp == INT_MAX)
+	{ // Renumber the stamps. Whatever the active iterators have checked
+	  // gets stamp 1, everything else 0.
+		TThinkerIterator<AActor> it;
+		AActor *mo;
+
+		while ((mo = it.Next()) != NULL)
+		{
+			for (int i = 0; i < MAX_BLOCKTHINGSSTAMPS; ++i)
+			{
+				mo->BlockStamps[i] = ((UsedStampSlots & (1 << i)) && mo->BlockStamps[i] == SlotStamps[i]);
+			}
+		}
+		for (int i = 0; i < MAX_BLOCKTHINGSSTAMPS; ++i)
+		{
+			SlotStamps[i] = 1;
+		}
+		LastStamp = 1;
+	}
+	SlotStamps[Slot] = ++LastStamp;
+}
+
 //===========================================================================
 //
 // FBlockThingsIterator :: ClearHash
@@ -820,12 +976,14 @@ void FBlockThingsIterator::StartBlock(int x, int y)
 	cury = y; 
 	if (x >= 0 && y >= 0 && x < bmapwidth && y <bmapheight)
 	{
-		block = blocklinks[y*bmapwidth + x];
+		block = &blockthings[y*bmapwidth + x];
+		index = block->Count;
 	}
 	else
 	{
 		// invalid block
 		block = NULL;
+		index = 0;
 	}
 }
 
@@ -852,16 +1010,20 @@ AActor *FBlockThingsIterator::Next(bool centeronly)
 {
 	for (;;)
 	{
-		while (block != NULL)
+		while (index > 0)
 		{
-			AActor *me = block->Me;
-			FBlockNode *mynode = block;
+			// Actors linked into this block after the iteration started are
+			// behind the index and will not be returned.
+			AActor *me = block->Actors[--index];
 			HashEntry *entry;
 			int i;
 
-			block = block->NextActor;
+			if (me == NULL)
+			{ // Unlinked since the last compaction.
+				continue;
+			}
 			// Don't recheck things that were already checked
-			if (mynode->NextBlock == NULL && mynode->PrevBlock == &me->BlockNode)
+			if (me->BlockW == 1 && me->BlockH == 1)
 			{ // This actor doesn't span blocks, so we know it can only ever be checked once.
 				return me;
 			}
@@ -880,6 +1042,14 @@ AActor *FBlockThingsIterator::Next(bool centeronly)
 					return me;
 				}
 			}
+			else if (Slot >= 0)
+			{
+				if (me->BlockStamps[Slot] != SlotStamps[Slot])
+				{
+					me->BlockStamps[Slot] = SlotStamps[Slot];
+					return me;
+				}
+			}
 			else
 			{
 				size_t hash = ((size_t)me >> 3) % countof(Buckets);
@@ -1504,21 +1674,108 @@ AActor *P_BlockmapSearch (AActor *mo, int distance, AActor *(*check)(AActor*, in
 static AActor *RoughBlockCheck (AActor *mo, int index, void *param)
 {
 	bool onlyseekable = param != NULL;
-	FBlockNode *link;
+	FBlockThings *block = &blockthings[index];
 
-	for (link = blocklinks[index]; link != NULL; link = link->NextActor)
+	for (int i = block->Count - 1; i >= 0; --i)
 	{
-		if (link->Me != mo)
+		AActor *link = block->Actors[i];
+
+		if (link != NULL && link != mo)
 		{
-			if (onlyseekable && !mo->CanSeek(link->Me))
+			if (onlyseekable && !mo->CanSeek(link))
 			{
 				continue;
 			}
-			if (mo->IsOkayToAttack (link->Me))
+			if (mo->IsOkayToAttack (link))
 			{
-				return link->Me;
+				return link;
 			}
 		}
 	}
 	return NULL;
 }
+
+//===========================================================================
+//
+// CCMD blockthingsbench
+//
+// Spawns <count> actors spread over the current level's blockmap, moves
+// them around <steps> times and searches the area around each of them
+// the way P_CheckPosition does, timing both.
+//
+//===========================================================================
+
+CCMD (blockthingsbench)
+{
+	if (gamestate != GS_LEVEL || netgame || demoplayback || demorecording)
+	{
+		Printf ("Only available in a single player game.\n");
+		return;
+	}
+
+	int count = argv.argc() > 1 ? atoi (argv[1]) : 10000;
+	int steps = argv.argc() > 2 ? atoi (argv[2]) : 10;
+	int width = bmapwidth * MAPBLOCKUNITS;
+	int height = bmapheight * MAPBLOCKUNITS;
+	DWORD seed = 1;
+	cycle_t movecycles, searchcycles;
+	int found = 0;
+	int i, j;
+
+	if (count <= 0 || steps <= 0)
+	{
+		Printf ("Usage: blockthingsbench [count] [steps]\n");
+		return;
+	}
+
+	TArray<AActor *> actors(count);
+	for (i = 0; i < count; ++i)
+	{
+		seed = seed * 1664525 + 1013904223;
+		fixed_t x = bmaporgx + (int(seed >> 8) % width) * FRACUNIT;
+		seed = seed * 1664525 + 1013904223;
+		fixed_t y = bmaporgy + (int(seed >> 8) % height) * FRACUNIT;
+		actors.Push (Spawn (RUNTIME_CLASS(AActor), x, y, ONFLOORZ, NO_REPLACE));
+	}
+
+	movecycles.Reset();
+	searchcycles.Reset();
+	for (j = 0; j < steps; ++j)
+	{
+		movecycles.Clock();
+		for (i = 0; i < count; ++i)
+		{
+			AActor *mo = actors[i];
+			seed = seed * 1664525 + 1013904223;
+			fixed_t dx = (int((seed >> 8) & 63) - 32) * FRACUNIT;
+			seed = seed * 1664525 + 1013904223;
+			fixed_t dy = (int((seed >> 8) & 63) - 32) * FRACUNIT;
+			mo->SetOrigin (mo->x + dx, mo->y + dy, mo->z);
+		}
+		movecycles.Unclock();
+
+		searchcycles.Clock();
+		for (i = 0; i < count; ++i)
+		{
+			AActor *mo = actors[i];
+			FBoundingBox box(mo->x, mo->y, mo->radius + 64*FRACUNIT);
+			FBlockThingsIterator it(box);
+
+			while (it.Next() != NULL)
+			{
+				found++;
+			}
+		}
+		searchcycles.Unclock();
+		P_CompactBlockThings ();
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		actors[i]->Destroy ();
+	}
+	P_CompactBlockThings ();
+
+	Printf ("%d actors, %d steps: move %.3f ms, search %.3f ms (%d found)\n",
+		count, steps, movecycles.TimeMS(), searchcycles.TimeMS(), found);
+}
@@ -2617,7 +2617,223 @@ void P_NightmareRespawn (AActor *mobj)
 }
 
 
-AActor *AActor::TIDHash[128];
+FTIDHash AActor::TIDHash;
+
+//==========================================================================
+//
+// FTIDHash
+//
+//==========================================================================
+
+FTIDHash::FTIDHash ()
+{
+	Entries = NULL;
+	Size = Used = 0;
+}
+
+FTIDHash::~FTIDHash ()
+{
+	if (Entries != NULL)
+	{
+		delete[] Entries;
+	}
+}
+
+//==========================================================================
+//
+// FTIDHash :: Find
+//
+// Returns the first actor in the chain for <tid> and <type>.
+//
+//==========================================================================
+
+AActor *FTIDHash::Find (int tid, const PClass *type) const
+{
+	if (Entries == NULL)
+	{
+		return NULL;
+	}
+	for (unsigned int i = Hash (tid, type) & (Size - 1); Entries[i].TID != 0; i = (i + 1) & (Size - 1))
+	{
+		if (Entries[i].TID == tid && Entries[i].Type == type)
+		{
+			return Entries[i].Head;
+		}
+	}
+	return NULL;
+}
+
+//==========================================================================
+//
+// FTIDHash :: Insert
+//
+// Returns the address of the head of the chain for <tid> and <type>,
+// creating an empty chain if there is none yet. The address is only valid
+// until the next call.
+//
+//==========================================================================
+
+AActor **FTIDHash::Insert (int tid, const PClass *type)
+{
+	unsigned int i;
+
+	if ((Used + 1) * 2 > Size)
+	{
+		Rehash ();
+	}
+	for (i = Hash (tid, type) & (Size - 1); Entries[i].TID != 0; i = (i + 1) & (Size - 1))
+	{
+		if (Entries[i].TID == tid && Entries[i].Type == type)
+		{
+			return &Entries[i].Head;
+		}
+	}
+	Entries[i].TID = tid;
+	Entries[i].Type = type;
+	Entries[i].Head = NULL;
+	Used++;
+	return &Entries[i].Head;
+}
+
+//==========================================================================
+//
+// FTIDHash :: Rehash
+//
+// Drops the entries of chains that became empty and grows the table if
+// it is still too full afterwards. The first actor of each chain points
+// back at its entry, so that has to be updated.
+//
+//==========================================================================
+
+void FTIDHash::Rehash ()
+{
+	Entry *oldentries = Entries;
+	unsigned int oldsize = Size;
+	unsigned int live = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < oldsize; ++i)
+	{
+		if (oldentries[i].Head != NULL)
+		{
+			live++;
+		}
+	}
+	if (Size == 0)
+	{
+		Size = 256;
+	}
+	while (live * 4 >= Size)
+	{
+		Size <<= 1;
+	}
+	Entries = new Entry[Size];
+	memset (Entries, 0, Size * sizeof(Entry));
+	Used = live;
+
+	for (i = 0; i < oldsize; ++i)
+	{
+		Entry *old = &oldentries[i];
+
+		if (old->Head != NULL)
+		{
+			for (j = Hash (old->TID, old->Type) & (Size - 1); Entries[j].TID != 0; j = (j + 1) & (Size - 1))
+			{
+			}
+			Entries[j] = *old;
+			if (old->Type == NULL)
+			{
+				old->Head->iprev = &Entries[j].Head;
+			}
+			else
+			{
+				old->Head->cprev = &Entries[j].Head;
+			}
+		}
+	}
+	if (oldentries != NULL)
+	{
+		delete[] oldentries;
+	}
+}
+
+//==========================================================================
+//
+// FTIDHash :: Clear
+//
+// Unlinks every actor that is still in the hash, so none of them points
+// back into the table afterwards.
+//
+//==========================================================================
+
+void FTIDHash::Clear ()
+{
+	for (unsigned int i = 0; i < Size; ++i)
+	{
+		AActor *probe = Entries[i].Head;
+
+		while (probe != NULL)
+		{
+			AActor *next;
+
+			if (Entries[i].Type == NULL)
+			{
+				next = probe->inext;
+				probe->inext = NULL;
+				probe->iprev = NULL;
+			}
+			else
+			{
+				next = probe->cnext;
+				probe->cnext = NULL;
+				probe->cprev = NULL;
+			}
+			probe = next;
+		}
+	}
+	if (Entries != NULL)
+	{
+		memset (Entries, 0, Size * sizeof(Entry));
+	}
+	Used = 0;
+}
+
+//==========================================================================
+//
+// P_IsLeafClass
+//
+// Returns true if no other class inherits from <type>, so looking for
+// actors of that class is the same as looking for actors of exactly that
+// class.
+//
+//==========================================================================
+
+static TMap<const PClass *, bool> LeafClasses;
+static unsigned int NumLeafClassTypes;
+
+bool P_IsLeafClass (const PClass *type)
+{
+	if (NumLeafClassTypes != PClass::m_Types.Size())
+	{
+		unsigned int i;
+
+		LeafClasses.Clear();
+		for (i = 0; i < PClass::m_Types.Size(); ++i)
+		{
+			LeafClasses[PClass::m_Types[i]] = true;
+		}
+		for (i = 0; i < PClass::m_Types.Size(); ++i)
+		{
+			if (PClass::m_Types[i]->ParentClass != NULL)
+			{
+				LeafClasses[PClass::m_Types[i]->ParentClass] = false;
+			}
+		}
+		NumLeafClassTypes = PClass::m_Types.Size();
+	}
+	bool *leaf = LeafClasses.CheckKey (type);
+	return leaf != NULL && *leaf;
+}
 
 //
 // P_ClearTidHashes
@@ -2627,13 +2843,14 @@ AActor *AActor::TIDHash[128];
 
 void AActor::ClearTIDHashes ()
 {
-	memset(TIDHash, 0, sizeof(TIDHash));
+	TIDHash.Clear ();
+	NumLeafClassTypes = 0;
 }
 
 //
 // P_AddMobjToHash
 //
-// Inserts an mobj into the correct chain based on its tid.
+// Inserts an mobj into the correct chains based on its tid and class.
 // If its tid is 0, this function does nothing.
 //
 void AActor::AddToHash ()
@@ -2642,26 +2859,39 @@ void AActor::AddToHash ()
 	{
 		iprev = NULL;
 		inext = NULL;
+		cprev = NULL;
+		cnext = NULL;
 		return;
 	}
 	else
 	{
-		int hash = TIDHASH (tid);
+		// Inserting the second chain may move the first one's head,
+		// so this must be completely linked in before.
+		AActor **head = TIDHash.Insert (tid, NULL);
 
-		inext = TIDHash[hash];
-		iprev = &TIDHash[hash];
-		TIDHash[hash] = this;
+		inext = *head;
+		iprev = head;
+		*head = this;
 		if (inext)
 		{
 			inext->iprev = &inext;
 		}
+
+		head = TIDHash.Insert (tid, GetClass());
+		cnext = *head;
+		cprev = head;
+		*head = this;
+		if (cnext)
+		{
+			cnext->cprev = &cnext;
+		}
 	}
 }
 
 //
 // P_RemoveMobjFromHash
 //
-// Removes an mobj from its hash chain.
+// Removes an mobj from its hash chains.
 //
 void AActor::RemoveFromHash ()
 {
@@ -2675,6 +2905,16 @@ void AActor::RemoveFromHash ()
 		iprev = NULL;
 		inext = NULL;
 	}
+	if (tid != 0 && cprev)
+	{
+		*cprev = cnext;
+		if (cnext)
+		{
+			cnext->cprev = cprev;
+		}
+		cprev = NULL;
+		cnext = NULL;
+	}
 	tid = 0;
 }
 
@@ -2689,7 +2929,7 @@ void AActor::RemoveFromHash ()
 
 bool P_IsTIDUsed(int tid)
 {
-	AActor *probe = AActor::TIDHash[tid & 127];
+	AActor *probe = AActor::TIDHash.Find (tid, NULL);
 	while (probe != NULL)
 	{
 		if (probe->tid == tid)
@@ -0,0 +1,353 @@
+/*
+** p_profile.cpp
+** Per-class and per-action function tick cost accounting
+**
+**---------------------------------------------------------------------------
+**
+** This is off unless turned on with "actorprofile on", because it looks
+** up a hash table for every thinker and every action function call.
+**
+** Times are inclusive: a class's time includes the action functions its
+** Tick() called, and an action function's time includes anything it
+** called in turn, such as other action functions through SetState.
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#include "doomtype.h"
+#include "templates.h"
+#include "doomstat.h"
+#include "tarray.h"
+#include "zstring.h"
+#include "c_dispatch.h"
+#include "v_text.h"
+#include "dthinker.h"
+#include "info.h"
+#include "thingdef/thingdef.h"
+#include "profiler.h"
+#include "p_profile.h"
+
+// TYPES -------------------------------------------------------------------
+
+struct FCostInfo
+{
+	QWORD Time;			// in nanoseconds
+	unsigned int Calls;
+};
+
+struct FCostEntry
+{
+	FString Name;
+	FCostInfo Cost;
+};
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+bool ActorProfiling;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static TMap<const PClass *, FCostInfo> ClassCosts;
+static TMap<actionf_p, FCostInfo> ActionCosts;
+static int ProfileStartTic;
+static int ProfileTics;			// tics profiled before the last "off"
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// P_ProfileTick
+//
+// The class is looked up before ticking, since the thinker may destroy
+// itself. The table is not touched until Tick() returns, because nothing
+// else must hold a reference into it while it might grow.
+//
+//==========================================================================
+
+void P_ProfileTick (DThinker *thinker)
+{
+	const PClass *type = thinker->GetClass();
+	QWORD start = Profile_Now();
+
+	thinker->Tick();
+
+	FCostInfo *cost = ClassCosts.CheckKey(type);
+	if (cost == NULL)
+	{
+		cost = &ClassCosts.Insert(type, FCostInfo());
+		cost->Time = 0;
+		cost->Calls = 0;
+	}
+	cost->Time += Profile_Now() - start;
+	cost->Calls++;
+}
+
+//==========================================================================
+//
+// P_ProfileAction
+//
+// Called by FState::CallAction instead of the action function.
+//
+//==========================================================================
+
+void P_ProfileAction (FState *state, AActor *self, AActor *stateowner, StateCallData *statecall)
+{
+	actionf_p func = state->ActionFunc;
+	QWORD start = Profile_Now();
+
+	func(self, stateowner, state, state->ParameterIndex-1, statecall);
+
+	FCostInfo *cost = ActionCosts.CheckKey(func);
+	if (cost == NULL)
+	{
+		cost = &ActionCosts.Insert(func, FCostInfo());
+		cost->Time = 0;
+		cost->Calls = 0;
+	}
+	cost->Time += Profile_Now() - start;
+	cost->Calls++;
+}
+
+//==========================================================================
+//
+// CollectCosts
+//
+//==========================================================================
+
+static void CollectCosts (TArray<FCostEntry> &classes, TArray<FCostEntry> &actions)
+{
+	TMapIterator<const PClass *, FCostInfo> cit(ClassCosts);
+	TMap<const PClass *, FCostInfo>::Pair *cpair;
+
+	while (cit.NextPair(cpair))
+	{
+		FCostEntry &entry = classes[classes.Reserve(1)];
+		entry.Name = cpair->Key->TypeName.GetChars();
+		entry.Cost = cpair->Value;
+	}
+
+	TMapIterator<actionf_p, FCostInfo> ait(ActionCosts);
+	TMap<actionf_p, FCostInfo>::Pair *apair;
+
+	while (ait.NextPair(apair))
+	{
+		FCostEntry &entry = actions[actions.Reserve(1)];
+		const char *name = FindFunctionName(apair->Key);
+		if (name != NULL)
+		{
+			entry.Name = name;
+		}
+		else
+		{
+			entry.Name.Format("%p", (void *)apair->Key);
+		}
+		entry.Cost = apair->Value;
+	}
+}
+
+static int STACK_ARGS sort_by_total(const void *a_, const void *b_)
+{
+	const FCostEntry *a = (const FCostEntry *)a_;
+	const FCostEntry *b = (const FCostEntry *)b_;
+
+	return a->Cost.Time < b->Cost.Time ? 1 : a->Cost.Time > b->Cost.Time ? -1 : 0;
+}
+
+static int STACK_ARGS sort_by_calls(const void *a_, const void *b_)
+{
+	const FCostEntry *a = (const FCostEntry *)a_;
+	const FCostEntry *b = (const FCostEntry *)b_;
+
+	return a->Cost.Calls < b->Cost.Calls ? 1 : a->Cost.Calls > b->Cost.Calls ? -1 : 0;
+}
+
+static int STACK_ARGS sort_by_avg(const void *a_, const void *b_)
+{
+	const FCostEntry *a = (const FCostEntry *)a_;
+	const FCostEntry *b = (const FCostEntry *)b_;
+	double a_avg = double(a->Cost.Time) / a->Cost.Calls;
+	double b_avg = double(b->Cost.Time) / b->Cost.Calls;
+
+	return a_avg < b_avg ? 1 : a_avg > b_avg ? -1 : 0;
+}
+
+//==========================================================================
+//
+// GetProfiledTics
+//
+//==========================================================================
+
+static int GetProfiledTics ()
+{
+	return ProfileTics + (ActorProfiling ? gametic - ProfileStartTic : 0);
+}
+
+//==========================================================================
+//
+// ShowCosts
+//
+//==========================================================================
+
+static void ShowCosts (TArray<FCostEntry> &costs, unsigned int limit,
+	int (STACK_ARGS *sorter)(const void *, const void *), const char *label)
+{
+	int tics = MAX(GetProfiledTics(), 1);
+
+	if (costs.Size() == 0)
+	{
+		return;
+	}
+	qsort(&costs[0], costs.Size(), sizeof(FCostEntry), sorter);
+
+	Printf(TEXTCOLOR_ORANGE "Top %u %s:\n", MIN(limit, costs.Size()), label);
+	Printf(TEXTCOLOR_YELLOW "%-24s   Total ms    Calls   Avg us  ms/tic\n", label);
+	Printf(TEXTCOLOR_YELLOW "------------------------ ---------- -------- -------- -------\n");
+	for (unsigned int i = 0; i < limit && i < costs.Size(); ++i)
+	{
+		const FCostEntry &entry = costs[i];
+
+		Printf("%-24.24s %10.3f %8u %8.2f %7.3f\n", entry.Name.GetChars(),
+			entry.Cost.Time / 1e6, entry.Cost.Calls,
+			entry.Cost.Time / 1e3 / entry.Cost.Calls,
+			entry.Cost.Time / 1e6 / tics);
+	}
+}
+
+//==========================================================================
+//
+// WriteCosts
+//
+//==========================================================================
+
+static bool WriteCosts (const char *filename, const TArray<FCostEntry> &classes, const TArray<FCostEntry> &actions)
+{
+	FILE *f = fopen(filename, "w");
+
+	if (f == NULL)
+	{
+		return false;
+	}
+	fprintf(f, "kind,name,calls,total_ms,avg_us,ms_per_tic\n");
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		const TArray<FCostEntry> &costs = pass == 0 ? classes : actions;
+		int tics = MAX(GetProfiledTics(), 1);
+
+		for (unsigned int i = 0; i < costs.Size(); ++i)
+		{
+			fprintf(f, "%s,%s,%u,%.4f,%.3f,%.4f\n", pass == 0 ? "class" : "action",
+				costs[i].Name.GetChars(), costs[i].Cost.Calls,
+				costs[i].Cost.Time / 1e6, costs[i].Cost.Time / 1e3 / costs[i].Cost.Calls,
+				costs[i].Cost.Time / 1e6 / tics);
+		}
+	}
+	return fclose(f) == 0;
+}
+
+//==========================================================================
+//
+// CCMD actorprofile
+//
+// actorprofile on|off|clear
+// actorprofile [<count>] [total|calls|avg]
+// actorprofile csv [<file>]
+//
+//==========================================================================
+
+CCMD (actorprofile)
+{
+	if (argv.argc() > 1)
+	{
+		if (stricmp(argv[1], "on") == 0)
+		{
+			if (!ActorProfiling)
+			{
+				ActorProfiling = true;
+				ProfileStartTic = gametic;
+			}
+			return;
+		}
+		if (stricmp(argv[1], "off") == 0)
+		{
+			if (ActorProfiling)
+			{
+				ProfileTics += gametic - ProfileStartTic;
+				ActorProfiling = false;
+			}
+			return;
+		}
+		if (stricmp(argv[1], "clear") == 0)
+		{
+			ClassCosts.Clear();
+			ActionCosts.Clear();
+			ProfileTics = 0;
+			ProfileStartTic = gametic;
+			return;
+		}
+	}
+
+	TArray<FCostEntry> classes, actions;
+	CollectCosts(classes, actions);
+
+	if (classes.Size() == 0 && actions.Size() == 0)
+	{
+		Printf ("No profiling data. Use \"actorprofile on\" to start collecting.\n");
+		return;
+	}
+
+	if (argv.argc() > 1 && stricmp(argv[1], "csv") == 0)
+	{
+		const char *filename = argv.argc() > 2 ? argv[2] : "actorprofile.csv";
+
+		qsort(&classes[0], classes.Size(), sizeof(FCostEntry), sort_by_total);
+		if (actions.Size() > 0)
+		{
+			qsort(&actions[0], actions.Size(), sizeof(FCostEntry), sort_by_total);
+		}
+		if (WriteCosts(filename, classes, actions))
+		{
+			Printf ("Wrote %u classes and %u action functions to %s\n", classes.Size(), actions.Size(), filename);
+		}
+		else
+		{
+			Printf ("Could not write %s\n", filename);
+		}
+		return;
+	}
+
+	unsigned int limit = 10;
+	int (STACK_ARGS *sorter)(const void *, const void *) = sort_by_total;
+
+	for (int i = 1; i < argv.argc(); ++i)
+	{
+		char *endptr;
+		long num = strtol(argv[i], &endptr, 0);
+		if (endptr != argv[i])
+		{
+			limit = num > 0 ? (unsigned int)num : UINT_MAX;
+		}
+		else if (stricmp(argv[i], "calls") == 0)
+		{
+			sorter = sort_by_calls;
+		}
+		else if (stricmp(argv[i], "avg") == 0)
+		{
+			sorter = sort_by_avg;
+		}
+		else if (stricmp(argv[i], "total") == 0)
+		{
+			sorter = sort_by_total;
+		}
+		else
+		{
+			Printf ("Unknown option %s\n", argv[i]);
+			return;
+		}
+	}
+	Printf ("%d tics profiled\n", GetProfiledTics());
+	ShowCosts(classes, limit, sorter, "classes");
+	ShowCosts(actions, limit, sorter, "actions");
+}
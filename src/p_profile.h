@@ -0,0 +1,18 @@
+#ifndef __P_PROFILE_H__
+#define __P_PROFILE_H__
+
+// Opt-in cost accounting for thinkers and action functions. While it is
+// on, every thinker's Tick() is charged to its class and every action
+// function call to the function. See the "actorprofile" command.
+
+class DThinker;
+class AActor;
+struct FState;
+struct StateCallData;
+
+extern bool ActorProfiling;
+
+void P_ProfileTick (DThinker *thinker);
+void P_ProfileAction (FState *state, AActor *self, AActor *stateowner, StateCallData *statecall);
+
+#endif
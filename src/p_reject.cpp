@@ -0,0 +1,876 @@
+/*
+** p_reject.cpp
+** Builds a REJECT table for maps that come without a usable one
+**
+**---------------------------------------------------------------------------
+**
+** The table is derived from the GL nodes: every subsector is a convex leaf
+** and the segs it shares with its neighbors (two-sided lines and minisegs)
+** are the portals between them. Starting at each leaf, visibility is flowed
+** through the portals, and every portal that is passed is clipped to the
+** part that can still be seen from the first portal through the current one.
+** This is the same idea vis tools use for PVS generation, reduced to 2D.
+**
+** The result has to be conservative, so that P_CheckSight's result never
+** changes because of it. Since doors and lifts can move, sector heights are
+** ignored and all two-sided lines are considered open. Polyobjects are not
+** part of the BSP, so they can never block anything here either. All clipping
+** is done with some tolerance in favor of visibility, and leaves whose flow
+** gets too expensive simply see everything that is connected to them.
+**
+** The finished table is stored in the node cache directory under the map's
+** checksum so that it only has to be built once.
+**
+** If the map has no GL nodes, the background job builds them first, from
+** its own copy of the vertexes, lines and sides.
+**
+** Unless the game must stay in sync, the level starts before the table is
+** done and it is installed at the beginning of whatever tic it is finished
+** in. To keep that from changing the game, P_CheckSight rolls for
+** invisible targets before it looks at a generated table (see
+** rejectgenerated), so the table never changes how many random numbers
+** are used. Since it is conservative, it never changes a sight check's
+** result either.
+**
+*/
+
+#include <math.h>
+#include <stdio.h>
+
+#include "templates.h"
+#include "doomdef.h"
+#include "doomstat.h"
+#include "p_local.h"
+#include "p_setup.h"
+#include "nodebuild.h"
+#include "r_state.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "cmdlib.h"
+#include "m_swap.h"
+#include "i_system.h"
+#include "workerpool.h"
+#include "stats.h"
+#include <zlib.h>
+
+void P_GetPolySpots (MapData * lump, TArray<FNodeBuilder::FPolyStart> &spots, TArray<FNodeBuilder::FPolyStart> &anchors);
+
+CVAR (Bool, genreject, false, CVAR_SERVERINFO|CVAR_GLOBALCONFIG);
+
+bool rejectgenerated;
+
+enum
+{
+	REJECT_FLOW_BUDGET = 20000		// portal steps per leaf before giving up
+};
+
+static const double REJECT_EPSILON = 0.5;	// in map units
+
+//==========================================================================
+//
+// FRejectBuilder
+//
+//==========================================================================
+
+struct FRejectWinding
+{
+	double x1, y1, x2, y2;
+};
+
+struct FRejectPortal
+{
+	FRejectWinding Winding;
+	int Leaf;			// the leaf on the other side
+};
+
+struct FRejectLeaf
+{
+	int Sector;
+	unsigned FirstPortal, NumPortals;
+};
+
+class FRejectBuilder : public FBackgroundJob
+{
+public:
+	TArray<FRejectLeaf> Leafs;
+	TArray<FRejectPortal> Portals;
+	TArray<int> Neighbors;			// pairs of sectors that share a two-sided line
+	int NumSectors;
+	BYTE Checksum[16];
+	BYTE *Matrix;
+	volatile bool Done;
+	unsigned BuildTime;
+
+	// Copies of the level for building GL nodes, if the map has none.
+	vertex_t *NodeVertices;
+	line_t *NodeLines;
+	side_t *NodeSides;
+	FNodeBuilder::FPolyStart *PolySpots, *PolyAnchors;
+	int NumNodeVertices, NumNodeLines, NumNodeSides;
+	int NumPolySpots, NumPolyAnchors;
+
+	FRejectBuilder();
+	~FRejectBuilder();
+
+	void CopyLevel(MapData *map);
+	void AddLeafs(seg_t *segs, glsegextra_t *extras, int numsegs, subsector_t *subs, int numsubs);
+	void Prepare();
+	void Run();
+
+private:
+	struct FStackEntry
+	{
+		int Leaf;
+		unsigned NextPortal;
+		FRejectWinding Pass;
+	};
+
+	TArray<BYTE> Visible;			// one row of <RowSize> bytes per sector
+	TArray<BYTE> Widened;
+	TArray<BYTE> OnStack;
+	TArray<FStackEntry> Stack;
+	TArray<int> FloodTodo;
+	TArray<BYTE> FloodSeen;
+	unsigned RowSize;
+
+	void SetVisible(int from, int to)
+	{
+		Visible[from * RowSize + (to >> 3)] |= 1 << (to & 7);
+	}
+	void FlowLeaf(int leafnum);
+	void FloodLeaf(int leafnum);
+	void FinishMatrix();
+	void BuildNodes();
+	void FreeLevelCopy();
+	void FreeWorkData();
+	static bool ClipToSeparators(const FRejectWinding &source, const FRejectWinding &pass, FRejectWinding &target);
+};
+
+//==========================================================================
+//
+// FRejectBuilder :: FRejectBuilder
+//
+//==========================================================================
+
+FRejectBuilder::FRejectBuilder()
+: NumSectors(0), Matrix(NULL), Done(false), BuildTime(0),
+  NodeVertices(NULL), NodeLines(NULL), NodeSides(NULL), PolySpots(NULL), PolyAnchors(NULL),
+  NumNodeVertices(0), NumNodeLines(0), NumNodeSides(0), NumPolySpots(0), NumPolyAnchors(0)
+{
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: ~FRejectBuilder
+//
+//==========================================================================
+
+FRejectBuilder::~FRejectBuilder()
+{
+	if (Matrix != NULL)
+	{
+		delete[] Matrix;
+	}
+	FreeLevelCopy();
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: ClipToSeparators
+//
+// Reduces <target> to the part that can be seen from <source> through
+// <pass>. In 2D the lines through one end of the source and the opposite
+// end of the pass portal bound that region. Returns false if nothing
+// of the target is left.
+//
+//==========================================================================
+
+bool FRejectBuilder::ClipToSeparators(const FRejectWinding &source, const FRejectWinding &pass, FRejectWinding &target)
+{
+	const double sx[2] = { source.x1, source.x2 }, sy[2] = { source.y1, source.y2 };
+	const double px[2] = { pass.x1, pass.x2 }, py[2] = { pass.y1, pass.y2 };
+
+	for (int i = 0; i < 2; ++i)
+	{
+		for (int j = 0; j < 2; ++j)
+		{
+			double dx = px[j] - sx[i];
+			double dy = py[j] - sy[i];
+			double len = sqrt(dx*dx + dy*dy);
+
+			if (len < REJECT_EPSILON)
+			{
+				continue;
+			}
+			dx /= len;
+			dy /= len;
+
+			// Distances of the other source and pass ends from this line.
+			double so = (sx[1-i] - sx[i]) * dy - (sy[1-i] - sy[i]) * dx;
+			double po = (px[1-j] - sx[i]) * dy - (py[1-j] - sy[i]) * dx;
+			double keep;
+
+			if (fabs(so) < REJECT_EPSILON)
+			{
+				if (fabs(po) < REJECT_EPSILON)
+				{
+					continue;		// everything is on one line
+				}
+				keep = po > 0 ? 1 : -1;
+			}
+			else
+			{
+				if (so * po > 0 && fabs(po) >= REJECT_EPSILON)
+				{
+					continue;		// not a separating line
+				}
+				keep = so > 0 ? -1 : 1;
+			}
+
+			double d1 = ((target.x1 - sx[i]) * dy - (target.y1 - sy[i]) * dx) * keep;
+			double d2 = ((target.x2 - sx[i]) * dy - (target.y2 - sy[i]) * dx) * keep;
+
+			if (d1 < -REJECT_EPSILON && d2 < -REJECT_EPSILON)
+			{
+				return false;
+			}
+			if (d1 < -REJECT_EPSILON)
+			{
+				double frac = (d1 + REJECT_EPSILON) / (d1 - d2);
+				target.x1 += (target.x2 - target.x1) * frac;
+				target.y1 += (target.y2 - target.y1) * frac;
+			}
+			else if (d2 < -REJECT_EPSILON)
+			{
+				double frac = (d2 + REJECT_EPSILON) / (d2 - d1);
+				target.x2 += (target.x1 - target.x2) * frac;
+				target.y2 += (target.y1 - target.y2) * frac;
+			}
+		}
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: FloodLeaf
+//
+// Fallback for leaves whose flow is too expensive: Everything that is
+// connected to it at all counts as visible.
+//
+//==========================================================================
+
+void FRejectBuilder::FloodLeaf(int leafnum)
+{
+	TArray<int> &todo = FloodTodo;
+	TArray<BYTE> &seen = FloodSeen;
+	int source = Leafs[leafnum].Sector;
+
+	memset(&seen[0], 0, seen.Size());
+	todo.Push(leafnum);
+	seen[leafnum] = true;
+	while (todo.Pop(leafnum))
+	{
+		const FRejectLeaf &leaf = Leafs[leafnum];
+
+		SetVisible(source, leaf.Sector);
+		for (unsigned i = 0; i < leaf.NumPortals; ++i)
+		{
+			int next = Portals[leaf.FirstPortal + i].Leaf;
+			if (!seen[next])
+			{
+				seen[next] = true;
+				todo.Push(next);
+			}
+		}
+	}
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: FlowLeaf
+//
+// Marks everything that can be seen from anywhere inside the leaf. This
+// is done with an explicit stack because the paths through a big map can
+// be far too long for recursion on a thread's stack.
+//
+//==========================================================================
+
+void FRejectBuilder::FlowLeaf(int leafnum)
+{
+	const int source = Leafs[leafnum].Sector;
+	const FRejectLeaf &start = Leafs[leafnum];
+	int budget = REJECT_FLOW_BUDGET;
+
+	SetVisible(source, source);
+	OnStack[leafnum] = true;
+
+	for (unsigned p = 0; p < start.NumPortals; ++p)
+	{
+		const FRejectPortal &first = Portals[start.FirstPortal + p];
+		FStackEntry entry;
+
+		if (OnStack[first.Leaf])
+		{
+			continue;
+		}
+		entry.Leaf = first.Leaf;
+		entry.NextPortal = 0;
+		entry.Pass = first.Winding;
+		Stack.Push(entry);
+		OnStack[first.Leaf] = true;
+		SetVisible(source, Leafs[first.Leaf].Sector);
+
+		while (Stack.Size() > 0)
+		{
+			FStackEntry &top = Stack[Stack.Size() - 1];
+			const FRejectLeaf &leaf = Leafs[top.Leaf];
+
+			if (top.NextPortal >= leaf.NumPortals)
+			{
+				OnStack[top.Leaf] = false;
+				Stack.Pop();
+				continue;
+			}
+
+			const FRejectPortal &portal = Portals[leaf.FirstPortal + top.NextPortal++];
+			FRejectWinding target = portal.Winding;
+
+			if (OnStack[portal.Leaf])
+			{
+				continue;
+			}
+			if (--budget < 0)
+			{
+				// Too expensive. Unwind and be generous.
+				while (Stack.Pop(entry))
+				{
+					OnStack[entry.Leaf] = false;
+				}
+				OnStack[leafnum] = false;
+				FloodLeaf(leafnum);
+				return;
+			}
+			if (!ClipToSeparators(first.Winding, top.Pass, target))
+			{
+				continue;
+			}
+			SetVisible(source, Leafs[portal.Leaf].Sector);
+			entry.Leaf = portal.Leaf;
+			entry.NextPortal = 0;
+			entry.Pass = target;
+			OnStack[portal.Leaf] = true;
+			Stack.Push(entry);		// invalidates <top>
+		}
+	}
+	OnStack[leafnum] = false;
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: FinishMatrix
+//
+// Makes the visibility symmetric, widens it by one sector in each
+// direction (actors right at a line may count as being in the sector on
+// the other side, and the sight trace's starting point may be nudged across
+// it) and converts it into a REJECT table.
+//
+//==========================================================================
+
+void FRejectBuilder::FinishMatrix()
+{
+	int i, j;
+
+	for (i = 0; i < NumSectors; ++i)
+	{
+		for (j = i + 1; j < NumSectors; ++j)
+		{
+			bool ij = !!(Visible[i * RowSize + (j >> 3)] & (1 << (j & 7)));
+			bool ji = !!(Visible[j * RowSize + (i >> 3)] & (1 << (i & 7)));
+			if (ij != ji)
+			{
+				SetVisible(i, j);
+				SetVisible(j, i);
+			}
+		}
+	}
+
+	memcpy(&Widened[0], &Visible[0], Visible.Size());
+	for (unsigned n = 0; n < Neighbors.Size(); n += 2)
+	{
+		int a = Neighbors[n], b = Neighbors[n+1];
+		for (unsigned k = 0; k < RowSize; ++k)
+		{
+			Widened[a * RowSize + k] |= Visible[b * RowSize + k];
+			Widened[b * RowSize + k] |= Visible[a * RowSize + k];
+		}
+	}
+	memcpy(&Visible[0], &Widened[0], Visible.Size());
+
+	memset(Matrix, 0, (NumSectors * NumSectors + 7) >> 3);
+	for (i = 0; i < NumSectors; ++i)
+	{
+		for (j = 0; j < NumSectors; ++j)
+		{
+			if (!(Visible[i * RowSize + (j >> 3)] & (1 << (j & 7))) &&
+				!(Visible[j * RowSize + (i >> 3)] & (1 << (i & 7))))
+			{
+				int pnum = i * NumSectors + j;
+				Matrix[pnum >> 3] |= 1 << (pnum & 7);
+			}
+		}
+	}
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: CopyLevel
+//
+// Copies what the node builder needs, so that Run does not read level data
+// the game may change while it runs. The copies are made with new instead
+// of TArray, because M_Malloc memory must be freed by the same thread and
+// in the same accounting mode it was allocated in.
+//
+//==========================================================================
+
+void FRejectBuilder::CopyLevel(MapData *map)
+{
+	TArray<FNodeBuilder::FPolyStart> polyspots, anchors;
+	int i;
+
+	P_GetPolySpots (map, polyspots, anchors);
+	NumPolySpots = polyspots.Size();
+	NumPolyAnchors = anchors.Size();
+	PolySpots = new FNodeBuilder::FPolyStart[NumPolySpots + 1];
+	PolyAnchors = new FNodeBuilder::FPolyStart[NumPolyAnchors + 1];
+	for (i = 0; i < NumPolySpots; ++i)
+	{
+		PolySpots[i] = polyspots[i];
+	}
+	for (i = 0; i < NumPolyAnchors; ++i)
+	{
+		PolyAnchors[i] = anchors[i];
+	}
+
+	// Only plain data is read from these, so they are copied as bytes.
+	NumNodeVertices = numvertexes;
+	NumNodeLines = numlines;
+	NumNodeSides = numsides;
+	NodeVertices = (vertex_t *)new BYTE[numvertexes * sizeof(vertex_t)];
+	NodeLines = (line_t *)new BYTE[numlines * sizeof(line_t)];
+	NodeSides = (side_t *)new BYTE[numsides * sizeof(side_t)];
+	memcpy(NodeVertices, vertexes, numvertexes * sizeof(vertex_t));
+	memcpy(NodeLines, lines, numlines * sizeof(line_t));
+	memcpy(NodeSides, sides, numsides * sizeof(side_t));
+
+	// Point everything the node builder follows at the copies.
+	for (i = 0; i < numlines; ++i)
+	{
+		line_t *line = &NodeLines[i];
+
+		line->v1 = NodeVertices + (lines[i].v1 - vertexes);
+		line->v2 = NodeVertices + (lines[i].v2 - vertexes);
+		for (int j = 0; j < 2; ++j)
+		{
+			if (lines[i].sidedef[j] != NULL)
+			{
+				line->sidedef[j] = NodeSides + (lines[i].sidedef[j] - sides);
+			}
+		}
+	}
+	for (i = 0; i < numsides; ++i)
+	{
+		NodeSides[i].linedef = NodeLines + (sides[i].linedef - lines);
+	}
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: FreeLevelCopy
+//
+//==========================================================================
+
+void FRejectBuilder::FreeLevelCopy()
+{
+	if (NodeLines != NULL)
+	{
+		delete[] (BYTE *)NodeVertices;
+		delete[] (BYTE *)NodeLines;
+		delete[] (BYTE *)NodeSides;
+		delete[] PolySpots;
+		delete[] PolyAnchors;
+		NodeVertices = NULL;
+		NodeLines = NULL;
+		NodeSides = NULL;
+		PolySpots = PolyAnchors = NULL;
+	}
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: AddLeafs
+//
+// Makes a leaf for every subsector of the GL nodes and a portal for every
+// seg that has a partner in another subsector.
+//
+//==========================================================================
+
+void FRejectBuilder::AddLeafs(seg_t *segs, glsegextra_t *extras, int numsegs, subsector_t *subs, int numsubs)
+{
+	TArray<int> segleaf;
+	int i;
+
+	segleaf.Resize(numsegs);
+	Leafs.Resize(numsubs);
+	for (i = 0; i < numsubs; ++i)
+	{
+		FRejectLeaf &leaf = Leafs[i];
+		seg_t *first = subs[i].firstline;
+
+		leaf.Sector = 0;
+		for (DWORD j = 0; j < subs[i].numlines; ++j)
+		{
+			segleaf[int(first - segs) + j] = i;
+			if (first[j].sidedef != NULL)
+			{
+				leaf.Sector = int(first[j].sidedef->sector - sectors);
+			}
+		}
+	}
+	for (i = 0; i < numsubs; ++i)
+	{
+		FRejectLeaf &leaf = Leafs[i];
+		seg_t *first = subs[i].firstline;
+
+		leaf.FirstPortal = Portals.Size();
+		for (DWORD j = 0; j < subs[i].numlines; ++j)
+		{
+			seg_t *seg = &first[j];
+			DWORD partner = extras[seg - segs].PartnerSeg;
+
+			if (partner < (DWORD)numsegs && (seg->linedef == NULL || seg->linedef->backsector != NULL))
+			{
+				FRejectPortal portal;
+				portal.Winding.x1 = FIXED2DBL(seg->v1->x);
+				portal.Winding.y1 = FIXED2DBL(seg->v1->y);
+				portal.Winding.x2 = FIXED2DBL(seg->v2->x);
+				portal.Winding.y2 = FIXED2DBL(seg->v2->y);
+				portal.Leaf = segleaf[partner];
+				Portals.Push(portal);
+			}
+		}
+		leaf.NumPortals = Portals.Size() - leaf.FirstPortal;
+	}
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: BuildNodes
+//
+// Builds GL nodes from the copy of the level and makes the leafs from
+// them. Runs on the job's thread.
+//
+//==========================================================================
+
+void FRejectBuilder::BuildNodes()
+{
+	TArray<FNodeBuilder::FPolyStart> polyspots, anchors;
+	node_t *bnodes;
+	seg_t *bsegs;
+	glsegextra_t *bextras;
+	subsector_t *bsubs;
+	vertex_t *bverts;
+	int bnumnodes, bnumsegs, bnumsubs, bnumverts;
+	int i;
+
+	for (i = 0; i < NumPolySpots; ++i)
+	{
+		polyspots.Push(PolySpots[i]);
+	}
+	for (i = 0; i < NumPolyAnchors; ++i)
+	{
+		anchors.Push(PolyAnchors[i]);
+	}
+
+	FNodeBuilder::FLevel leveldata =
+	{
+		NodeVertices, NumNodeVertices,
+		NodeSides, NumNodeSides,
+		NodeLines, NumNodeLines,
+		0, 0, 0, 0
+	};
+	leveldata.FindMapBounds ();
+	{
+		FNodeBuilder builder (leveldata, polyspots, anchors, true, true);
+		builder.Extract (bnodes, bnumnodes,
+			bsegs, bextras, bnumsegs,
+			bsubs, bnumsubs,
+			bverts, bnumverts);
+	}
+	AddLeafs(bsegs, bextras, bnumsegs, bsubs, bnumsubs);
+
+	delete[] bnodes;
+	delete[] bsegs;
+	delete[] bextras;
+	delete[] bsubs;
+	delete[] bverts;
+	FreeLevelCopy();
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: FreeWorkData
+//
+// Frees everything BuildNodes and Prepare allocated on the job's thread.
+//
+//==========================================================================
+
+void FRejectBuilder::FreeWorkData()
+{
+	Leafs.Clear();		Leafs.ShrinkToFit();
+	Portals.Clear();	Portals.ShrinkToFit();
+	Visible.Clear();	Visible.ShrinkToFit();
+	Widened.Clear();	Widened.ShrinkToFit();
+	OnStack.Clear();	OnStack.ShrinkToFit();
+	Stack.Clear();		Stack.ShrinkToFit();
+	FloodTodo.Clear();	FloodTodo.ShrinkToFit();
+	FloodSeen.Clear();	FloodSeen.ShrinkToFit();
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: Prepare
+//
+// Allocates everything the flow needs. No leaf can be on the stack or in
+// the flood list twice, so neither ever has to hold more than one entry
+// per leaf.
+//
+//==========================================================================
+
+void FRejectBuilder::Prepare()
+{
+	RowSize = (NumSectors + 7) >> 3;
+	Visible.Resize(RowSize * NumSectors);
+	memset(&Visible[0], 0, Visible.Size());
+	Widened.Resize(Visible.Size());
+	OnStack.Resize(Leafs.Size());
+	memset(&OnStack[0], 0, OnStack.Size());
+	Stack.Grow(Leafs.Size());
+	FloodTodo.Grow(Leafs.Size());
+	FloodSeen.Resize(Leafs.Size());
+	Matrix = new BYTE[(NumSectors * NumSectors + 7) >> 3];
+}
+
+//==========================================================================
+//
+// FRejectBuilder :: Run
+//
+// Runs on its own thread and only touches the builder's own data.
+//
+// M_Malloc updates the garbage collector's counters, which only the main
+// thread may do. When the map has GL nodes, P_StartRejectBuilder makes
+// the leafs and calls Prepare, so the flow does not allocate anything.
+// Otherwise, the node builder's memory, the leafs and Prepare's buffers
+// are allocated here without being counted, and are all freed again
+// before Run returns.
+//
+//==========================================================================
+
+void FRejectBuilder::Run()
+{
+	unsigned starttime = I_MSTime();
+	bool buildnodes = NodeLines != NULL;
+
+	if (buildnodes)
+	{
+		M_BeginUncounted();
+		BuildNodes();
+		Prepare();
+	}
+	for (unsigned i = 0; i < Leafs.Size(); ++i)
+	{
+		FlowLeaf(i);
+	}
+	FinishMatrix();
+	if (buildnodes)
+	{
+		FreeWorkData();
+		M_EndUncounted();
+	}
+	BuildTime = I_MSTime() - starttime;
+	Done = true;
+}
+
+//==========================================================================
+//
+// Cache handling
+//
+//==========================================================================
+
+static BYTE *LoadCachedReject(const BYTE checksum[16])
+{
+	MappedFileReader *fr = P_OpenCacheFile(P_GetCacheFileName("reject", checksum, ".rej", false));
+	BYTE *matrix = NULL;
+	uLongf size = (numsectors * numsectors + 7) >> 3;
+	DWORD complen;
+
+	if (fr == NULL)
+	{
+		return NULL;
+	}
+
+	const BYTE *data = (const BYTE *)fr->GetBuffer();
+	long len = fr->GetLength();
+
+	if (len >= 28 &&
+		memcmp(data, "REJ1", 4) == 0 &&
+		LittleLong(*(const DWORD *)(data + 4)) == (DWORD)numsectors &&
+		memcmp(data + 8, checksum, 16) == 0)
+	{
+		complen = LittleLong(*(const DWORD *)(data + 24));
+		matrix = new BYTE[size];
+		if (complen > (DWORD)(len - 28) ||
+			uncompress(matrix, &size, data + 28, complen) != Z_OK ||
+			size != (uLongf)((numsectors * numsectors + 7) >> 3))
+		{
+			delete[] matrix;
+			matrix = NULL;
+		}
+	}
+	delete fr;
+	return matrix;
+}
+
+static void SaveCachedReject(const BYTE checksum[16], const BYTE *matrix)
+{
+	uLong size = (numsectors * numsectors + 7) >> 3;
+	uLongf complen = compressBound(size);
+	BYTE *compressed = new BYTE[complen + 28];
+
+	if (compress(compressed + 28, &complen, matrix, size) == Z_OK)
+	{
+		memcpy(compressed, "REJ1", 4);
+		*(DWORD *)(compressed + 4) = LittleLong((DWORD)numsectors);
+		memcpy(compressed + 8, checksum, 16);
+		*(DWORD *)(compressed + 24) = LittleLong((DWORD)complen);
+
+		FString path = P_GetCacheFileName("reject", checksum, ".rej", true);
+		FILE *f = fopen(path, "wb");
+		if (f != NULL)
+		{
+			fwrite(compressed, 1, complen + 28, f);
+			fclose(f);
+			P_TrimCache();
+		}
+	}
+	delete[] compressed;
+}
+
+//==========================================================================
+//
+// P_StartRejectBuilder
+//
+// Called by P_SetupLevel after the nodes have been loaded. If the map
+// needs a REJECT table and there is none in the cache, the level's
+// geometry is copied and the table is built on a background thread,
+// together with GL nodes if the map does not have any.
+//
+//==========================================================================
+
+static FRejectBuilder *RejectBuilder;
+
+void P_StartRejectBuilder(MapData *map, bool hasglnodes)
+{
+	BYTE checksum[16];
+
+	P_CancelRejectBuilder();
+	rejectgenerated = false;
+	if (!genreject || rejectmatrix != NULL || numsectors == 0 || numlines == 0)
+	{
+		return;
+	}
+
+	map->GetChecksum(checksum);
+	if ((rejectmatrix = LoadCachedReject(checksum)) != NULL)
+	{
+		DPrintf("Using cached REJECT\n");
+		rejectgenerated = true;
+		return;
+	}
+
+	FRejectBuilder *job = new FRejectBuilder;
+	int i;
+
+	job->NumSectors = numsectors;
+	memcpy(job->Checksum, checksum, 16);
+
+	for (i = 0; i < numlines; ++i)
+	{
+		if (lines[i].frontsector != NULL && lines[i].backsector != NULL &&
+			lines[i].frontsector != lines[i].backsector)
+		{
+			job->Neighbors.Push(int(lines[i].frontsector - sectors));
+			job->Neighbors.Push(int(lines[i].backsector - sectors));
+		}
+	}
+
+	RejectBuilder = job;
+	if (!hasglnodes || glsegextras == NULL)
+	{
+		// Only GL nodes know which subsectors are next to each other.
+		// The job builds them itself.
+		job->CopyLevel(map);
+	}
+	else
+	{
+		job->AddLeafs(segs, glsegextras, numsegs, subsectors, numsubsectors);
+		job->Prepare();
+	}
+	job->Start();
+}
+
+//==========================================================================
+//
+// P_FinishRejectBuilder
+//
+// Installs the generated table once it is done. With <wait> set this
+// blocks until then, which is what P_SetupLevel does for games that must
+// stay in sync. Otherwise it is polled at the beginning of every tic.
+//
+//==========================================================================
+
+void P_FinishRejectBuilder(bool wait)
+{
+	FRejectBuilder *job = RejectBuilder;
+
+	if (job == NULL || (!wait && !job->Done))
+	{
+		return;
+	}
+	job->Wait();
+	RejectBuilder = NULL;
+
+	assert(rejectmatrix == NULL);
+	rejectmatrix = job->Matrix;
+	rejectgenerated = true;
+	job->Matrix = NULL;
+	DPrintf("REJECT generation took %.3f sec\n", job->BuildTime * 0.001);
+	SaveCachedReject(job->Checksum, rejectmatrix);
+	delete job;
+}
+
+//==========================================================================
+//
+// P_CancelRejectBuilder
+//
+//==========================================================================
+
+void P_CancelRejectBuilder()
+{
+	if (RejectBuilder != NULL)
+	{
+		RejectBuilder->Wait();
+		delete RejectBuilder;
+		RejectBuilder = NULL;
+	}
+}
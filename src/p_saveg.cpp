@@ -483,6 +483,12 @@ FArchive &operator<< (FArchive &arc, sector_t::splane &p)
 
 void P_SerializeThinkers (FArchive &arc, bool hubLoad)
 {
+	if (arc.IsLoading ())
+	{
+		// Loaded actors put themselves back into the TID hash, so start
+		// with an empty table instead of one full of emptied chains.
+		AActor::ClearTIDHashes ();
+	}
 	DImpactDecal::SerializeTime (arc);
 	DThinker::SerializeAll (arc, hubLoad);
 }
@@ -36,6 +36,7 @@
 
 class FArchive;
 struct PNGHandle;
+class FileWriter;
 
 // Persistent storage/archiving.
 // These are the load / save game routines.
@@ -48,6 +49,6 @@ void P_SerializeSubsectors(FArchive &arc);
 void P_SerializeSounds (FArchive &arc);
 
 void P_ReadACSDefereds (PNGHandle *png);
-void P_WriteACSDefereds (FILE *file);
+void P_WriteACSDefereds (FileWriter *file);
 
 #endif // __P_SAVEG_H__
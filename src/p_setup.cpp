@@ -68,6 +68,7 @@
 #include "po_man.h"
 #include "r_renderer.h"
 #include "r_data/colormaps.h"
+#include "profiler.h"
 
 #include "fragglescript/t_fs.h"
 
@@ -85,11 +86,14 @@ extern bool P_LoadBuildMap (BYTE *mapdata, size_t len, FMapThing **things, int *
 extern void P_TranslateTeleportThings (void);
 
 void P_ParseTextMap(MapData *map, FMissingTextureTracker &);
+void G_NodeBenchmarkLevel (FNodeBuilder::FLevel &leveldata, TArray<FNodeBuilder::FPolyStart> &polyspots,
+	TArray<FNodeBuilder::FPolyStart> &anchors, bool buildGLNodes);
 
 extern int numinterpolations;
 extern unsigned int R_OldBlend;
 
 EXTERN_CVAR(Bool, am_textured)
+EXTERN_CVAR(Bool, gl_cachenodes)
 
 CVAR (Bool, genblockmap, false, CVAR_SERVERINFO|CVAR_GLOBALCONFIG);
 CVAR (Bool, gennodes, false, CVAR_SERVERINFO|CVAR_GLOBALCONFIG);
@@ -169,7 +173,7 @@ fixed_t 		bmaporgy;
 int				bmapnegx;		// min negs of block map before wrapping
 int				bmapnegy;
 
-FBlockNode**	blocklinks;		// for thing chains
+FBlockThings*	blockthings;	// for thing chains
 
 
 // REJECT
@@ -511,6 +515,13 @@ void MapData::GetChecksum(BYTE cksum[16])
 {
 	MD5Context md5;
 
+	// The caches for nodes, blockmap and REJECT all need it, so it is only
+	// calculated once.
+	if (HasChecksum)
+	{
+		memcpy(cksum, Checksum, 16);
+		return;
+	}
 	if (file != NULL)
 	{
 		if (isText)
@@ -541,6 +552,8 @@ void MapData::GetChecksum(BYTE cksum[16])
 		}
 	}
 	md5.Final(cksum);
+	memcpy(Checksum, cksum, 16);
+	HasChecksum = true;
 }
 
 
@@ -2707,7 +2720,7 @@ static void CreatePackedBlockmap (TArray<int> &BlockMap, TArray<int> *blocks, in
 #define BLOCKBITS 7
 #define BLOCKSIZE 128
 
-static void P_CreateBlockMap ()
+static int P_CreateBlockMap ()
 {
 	TArray<int> *BlockLists, *block, *endblock;
 	int adder;
@@ -2873,6 +2886,7 @@ static void P_CreateBlockMap ()
 	{
 		blockmaplump[ii] = BlockMap[ii];
 	}
+	return BlockMap.Size();
 }
 
 
@@ -2948,6 +2962,122 @@ static bool P_VerifyBlockMap(int count)
 	return true;
 }
 
+//===========================================================================
+//
+// P_LoadCachedBlockMap
+//
+// A cached blockmap is stored as a header, followed by the zlib-compressed
+// blockmaplump as little-endian ints. It is checked with P_VerifyBlockMap
+// before it is used.
+//
+//===========================================================================
+
+static bool P_LoadCachedBlockMap (const BYTE checksum[16])
+{
+	MappedFileReader *fr = P_OpenCacheFile (P_GetCacheFileName ("blockmap", checksum, ".bmp", false));
+	bool ok = false;
+
+	if (fr == NULL)
+	{
+		return false;
+	}
+
+	const BYTE *data = (const BYTE *)fr->GetBuffer();
+	long len = fr->GetLength();
+
+	if (len > 28 && memcmp(data, "BMP1", 4) == 0 &&
+		LittleLong(*(const DWORD *)(data + 4)) == (DWORD)numlines &&
+		memcmp(data + 8, checksum, 16) == 0)
+	{
+		DWORD count = LittleLong(*(const DWORD *)(data + 24));
+		uLongf size = count * sizeof(int);
+
+		if (count >= 4 && count < 0x10000000)
+		{
+			blockmaplump = new int[count];
+			if (uncompress ((Bytef *)blockmaplump, &size, data + 28, len - 28) == Z_OK &&
+				size == count * sizeof(int))
+			{
+				for (DWORD i = 0; i < count; ++i)
+				{
+					blockmaplump[i] = LittleLong(blockmaplump[i]);
+				}
+				ok = P_VerifyBlockMap (count);
+			}
+			if (!ok)
+			{
+				delete[] blockmaplump;
+				blockmaplump = NULL;
+			}
+		}
+	}
+	delete fr;
+	return ok;
+}
+
+//===========================================================================
+//
+// P_SaveCachedBlockMap
+//
+//===========================================================================
+
+static void P_SaveCachedBlockMap (const BYTE checksum[16], int count)
+{
+	uLong size = count * sizeof(int);
+	uLongf complen = compressBound (size);
+	int *swapped = new int[count];
+	BYTE *compressed = new BYTE[complen + 28];
+
+	for (int i = 0; i < count; ++i)
+	{
+		swapped[i] = LittleLong(blockmaplump[i]);
+	}
+	if (compress (compressed + 28, &complen, (const Bytef *)swapped, size) == Z_OK)
+	{
+		memcpy (compressed, "BMP1", 4);
+		*(DWORD *)(compressed + 4) = LittleLong((DWORD)numlines);
+		memcpy (compressed + 8, checksum, 16);
+		*(DWORD *)(compressed + 24) = LittleLong((DWORD)count);
+
+		FString path = P_GetCacheFileName ("blockmap", checksum, ".bmp", true);
+		FILE *f = fopen (path, "wb");
+		if (f != NULL)
+		{
+			fwrite (compressed, 1, complen + 28, f);
+			fclose (f);
+			P_TrimCache ();
+		}
+	}
+	delete[] compressed;
+	delete[] swapped;
+}
+
+//===========================================================================
+//
+// P_GenerateBlockMap
+//
+// Takes the blockmap from the cache or creates it and puts it there.
+//
+//===========================================================================
+
+static void P_GenerateBlockMap (MapData *map)
+{
+	BYTE checksum[16];
+
+	map->GetChecksum (checksum);
+	if (gl_cachenodes && P_LoadCachedBlockMap (checksum))
+	{
+		DPrintf ("Using cached BLOCKMAP\n");
+		return;
+	}
+	DPrintf ("Generating BLOCKMAP\n");
+	int count = P_CreateBlockMap ();
+	if (gl_cachenodes)
+	{
+		P_SaveCachedBlockMap (checksum, count);
+	}
+}
+
 //
 // P_LoadBlockMap
 //
@@ -2966,8 +3096,7 @@ void P_LoadBlockMap (MapData * map)
 		Args->CheckParm("-blockmap")
 		)
 	{
-		DPrintf ("Generating BLOCKMAP\n");
-		P_CreateBlockMap ();
+		P_GenerateBlockMap (map);
 	}
 	else
 	{
@@ -2998,8 +3127,8 @@ void P_LoadBlockMap (MapData * map)
 
 		if (!P_VerifyBlockMap(count))
 		{
-			DPrintf ("Generating BLOCKMAP\n");
-			P_CreateBlockMap();
+			delete[] blockmaplump;
+			P_GenerateBlockMap (map);
 		}
 
 	}
@@ -3015,9 +3144,7 @@ void P_LoadBlockMap (MapData * map)
 	bmapnegy = bmapheight > 255 ? bmapheight - 512 : -257;
 
 	// clear out mobj chains
-	count = bmapwidth*bmapheight;
-	blocklinks = new FBlockNode *[count];
-	memset (blocklinks, 0, count*sizeof(*blocklinks));
+	P_InitBlockThings ();
 	blockmap = blockmaplump+4;
 }
 
@@ -3438,11 +3565,7 @@ void P_FreeLevelData ()
 		delete[] blockmaplump;
 		blockmaplump = NULL;
 	}
-	if (blocklinks != NULL)
-	{
-		delete[] blocklinks;
-		blocklinks = NULL;
-	}
+	P_FreeBlockThings ();
 	if (PolyBlockMap != NULL)
 	{
 		for (int i = bmapwidth*bmapheight-1; i >= 0; --i)
@@ -3458,6 +3581,7 @@ void P_FreeLevelData ()
 		delete[] PolyBlockMap;
 		PolyBlockMap = NULL;
 	}
+	P_CancelRejectBuilder ();
 	if (rejectmatrix != NULL)
 	{
 		delete[] rejectmatrix;
@@ -3493,19 +3617,9 @@ extern msecnode_t *headsecnode;
 
 void P_FreeExtraLevelData()
 {
-	// Free all blocknodes and msecnodes.
+	// Free all msecnodes.
 	// *NEVER* call this function without calling
 	// P_FreeLevelData() first, or they might not all be freed.
-	{
-		FBlockNode *node = FBlockNode::FreeBlocks;
-		while (node != NULL)
-		{
-			FBlockNode *next = node->NextBlock;
-			delete node;
-			node = next;
-		}
-		FBlockNode::FreeBlocks = NULL;
-	}
 	{
 		msecnode_t *node = headsecnode;
 
@@ -3526,6 +3640,7 @@ void P_FreeExtraLevelData()
 // [RH] position indicates the start spot to spawn at
 void P_SetupLevel (char *lumpname, int position)
 {
+	PROFILE_ZONE("P_SetupLevel");
 	cycle_t times[20];
 	FMapThing *buildthings;
 	int numbuildthings;
@@ -3545,6 +3660,10 @@ void P_SetupLevel (char *lumpname, int position)
 	level.maptype = MAPTYPE_UNKNOWN;
 	wminfo.partime = 180;
 
+	// Whatever the last level did not use of its prefetched lumps is not
+	// going to be used now.
+	Wads.FlushPrefetch();
+
 	MapThingsConverted.Clear();
 	MapThingsUserDataIndex.Clear();
 	MapThingsUserData.Clear();
@@ -3849,13 +3968,19 @@ void P_SetupLevel (char *lumpname, int position)
 	}
 	else reloop = true;
 
-	unsigned int startTime=0, endTime=0;
-
 	bool BuildGLNodes;
-	if (ForceNodeBuild)
+	// Nodes that were built for this map before may be in the cache.
+	if (ForceNodeBuild && !nodebenchmarking && P_LoadCachedNodes(map, &oldvertextable))
+	{
+		BuildGLNodes = true;
+		reloop = true;
+	}
+	else if (ForceNodeBuild)
 	{
 		BuildGLNodes = RequireGLNodes || multiplayer || demoplayback || demorecording || genglnodes;
 
+		unsigned int startTime, endTime;
+
 		startTime = I_FPSTime ();
 		TArray<FNodeBuilder::FPolyStart> polyspots, anchors;
 		P_GetPolySpots (map, polyspots, anchors);
@@ -3867,6 +3992,10 @@ void P_SetupLevel (char *lumpname, int position)
 			0, 0, 0, 0
 		};
 		leveldata.FindMapBounds ();
+		if (nodebenchmarking)
+		{
+			G_NodeBenchmarkLevel (leveldata, polyspots, anchors, BuildGLNodes);
+		}
 		// We need GL nodes if am_textured is on.
 		// In case a sync critical game mode is started, also build GL nodes to avoid problems
 		// if the different machines' am_textured setting differs.
@@ -3879,6 +4008,10 @@ void P_SetupLevel (char *lumpname, int position)
 		endTime = I_FPSTime ();
 		DPrintf ("BSP generation took %.3f sec (%d segs)\n", (endTime - startTime) * 0.001, numsegs);
 		oldvertextable = builder.GetOldVertexTable();
+		if (BuildGLNodes)
+		{
+			P_CacheNodes(map, endTime - startTime);
+		}
 		reloop = true;
 	}
 	else
@@ -3924,7 +4057,7 @@ void P_SetupLevel (char *lumpname, int position)
 		// If the original nodes being loaded are not GL nodes they will be kept around for
 		// use in P_PointInSubsector to avoid problems with maps that depend on the specific
 		// nodes they were built with (P:AR E1M3 is a good example for a map where this is the case.)
-		reloop |= P_CheckNodes(map, BuildGLNodes, endTime - startTime);
+		reloop |= P_CheckNodes(map, BuildGLNodes);
 		hasglnodes = true;
 	}
 	else
@@ -3938,6 +4071,7 @@ void P_SetupLevel (char *lumpname, int position)
 
 	times[11].Clock();
 	P_LoadReject (map, buildmap);
+	P_StartRejectBuilder (map, hasglnodes);
 	times[11].Unclock();
 
 	times[12].Clock();
@@ -4085,6 +4219,9 @@ void P_SetupLevel (char *lumpname, int position)
 		AnnounceGameStart ();
 	}
 
+	// A generated REJECT must be in place from the start in games that need
+	// to stay in sync. Otherwise it is picked up when it is done.
+	P_FinishRejectBuilder (multiplayer || demoplayback || demorecording);
 	P_ResetSightCounters (true);
 	//Printf ("free memory: 0x%x\n", Z_FreeMemory());
 
@@ -38,9 +38,11 @@ struct MapData
 	bool Encrypted;
 	bool isText;
 	bool InWad;
+	bool HasChecksum;
 	int lumpnum;
 	FileReader * file;
 	FResourceFile * resource;
+	BYTE Checksum[16];
 	
 	MapData()
 	{
@@ -52,6 +54,7 @@ struct MapData
 		Encrypted = false;
 		isText = false;
 		InWad = false;
+		HasChecksum = false;
 	}
 	
 	~MapData()
@@ -122,9 +125,19 @@ int GetUDMFInt(int type, int index, const char *key);
 fixed_t GetUDMFFixed(int type, int index, const char *key);
 
 bool P_LoadGLNodes(MapData * map);
-bool P_CheckNodes(MapData * map, bool rebuilt, int buildtime);
+bool P_CheckNodes(MapData * map, bool rebuilt);
 bool P_CheckForGLNodes();
 void P_SetRenderSector();
+bool P_LoadCachedNodes(MapData *map, const int **oldvertextable);
+void P_CacheNodes(MapData *map, int buildtime);
+FString GetCachePath();
+FString P_GetCacheFileName(const char *dir, const BYTE checksum[16], const char *ext, bool create);
+MappedFileReader *P_OpenCacheFile(const char *path);
+void P_TrimCache();
+
+void P_StartRejectBuilder(MapData *map, bool hasglnodes);
+void P_FinishRejectBuilder(bool wait);
+void P_CancelRejectBuilder();
 
 
 struct sidei_t	// [RH] Only keep BOOM sidedef init stuff around for init
@@ -19,6 +19,8 @@
 #include "p_lnspec.h"
 #include "g_level.h"
 #include "po_man.h"
+#include "workerpool.h"
+#include "c_cvars.h"
 
 // State.
 #include "r_state.h"
@@ -39,14 +41,94 @@ This uses specialized forms of the maputils routines for optimized performance
 */
 
 // Performance meters
-static int sightcounts[6];
 static cycle_t SightCycles;
 static cycle_t MaxSightCycles;
+static int SightBatches;
+static int SightPrefetches;
+static int SightCacheHits, SightCacheMisses;
 
-static TArray<intercept_t> intercepts (128);
+// Remembers the results of line of sight traces for the rest of the tic
+// (or until something that can change the level geometry runs), since
+// monsters looking for the player tend to ask the same thing repeatedly.
+CVAR (Bool, sightcache, true, 0)
+
+struct FSightCacheEntry
+{
+	const AActor *t1, *t2;
+	fixed_t x1, y1, z1, h1;
+	fixed_t x2, y2, z2, h2;
+	int flags;
+	int epoch;
+	bool result;
+};
+
+enum { SIGHTCACHE_SIZE = 4096 };
+
+static FSightCacheEntry SightCache[SIGHTCACHE_SIZE];
+static int SightCacheEpoch = 1;
+
+//
+// Per-thread state of the sight checker. Context 0 belongs to P_CheckSight
+// and marks lines through their validcount, exactly like it always did.
+// The others are used by FSightBatch's workers which must not write to
+// the level data, so they keep their own visit stamps instead.
+//
+// Workers must not allocate memory either, so Prepare() sizes everything
+// on the main thread before a batch is run. If a trace needs more
+// intercepts than there is room for, it gives up and sets overflow, and
+// the query is left to P_CheckSight. The next batch gets more room.
+//
+struct FSightContext
+{
+	TArray<intercept_t> intercepts;
+	TArray<int> linestamps;
+	TArray<int> polystamps;
+	int stamp;
+	bool overflow;
+	bool overflowed;
+	int sightcounts[6];
+	int queries;
+	cycle_t cycles;
+
+	FSightContext() : intercepts(128), stamp(0), overflow(false), overflowed(false), queries(0)
+	{
+		memset (sightcounts, 0, sizeof(sightcounts));
+		cycles.Reset();
+	}
+
+	void Prepare()
+	{
+		if (linestamps.Size() != (unsigned)numlines || polystamps.Size() != (unsigned)po_NumPolyobjs)
+		{
+			linestamps.Resize(numlines);
+			polystamps.Resize(po_NumPolyobjs);
+			if (numlines > 0) memset (&linestamps[0], 0, numlines * sizeof(int));
+			if (po_NumPolyobjs > 0) memset (&polystamps[0], 0, po_NumPolyobjs * sizeof(int));
+			stamp = 0;
+		}
+		intercepts.Clear();
+		intercepts.Grow(overflowed ? intercepts.Max() * 2 : 128);
+		overflowed = false;
+	}
+
+	void NewStamp()
+	{
+		if (stamp == INT_MAX)
+		{
+			if (numlines > 0) memset (&linestamps[0], 0, numlines * sizeof(int));
+			if (po_NumPolyobjs > 0) memset (&polystamps[0], 0, po_NumPolyobjs * sizeof(int));
+			stamp = 0;
+		}
+		stamp++;
+		overflow = false;
+	}
+};
+
+static FSightContext SightContexts[MAX_WORKER_THREADS + 1];
 
 class SightCheck
 {
+	FSightContext *context;
 	fixed_t sightzstart;				// eye z of looker
 	const AActor * sightthing;
 	const AActor * seeingthing;
@@ -58,6 +140,8 @@ class SightCheck
 	divline_t trace;
 	int myseethrough;
 
+	bool MarkLine (line_t *ld);
+	bool MarkPolyobj (FPolyObj *po);
 	bool PTR_SightTraverse (intercept_t *in);
 	bool P_SightCheckLine (line_t *ld);
 	bool P_SightBlockLinesIterator (int x, int y);
@@ -66,8 +150,9 @@ class SightCheck
 public:
 	bool P_SightPathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2);
 
-	SightCheck(const AActor * t1, const AActor * t2, int flags)
+	SightCheck(const AActor * t1, const AActor * t2, int flags, FSightContext *ctx = &SightContexts[0])
 	{
+		context = ctx;
 		lastztop = lastzbottom = sightzstart = t1->z + t1->height - (t1->height>>2);
 		lastsector = t1->Sector;
 		sightthing=t1;
@@ -80,6 +165,60 @@ public:
 	}
 };
 
+/*
+==============
+=
+= MarkLine / MarkPolyobj
+=
+= Returns false if the line or polyobject was already checked by this trace
+=
+==============
+*/
+
+inline bool SightCheck::MarkLine (line_t *ld)
+{
+	if (context == &SightContexts[0])
+	{
+		if (ld->validcount == validcount)
+		{
+			return false;
+		}
+		ld->validcount = validcount;
+	}
+	else
+	{
+		int &mark = context->linestamps[int(ld - lines)];
+		if (mark == context->stamp)
+		{
+			return false;
+		}
+		mark = context->stamp;
+	}
+	return true;
+}
+
+inline bool SightCheck::MarkPolyobj (FPolyObj *po)
+{
+	if (context == &SightContexts[0])
+	{
+		if (po->validcount == validcount)
+		{
+			return false;
+		}
+		po->validcount = validcount;
+	}
+	else
+	{
+		int &mark = context->polystamps[int(po - polyobjs)];
+		if (mark == context->stamp)
+		{
+			return false;
+		}
+		mark = context->stamp;
+	}
+	return true;
+}
+
 /*
 ==============
 =
@@ -238,11 +377,10 @@ bool SightCheck::P_SightCheckLine (line_t *ld)
 {
 	divline_t dl;
 
-	if (ld->validcount == validcount)
+	if (!MarkLine (ld))
 	{
 		return true;
 	}
-	ld->validcount = validcount;
 	if (P_PointOnDivlineSide (ld->v1->x, ld->v1->y, &trace) ==
 		P_PointOnDivlineSide (ld->v2->x, ld->v2->y, &trace))
 	{
@@ -287,12 +425,17 @@ bool SightCheck::P_SightCheckLine (line_t *ld)
 		}
 	}
 
-	sightcounts[3]++;
+	context->sightcounts[3]++;
+	if (context != &SightContexts[0] && context->intercepts.Size() == context->intercepts.Max())
+	{
+		context->overflow = context->overflowed = true;
+		return false;
+	}
 	// store the line for later intersection testing
 	intercept_t newintercept;
 	newintercept.isaline = true;
 	newintercept.d.line = ld;
-	intercepts.Push (newintercept);
+	context->intercepts.Push (newintercept);
 
 	return true;
 }
@@ -321,9 +464,8 @@ bool SightCheck::P_SightBlockLinesIterator (int x, int y)
 	{
 		if (polyLink->polyobj)
 		{ // only check non-empty links
-			if (polyLink->polyobj->validcount != validcount)
+			if (MarkPolyobj (polyLink->polyobj))
 			{
-				polyLink->polyobj->validcount = validcount;
 				for (i = 0; i < polyLink->polyobj->Linedefs.Size(); i++)
 				{
 					if (!P_SightCheckLine (polyLink->polyobj->Linedefs[i]))
@@ -361,6 +503,7 @@ bool SightCheck::P_SightTraverseIntercepts ()
 	intercept_t *scan, *in;
 	unsigned scanpos;
 	divline_t dl;
+	TArray<intercept_t> &intercepts = context->intercepts;
 
 	count = intercepts.Size ();
 //
@@ -450,8 +593,15 @@ bool SightCheck::P_SightPathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_
 	int mapx, mapy, mapxstep, mapystep;
 	int count;
 
-	validcount++;
-	intercepts.Clear ();
+	if (context == &SightContexts[0])
+	{
+		validcount++;
+	}
+	else
+	{
+		context->NewStamp();
+	}
+	context->intercepts.Clear ();
 
 #ifdef _3DFLOORS
 	// for FF_SEETHROUGH the following rule applies:
@@ -575,7 +725,7 @@ bool SightCheck::P_SightPathTraverse (fixed_t x1, fixed_t y1, fixed_t x2, fixed_
 	{
 		if (!P_SightBlockLinesIterator (mapx, mapy))
 		{
-sightcounts[1]++;
+context->sightcounts[1]++;
 			return false;	// early out
 		}
 
@@ -585,7 +735,7 @@ sightcounts[1]++;
 		switch ((((yintercept >> FRACBITS) == mapy) << 1) | ((xintercept >> FRACBITS) == mapx))
 		{
 		case 0:		// neither xintercept nor yintercept match!
-sightcounts[5]++;
+context->sightcounts[5]++;
 			// Continuing won't make things any better, so we might as well stop right here
 			count = 100;
 			break;
@@ -605,7 +755,7 @@ sightcounts[5]++;
 			break;
 
 		case 3:		// xintercept and yintercept both match
-			sightcounts[4]++;
+			context->sightcounts[4]++;
 			// The trace is exiting a block through its corner. Not only does the block
 			// being entered need to be checked (which will happen when this loop
 			// continues), but the other two blocks adjacent to the corner also need to
@@ -613,7 +763,7 @@ sightcounts[5]++;
 			if (!P_SightBlockLinesIterator (mapx + mapxstep, mapy) ||
 				!P_SightBlockLinesIterator (mapx, mapy + mapystep))
 			{
-sightcounts[1]++;
+context->sightcounts[1]++;
 				return false;
 			}
 			xintercept += xstep;
@@ -632,11 +782,102 @@ sightcounts[1]++;
 //
 // couldn't early out, so go through the sorted list
 //
-sightcounts[2]++;
+context->sightcounts[2]++;
 
 	return P_SightTraverseIntercepts ( );
 }
 
+/*
+=====================
+=
+= P_SightRejected
+= P_SightInvisible
+= P_SightBlockedByHeightSec
+=
+= The individual stages of P_CheckSight before the actual trace. They are
+= shared with FSightBatch, which does them in the same order.
+=
+=====================
+*/
+
+static inline bool P_SightRejected (const AActor *t1, const AActor *t2)
+{
+	int pnum = int(t1->Sector - sectors) * numsectors + int(t2->Sector - sectors);
+
+	return rejectmatrix != NULL &&
+		(rejectmatrix[pnum>>3] & (1 << (pnum & 7)));
+}
+
+// Note that this consumes a random number for invisible targets.
+static bool P_SightInvisible (const AActor *t2, int flags)
+{
+	// [RH] Andy Baker's stealth monsters:
+	// Cannot see an invisible object
+	if ((flags & SF_IGNOREVISIBILITY) == 0 && ((t2->renderflags & RF_INVISIBLE) || !t2->RenderStyle.IsVisible(t2->alpha)))
+	{ // small chance of an attack being made anyway
+		if ((bglobal.m_Thinking ? pr_botchecksight() : pr_checksight()) > 50)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool P_SightBlockedByHeightSec (const AActor *t1, const AActor *t2, int flags)
+{
+	const sector_t *s1 = t1->Sector;
+	const sector_t *s2 = t2->Sector;
+
+	// killough 4/19/98: make fake floors and ceilings block monster view
+
+	if (!(flags & SF_IGNOREWATERBOUNDARY))
+	{
+		if ((s1->GetHeightSec() &&
+			((t1->z + t1->height <= s1->heightsec->floorplane.ZatPoint (t1->x, t1->y) &&
+			  t2->z >= s1->heightsec->floorplane.ZatPoint (t2->x, t2->y)) ||
+			 (t1->z >= s1->heightsec->ceilingplane.ZatPoint (t1->x, t1->y) &&
+			  t2->z + t1->height <= s1->heightsec->ceilingplane.ZatPoint (t2->x, t2->y))))
+			||
+			(s2->GetHeightSec() &&
+			 ((t2->z + t2->height <= s2->heightsec->floorplane.ZatPoint (t2->x, t2->y) &&
+			   t1->z >= s2->heightsec->floorplane.ZatPoint (t1->x, t1->y)) ||
+			  (t2->z >= s2->heightsec->ceilingplane.ZatPoint (t2->x, t2->y) &&
+			   t1->z + t2->height <= s2->heightsec->ceilingplane.ZatPoint (t1->x, t1->y)))))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// Sight cache access
+//
+//==========================================================================
+
+static inline FSightCacheEntry *P_SightCacheEntry (const AActor *t1, const AActor *t2, int flags)
+{
+	return &SightCache[(((size_t)t1 >> 4) ^ ((size_t)t2 >> 2) ^ flags) & (SIGHTCACHE_SIZE - 1)];
+}
+
+static inline bool P_SightCacheMatches (const FSightCacheEntry *entry, const AActor *t1, const AActor *t2, int flags)
+{
+	return entry->epoch == SightCacheEpoch && entry->t1 == t1 && entry->t2 == t2 && entry->flags == flags &&
+		entry->x1 == t1->x && entry->y1 == t1->y && entry->z1 == t1->z && entry->h1 == t1->height &&
+		entry->x2 == t2->x && entry->y2 == t2->y && entry->z2 == t2->z && entry->h2 == t2->height;
+}
+
+static void P_StoreSight (FSightCacheEntry *entry, const AActor *t1, const AActor *t2, int flags, bool res)
+{
+	entry->t1 = t1;		entry->t2 = t2;
+	entry->x1 = t1->x;	entry->y1 = t1->y;	entry->z1 = t1->z;	entry->h1 = t1->height;
+	entry->x2 = t2->x;	entry->y2 = t2->y;	entry->z2 = t2->z;	entry->h2 = t2->height;
+	entry->flags = flags;
+	entry->epoch = SightCacheEpoch;
+	entry->result = res;
+}
+
 /*
 =====================
 =
@@ -663,17 +904,19 @@ bool P_CheckSight (const AActor *t1, const AActor *t2, int flags)
 		return false;
 	}
 
-	const sector_t *s1 = t1->Sector;
-	const sector_t *s2 = t2->Sector;
-	int pnum = int(s1 - sectors) * numsectors + int(s2 - sectors);
-
 //
 // check for trivial rejection
 //
-	if (rejectmatrix != NULL &&
-		(rejectmatrix[pnum>>3] & (1 << (pnum & 7))))
+	// A generated table can be installed in the middle of a level, so it
+	// must not change whether a random number is used here.
+	if (rejectgenerated && P_SightInvisible (t2, flags))
 	{
-sightcounts[0]++;
+		res = false;
+		goto done;
+	}
+	if (P_SightRejected (t1, t2))
+	{
+SightContexts[0].sightcounts[0]++;
 		res = false;			// can't possibly be connected
 		goto done;
 	}
@@ -681,40 +924,35 @@ sightcounts[0]++;
 //
 // check precisely
 //
-	// [RH] Andy Baker's stealth monsters:
-	// Cannot see an invisible object
-	if ((flags & SF_IGNOREVISIBILITY) == 0 && ((t2->renderflags & RF_INVISIBLE) || !t2->RenderStyle.IsVisible(t2->alpha)))
-	{ // small chance of an attack being made anyway
-		if ((bglobal.m_Thinking ? pr_botchecksight() : pr_checksight()) > 50)
-		{
-			res = false;
-			goto done;
-		}
+	if ((!rejectgenerated && P_SightInvisible (t2, flags)) || P_SightBlockedByHeightSec (t1, t2, flags))
+	{
+		res = false;
+		goto done;
 	}
 
-	// killough 4/19/98: make fake floors and ceilings block monster view
+	// An unobstructed LOS is possible.
+	// Now look from eyes of t1 to any part of t2.
 
-	if (!(flags & SF_IGNOREWATERBOUNDARY))
+	if (sightcache)
 	{
-		if ((s1->GetHeightSec() &&
-			((t1->z + t1->height <= s1->heightsec->floorplane.ZatPoint (t1->x, t1->y) &&
-			  t2->z >= s1->heightsec->floorplane.ZatPoint (t2->x, t2->y)) ||
-			 (t1->z >= s1->heightsec->ceilingplane.ZatPoint (t1->x, t1->y) &&
-			  t2->z + t1->height <= s1->heightsec->ceilingplane.ZatPoint (t2->x, t2->y))))
-			||
-			(s2->GetHeightSec() &&
-			 ((t2->z + t2->height <= s2->heightsec->floorplane.ZatPoint (t2->x, t2->y) &&
-			   t1->z >= s2->heightsec->floorplane.ZatPoint (t1->x, t1->y)) ||
-			  (t2->z >= s2->heightsec->ceilingplane.ZatPoint (t2->x, t2->y) &&
-			   t1->z + t2->height <= s2->heightsec->ceilingplane.ZatPoint (t1->x, t1->y)))))
+		FSightCacheEntry *entry = P_SightCacheEntry (t1, t2, flags);
+
+		if (P_SightCacheMatches (entry, t1, t2, flags))
 		{
-			res = false;
+			SightCacheHits++;
+			res = entry->result;
 			goto done;
 		}
-	}
+		SightCacheMisses++;
 
-	// An unobstructed LOS is possible.
-	// Now look from eyes of t1 to any part of t2.
+		validcount++;
+		{
+			SightCheck s(t1, t2, flags);
+			res = s.P_SightPathTraverse (t1->x, t1->y, t2->x, t2->y);
+		}
+		P_StoreSight (entry, t1, t2, flags, res);
+		goto done;
+	}
 
 	validcount++;
 	{
@@ -727,12 +965,251 @@ done:
 	return res;
 }
 
+//==========================================================================
+//
+// P_InvalidateSightCache
+//
+// Must be called whenever something may have changed the level geometry:
+// sector movers, polyobjects, line specials and scripts.
+//
+//==========================================================================
+
+void P_InvalidateSightCache ()
+{
+	if (++SightCacheEpoch == INT_MAX)
+	{
+		memset (SightCache, 0, sizeof(SightCache));
+		SightCacheEpoch = 1;
+	}
+}
+
+//==========================================================================
+//
+// FSightBatch
+//
+// Resolves a set of sight checks at once on the worker pool. Resolve()
+// only does the parts of P_CheckSight that depend on the level geometry.
+// The random chance to see an invisible target is rolled by Result(), so
+// as long as the results are read in the same order as the individual
+// P_CheckSight calls would have been made, the random number sequence is
+// the same and demos stay in sync. The world must not be changed between
+// Resolve() and reading the results.
+//
+//==========================================================================
+
+enum
+{
+	SIGHTQ_Pending,
+	SIGHTQ_Never,		// false without rolling for invisibility
+	SIGHTQ_Rejected,	// false after rolling for invisibility (generated REJECT)
+	SIGHTQ_HeightSec,	// blocked by a fake floor or ceiling
+	SIGHTQ_Blocked,		// blocked by a line
+	SIGHTQ_Visible
+};
+
+class FSightBatchWorker : public FWorkerBatch
+{
+	FSightBatch::FQuery *Queries;
+
+public:
+	FSightBatchWorker (FSightBatch::FQuery *queries)
+		: Queries(queries)
+	{
+	}
+
+	void Execute (int index, int thread)
+	{
+		FSightContext *context = &SightContexts[thread + 1];
+		FSightBatch::FQuery *q = &Queries[index];
+
+		context->cycles.Clock();
+		context->queries++;
+		if (q->t1 == NULL || q->t2 == NULL)
+		{
+			q->result = SIGHTQ_Never;
+		}
+		else if (P_SightRejected (q->t1, q->t2))
+		{
+			context->sightcounts[0]++;
+			q->result = rejectgenerated ? SIGHTQ_Rejected : SIGHTQ_Never;
+		}
+		else if (P_SightBlockedByHeightSec (q->t1, q->t2, q->flags))
+		{
+			q->result = SIGHTQ_HeightSec;
+		}
+		else
+		{
+			SightCheck s(q->t1, q->t2, q->flags, context);
+			bool res = s.P_SightPathTraverse (q->t1->x, q->t1->y, q->t2->x, q->t2->y);
+
+			// If it ran out of room, P_CheckSight has to do it.
+			q->result = context->overflow ? SIGHTQ_Pending : res ? SIGHTQ_Visible : SIGHTQ_Blocked;
+		}
+		context->cycles.Unclock();
+	}
+};
+
+unsigned FSightBatch::Add (const AActor *t1, const AActor *t2, int flags)
+{
+	FQuery q = { t1, t2, flags, SIGHTQ_Pending };
+	return Queries.Push (q);
+}
+
+void FSightBatch::Resolve ()
+{
+	if (Resolved < Queries.Size())
+	{
+		FSightBatchWorker worker(&Queries[Resolved]);
+
+		for (int i = 1; i <= WorkerPool.GetNumThreads(); ++i)
+		{
+			SightContexts[i].Prepare();
+		}
+		WorkerPool.Run (&worker, Queries.Size() - Resolved, 4);
+		Resolved = Queries.Size();
+		SightBatches++;
+	}
+}
+
+bool FSightBatch::Result (unsigned index)
+{
+	const FQuery &q = Queries[index];
+
+	switch (q.result)
+	{
+	case SIGHTQ_Pending:
+		// Not resolved yet, so it is not too late to do it the normal way.
+		return P_CheckSight (q.t1, q.t2, q.flags);
+
+	case SIGHTQ_Never:
+		return false;
+
+	default:
+		if (P_SightInvisible (q.t2, q.flags))
+		{
+			return false;
+		}
+		return q.result == SIGHTQ_Visible;
+	}
+}
+
+void FSightBatch::Clear ()
+{
+	Queries.Clear();
+	Resolved = 0;
+}
+
+//==========================================================================
+//
+// P_PrefetchSight
+//
+// Called by DThinker::RunThinkers before the actors think. Monsters that
+// enter a new state this tic will most likely call A_Look or A_Chase,
+// which check whether they can see a player or their target. Those traces
+// are done here for all of them at once on the worker pool, and the
+// results are put into the sight cache. P_CheckSight only uses a cache
+// entry if neither actor has moved and the level geometry has not changed
+// since, so this never changes what it returns, and the invisibility roll
+// still happens in P_CheckSight itself.
+//
+//==========================================================================
+
+CVAR (Bool, sightprefetch, true, 0)
+
+static FSightBatch SightPrefetch;
+
+static void P_AddSightPrefetch (const AActor *t1, const AActor *t2, int flags)
+{
+	if (t2 != NULL && !P_SightCacheMatches (P_SightCacheEntry (t1, t2, flags), t1, t2, flags))
+	{
+		SightPrefetch.Add (t1, t2, flags);
+	}
+}
+
+void P_PrefetchSight ()
+{
+	if (!sightcache || !sightprefetch || WorkerPool.GetNumThreads() < 2 || numlines == 0)
+	{
+		return;
+	}
+
+	TThinkerIterator<AActor> it(STAT_DEFAULT);
+	AActor *mo;
+
+	SightPrefetch.Clear();
+	while ((mo = it.Next()) != NULL && SightPrefetch.Size() < SIGHTCACHE_SIZE / 2)
+	{
+		if (mo->tics != 1 || mo->health <= 0 || !(mo->flags3 & MF3_ISMONSTER) || mo->player != NULL)
+		{
+			continue;
+		}
+		if (mo->target != NULL)
+		{
+			// A_Chase and P_CheckMissileRange
+			P_AddSightPrefetch (mo, mo->target, 0);
+			P_AddSightPrefetch (mo, mo->target, SF_SEEPASTBLOCKEVERYTHING);
+		}
+		else
+		{
+			// P_LookForPlayers
+			for (int i = 0; i < MAXPLAYERS; ++i)
+			{
+				if (playeringame[i])
+				{
+					P_AddSightPrefetch (mo, players[i].mo, SF_SEEPASTSHOOTABLELINES);
+				}
+			}
+		}
+	}
+
+	// Not worth waking the workers for.
+	if (SightPrefetch.Size() < 16)
+	{
+		return;
+	}
+	SightCycles.Clock();
+	SightPrefetch.Resolve();
+	for (unsigned i = 0; i < SightPrefetch.Size(); ++i)
+	{
+		const FSightBatch::FQuery &q = SightPrefetch.GetQuery(i);
+
+		if (q.result == SIGHTQ_Blocked || q.result == SIGHTQ_Visible)
+		{
+			P_StoreSight (P_SightCacheEntry (q.t1, q.t2, q.flags), q.t1, q.t2, q.flags, q.result == SIGHTQ_Visible);
+		}
+	}
+	SightPrefetches += SightPrefetch.Size();
+	SightCycles.Unclock();
+}
+
 ADD_STAT (sight)
 {
 	FString out;
+	int counts[6] = { 0 };
+	int queries = 0;
+	int i, j;
+
+	for (i = 0; i <= MAX_WORKER_THREADS; ++i)
+	{
+		for (j = 0; j < 6; ++j)
+		{
+			counts[j] += SightContexts[i].sightcounts[j];
+		}
+		queries += SightContexts[i].queries;
+	}
 	out.Format ("%04.1f ms (%04.1f max), %5d %2d%4d%4d%4d%4d\n",
 		SightCycles.TimeMS(), MaxSightCycles.TimeMS(),
-		sightcounts[3], sightcounts[0], sightcounts[1], sightcounts[2], sightcounts[4], sightcounts[5]);
+		counts[3], counts[0], counts[1], counts[2], counts[4], counts[5]);
+	out.AppendFormat ("batched: %d queries in %d batches (%d prefetched), workers:", queries, SightBatches, SightPrefetches);
+	for (i = 1; i <= WorkerPool.GetNumThreads(); ++i)
+	{
+		out.AppendFormat (" %04.2f", SightContexts[i].cycles.TimeMS());
+	}
+	out += " ms\n";
+	if (sightcache)
+	{
+		out.AppendFormat ("cache: %d hits, %d misses\n", SightCacheHits, SightCacheMisses);
+	}
 	return out;
 }
 
@@ -747,7 +1224,13 @@ void P_ResetSightCounters (bool full)
 		MaxSightCycles = SightCycles;
 	}
 	SightCycles.Reset();
-	memset (sightcounts, 0, sizeof(sightcounts));
+	SightBatches = SightPrefetches = 0;
+	SightCacheHits = SightCacheMisses = 0;
+	P_InvalidateSightCache ();
+	for (int i = 0; i <= MAX_WORKER_THREADS; ++i)
+	{
+		memset (SightContexts[i].sightcounts, 0, sizeof(SightContexts[i].sightcounts));
+		SightContexts[i].queries = 0;
+		SightContexts[i].cycles.Reset();
+	}
 }
-
-
@@ -32,6 +32,8 @@
 #include "r_data/r_interpolate.h"
 #include "i_sound.h"
 #include "g_level.h"
+#include "p_setup.h"
+#include "profiler.h"
 
 extern gamestate_t wipegamestate;
 
@@ -68,6 +70,7 @@ bool P_CheckTickerPaused ()
 //
 void P_Ticker (void)
 {
+	PROFILE_ZONE("P_Ticker");
 	int i;
 
 	interpolator.UpdateInterpolations ();
@@ -108,7 +111,9 @@ void P_Ticker (void)
 	if ( i == MAXPLAYERS )
 		S_ResumeSound (false);
 
+	P_FinishRejectBuilder (false);
 	P_ResetSightCounters (false);
+	P_CompactBlockThings ();
 
 	// Since things will be moving, it's okay to interpolate them in the renderer.
 	r_NoInterpolate = false;
@@ -65,6 +65,7 @@ CVAR (Bool, cl_noprediction, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 static player_t PredictionPlayerBackup;
 static BYTE PredictionActorBackup[sizeof(AActor)];
 static TArray<sector_t *> PredictionTouchingSectorsBackup;
+static TArray<int> PredictionBlockSlotsBackup;
 
 // [GRB] Custom player classes
 TArray<FPlayerClass> PlayerClasses;
@@ -2550,20 +2551,21 @@ void P_PredictPlayer (player_t *player)
 		mnode = mnode->m_tnext;
 	}
 
-	// Blockmap ordering also needs to stay the same, so unlink the block nodes
-	// without releasing them. (They will be used again in P_UnpredictPlayer).
-	FBlockNode *block = act->BlockNode;
-
-	while (block != NULL)
+	// Blockmap ordering also needs to stay the same, so remember the slots
+	// the actor occupied. (They will be used again in P_UnpredictPlayer).
+	// The blocks are not compacted before that, so the slots stay free.
+	// The actor's own BlockSlots come back with PredictionActorBackup.
+	PredictionBlockSlotsBackup.Clear ();
+	int blockslot = 0;
+	for (int y = act->BlockY; y < act->BlockY + act->BlockH; ++y)
 	{
-		if (block->NextActor != NULL)
+		for (int x = act->BlockX; x < act->BlockX + act->BlockW; ++x, ++blockslot)
 		{
-			block->NextActor->PrevActor = block->PrevActor;
+			PredictionBlockSlotsBackup.Push (blockthings[y*bmapwidth + x].Remove (act,
+				blockslot < MAX_BLOCKSLOTS ? act->BlockSlots[blockslot] : -1));
 		}
-		*(block->PrevActor) = block->NextActor;
-		block = block->NextBlock;
 	}
-	act->BlockNode = NULL;
+	act->BlockW = act->BlockH = 0;
 
 	for (int i = gametic; i < maxtic; ++i)
 	{
@@ -2602,23 +2604,25 @@ void P_UnPredictPlayer ()
 		}
 
 		// The blockmap ordering needs to remain unchanged, too. Right now, act has the right
-		// pointers, so temporarily set its MF_NOBLOCKMAP flag so that LinkToWorld() does not
-		// mess with them.
+		// block range, so temporarily set its MF_NOBLOCKMAP flag so that LinkToWorld() does not
+		// mess with it.
 		act->flags |= MF_NOBLOCKMAP;
 		act->LinkToWorld ();
 		act->flags &= ~MF_NOBLOCKMAP;
 
-		// Now fix the pointers in the blocknode chain
-		FBlockNode *block = act->BlockNode;
+		// Now put it back into the slots it had in those blocks
+		unsigned int slot = 0;
 
-		while (block != NULL)
+		for (int y = act->BlockY; y < act->BlockY + act->BlockH; ++y)
 		{
-			*(block->PrevActor) = block;
-			if (block->NextActor != NULL)
+			for (int x = act->BlockX; x < act->BlockX + act->BlockW; ++x)
 			{
-				block->NextActor->PrevActor = &block->NextActor;
+				int index = PredictionBlockSlotsBackup[slot++];
+				if (index >= 0)
+				{
+					blockthings[y*bmapwidth + x].Actors[index] = act;
+				}
 			}
-			block = block->NextBlock;
 		}
 	}
 }
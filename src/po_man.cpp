@@ -1154,7 +1154,7 @@ void FPolyObj::UnLinkPolyobj ()
 bool FPolyObj::CheckMobjBlocking (side_t *sd)
 {
 	static TArray<AActor *> checker;
-	FBlockNode *block;
+	FBlockThings *block;
 	AActor *mobj;
 	int i, j, k;
 	int left, right, top, bottom;
@@ -1185,9 +1185,13 @@ bool FPolyObj::CheckMobjBlocking (side_t *sd)
 	{
 		for (i = left; i <= right; i++)
 		{
-			for (block = blocklinks[j+i]; block != NULL; block = block->NextActor)
+			block = &blockthings[j+i];
+			for (int n = block->Count - 1; n >= 0; --n)
 			{
-				mobj = block->Me;
+				if ((mobj = block->Actors[n]) == NULL)
+				{
+					continue;
+				}
 				for (k = (int)checker.Size()-1; k >= 0; --k)
 				{
 					if (checker[k] == mobj)
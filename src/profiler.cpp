@@ -0,0 +1,391 @@
+/*
+** profiler.cpp
+** Scoped, nestable profiling zones with Chrome trace export
+**
+**---------------------------------------------------------------------------
+**
+** Each thread gets a buffer the first time it records a zone. Only the
+** main thread creates buffers, since growing the list goes through
+** M_Realloc, which is not thread-safe. Before it starts a thread, it calls
+** Profile_ReserveThreads so that a free buffer is waiting for it. The
+** buffers are never freed. When a thread exits, its buffer is handed to
+** the next thread that needs one, so restarting the worker threads does
+** not make the list grow. The main loop also keeps the start times of the most
+** recent frames, which is how "profdump" finds the zones that belong to
+** the last N frames.
+**
+** profdump reads the other threads' buffers without stopping them. It is
+** run from the console between frames, when the worker threads have
+** nothing to do, so this is not a problem in practice.
+**
+*/
+
+#ifdef _WIN32
+#ifndef _WINNT_
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+#define PROFILE_THREADLOCAL __declspec(thread)
+#else
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+#define PROFILE_THREADLOCAL __thread
+#endif
+
+#include <stdio.h>
+
+#include "doomtype.h"
+#include "templates.h"
+#include "tarray.h"
+#include "zstring.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "critsec.h"
+#include "profiler.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define PROFILE_BUFFER_SIZE		16384		// zones per thread
+#define PROFILE_MAX_FRAMES		256
+
+// TYPES -------------------------------------------------------------------
+
+struct FProfileEvent
+{
+	const char *Name;
+	QWORD Start, End;
+};
+
+struct FProfileBuffer
+{
+	FProfileEvent Zones[PROFILE_BUFFER_SIZE];
+	unsigned int Count;			// zones ever recorded, not only the ones still buffered
+	FString Name;
+	bool InUse;
+};
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+bool ProfileActive = true;
+
+CUSTOM_CVAR (Bool, prof_zones, true, 0)
+{
+	ProfileActive = self;
+}
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static TArray<FProfileBuffer *> Buffers;
+static FCriticalSection *BufferLock;
+static int ReservedBuffers;		// promised to threads that have not taken one yet
+static PROFILE_THREADLOCAL FProfileBuffer *ThreadBuffer;
+
+static QWORD FrameStarts[PROFILE_MAX_FRAMES];
+static unsigned int FrameCount;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// Profile_Now
+//
+//==========================================================================
+
+QWORD Profile_Now ()
+{
+#ifdef _WIN32
+	static double NsPerTick;
+	LARGE_INTEGER count;
+
+	if (NsPerTick == 0)
+	{
+		LARGE_INTEGER freq;
+		QueryPerformanceFrequency(&freq);
+		NsPerTick = 1e9 / double(freq.QuadPart);
+	}
+	QueryPerformanceCounter(&count);
+	return QWORD(count.QuadPart * NsPerTick);
+#elif defined(__APPLE__)
+	static mach_timebase_info_data_t info;
+
+	if (info.denom == 0)
+	{
+		mach_timebase_info(&info);
+	}
+	return mach_absolute_time() * info.numer / info.denom;
+#elif defined(NO_CLOCK_GETTIME)
+	timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return QWORD(tv.tv_sec) * 1000000000 + QWORD(tv.tv_usec) * 1000;
+#else
+	timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return QWORD(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+//==========================================================================
+//
+// NewBuffer
+//
+// Only the main thread may call this.
+//
+//==========================================================================
+
+static FProfileBuffer *NewBuffer ()
+{
+	FProfileBuffer *buffer = new FProfileBuffer;
+
+	buffer->Count = 0;
+	buffer->Name.Format("Thread %u", Buffers.Size());
+	buffer->InUse = false;
+	Buffers.Push(buffer);
+	return buffer;
+}
+
+//==========================================================================
+//
+// CountFreeBuffers
+//
+// BufferLock must be held.
+//
+//==========================================================================
+
+static int CountFreeBuffers ()
+{
+	int count = 0;
+
+	for (unsigned int i = 0; i < Buffers.Size(); ++i)
+	{
+		if (!Buffers[i]->InUse)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+//==========================================================================
+//
+// GetThreadBuffer
+//
+// Returns NULL if the thread was started without reserving a buffer for
+// it and none is free. Its zones are not recorded then.
+//
+//==========================================================================
+
+static FProfileBuffer *GetThreadBuffer ()
+{
+	FProfileBuffer *buffer = ThreadBuffer;
+
+	if (buffer != NULL)
+	{
+		return buffer;
+	}
+	if (BufferLock == NULL)
+	{
+		// The main thread records the first zone, long before any other
+		// thread is started.
+		BufferLock = new FCriticalSection;
+		buffer = NewBuffer();
+	}
+	else
+	{
+		BufferLock->Enter();
+		for (unsigned int i = 0; i < Buffers.Size(); ++i)
+		{
+			if (!Buffers[i]->InUse)
+			{
+				buffer = Buffers[i];
+				break;
+			}
+		}
+		if (buffer != NULL)
+		{
+			buffer->InUse = true;
+			if (ReservedBuffers > 0)
+			{
+				ReservedBuffers--;
+			}
+		}
+		BufferLock->Leave();
+		if (buffer == NULL)
+		{
+			return NULL;
+		}
+	}
+	buffer->InUse = true;
+	ThreadBuffer = buffer;
+	return buffer;
+}
+
+//==========================================================================
+//
+// Profile_ReserveThreads
+//
+//==========================================================================
+
+void Profile_ReserveThreads (int count)
+{
+	GetThreadBuffer();		// make sure the main thread has its own
+	BufferLock->Enter();
+	ReservedBuffers = MAX(0, ReservedBuffers + count);
+	for (int i = CountFreeBuffers(); i < ReservedBuffers; ++i)
+	{
+		NewBuffer();
+	}
+	BufferLock->Leave();
+}
+
+//==========================================================================
+//
+// Profile_AddZone
+//
+//==========================================================================
+
+void Profile_AddZone (const char *name, QWORD start)
+{
+	FProfileBuffer *buffer = GetThreadBuffer();
+	FProfileEvent *ev;
+
+	if (buffer == NULL)
+	{
+		return;
+	}
+	ev = &buffer->Zones[buffer->Count % PROFILE_BUFFER_SIZE];
+
+	ev->Name = name;
+	ev->Start = start;
+	ev->End = Profile_Now();
+	buffer->Count++;
+}
+
+//==========================================================================
+//
+// Profile_StartFrame
+//
+// Also records the frame that just ended as a zone of its own.
+//
+//==========================================================================
+
+void Profile_StartFrame ()
+{
+	QWORD now = Profile_Now();
+
+	if (FrameCount > 0 && ProfileActive)
+	{
+		Profile_AddZone("Frame", FrameStarts[(FrameCount - 1) % PROFILE_MAX_FRAMES]);
+	}
+	FrameStarts[FrameCount % PROFILE_MAX_FRAMES] = now;
+	FrameCount++;
+}
+
+//==========================================================================
+//
+// Profile_SetThreadName
+//
+//==========================================================================
+
+void Profile_SetThreadName (const char *name)
+{
+	FProfileBuffer *buffer = GetThreadBuffer();
+
+	if (buffer != NULL)
+	{
+		buffer->Name = name;
+	}
+}
+
+//==========================================================================
+//
+// Profile_ReleaseThread
+//
+//==========================================================================
+
+void Profile_ReleaseThread ()
+{
+	if (ThreadBuffer != NULL)
+	{
+		BufferLock->Enter();
+		ThreadBuffer->InUse = false;
+		BufferLock->Leave();
+		ThreadBuffer = NULL;
+	}
+}
+
+//==========================================================================
+//
+// WriteTrace
+//
+// Writes every buffered zone that started at or after <first> as a
+// complete ("X") trace event. Times are in microseconds relative to <first>.
+//
+//==========================================================================
+
+static int WriteTrace (FILE *f, QWORD first)
+{
+	int count = 0;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	BufferLock->Enter();
+	for (unsigned int i = 0; i < Buffers.Size(); ++i)
+	{
+		const FProfileBuffer *buffer = Buffers[i];
+		unsigned int start = buffer->Count > PROFILE_BUFFER_SIZE ? buffer->Count - PROFILE_BUFFER_SIZE : 0;
+
+		fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			i > 0 ? "," : "", i, buffer->Name.GetChars());
+		for (unsigned int j = start; j < buffer->Count; ++j)
+		{
+			const FProfileEvent *ev = &buffer->Zones[j % PROFILE_BUFFER_SIZE];
+
+			if (ev->Start >= first)
+			{
+				fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					ev->Name, i, (ev->Start - first) / 1000.0, (ev->End - ev->Start) / 1000.0);
+				count++;
+			}
+		}
+	}
+	BufferLock->Leave();
+	fprintf(f, "\n]}\n");
+	return count;
+}
+
+//==========================================================================
+//
+// CCMD profdump
+//
+// Writes the zones of the last few frames to a trace file.
+//
+//==========================================================================
+
+CCMD (profdump)
+{
+	int frames = argv.argc() > 1 ? atoi(argv[1]) : 10;
+	const char *filename = argv.argc() > 2 ? argv[2] : "profile.json";
+
+	if (BufferLock == NULL || FrameCount < 2)
+	{
+		Printf ("Nothing has been profiled yet.\n");
+		return;
+	}
+	// The current frame is still in progress and not included.
+	frames = clamp<int>(frames, 1, MIN<int>(FrameCount - 1, PROFILE_MAX_FRAMES - 1));
+
+	FILE *f = fopen(filename, "w");
+	if (f == NULL)
+	{
+		Printf ("Could not open %s\n", filename);
+		return;
+	}
+	int count = WriteTrace(f, FrameStarts[(FrameCount - 1 - frames) % PROFILE_MAX_FRAMES]);
+	fclose(f);
+	Printf ("Wrote %d zones from %d frames to %s\n", count, frames, filename);
+}
@@ -0,0 +1,81 @@
+/*
+** profiler.h
+** Scoped, nestable profiling zones with Chrome trace export
+**
+**---------------------------------------------------------------------------
+**
+** A zone is timed from the point where it is declared to the end of the
+** enclosing scope:
+**
+**		void P_Ticker ()
+**		{
+**			PROFILE_ZONE("P_Ticker");
+**			...
+**		}
+**
+** Every thread records its finished zones into a ring buffer of its own,
+** so recording needs no locking and costs two clock reads per zone. The
+** "profdump" console command writes the zones of the last few frames in
+** the trace_event format, which chrome://tracing and similar viewers can
+** load. Nesting is implied by the times, so it needs no bookkeeping here.
+**
+** Zone names must be string literals or otherwise live forever, since only
+** the pointer is stored.
+**
+*/
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "doomtype.h"
+
+extern bool ProfileActive;
+
+// Returns a monotonic time stamp in nanoseconds.
+QWORD Profile_Now ();
+
+// Records a zone that started at <start> and ends now.
+void Profile_AddZone (const char *name, QWORD start);
+
+// Marks the start of a new frame. Only the main loop should call this.
+void Profile_StartFrame ();
+
+// Makes sure that <count> more threads can get a buffer. Threads other than
+// the main one cannot create buffers, so the main thread must call this
+// before starting a thread that records zones. A negative count takes a
+// reservation back if the thread could not be started.
+void Profile_ReserveThreads (int count);
+
+// Names the calling thread in the trace. Must be called before the thread
+// records its first zone.
+void Profile_SetThreadName (const char *name);
+
+// Must be called by threads that record zones before they exit, so their
+// buffer can be reused by another thread.
+void Profile_ReleaseThread ();
+
+class FProfileZone
+{
+public:
+	FProfileZone (const char *name)
+		: Name(name), Start(ProfileActive ? Profile_Now() : 0)
+	{
+	}
+	~FProfileZone ()
+	{
+		if (Start != 0)
+		{
+			Profile_AddZone (Name, Start);
+		}
+	}
+
+private:
+	const char *Name;
+	QWORD Start;
+};
+
+#define PROFILE_ZONE_CAT2(a,b)	a##b
+#define PROFILE_ZONE_CAT(a,b)	PROFILE_ZONE_CAT2(a,b)
+#define PROFILE_ZONE(name)		FProfileZone PROFILE_ZONE_CAT(profilezone_,__LINE__)(name)
+
+#endif
@@ -82,6 +82,13 @@ void (*R_DrawSpanMaskedTranslucent)(void);
 void (*R_DrawSpanAddClamp)(void);
 void (*R_DrawSpanMaskedAddClamp)(void);
 void (STACK_ARGS *rt_map4cols)(int,int,int);
+#ifndef X86_ASM
+void (STACK_ARGS *rt_shaded4cols)(int,int,int);
+void (STACK_ARGS *rt_add4cols)(int,int,int);
+void (STACK_ARGS *rt_addclamp4cols)(int,int,int);
+void (STACK_ARGS *rt_subclamp4cols)(int,int,int);
+void (STACK_ARGS *rt_revsubclamp4cols)(int,int,int);
+#endif
 
 //
 // R_DrawColumn
@@ -1576,7 +1583,7 @@ extern "C" void STACK_ARGS R_DrawSlabC(int dx, fixed_t v, int dy, fixed_t vi, co
 
 #ifndef X86_ASM
 static DWORD STACK_ARGS vlinec1 ();
-static int vlinebits;
+int vlinebits;
 
 DWORD (STACK_ARGS *dovline1)() = vlinec1;
 DWORD (STACK_ARGS *doprevline1)() = vlinec1;
@@ -1586,13 +1593,13 @@ extern "C" void vlinetallasm4();
 #define dovline4 vlinetallasm4
 extern "C" void setupvlinetallasm (int);
 #else
-static void STACK_ARGS vlinec4 ();
+void STACK_ARGS vlinec4 ();
 void (STACK_ARGS *dovline4)() = vlinec4;
 #endif
 
 static DWORD STACK_ARGS mvlinec1();
-static void STACK_ARGS mvlinec4();
-static int mvlinebits;
+void STACK_ARGS mvlinec4();
+int mvlinebits;
 
 DWORD (STACK_ARGS *domvline1)() = mvlinec1;
 void (STACK_ARGS *domvline4)() = mvlinec4;
@@ -2193,6 +2200,26 @@ void R_InitColumnDrawers ()
 	R_DrawSpan					= R_DrawSpanP_C;
 	R_DrawSpanMasked			= R_DrawSpanMaskedP_C;
 	rt_map4cols					= rt_map4cols_c;
+	rt_shaded4cols				= rt_shaded4cols_c;
+	rt_add4cols					= rt_add4cols_c;
+	rt_addclamp4cols			= rt_addclamp4cols_c;
+	rt_subclamp4cols			= rt_subclamp4cols_c;
+	rt_revsubclamp4cols			= rt_revsubclamp4cols_c;
+#ifdef SSE2_DRAWERS
+	if (CPU.bSSE2)
+	{
+		R_DrawSpan				= R_DrawSpanP_SSE2;
+		rt_shaded4cols			= rt_shaded4cols_sse2;
+		rt_add4cols				= rt_add4cols_sse2;
+		rt_addclamp4cols		= rt_addclamp4cols_sse2;
+		rt_subclamp4cols		= rt_subclamp4cols_sse2;
+		rt_revsubclamp4cols		= rt_revsubclamp4cols_sse2;
+#ifndef X64_ASM
+		dovline4				= vlinec4_sse2;
+#endif
+		domvline4				= mvlinec4_sse2;
+	}
+#endif
 #endif
 	R_DrawSpanTranslucent		= R_DrawSpanTranslucentP_C;
 	R_DrawSpanMaskedTranslucent = R_DrawSpanMaskedTranslucentP_C;
@@ -2453,24 +2480,36 @@ bool R_GetTransMaskDrawers (fixed_t (**tmvline1)(), void (**tmvline4)())
 	{
 		*tmvline1 = tmvline1_add;
 		*tmvline4 = tmvline4_add;
+#ifdef SSE2_DRAWERS
+		if (CPU.bSSE2) *tmvline4 = tmvline4_add_sse2;
+#endif
 		return true;
 	}
 	if (colfunc == R_DrawAddClampColumnP_C)
 	{
 		*tmvline1 = tmvline1_addclamp;
 		*tmvline4 = tmvline4_addclamp;
+#ifdef SSE2_DRAWERS
+		if (CPU.bSSE2) *tmvline4 = tmvline4_addclamp_sse2;
+#endif
 		return true;
 	}
 	if (colfunc == R_DrawSubClampColumnP_C)
 	{
 		*tmvline1 = tmvline1_subclamp;
 		*tmvline4 = tmvline4_subclamp;
+#ifdef SSE2_DRAWERS
+		if (CPU.bSSE2) *tmvline4 = tmvline4_subclamp_sse2;
+#endif
 		return true;
 	}
 	if (colfunc == R_DrawRevSubClampColumnP_C)
 	{
 		*tmvline1 = tmvline1_revsubclamp;
 		*tmvline4 = tmvline4_revsubclamp;
+#ifdef SSE2_DRAWERS
+		if (CPU.bSSE2) *tmvline4 = tmvline4_revsubclamp_sse2;
+#endif
 		return true;
 	}
 	return false;
@@ -25,6 +25,12 @@
 
 #include "r_defs.h"
 
+// SSE2 versions of the C drawers, see r_draw_sse2.cpp. They are picked
+// when the CPU supports SSE2, which all x86_64 CPUs do.
+#if !defined(X86_ASM) && (defined(__amd64__) || defined(_M_X64))
+#define SSE2_DRAWERS
+#endif
+
 extern "C" int			ylookup[MAXHEIGHT];
 
 extern "C" int			dc_pitch;		// [RH] Distance between rows
@@ -144,8 +150,8 @@ void rt_tlaterevsubclamp1col (int hx, int sx, int yl, int yh);
 void STACK_ARGS rt_map4cols_c (int sx, int yl, int yh);
 void STACK_ARGS rt_add4cols_c (int sx, int yl, int yh);
 void STACK_ARGS rt_addclamp4cols_c (int sx, int yl, int yh);
-void STACK_ARGS rt_subclamp4cols (int sx, int yl, int yh);
-void STACK_ARGS rt_revsubclamp4cols (int sx, int yl, int yh);
+void STACK_ARGS rt_subclamp4cols_c (int sx, int yl, int yh);
+void STACK_ARGS rt_revsubclamp4cols_c (int sx, int yl, int yh);
 
 void STACK_ARGS rt_tlate4cols (int sx, int yl, int yh);
 void STACK_ARGS rt_tlateadd4cols (int sx, int yl, int yh);
@@ -172,13 +178,32 @@ extern void (STACK_ARGS *rt_map4cols)(int sx, int yl, int yh);
 #define rt_shaded4cols		rt_shaded4cols_asm
 #define rt_add4cols			rt_add4cols_asm
 #define rt_addclamp4cols	rt_addclamp4cols_asm
+#define rt_subclamp4cols	rt_subclamp4cols_c
+#define rt_revsubclamp4cols	rt_revsubclamp4cols_c
 #else
 #define rt_copy1col			rt_copy1col_c
 #define rt_copy4cols		rt_copy4cols_c
 #define rt_map1col			rt_map1col_c
-#define rt_shaded4cols		rt_shaded4cols_c
-#define rt_add4cols			rt_add4cols_c
-#define rt_addclamp4cols	rt_addclamp4cols_c
+extern void (STACK_ARGS *rt_shaded4cols)(int sx, int yl, int yh);
+extern void (STACK_ARGS *rt_add4cols)(int sx, int yl, int yh);
+extern void (STACK_ARGS *rt_addclamp4cols)(int sx, int yl, int yh);
+extern void (STACK_ARGS *rt_subclamp4cols)(int sx, int yl, int yh);
+extern void (STACK_ARGS *rt_revsubclamp4cols)(int sx, int yl, int yh);
+#endif
+
+#ifdef SSE2_DRAWERS
+void STACK_ARGS rt_shaded4cols_sse2 (int sx, int yl, int yh);
+void STACK_ARGS rt_add4cols_sse2 (int sx, int yl, int yh);
+void STACK_ARGS rt_addclamp4cols_sse2 (int sx, int yl, int yh);
+void STACK_ARGS rt_subclamp4cols_sse2 (int sx, int yl, int yh);
+void STACK_ARGS rt_revsubclamp4cols_sse2 (int sx, int yl, int yh);
+void R_DrawSpanP_SSE2 (void);
+void STACK_ARGS vlinec4_sse2 ();
+void STACK_ARGS mvlinec4_sse2 ();
+void tmvline4_add_sse2 ();
+void tmvline4_addclamp_sse2 ();
+void tmvline4_subclamp_sse2 ();
+void tmvline4_revsubclamp_sse2 ();
 #endif
 
 void rt_draw4cols (int sx);
@@ -188,6 +213,19 @@ void rt_initcols (BYTE *buffer=NULL);
 
 void R_DrawFogBoundary (int x1, int x2, short *uclip, short *dclip);
 
+// Deferred wall columns and flat spans (see r_drawcmd.cpp)
+extern bool DeferringColumns;
+extern bool DeferringSpans;
+void R_BeginColumnCommands ();
+void R_AddColumnCommand (int x, BYTE *dest, const BYTE *source, const BYTE *colormap,
+	DWORD texturefrac, DWORD iscale, int count, int bits);
+void R_FlushColumnCommands ();
+void R_EndColumnCommands ();
+void R_BeginSpanCommands ();
+void R_AddSpanCommand ();
+void R_EndSpanCommands ();
+void R_ResetDrawCmdStats ();
+
 
 #ifdef X86_ASM
 
@@ -0,0 +1,614 @@
+/*
+** r_draw_sse2.cpp
+** SSE2 versions of the C column and span drawers
+**
+**---------------------------------------------------------------------------
+**
+** Every pixel these drawers write goes through at least two table lookups,
+** which SSE2 cannot do. What it can do is the rest: stepping four texture
+** coordinates at once, and the blending arithmetic for four pixels at
+** once. The lookups are still done one at a time, in the same order as
+** the C drawers, so the output is exactly the same. drawerbench checks
+** that and shows how much faster each drawer is on this machine.
+**
+** These are only used on x86_64 builds, where SSE2 is always available
+** and there is no assembly version of these drawers.
+**
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "templates.h"
+#include "doomtype.h"
+#include "doomdef.h"
+#include "r_defs.h"
+#include "r_draw.h"
+#include "r_main.h"
+#include "v_video.h"
+#include "c_dispatch.h"
+#include "v_text.h"
+#include "stats.h"
+#include "x86.h"
+
+#ifdef SSE2_DRAWERS
+
+#include <emmintrin.h>
+
+// EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
+
+#ifndef X64_ASM
+void STACK_ARGS vlinec4 ();
+extern int vlinebits;
+#endif
+void STACK_ARGS mvlinec4 ();
+extern int mvlinebits;
+extern int tmvlinebits;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// The blending arithmetic of the C drawers, four pixels at a time. Each
+// returns the indices into RGB32k.
+//
+//==========================================================================
+
+struct FBlendAdd
+{
+	static inline __m128i Blend(__m128i fg, __m128i bg)
+	{
+		fg = _mm_or_si128(_mm_add_epi32(fg, bg), _mm_set1_epi32(0x1f07c1f));
+		return _mm_and_si128(fg, _mm_srli_epi32(fg, 15));
+	}
+};
+
+struct FBlendAddClamp
+{
+	static inline __m128i Blend(__m128i fg, __m128i bg)
+	{
+		__m128i a = _mm_add_epi32(fg, bg);
+		__m128i b = _mm_and_si128(a, _mm_set1_epi32(0x40100400));
+		a = _mm_and_si128(_mm_or_si128(a, _mm_set1_epi32(0x01f07c1f)), _mm_set1_epi32(0x3fffffff));
+		a = _mm_or_si128(a, _mm_sub_epi32(b, _mm_srli_epi32(b, 5)));
+		return _mm_and_si128(a, _mm_srli_epi32(a, 15));
+	}
+};
+
+struct FBlendSubClamp
+{
+	static inline __m128i Blend(__m128i fg, __m128i bg)
+	{
+		__m128i a = _mm_sub_epi32(_mm_or_si128(fg, _mm_set1_epi32(0x40100400)), bg);
+		__m128i b = _mm_and_si128(a, _mm_set1_epi32(0x40100400));
+		a = _mm_and_si128(a, _mm_sub_epi32(b, _mm_srli_epi32(b, 5)));
+		a = _mm_or_si128(a, _mm_set1_epi32(0x01f07c1f));
+		return _mm_and_si128(a, _mm_srli_epi32(a, 15));
+	}
+};
+
+struct FBlendRevSubClamp
+{
+	static inline __m128i Blend(__m128i fg, __m128i bg)
+	{
+		return FBlendSubClamp::Blend(bg, fg);
+	}
+};
+
+//==========================================================================
+//
+// WriteBlended
+//
+// Looks up the four blended colors and writes those pixels whose bit is
+// set in mask.
+//
+//==========================================================================
+
+static inline void WriteBlended(BYTE *dest, __m128i index, int mask = 15)
+{
+	DWORD idx[4];
+
+	_mm_storeu_si128((__m128i *)idx, index);
+	if (mask & 1) dest[0] = RGB32k[0][0][idx[0]];
+	if (mask & 2) dest[1] = RGB32k[0][0][idx[1]];
+	if (mask & 4) dest[2] = RGB32k[0][0][idx[2]];
+	if (mask & 8) dest[3] = RGB32k[0][0][idx[3]];
+}
+
+//==========================================================================
+//
+// rt_blend4cols
+//
+// The body of rt_add4cols, rt_addclamp4cols, rt_subclamp4cols and
+// rt_revsubclamp4cols.
+//
+//==========================================================================
+
+template<class Blend> static void rt_blend4cols(int sx, int yl, int yh)
+{
+	BYTE *colormap;
+	BYTE *source;
+	BYTE *dest;
+	int count;
+	int pitch;
+
+	count = yh-yl;
+	if (count < 0)
+		return;
+	count++;
+
+	DWORD *fg2rgb = dc_srcblend;
+	DWORD *bg2rgb = dc_destblend;
+	dest = ylookup[yl] + sx + dc_destorg;
+	source = &dc_temp[yl*4];
+	pitch = dc_pitch;
+	colormap = dc_colormap;
+
+	do {
+		__m128i fg = _mm_setr_epi32(fg2rgb[colormap[source[0]]], fg2rgb[colormap[source[1]]],
+			fg2rgb[colormap[source[2]]], fg2rgb[colormap[source[3]]]);
+		__m128i bg = _mm_setr_epi32(bg2rgb[dest[0]], bg2rgb[dest[1]], bg2rgb[dest[2]], bg2rgb[dest[3]]);
+
+		WriteBlended(dest, Blend::Blend(fg, bg));
+		source += 4;
+		dest += pitch;
+	} while (--count);
+}
+
+void STACK_ARGS rt_add4cols_sse2 (int sx, int yl, int yh)
+{
+	rt_blend4cols<FBlendAdd>(sx, yl, yh);
+}
+
+void STACK_ARGS rt_addclamp4cols_sse2 (int sx, int yl, int yh)
+{
+	rt_blend4cols<FBlendAddClamp>(sx, yl, yh);
+}
+
+void STACK_ARGS rt_subclamp4cols_sse2 (int sx, int yl, int yh)
+{
+	rt_blend4cols<FBlendSubClamp>(sx, yl, yh);
+}
+
+void STACK_ARGS rt_revsubclamp4cols_sse2 (int sx, int yl, int yh)
+{
+	rt_blend4cols<FBlendRevSubClamp>(sx, yl, yh);
+}
+
+//==========================================================================
+//
+// rt_shaded4cols_sse2
+//
+//==========================================================================
+
+void STACK_ARGS rt_shaded4cols_sse2 (int sx, int yl, int yh)
+{
+	DWORD *fgstart;
+	BYTE *colormap;
+	BYTE *source;
+	BYTE *dest;
+	int count;
+	int pitch;
+
+	count = yh-yl;
+	if (count < 0)
+		return;
+	count++;
+
+	fgstart = &Col2RGB8[0][dc_color];
+	colormap = dc_colormap;
+	dest = ylookup[yl] + sx + dc_destorg;
+	source = &dc_temp[yl*4];
+	pitch = dc_pitch;
+
+	do {
+		DWORD v0 = colormap[source[0]], v1 = colormap[source[1]];
+		DWORD v2 = colormap[source[2]], v3 = colormap[source[3]];
+		__m128i fg = _mm_setr_epi32(fgstart[v0<<8], fgstart[v1<<8], fgstart[v2<<8], fgstart[v3<<8]);
+		__m128i bg = _mm_setr_epi32(Col2RGB8[64-v0][dest[0]], Col2RGB8[64-v1][dest[1]],
+			Col2RGB8[64-v2][dest[2]], Col2RGB8[64-v3][dest[3]]);
+
+		WriteBlended(dest, FBlendAdd::Blend(fg, bg));
+		source += 4;
+		dest += pitch;
+	} while (--count);
+}
+
+//==========================================================================
+//
+// R_DrawSpanP_SSE2
+//
+// Steps the texture coordinates of four pixels at once.
+//
+//==========================================================================
+
+void R_DrawSpanP_SSE2 (void)
+{
+	const BYTE *source = ds_source;
+	const BYTE *colormap = ds_colormap;
+	BYTE *dest = ylookup[ds_y] + ds_x1 + dc_destorg;
+	int count = ds_x2 - ds_x1 + 1;
+	dsfixed_t xfrac = ds_xfrac;
+	dsfixed_t yfrac = ds_yfrac;
+	dsfixed_t xstep = ds_xstep;
+	dsfixed_t ystep = ds_ystep;
+	BYTE yshift = 32 - ds_ybits;
+	BYTE xshift = yshift - ds_xbits;
+	int xmask = ((1 << ds_xbits) - 1) << ds_ybits;
+
+	if (count >= 4)
+	{
+		__m128i xf = _mm_setr_epi32(xfrac, xfrac + xstep, xfrac + xstep*2, xfrac + xstep*3);
+		__m128i yf = _mm_setr_epi32(yfrac, yfrac + ystep, yfrac + ystep*2, yfrac + ystep*3);
+		__m128i xs = _mm_set1_epi32(xstep * 4);
+		__m128i ys = _mm_set1_epi32(ystep * 4);
+		__m128i xm = _mm_set1_epi32(xmask);
+		__m128i xsh = _mm_cvtsi32_si128(xshift);
+		__m128i ysh = _mm_cvtsi32_si128(yshift);
+		int quads = count >> 2;
+		DWORD spot[4];
+
+		do
+		{
+			__m128i s = _mm_add_epi32(_mm_and_si128(_mm_srl_epi32(xf, xsh), xm), _mm_srl_epi32(yf, ysh));
+			_mm_storeu_si128((__m128i *)spot, s);
+			dest[0] = colormap[source[spot[0]]];
+			dest[1] = colormap[source[spot[1]]];
+			dest[2] = colormap[source[spot[2]]];
+			dest[3] = colormap[source[spot[3]]];
+			dest += 4;
+			xf = _mm_add_epi32(xf, xs);
+			yf = _mm_add_epi32(yf, ys);
+		} while (--quads);
+
+		xfrac += xstep * (count & ~3);
+		yfrac += ystep * (count & ~3);
+		count &= 3;
+	}
+	while (count-- > 0)
+	{
+		*dest++ = colormap[source[((xfrac >> xshift) & xmask) + (yfrac >> yshift)]];
+		xfrac += xstep;
+		yfrac += ystep;
+	}
+}
+
+//==========================================================================
+//
+// vlinec4_sse2
+//
+//==========================================================================
+
+#ifndef X64_ASM
+void STACK_ARGS vlinec4_sse2 ()
+{
+	BYTE *dest = dc_dest;
+	int count = dc_count;
+	__m128i bits = _mm_cvtsi32_si128(vlinebits);
+	__m128i place = _mm_loadu_si128((__m128i *)vplce);
+	__m128i step = _mm_loadu_si128((__m128i *)vince);
+	DWORD ofs[4];
+
+	do
+	{
+		_mm_storeu_si128((__m128i *)ofs, _mm_srl_epi32(place, bits));
+		dest[0] = palookupoffse[0][bufplce[0][ofs[0]]];
+		dest[1] = palookupoffse[1][bufplce[1][ofs[1]]];
+		dest[2] = palookupoffse[2][bufplce[2][ofs[2]]];
+		dest[3] = palookupoffse[3][bufplce[3][ofs[3]]];
+		place = _mm_add_epi32(place, step);
+		dest += dc_pitch;
+	} while (--count);
+	_mm_storeu_si128((__m128i *)vplce, place);
+}
+#endif
+
+//==========================================================================
+//
+// mvlinec4_sse2
+//
+//==========================================================================
+
+void STACK_ARGS mvlinec4_sse2 ()
+{
+	BYTE *dest = dc_dest;
+	int count = dc_count;
+	__m128i bits = _mm_cvtsi32_si128(mvlinebits);
+	__m128i place = _mm_loadu_si128((__m128i *)vplce);
+	__m128i step = _mm_loadu_si128((__m128i *)vince);
+	DWORD ofs[4];
+
+	do
+	{
+		BYTE pix;
+
+		_mm_storeu_si128((__m128i *)ofs, _mm_srl_epi32(place, bits));
+		pix = bufplce[0][ofs[0]]; if (pix) dest[0] = palookupoffse[0][pix];
+		pix = bufplce[1][ofs[1]]; if (pix) dest[1] = palookupoffse[1][pix];
+		pix = bufplce[2][ofs[2]]; if (pix) dest[2] = palookupoffse[2][pix];
+		pix = bufplce[3][ofs[3]]; if (pix) dest[3] = palookupoffse[3][pix];
+		place = _mm_add_epi32(place, step);
+		dest += dc_pitch;
+	} while (--count);
+	_mm_storeu_si128((__m128i *)vplce, place);
+}
+
+//==========================================================================
+//
+// tmvline4_blend
+//
+// The body of the tmvline4_* drawers. Color 0 is transparent, so only the
+// pixels whose source is not 0 are written.
+//
+//==========================================================================
+
+template<class Blend> static void tmvline4_blend()
+{
+	BYTE *dest = dc_dest;
+	int count = dc_count;
+	__m128i bits = _mm_cvtsi32_si128(tmvlinebits);
+	__m128i place = _mm_loadu_si128((__m128i *)vplce);
+	__m128i step = _mm_loadu_si128((__m128i *)vince);
+	DWORD *fg2rgb = dc_srcblend;
+	DWORD *bg2rgb = dc_destblend;
+	DWORD ofs[4];
+
+	do
+	{
+		_mm_storeu_si128((__m128i *)ofs, _mm_srl_epi32(place, bits));
+		BYTE p0 = bufplce[0][ofs[0]], p1 = bufplce[1][ofs[1]];
+		BYTE p2 = bufplce[2][ofs[2]], p3 = bufplce[3][ofs[3]];
+		int mask = (p0 != 0) | ((p1 != 0) << 1) | ((p2 != 0) << 2) | ((p3 != 0) << 3);
+
+		if (mask != 0)
+		{
+			__m128i fg = _mm_setr_epi32(fg2rgb[palookupoffse[0][p0]], fg2rgb[palookupoffse[1][p1]],
+				fg2rgb[palookupoffse[2][p2]], fg2rgb[palookupoffse[3][p3]]);
+			__m128i bg = _mm_setr_epi32(bg2rgb[dest[0]], bg2rgb[dest[1]], bg2rgb[dest[2]], bg2rgb[dest[3]]);
+
+			WriteBlended(dest, Blend::Blend(fg, bg), mask);
+		}
+		place = _mm_add_epi32(place, step);
+		dest += dc_pitch;
+	} while (--count);
+	_mm_storeu_si128((__m128i *)vplce, place);
+}
+
+void tmvline4_add_sse2 ()
+{
+	tmvline4_blend<FBlendAdd>();
+}
+
+void tmvline4_addclamp_sse2 ()
+{
+	tmvline4_blend<FBlendAddClamp>();
+}
+
+void tmvline4_subclamp_sse2 ()
+{
+	tmvline4_blend<FBlendSubClamp>();
+}
+
+void tmvline4_revsubclamp_sse2 ()
+{
+	tmvline4_blend<FBlendRevSubClamp>();
+}
+
+//==========================================================================
+//
+// CCMD drawerbench
+//
+// Runs the C and SSE2 version of every drawer above on the same random
+// data, checks that they draw the same pixels, and shows how many pixels
+// per second each of them manages.
+//
+//==========================================================================
+
+void tmvline4_add ();
+void tmvline4_addclamp ();
+void tmvline4_subclamp ();
+void tmvline4_revsubclamp ();
+
+enum
+{
+	BENCH_WIDTH = 256,
+	BENCH_HEIGHT = 256,
+	BENCH_PASSES = 200
+};
+
+struct FDrawerBench
+{
+	const char *Name;
+	int Kind;
+	void (STACK_ARGS *C4cols)(int, int, int);
+	void (STACK_ARGS *SSE24cols)(int, int, int);
+	void (*CSpan)(void);
+	void (*SSE2Span)(void);
+};
+
+enum { BENCH_4cols, BENCH_span, BENCH_vline4 };
+
+static BYTE BenchSource[BENCH_HEIGHT*4];
+static BYTE BenchTexture[4][BENCH_HEIGHT];
+static BYTE BenchScreen[2][BENCH_HEIGHT*BENCH_WIDTH];
+static BYTE BenchColormap[256];
+
+//==========================================================================
+//
+// RunDrawerBench
+//
+// Draws the whole bench screen once with either version of the drawer.
+//
+//==========================================================================
+
+static void RunDrawerBench(const FDrawerBench &bench, bool sse2)
+{
+	int x;
+
+	switch (bench.Kind)
+	{
+	case BENCH_4cols:
+		for (x = 0; x < BENCH_WIDTH; x += 4)
+		{
+			(sse2 ? bench.SSE24cols : bench.C4cols)(x, 0, BENCH_HEIGHT - 1);
+		}
+		break;
+
+	case BENCH_span:
+		ds_source = BenchTexture[0];
+		ds_colormap = BenchColormap;
+		ds_xbits = 4;
+		ds_ybits = 4;
+		ds_x1 = 0;
+		ds_x2 = BENCH_WIDTH - 1;
+		for (ds_y = 0; ds_y < BENCH_HEIGHT; ++ds_y)
+		{
+			ds_xfrac = ds_y * 0x1234567;
+			ds_yfrac = ds_y * 0x7654321;
+			ds_xstep = 0x00731234 + ds_y * 0x1000;
+			ds_ystep = 0x00123456 - ds_y * 0x800;
+			(sse2 ? bench.SSE2Span : bench.CSpan)();
+		}
+		break;
+
+	case BENCH_vline4:
+		for (x = 0; x < BENCH_WIDTH; x += 4)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				bufplce[i] = BenchTexture[i];
+				palookupoffse[i] = BenchColormap;
+				vplce[i] = (x + i) * 0x01234567;
+				vince[i] = 0x00345678 + (x + i) * 0x1000;
+			}
+			dc_dest = ylookup[0] + x + dc_destorg;
+			dc_count = BENCH_HEIGHT;
+			(sse2 ? bench.SSE2Span : bench.CSpan)();
+		}
+		break;
+	}
+}
+
+CCMD (drawerbench)
+{
+	static const FDrawerBench benches[] =
+	{
+		{ "add4cols",			BENCH_4cols,	rt_add4cols_c,			rt_add4cols_sse2 },
+		{ "addclamp4cols",		BENCH_4cols,	rt_addclamp4cols_c,		rt_addclamp4cols_sse2 },
+		{ "subclamp4cols",		BENCH_4cols,	rt_subclamp4cols_c,		rt_subclamp4cols_sse2 },
+		{ "revsubclamp4cols",	BENCH_4cols,	rt_revsubclamp4cols_c,	rt_revsubclamp4cols_sse2 },
+		{ "shaded4cols",		BENCH_4cols,	rt_shaded4cols_c,		rt_shaded4cols_sse2 },
+		{ "span",				BENCH_span,		NULL, NULL,	R_DrawSpanP_C,			R_DrawSpanP_SSE2 },
+#ifndef X64_ASM
+		{ "vline4",				BENCH_vline4,	NULL, NULL,	vlinec4,				vlinec4_sse2 },
+#endif
+		{ "mvline4",			BENCH_vline4,	NULL, NULL,	mvlinec4,				mvlinec4_sse2 },
+		{ "tmvline4 add",		BENCH_vline4,	NULL, NULL,	tmvline4_add,			tmvline4_add_sse2 },
+		{ "tmvline4 addclamp",	BENCH_vline4,	NULL, NULL,	tmvline4_addclamp,		tmvline4_addclamp_sse2 },
+		{ "tmvline4 subclamp",	BENCH_vline4,	NULL, NULL,	tmvline4_subclamp,		tmvline4_subclamp_sse2 },
+		{ "tmvline4 revsubclamp",BENCH_vline4,	NULL, NULL,	tmvline4_revsubclamp,	tmvline4_revsubclamp_sse2 },
+	};
+
+	if (!CPU.bSSE2)
+	{
+		Printf ("This CPU does not support SSE2.\n");
+		return;
+	}
+
+	// Save everything the benchmark changes that the renderer relies on
+	// from one frame to the next.
+	int savedylookup[BENCH_HEIGHT];
+	BYTE *saveddestorg = dc_destorg;
+	int savedpitch = dc_pitch;
+	BYTE *savedtemp = dc_temp;
+	BYTE *savedcolormap = dc_colormap;
+	DWORD *savedsrcblend = dc_srcblend, *saveddestblend = dc_destblend;
+	int savedcolor = dc_color;
+	int savedmvlinebits = mvlinebits, savedtmvlinebits = tmvlinebits;
+#ifndef X64_ASM
+	int savedvlinebits = vlinebits;
+#endif
+	int i;
+
+	memcpy (savedylookup, ylookup, sizeof(savedylookup));
+	for (i = 0; i < BENCH_HEIGHT; ++i)
+	{
+		ylookup[i] = i * BENCH_WIDTH;
+		BenchSource[i*4+0] = rand();
+		BenchSource[i*4+1] = rand();
+		BenchSource[i*4+2] = rand();
+		BenchSource[i*4+3] = rand();
+		BenchTexture[0][i] = rand();
+		BenchTexture[1][i] = rand() & 7 ? rand() : 0;
+		BenchTexture[2][i] = rand() & 3 ? rand() : 0;
+		BenchTexture[3][i] = i & 16 ? rand() : 0;
+	}
+	// Keep the colors in [0,64], so they also work as shades for shaded4cols.
+	for (i = 0; i < 256; ++i)
+	{
+		BenchColormap[i] = (i * 7 + 3) % 65;
+	}
+	dc_pitch = BENCH_WIDTH;
+	dc_temp = BenchSource;
+	dc_colormap = BenchColormap;
+	dc_srcblend = Col2RGB8[40];
+	dc_destblend = Col2RGB8[24];
+	dc_color = 176;
+#ifndef X64_ASM
+	vlinebits = 24;
+#endif
+	mvlinebits = tmvlinebits = 24;
+
+	for (unsigned int b = 0; b < countof(benches); ++b)
+	{
+		const FDrawerBench &bench = benches[b];
+		double ms[2];
+
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			cycle_t clock;
+
+			for (i = 0; i < BENCH_HEIGHT * BENCH_WIDTH; ++i)
+			{
+				BenchScreen[pass][i] = (i * 13) ^ (i >> 8);
+			}
+			dc_destorg = BenchScreen[pass];
+			RunDrawerBench(bench, pass != 0);
+
+			// Time it on a copy, so the checked pixels are not overwritten.
+			static BYTE scratch[BENCH_HEIGHT*BENCH_WIDTH];
+			dc_destorg = scratch;
+			clock.Reset();
+			clock.Clock();
+			for (i = 0; i < BENCH_PASSES; ++i)
+			{
+				RunDrawerBench(bench, pass != 0);
+			}
+			clock.Unclock();
+			ms[pass] = clock.TimeMS();
+		}
+
+		double pixels = double(BENCH_WIDTH) * BENCH_HEIGHT * BENCH_PASSES;
+		bool same = memcmp(BenchScreen[0], BenchScreen[1], sizeof(BenchScreen[0])) == 0;
+
+		Printf ("%-22s C: %7.1f  SSE2: %7.1f Mpixels/s  %s\n", bench.Name,
+			pixels / (ms[0] * 1000), pixels / (ms[1] * 1000),
+			same ? "" : TEXTCOLOR_RED "MISMATCH");
+	}
+
+	memcpy (ylookup, savedylookup, sizeof(savedylookup));
+	dc_destorg = saveddestorg;
+	dc_pitch = savedpitch;
+	dc_temp = savedtemp;
+	dc_colormap = savedcolormap;
+	dc_srcblend = savedsrcblend;
+	dc_destblend = saveddestblend;
+	dc_color = savedcolor;
+	mvlinebits = savedmvlinebits;
+	tmvlinebits = savedtmvlinebits;
+#ifndef X64_ASM
+	vlinebits = savedvlinebits;
+#endif
+}
+
+#endif
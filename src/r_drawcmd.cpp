@@ -0,0 +1,528 @@
+/*
+** r_drawcmd.cpp
+** Records wall columns and flat spans and draws them afterwards
+**
+**---------------------------------------------------------------------------
+**
+** With r_deferwalls on, wallscan does not draw the columns of solid walls
+** right away. Instead, everything the column drawer needs is stored in a
+** command, and the commands are drawn when the BSP walk is done. Until
+** then, nothing else is drawn on the pixels they cover. The clipping
+** arrays make sure that no two wall columns overlap, so the commands can
+** be drawn in any order and by more than one thread.
+**
+** R_DrawPlanes does the same for the spans of opaque, untilted flats that
+** would be drawn by R_DrawSpan. Visplanes never overlap each other or the
+** walls, so the spans of one R_DrawPlanes call can be drawn in any order,
+** too.
+**
+** Each group of commands (the columns of one BSP walk, or the spans of one
+** R_DrawPlanes call) is split into r_drawthreads slices, and each slice is
+** drawn by its own thread. Columns are sliced by screen column and spans
+** by screen row. Each slice sorts its commands by colormap and texture, so
+** commands that read the same data are drawn one after the other.
+**
+** Only opaque drawing is recorded. Masked and translucent walls, masked
+** and translucent planes, sprites, decals, skies and tilted planes are
+** drawn right away as before. Decals are drawn on top of walls while the
+** BSP is being walked, so R_StoreWallRange draws all recorded columns
+** before it draws a decal.
+**
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "templates.h"
+#include "doomtype.h"
+#include "doomdef.h"
+#include "r_defs.h"
+#include "r_draw.h"
+#include "r_main.h"
+#include "c_cvars.h"
+#include "stats.h"
+#include "workerpool.h"
+#include "profiler.h"
+
+// TYPES -------------------------------------------------------------------
+
+struct FColumnCmd
+{
+	BYTE *Dest;
+	const BYTE *Source;
+	const BYTE *Colormap;
+	DWORD TextureFrac;
+	DWORD IScale;
+	short X;
+	short Count;
+	BYTE Bits;
+};
+
+struct FSpanCmd
+{
+	BYTE *Dest;
+	const BYTE *Source;
+	const BYTE *Colormap;
+	DWORD XFrac, YFrac;
+	DWORD XStep, YStep;
+	short Y;
+	short Count;
+	BYTE XBits, YBits;
+};
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+CVAR (Bool, r_deferwalls, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
+// Number of threads that draw the deferred wall columns. Only the drawing
+// of the recorded commands is split up: the BSP walk, clipping, planes,
+// sprites and everything else are still done by the main thread alone.
+CUSTOM_CVAR (Int, r_drawthreads, 0, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0)
+	{
+		self = 0;
+	}
+	else if (self > MAX_WORKER_THREADS)
+	{
+		self = MAX_WORKER_THREADS;
+	}
+}
+
+bool DeferringColumns;
+bool DeferringSpans;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static TArray<FColumnCmd> ColumnCmds;
+static TArray<FSpanCmd> SpanCmds;
+static int ColumnPitch;
+
+// Shared by columns and spans, which are never drawn at the same time.
+static TArray<unsigned int> CmdOrder;
+static unsigned int CmdSliceStart[MAX_WORKER_THREADS + 1];
+
+static int NumCmdSlices;
+static int ColumnCmdCount;
+static int ColumnFlushes;
+static int SpanCmdCount;
+static cycle_t CmdSliceCycles[MAX_WORKER_THREADS];
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// R_BeginColumnCommands
+//
+// Called before the BSP is walked. Starts recording if r_deferwalls is on.
+//
+//==========================================================================
+
+void R_BeginColumnCommands ()
+{
+	DeferringColumns = r_deferwalls;
+	ColumnPitch = dc_pitch;
+	ColumnCmds.Clear();
+}
+
+//==========================================================================
+//
+// R_AddColumnCommand
+//
+// Records a column that would otherwise be drawn by dovline1 with these
+// values in dc_dest, dc_source, dc_colormap, dc_texturefrac, dc_iscale
+// and dc_count, after setupvline(bits).
+//
+//==========================================================================
+
+void R_AddColumnCommand (int x, BYTE *dest, const BYTE *source, const BYTE *colormap,
+	DWORD texturefrac, DWORD iscale, int count, int bits)
+{
+	FColumnCmd &cmd = ColumnCmds[ColumnCmds.Reserve(1)];
+
+	cmd.Dest = dest;
+	cmd.Source = source;
+	cmd.Colormap = colormap;
+	cmd.TextureFrac = texturefrac;
+	cmd.IScale = iscale;
+	cmd.X = x;
+	cmd.Count = count;
+	cmd.Bits = bits;
+}
+
+//==========================================================================
+//
+// R_DrawColumnCommand
+//
+// The same loop as vlinec1, but with everything taken from the command.
+//
+//==========================================================================
+
+static void R_DrawColumnCommand (const FColumnCmd &cmd, int pitch)
+{
+	DWORD fracstep = cmd.IScale;
+	DWORD frac = cmd.TextureFrac;
+	const BYTE *colormap = cmd.Colormap;
+	const BYTE *source = cmd.Source;
+	BYTE *dest = cmd.Dest;
+	int count = cmd.Count;
+	int bits = cmd.Bits;
+
+	do
+	{
+		*dest = colormap[source[frac>>bits]];
+		frac += fracstep;
+		dest += pitch;
+	} while (--count);
+}
+
+//==========================================================================
+//
+// R_AddSpanCommand
+//
+// Records the span that spanfunc would draw with the current ds_* values.
+//
+//==========================================================================
+
+void R_AddSpanCommand ()
+{
+	FSpanCmd &cmd = SpanCmds[SpanCmds.Reserve(1)];
+
+	cmd.Dest = ylookup[ds_y] + ds_x1 + dc_destorg;
+	cmd.Source = ds_source;
+	cmd.Colormap = ds_colormap;
+	cmd.XFrac = ds_xfrac;
+	cmd.YFrac = ds_yfrac;
+	cmd.XStep = ds_xstep;
+	cmd.YStep = ds_ystep;
+	cmd.Y = ds_y;
+	cmd.Count = ds_x2 - ds_x1 + 1;
+	cmd.XBits = ds_xbits;
+	cmd.YBits = ds_ybits;
+}
+
+//==========================================================================
+//
+// R_DrawSpanCommand
+//
+// The same loop as R_DrawSpanP_C, but with everything taken from the
+// command.
+//
+//==========================================================================
+
+static void R_DrawSpanCommand (const FSpanCmd &cmd)
+{
+	DWORD xfrac = cmd.XFrac;
+	DWORD yfrac = cmd.YFrac;
+	DWORD xstep = cmd.XStep;
+	DWORD ystep = cmd.YStep;
+	const BYTE *source = cmd.Source;
+	const BYTE *colormap = cmd.Colormap;
+	BYTE *dest = cmd.Dest;
+	int count = cmd.Count;
+	int spot;
+
+	if (cmd.XBits == 6 && cmd.YBits == 6)
+	{
+		do
+		{
+			spot = ((xfrac>>(32-6-6))&(63*64)) + (yfrac>>(32-6));
+			*dest++ = colormap[source[spot]];
+			xfrac += xstep;
+			yfrac += ystep;
+		} while (--count);
+	}
+	else
+	{
+		BYTE yshift = 32 - cmd.YBits;
+		BYTE xshift = yshift - cmd.XBits;
+		int xmask = ((1 << cmd.XBits) - 1) << cmd.YBits;
+
+		do
+		{
+			spot = ((xfrac >> xshift) & xmask) + (yfrac >> yshift);
+			*dest++ = colormap[source[spot]];
+			xfrac += xstep;
+			yfrac += ystep;
+		} while (--count);
+	}
+}
+
+//==========================================================================
+//
+// SortColumnCmds / SortSpanCmds
+//
+//==========================================================================
+
+static bool SortColumnCmds (unsigned int a, unsigned int b)
+{
+	const FColumnCmd &ca = ColumnCmds[a];
+	const FColumnCmd &cb = ColumnCmds[b];
+
+	if (ca.Colormap != cb.Colormap)
+	{
+		return ca.Colormap < cb.Colormap;
+	}
+	return ca.Source < cb.Source;
+}
+
+static bool SortSpanCmds (unsigned int a, unsigned int b)
+{
+	const FSpanCmd &ca = SpanCmds[a];
+	const FSpanCmd &cb = SpanCmds[b];
+
+	if (ca.Colormap != cb.Colormap)
+	{
+		return ca.Colormap < cb.Colormap;
+	}
+	return ca.Source < cb.Source;
+}
+
+//==========================================================================
+//
+// FColumnSliceBatch
+//
+// Each item is one slice of screen columns.
+//
+//==========================================================================
+
+class FColumnSliceBatch : public FWorkerBatch
+{
+public:
+	void Execute (int index, int thread)
+	{
+		unsigned int *order = &CmdOrder[0];
+		unsigned int start = CmdSliceStart[index];
+		unsigned int end = CmdSliceStart[index + 1];
+		int pitch = ColumnPitch;
+
+		PROFILE_ZONE("ColumnSlice");
+		CmdSliceCycles[index].Clock();
+		std::sort (order + start, order + end, SortColumnCmds);
+		for (unsigned int i = start; i < end; ++i)
+		{
+			R_DrawColumnCommand (ColumnCmds[order[i]], pitch);
+		}
+		CmdSliceCycles[index].Unclock();
+	}
+};
+
+//==========================================================================
+//
+// FSpanSliceBatch
+//
+// Each item is one slice of screen rows.
+//
+//==========================================================================
+
+class FSpanSliceBatch : public FWorkerBatch
+{
+public:
+	void Execute (int index, int thread)
+	{
+		unsigned int *order = &CmdOrder[0];
+		unsigned int start = CmdSliceStart[index];
+		unsigned int end = CmdSliceStart[index + 1];
+
+		PROFILE_ZONE("SpanSlice");
+		CmdSliceCycles[index].Clock();
+		std::sort (order + start, order + end, SortSpanCmds);
+		for (unsigned int i = start; i < end; ++i)
+		{
+			R_DrawSpanCommand (SpanCmds[order[i]]);
+		}
+		CmdSliceCycles[index].Unclock();
+	}
+};
+
+//==========================================================================
+//
+// R_SliceCommands
+//
+// Puts the indices of the commands into CmdOrder, grouped by slice, and
+// sets up CmdSliceStart. A command at position pos (screen column for
+// columns, screen row for spans) is in the last slice i that has
+// range * i / numslices <= pos. Returns the number of slices.
+//
+//==========================================================================
+
+static inline int CmdSlicePos (const FColumnCmd &cmd)
+{
+	return cmd.X;
+}
+
+static inline int CmdSlicePos (const FSpanCmd &cmd)
+{
+	return cmd.Y;
+}
+
+template<class T> static int R_SliceCommands (TArray<T> &cmds, int range)
+{
+	unsigned int count = cmds.Size();
+	unsigned int i;
+	int numslices, slice;
+
+	numslices = (r_drawthreads > 1 && range >= r_drawthreads * 16) ? r_drawthreads : 1;
+
+	memset (CmdSliceStart, 0, sizeof(CmdSliceStart));
+	for (i = 0; i < count; ++i)
+	{
+		slice = ((CmdSlicePos(cmds[i]) + 1) * numslices - 1) / range;
+		CmdSliceStart[slice + 1]++;
+	}
+	for (slice = 0; slice < numslices; ++slice)
+	{
+		CmdSliceStart[slice + 1] += CmdSliceStart[slice];
+	}
+	CmdOrder.Resize(count);
+	for (i = 0; i < count; ++i)
+	{
+		slice = ((CmdSlicePos(cmds[i]) + 1) * numslices - 1) / range;
+		CmdOrder[CmdSliceStart[slice]++] = i;
+	}
+	// Filling the slices moved each start to the start of the next one.
+	memmove (CmdSliceStart + 1, CmdSliceStart, numslices * sizeof(CmdSliceStart[0]));
+	CmdSliceStart[0] = 0;
+	NumCmdSlices = numslices;
+	return numslices;
+}
+
+//==========================================================================
+//
+// R_RunSlices
+//
+//==========================================================================
+
+static void R_RunSlices (FWorkerBatch *batch, int numslices)
+{
+	if (numslices > 1)
+	{
+		WorkerPool.Run (batch, numslices);
+	}
+	else
+	{
+		batch->Execute (0, 0);
+	}
+}
+
+//==========================================================================
+//
+// R_FlushColumnCommands
+//
+// Draws all recorded columns.
+//
+//==========================================================================
+
+void R_FlushColumnCommands ()
+{
+	if (ColumnCmds.Size() == 0)
+	{
+		return;
+	}
+
+	FColumnSliceBatch batch;
+	int numslices = R_SliceCommands (ColumnCmds, viewwidth);
+
+	ColumnCmdCount += ColumnCmds.Size();
+	ColumnFlushes++;
+	R_RunSlices (&batch, numslices);
+	ColumnCmds.Clear();
+}
+
+//==========================================================================
+//
+// R_EndColumnCommands
+//
+// Called when the BSP has been walked. Draws everything and stops
+// recording.
+//
+//==========================================================================
+
+void R_EndColumnCommands ()
+{
+	R_FlushColumnCommands ();
+	DeferringColumns = false;
+}
+
+//==========================================================================
+//
+// R_BeginSpanCommands
+//
+// Called by R_DrawPlanes before it draws anything. Starts recording if
+// r_deferwalls is on.
+//
+//==========================================================================
+
+void R_BeginSpanCommands ()
+{
+	DeferringSpans = r_deferwalls;
+	SpanCmds.Clear();
+}
+
+//==========================================================================
+//
+// R_EndSpanCommands
+//
+// Called by R_DrawPlanes when it is done. Draws all recorded spans and
+// stops recording.
+//
+//==========================================================================
+
+void R_EndSpanCommands ()
+{
+	DeferringSpans = false;
+	if (SpanCmds.Size() == 0)
+	{
+		return;
+	}
+
+	FSpanSliceBatch batch;
+	int numslices = R_SliceCommands (SpanCmds, viewheight);
+
+	SpanCmdCount += SpanCmds.Size();
+	R_RunSlices (&batch, numslices);
+	SpanCmds.Clear();
+}
+
+//==========================================================================
+//
+// R_ResetDrawCmdStats
+//
+// Called at frame start.
+//
+//==========================================================================
+
+void R_ResetDrawCmdStats ()
+{
+	for (int i = 0; i < MAX_WORKER_THREADS; ++i)
+	{
+		CmdSliceCycles[i].Reset();
+	}
+	NumCmdSlices = ColumnCmdCount = ColumnFlushes = SpanCmdCount = 0;
+}
+
+//==========================================================================
+//
+// STAT drawcmds
+//
+//==========================================================================
+
+ADD_STAT(drawcmds)
+{
+	FString out;
+
+	if (!r_deferwalls || NumCmdSlices == 0)
+	{
+		out = "Drawing not deferred";
+		return out;
+	}
+	out.Format ("%d columns, %d flushes, %d spans, %d slices:",
+		ColumnCmdCount, ColumnFlushes, SpanCmdCount, NumCmdSlices);
+	for (int i = 0; i < NumCmdSlices; ++i)
+	{
+		out.AppendFormat (" %.2f", CmdSliceCycles[i].TimeMS());
+	}
+	out += " ms";
+	return out;
+}
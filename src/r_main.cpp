@@ -57,6 +57,7 @@
 #include "v_font.h"
 #include "r_data/colormaps.h"
 #include "farchive.h"
+#include "profiler.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -690,7 +691,9 @@ void R_EnterMirror (drawseg_t *ds, int depth)
 	WindowRight = ds->x2;
 	MirrorFlags = (depth + 1) & 1;
 
+	R_BeginColumnCommands ();
 	R_RenderBSPNode (nodes + numnodes - 1);
+	R_EndColumnCommands ();
 	R_3D_ResetClip(); // reset clips (floor/ceiling)
 
 	R_DrawPlanes ();
@@ -757,10 +760,12 @@ void R_SetupBuffer ()
 
 void R_RenderActorView (AActor *actor, bool dontmaplines)
 {
+	PROFILE_ZONE("R_RenderActorView");
 	WallCycles.Reset();
 	PlaneCycles.Reset();
 	MaskedCycles.Reset();
 	WallScanCycles.Reset();
+	R_ResetDrawCmdStats ();
 
 	fakeActive = 0; // kg3D - reset fake floor indicator
 	R_3D_ResetClip(); // reset clips (floor/ceiling)
@@ -818,7 +823,9 @@ void R_RenderActorView (AActor *actor, bool dontmaplines)
 	PO_LinkToSubsectors();
 	if (r_polymost < 2)
 	{
+		R_BeginColumnCommands ();
 		R_RenderBSPNode (nodes + numnodes - 1);	// The head node is the last node output.
+		R_EndColumnCommands ();
 		R_3D_ResetClip(); // reset clips (floor/ceiling)
 	}
 	camera->renderflags = savedflags;
@@ -230,6 +230,11 @@ void R_MapPlane (int y, int x1)
 	ds_x1 = x1;
 	ds_x2 = x2;
 
+	if (DeferringSpans && spanfunc == R_DrawSpan)
+	{
+		R_AddSpanCommand ();
+		return;
+	}
 	spanfunc ();
 }
 
@@ -1036,6 +1041,7 @@ int R_DrawPlanes ()
 
 	ds_color = 3;
 
+	R_BeginSpanCommands ();
 	for (i = 0; i < MAXVISPLANES; i++)
 	{
 		for (pl = visplanes[i]; pl; pl = pl->next)
@@ -1050,6 +1056,7 @@ int R_DrawPlanes ()
 			}
 		}
 	}
+	R_EndSpanCommands ();
 	return vpcount;
 }
 
@@ -1295,7 +1302,9 @@ void R_DrawSkyBoxes ()
 		viewzStack.Push (viewz);
 		visplaneStack.Push (pl);
 
+		R_BeginColumnCommands ();
 		R_RenderBSPNode (nodes + numnodes - 1);
+		R_EndColumnCommands ();
 		R_3D_ResetClip(); // reset clips (floor/ceiling)
 		R_DrawPlanes ();
 
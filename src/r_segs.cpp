@@ -1094,6 +1094,32 @@ void wallscan (int x1, int x2, short *uwal, short *dwal, fixed_t *swal, fixed_t
 		palookupoffse[3] = dc_colormap;
 	}
 
+	if (DeferringColumns)
+	{ // record whole columns to be drawn after the BSP walk
+		for(; x <= x2; ++x)
+		{
+			light += rw_lightstep;
+			y1ve[0] = uwal[x];
+			y2ve[0] = dwal[x];
+			if (y2ve[0] <= y1ve[0]) continue;
+			assert (y1ve[0] < viewheight);
+			assert (y2ve[0] <= viewheight);
+
+			if (!fixed)
+			{ // calculate lighting
+				dc_colormap = basecolormapdata + (GETPALOOKUP (light, wallshade) << COLORMAPSHIFT);
+			}
+
+			dc_iscale = swal[x] * yrepeat;
+			R_AddColumnCommand (x, ylookup[y1ve[0]] + x + dc_destorg,
+				getcol (rw_pic, (lwal[x] + xoffset) >> FRACBITS), dc_colormap,
+				texturemid + FixedMul (dc_iscale, (y1ve[0]<<FRACBITS)-centeryfrac+FRACUNIT),
+				dc_iscale, y2ve[0] - y1ve[0], 32-shiftval);
+		}
+		NetUpdate ();
+		return;
+	}
+
 	for(; (x <= x2) && (x & 3); ++x)
 	{
 		light += rw_lightstep;
@@ -1183,7 +1209,7 @@ void wallscan (int x1, int x2, short *uwal, short *dwal, fixed_t *swal, fixed_t
 		{
 			if (y2ve[z] > d4)
 			{
-				prevline1(vince[z],palookupoffse[0],y2ve[z]-d4,vplce[z],bufplce[z],i+z);
+				prevline1(vince[z],palookupoffse[z],y2ve[z]-d4,vplce[z],bufplce[z],i+z);
 			}
 		}
 	}
@@ -2599,6 +2625,12 @@ void R_StoreWallRange (int start, int stop)
 	}
 
 	// [RH] Draw any decals bound to the seg
+	// They go on top of the wall, so any deferred wall columns must be
+	// drawn first.
+	if (DeferringColumns && curline->sidedef->AttachedDecals != NULL)
+	{
+		R_FlushColumnCommands ();
+	}
 	for (DBaseDecal *decal = curline->sidedef->AttachedDecals; decal != NULL; decal = decal->WallNext)
 	{
 		R_RenderDecal (curline->sidedef, decal, ds_p, 0);
@@ -18,7 +18,7 @@ struct FSoftwareRenderer : public FRenderer
 	virtual void RemapVoxels();
 
 	// renders view to a savegame picture
-	virtual void WriteSavePic (player_t *player, FILE *file, int width, int height);
+	virtual void WriteSavePic (player_t *player, FileWriter *file, int width, int height);
 
 	// draws player sprites with hardware acceleration (only useful for software rendering)
 	virtual void DrawRemainingPlayerSprites();
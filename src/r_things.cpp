@@ -62,6 +62,7 @@
 #include "r_data/colormaps.h"
 #include "r_data/voxels.h"
 #include "p_local.h"
+#include "stats.h"
 
 // [RH] A c-buffer. Used for keeping track of offscreen voxel spans.
 
@@ -141,18 +142,34 @@ vissprite_t		**lastvissprite;
 int 			newvissprite;
 bool			DrewAVoxel;
 
+// The vissprites themselves are allocated in blocks, which are merged into
+// one when a new frame starts, so a frame's sprites are next to each other.
+static TArray<vissprite_t *> VisSpriteBlocks;
+
+struct FSpriteSortKey
+{
+	QWORD Key;
+	vissprite_t *Sprite;
+};
+
 static vissprite_t **spritesorter;
+static FSpriteSortKey *spritekeys;	// two halves, used alternately by the passes
 static int spritesortersize = 0;
 static int vsprcount;
 
+static void R_FreeVisSpriteBlocks()
+{
+	for (unsigned int i = 0; i < VisSpriteBlocks.Size(); ++i)
+	{
+		delete[] VisSpriteBlocks[i];
+	}
+	VisSpriteBlocks.Clear();
+}
 
 void R_DeinitSprites()
 {
 	// Free vissprites
-	for (int i = 0; i < MaxVisSprites; ++i)
-	{
-		delete vissprites[i];
-	}
+	R_FreeVisSpriteBlocks();
 	free (vissprites);
 	vissprites = NULL;
 	vissprite_p = lastvissprite = NULL;
@@ -162,8 +179,10 @@ void R_DeinitSprites()
 	if (spritesorter != NULL)
 	{
 		delete[] spritesorter;
+		delete[] spritekeys;
 		spritesortersize = 0;
 		spritesorter = NULL;
+		spritekeys = NULL;
 	}
 
 	// Free offscreen buffer
@@ -180,12 +199,35 @@ void R_DeinitSprites()
 	OffscreenBufferHeight = OffscreenBufferWidth = 0;
 }
 
+//
+// R_AllocVisSprites
+// Fills a part of the vissprites table from a new block.
+//
+static void R_AllocVisSprites (vissprite_t **p, vissprite_t **end)
+{
+	vissprite_t *block = new vissprite_t[end - p];
+
+	VisSpriteBlocks.Push(block);
+	while (p < end)
+	{
+		*p++ = block++;
+	}
+}
+
 //
 // R_ClearSprites
 // Called at frame start.
 //
 void R_ClearSprites (void)
 {
+	// If the table grew during the last frame, its sprites are now spread
+	// over several blocks. Nothing points at them between frames, so they
+	// can be replaced with a single one.
+	if (VisSpriteBlocks.Size() > 1 && firstvissprite == vissprites)
+	{
+		R_FreeVisSpriteBlocks();
+		R_AllocVisSprites (vissprites, lastvissprite);
+	}
 	vissprite_p = firstvissprite;
 	DrewAVoxel = false;
 }
@@ -202,17 +244,14 @@ vissprite_t *R_NewVisSprite (void)
 		ptrdiff_t prevvisspritenum = vissprite_p - vissprites;
 
 		MaxVisSprites = MaxVisSprites ? MaxVisSprites * 2 : 128;
-		vissprites = (vissprite_t **)M_Realloc (vissprites, MaxVisSprites * sizeof(vissprite_t));
+		vissprites = (vissprite_t **)M_Realloc (vissprites, MaxVisSprites * sizeof(vissprite_t *));
 		lastvissprite = &vissprites[MaxVisSprites];
 		firstvissprite = &vissprites[firstvisspritenum];
 		vissprite_p = &vissprites[prevvisspritenum];
 		DPrintf ("MaxVisSprites increased to %d\n", MaxVisSprites);
 
 		// Allocate sprites from the new pile
-		for (vissprite_t **p = vissprite_p; p < lastvissprite; ++p)
-		{
-			*p = new vissprite_t;
-		}
+		R_AllocVisSprites (vissprite_p, lastvissprite);
 	}
 
 	vissprite_p++;
@@ -1335,20 +1374,29 @@ void R_DrawRemainingPlayerSprites()
 //		gain compared to the old function.
 //
 // Sort vissprites by depth, far to near
+//
+// Each sprite gets a key, and the keys are sorted with a stable radix sort,
+// so sprites with equal keys stay in the order they were put in the sort
+// array. The keys are chosen so that ascending key order is the same as the
+// order the old comparison functions sorted in.
 
 // This is the standard version, which does a simple test based on depth.
-static bool sv_compare(vissprite_t *a, vissprite_t *b)
+// Larger idepths come first.
+static QWORD sv_depthkey(vissprite_t *spr)
 {
-	return a->idepth > b->idepth;
+	return DWORD(spr->idepth) ^ 0x7fffffff;
 }
 
 // This is an alternate version, for when one or more voxel is in view.
 // It does a 2D distance test based on whichever one is furthest from
-// the viewpoint.
-static bool sv_compare2d(vissprite_t *a, vissprite_t *b)
+// the viewpoint. The distance is never negative, and the bits of a
+// non-negative double sort like the double itself.
+static QWORD sv_distkey(vissprite_t *spr)
 {
-	return TVector2<double>(a->deltax, a->deltay).LengthSquared() <
-		   TVector2<double>(b->deltax, b->deltay).LengthSquared();
+	union { double f; QWORD i; } dist;
+
+	dist.f = TVector2<double>(spr->deltax, spr->deltay).LengthSquared();
+	return dist.i;
 }
 
 #if 0
@@ -1491,10 +1539,63 @@ static void swap(vissprite_t *&a, vissprite_t *&b)
 }
 #endif
 
-void R_SortVisSprites (bool (*compare)(vissprite_t *, vissprite_t *), size_t first)
+//==========================================================================
+//
+// R_RadixSortKeys
+//
+// Sorts the keys one byte at a time, starting with the lowest. Returns
+// whichever of the two buffers holds the result.
+//
+//==========================================================================
+
+static FSpriteSortKey *R_RadixSortKeys (FSpriteSortKey *keys, FSpriteSortKey *temp, int count)
+{
+	unsigned int counts[8][256];
+	int i, b;
+
+	memset (counts, 0, sizeof(counts));
+	for (i = 0; i < count; ++i)
+	{
+		QWORD key = keys[i].Key;
+		for (b = 0; b < 8; ++b)
+		{
+			counts[b][(key >> (b*8)) & 255]++;
+		}
+	}
+	for (b = 0; b < 8; ++b)
+	{
+		unsigned int *c = counts[b];
+		unsigned int sum, n;
+		int shift = b*8;
+
+		// If all keys have the same byte here, this pass would not change
+		// anything. For depth keys, this skips at least the upper half.
+		if (c[(keys[0].Key >> shift) & 255] == (unsigned)count)
+		{
+			continue;
+		}
+		for (i = 0, sum = 0; i < 256; ++i)
+		{
+			n = c[i];
+			c[i] = sum;
+			sum += n;
+		}
+		for (i = 0; i < count; ++i)
+		{
+			temp[c[(keys[i].Key >> shift) & 255]++] = keys[i];
+		}
+		FSpriteSortKey *t = keys;
+		keys = temp;
+		temp = t;
+	}
+	return keys;
+}
+
+void R_SortVisSprites (QWORD (*getkey)(vissprite_t *), size_t first)
 {
 	int i;
 	vissprite_t **spr;
+	FSpriteSortKey *keys;
 
 	vsprcount = int(vissprite_p - &vissprites[first]);
 
@@ -1504,8 +1605,12 @@ void R_SortVisSprites (bool (*compare)(vissprite_t *, vissprite_t *), size_t fir
 	if (spritesortersize < MaxVisSprites)
 	{
 		if (spritesorter != NULL)
+		{
 			delete[] spritesorter;
+			delete[] spritekeys;
+		}
 		spritesorter = new vissprite_t *[MaxVisSprites];
+		spritekeys = new FSpriteSortKey[MaxVisSprites * 2];
 		spritesortersize = MaxVisSprites;
 	}
 
@@ -1513,7 +1618,8 @@ void R_SortVisSprites (bool (*compare)(vissprite_t *, vissprite_t *), size_t fir
 	{
 		for (i = 0, spr = firstvissprite; i < vsprcount; i++, spr++)
 		{
-			spritesorter[i] = *spr;
+			spritekeys[i].Key = getkey(*spr);
+			spritekeys[i].Sprite = *spr;
 		}
 	}
 	else
@@ -1523,13 +1629,170 @@ void R_SortVisSprites (bool (*compare)(vissprite_t *, vissprite_t *), size_t fir
 		// filling the sort array backwards before the sort.
 		for (i = 0, spr = firstvissprite + vsprcount-1; i < vsprcount; i++, spr--)
 		{
-			spritesorter[i] = *spr;
+			spritekeys[i].Key = getkey(*spr);
+			spritekeys[i].Sprite = *spr;
+		}
+	}
+
+	keys = R_RadixSortKeys (spritekeys, spritekeys + spritesortersize, vsprcount);
+	for (i = 0; i < vsprcount; ++i)
+	{
+		spritesorter[i] = keys[i].Sprite;
+	}
+}
+
+
+//==========================================================================
+//
+// Drawseg index
+//
+// R_DrawSprite has to look at every drawseg that overlaps the sprite, from
+// the last one to the first. So that it does not have to walk the whole
+// list for every sprite, R_DrawMasked sorts the drawsegs that can matter
+// to a sprite into buckets of screen columns. Each bucket is a bit set
+// with one bit per drawseg. The sets of all the buckets a sprite covers
+// are merged and walked from the highest bit down, which visits the
+// drawsegs in the same order as the full walk.
+//
+//==========================================================================
+
+#define DSEG_BUCKET_SHIFT	5			// 32 columns per bucket
+#define DSEG_NUM_BUCKETS	((MAXWIDTH >> DSEG_BUCKET_SHIFT) + 1)
+
+CVAR (Bool, r_drawsegindex, true, 0)
+
+static TArray<DWORD> DrawSegBits;				// [bucket][word]
+static int DrawSegBucketTop[DSEG_NUM_BUCKETS];	// highest word with a bit set, or -1
+static unsigned int DrawSegWords;
+static int DrawSegBuckets;
+static drawseg_t *DrawSegIndexFirst, *DrawSegIndexEnd;
+static TArray<drawseg_t *> SpriteClipSegs;
+static int SpriteClipVisits, SpriteClipWalk;
+
+//==========================================================================
+//
+// R_BuildDrawSegIndex
+//
+//==========================================================================
+
+static void R_BuildDrawSegIndex ()
+{
+	unsigned int count = unsigned(ds_p - firstdrawseg);
+
+	DrawSegIndexFirst = DrawSegIndexEnd = NULL;
+	SpriteClipVisits = SpriteClipWalk = 0;
+	if (!r_drawsegindex || count == 0)
+	{
+		return;
+	}
+
+	DrawSegBuckets = ((viewwidth - 1) >> DSEG_BUCKET_SHIFT) + 1;
+	DrawSegWords = (count + 31) / 32;
+	DrawSegBits.Resize (DrawSegBuckets * DrawSegWords);
+	memset (&DrawSegBits[0], 0, DrawSegBits.Size() * sizeof(DWORD));
+	for (int b = 0; b < DrawSegBuckets; ++b)
+	{
+		DrawSegBucketTop[b] = -1;
+	}
+
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		drawseg_t *ds = firstdrawseg + i;
+
+		// These are the drawsegs R_DrawSprite skips without looking at
+		// the sprite.
+		if (ds->fake || (!(ds->silhouette & SIL_BOTH) && ds->maskedtexturecol == -1 && !ds->bFogBoundary))
+		{
+			continue;
+		}
+		int b1 = MAX<int> (ds->x1, 0) >> DSEG_BUCKET_SHIFT;
+		int b2 = MIN<int> (ds->x2, viewwidth - 1) >> DSEG_BUCKET_SHIFT;
+		for (int b = b1; b <= b2; ++b)
+		{
+			DrawSegBits[b * DrawSegWords + i / 32] |= 1u << (i & 31);
+			DrawSegBucketTop[b] = i / 32;
 		}
 	}
+	DrawSegIndexFirst = firstdrawseg;
+	DrawSegIndexEnd = ds_p;
+}
 
-	std::stable_sort(&spritesorter[0], &spritesorter[vsprcount], compare);
+//==========================================================================
+//
+// R_GetSpriteClipSegs
+//
+// Fills SpriteClipSegs with the drawsegs R_DrawSprite has to look at for a
+// sprite covering columns x1 to x2, last one first.
+//
+// Merging the buckets costs one word per bucket and per 32 drawsegs, so
+// for wide sprites it can cost more than just walking every drawseg. In a
+// test with random drawsegs at 1920 columns, the walk was faster once the
+// merge had more than about 1.5 words to OR for every drawseg, so beyond
+// that the index is not used.
+//
+//==========================================================================
+
+static void R_GetSpriteClipSegs (int x1, int x2)
+{
+	int count = int(ds_p - firstdrawseg);
+	drawseg_t *ds;
+
+	SpriteClipSegs.Clear();
+	SpriteClipWalk += count;
+
+	int b1 = MAX (x1, 0) >> DSEG_BUCKET_SHIFT;
+	int b2 = MIN (x2 >> DSEG_BUCKET_SHIFT, DrawSegBuckets - 1);
+	int top = -1;
+	int b;
+
+	// The index is only good for the drawsegs it was built from.
+	bool useindex = DrawSegIndexFirst != NULL && DrawSegIndexFirst == firstdrawseg && DrawSegIndexEnd == ds_p;
+
+	if (useindex)
+	{
+		for (b = b1; b <= b2; ++b)
+		{
+			top = MAX (top, DrawSegBucketTop[b]);
+		}
+		useindex = (b2 - b1 + 1) * (top + 1) * 2 <= count * 3;
+	}
+	if (!useindex)
+	{
+		for (ds = ds_p; ds-- > firstdrawseg; )
+		{
+			SpriteClipSegs.Push (ds);
+		}
+		SpriteClipVisits += SpriteClipSegs.Size();
+		return;
+	}
+
+	for (int w = top; w >= 0; --w)
+	{
+		DWORD bits = 0;
+
+		for (b = b1; b <= b2; ++b)
+		{
+			bits |= DrawSegBits[b * DrawSegWords + w];
+		}
+		for (int bit = 31; bits != 0; --bit)
+		{
+			if (bits & (1u << bit))
+			{
+				bits &= ~(1u << bit);
+				SpriteClipSegs.Push (firstdrawseg + w * 32 + bit);
+			}
+		}
+	}
+	SpriteClipVisits += SpriteClipSegs.Size();
 }
 
+ADD_STAT(spriteclip)
+{
+	FString out;
+	out.Format ("Drawsegs checked for sprites: %d (%d without index)",
+		SpriteClipVisits, SpriteClipWalk);
+	return out;
+}
 
 //
 // R_DrawSprite
@@ -1823,8 +2086,12 @@ void R_DrawSprite (vissprite_t *spr)
 
 	//		for (ds=ds_p-1 ; ds >= drawsegs ; ds--)    old buggy code
 
-	for (ds = ds_p; ds-- > firstdrawseg; )  // new -- killough
+	// Only the drawsegs that can overlap the sprite are walked now, in the
+	// same order as before.
+	R_GetSpriteClipSegs (x1, x2);
+	for (unsigned int dsnum = 0; dsnum < SpriteClipSegs.Size(); ++dsnum)
 	{
+		ds = SpriteClipSegs[dsnum];
 		// kg3D - no clipping on fake segs
 		if(ds->fake) continue;
 		// determine if the drawseg obscures the sprite
@@ -1981,7 +2248,8 @@ void R_DrawHeightPlanes(fixed_t height); // kg3D - fake planes
 
 void R_DrawMasked (void)
 {
-	R_SortVisSprites (DrewAVoxel ? sv_compare2d : sv_compare, firstvissprite - vissprites);
+	R_SortVisSprites (DrewAVoxel ? sv_distkey : sv_depthkey, firstvissprite - vissprites);
+	R_BuildDrawSegIndex ();
 
 	if (height_top == NULL)
 	{ // kg3D - no visible 3D floors, normal rendering
@@ -40,6 +40,7 @@
 #include "w_zip.h"
 #include "i_system.h"
 #include "w_wad.h"
+#include "critsec.h"
 
 extern "C" {
 #include "Archive/7z/7zHeader.h"
@@ -117,6 +118,7 @@ struct C7zArchive
 	UInt32 BlockIndex;
 	Byte *OutBuffer;
 	size_t OutBufferSize;
+	FCriticalSection Lock;		// for Extract, which may be called by the prefetcher
 
 	C7zArchive(FileReader *file) : ArchiveStream(file)
 	{
@@ -148,9 +150,12 @@ struct C7zArchive
 		return SzArEx_Open(&DB, &LookStream.s, &g_Alloc, &g_Alloc);
 	}
 
+	// The most recently decoded solid block is kept in OutBuffer, so
+	// extracting the files of one block in a row decodes it only once.
 	SRes Extract(UInt32 file_index, char *buffer)
 	{
 		size_t offset, out_size_processed;
+		Lock.Enter();
 		SRes res = SzAr_Extract(&DB, &LookStream.s, file_index,
 			&BlockIndex, &OutBuffer, &OutBufferSize,
 			&offset, &out_size_processed,
@@ -159,6 +164,7 @@ struct C7zArchive
 		{
 			memcpy(buffer, OutBuffer + offset, out_size_processed);
 		}
+		Lock.Leave();
 		return res;
 	}
 };
@@ -173,6 +179,8 @@ struct F7ZLump : public FResourceLump
 	int		Position;
 
 	virtual int FillCache();
+	virtual int CanPrefetch() { return Position; }
+	virtual bool Prefetch(char *buffer);
 
 };
 
@@ -332,6 +340,18 @@ int F7ZLump::FillCache()
 	return 1;
 }
 
+//==========================================================================
+//
+// The archive is locked while extracting, so this can run concurrently
+// with FillCache.
+//
+//==========================================================================
+
+bool F7ZLump::Prefetch(char *buffer)
+{
+	return static_cast<F7ZFile*>(Owner)->Archive->Extract(Position, buffer) == SZ_OK;
+}
+
 //==========================================================================
 //
 // File open
@@ -117,9 +117,12 @@ struct FZipLump : public FResourceLump
 
 	virtual FileReader *GetReader();
 	virtual int FillCache();
+	virtual int CanPrefetch();
+	virtual bool Prefetch(char *buffer);
 
 private:
 	void SetLumpAddress();
+	bool Decompress(FileReader *reader, char *buffer);
 	virtual int GetFileOffset() 
 	{ 
 		if (Method != METHOD_STORED) return -1;
@@ -339,61 +342,97 @@ int FZipLump::FillCache()
 	if (Method == METHOD_STORED && (buffer = Owner->Reader->GetBuffer()) != NULL)
 	{
 		// This is an in-memory file so the cache can point directly to the file's data.
-		Cache = const_cast<char*>(buffer) + Position;
-		RefCount = -1;
-		return -1;
+		return CacheInPlace(buffer, Position);
 	}
 
 	Owner->Reader->Seek(Position, SEEK_SET);
 	Cache = new char[LumpSize];
+	if (!Decompress(Owner->Reader, Cache))
+	{
+		return 0;
+	}
+	RefCount = 1;
+	return 1;
+}
+
+//==========================================================================
+//
+// Reads the lump's data from the reader's current position into buffer
+//
+//==========================================================================
+
+bool FZipLump::Decompress(FileReader *reader, char *buffer)
+{
 	switch (Method)
 	{
 		case METHOD_STORED:
 		{
-			Owner->Reader->Read(Cache, LumpSize);
+			reader->Read(buffer, LumpSize);
 			break;
 		}
 
 		case METHOD_DEFLATE:
 		{
-			FileReaderZ frz(*Owner->Reader, true);
-			frz.Read(Cache, LumpSize);
+			FileReaderZ frz(*reader, true);
+			frz.Read(buffer, LumpSize);
 			break;
 		}
 
 		case METHOD_BZIP2:
 		{
-			FileReaderBZ2 frz(*Owner->Reader);
-			frz.Read(Cache, LumpSize);
+			FileReaderBZ2 frz(*reader);
+			frz.Read(buffer, LumpSize);
 			break;
 		}
 
 		case METHOD_LZMA:
 		{
-			FileReaderLZMA frz(*Owner->Reader, LumpSize, true);
-			frz.Read(Cache, LumpSize);
+			FileReaderLZMA frz(*reader, LumpSize, true);
+			frz.Read(buffer, LumpSize);
 			break;
 		}
 
 		case METHOD_IMPLODE:
 		{
 			FZipExploder exploder;
-			exploder.Explode((unsigned char *)Cache, LumpSize, Owner->Reader, CompressedSize, GPFlags);
+			exploder.Explode((unsigned char *)buffer, LumpSize, reader, CompressedSize, GPFlags);
 			break;
 		}
 
 		case METHOD_SHRINK:
 		{
-			ShrinkLoop((unsigned char *)Cache, LumpSize, Owner->Reader, CompressedSize);
+			ShrinkLoop((unsigned char *)buffer, LumpSize, reader, CompressedSize);
 			break;
 		}
 
 		default:
 			assert(0);
-			return 0;
+			return false;
 	}
-	RefCount = 1;
-	return 1;
+	return true;
+}
+
+//==========================================================================
+//
+// Only compressed lumps of files that are in memory can be prefetched,
+// because the main thread may use the file's reader at any time.
+//
+//==========================================================================
+
+int FZipLump::CanPrefetch()
+{
+	if (Method == METHOD_STORED || Owner->Reader->GetBuffer() == NULL)
+	{
+		return -1;
+	}
+	if (Flags & LUMPFZIP_NEEDFILESTART) SetLumpAddress();
+	return Position;
+}
+
+bool FZipLump::Prefetch(char *buffer)
+{
+	MemoryReader reader(Owner->Reader->GetBuffer() + Position, CompressedSize);
+	return Decompress(&reader, buffer);
 }
 
 
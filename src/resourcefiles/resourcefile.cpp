@@ -38,6 +38,10 @@
 #include "cmdlib.h"
 #include "w_wad.h"
 #include "doomerrors.h"
+#include "stats.h"
+
+static int InPlaceLumps;
+static size_t InPlaceBytes;
 
 
 
@@ -215,11 +219,38 @@ void *FResourceLump::CacheLump()
 	}
 	else if (LumpSize > 0)
 	{
-		FillCache();
+		char *data = FWadCollection::TakePrefetchedLump(this);
+
+		if (data != NULL)
+		{
+			Cache = data;
+			RefCount = 1;
+		}
+		else
+		{
+			FillCache();
+		}
 	}
 	return Cache;
 }
 
+//==========================================================================
+//
+// Points the cache at the lump's data in a buffer that holds the whole
+// file, i.e. an in-memory or memory-mapped file. Such a cache is never
+// released, so the reference counter is set to -1.
+//
+//==========================================================================
+
+int FResourceLump::CacheInPlace(const char *filedata, int position)
+{
+	Cache = const_cast<char*>(filedata) + position;
+	RefCount = -1;
+	InPlaceLumps++;
+	InPlaceBytes += LumpSize;
+	return -1;
+}
+
 //==========================================================================
 //
 // Decrements reference counter and frees lump if counter reaches 0
@@ -341,9 +372,7 @@ int FUncompressedLump::FillCache()
 	if (buffer != NULL)
 	{
 		// This is an in-memory file so the cache can point directly to the file's data.
-		Cache = const_cast<char*>(buffer) + Position;
-		RefCount = -1;
-		return -1;
+		return CacheInPlace(buffer, Position);
 	}
 
 	Owner->Reader->Seek(Position, SEEK_SET);
@@ -432,3 +461,22 @@ int FExternalLump::FillCache()
 	return 1;
 }
 
+
+//==========================================================================
+//
+// STAT mmap
+//
+// Lumps used in place would otherwise have been copied to the heap. This
+// includes lumps of in-memory files, such as WADs embedded in a zip.
+//
+//==========================================================================
+
+ADD_STAT(mmap)
+{
+	FString out;
+
+	out.Format("%d files mapped (%zuK)  %d lumps used in place (%zuK not copied)",
+		MappedFileReader::NumMapped, (MappedFileReader::MappedBytes + 1023) >> 10,
+		InPlaceLumps, (InPlaceBytes + 1023) >> 10);
+	return out;
+}
@@ -48,8 +48,18 @@ struct FResourceLump
 	void *CacheLump();
 	int ReleaseCache();
 
+	// Support for FWadCollection::PrefetchLumps. CanPrefetch is called on
+	// the main thread and returns -1 if the lump cannot be decompressed in
+	// the background. Otherwise it returns a key that sorts the lumps of
+	// one file in the order they are stored. Prefetch may then be called on
+	// any thread. It must neither touch the lump's cache nor use its file's
+	// reader, except under a lock that FillCache takes as well.
+	virtual int CanPrefetch() { return -1; }
+	virtual bool Prefetch(char *buffer) { return false; }
+
 protected:
 	virtual int FillCache() = 0;
+	int CacheInPlace(const char *filedata, int position);
 
 };
 
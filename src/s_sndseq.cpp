@@ -302,6 +302,7 @@ void DSeqNode::Serialize (FArchive &arc)
 	unsigned int i;
 
 	Super::Serialize (arc);
+	GC::EscapeBarrier(this);	// m_Next and m_Prev are plain pointers
 	if (arc.IsStoring ())
 	{
 		seqOffset = (int)SN_GetSequenceOffset (m_Sequence, m_SequencePtr);
@@ -782,6 +783,7 @@ DSeqNode::DSeqNode (int sequence, int modenum)
 		m_Prev = NULL;
 	}
 	GC::WriteBarrier(this);
+	GC::EscapeBarrier(this);	// m_Next and m_Prev are plain pointers
 	m_ParentSeqNode = m_ChildSeqNode = NULL;
 }
 
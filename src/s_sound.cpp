@@ -51,6 +51,7 @@
 #include "g_level.h"
 #include "po_man.h"
 #include "farchive.h"
+#include "profiler.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -488,6 +489,16 @@ void S_PrecacheLevel ()
 			level.info->PrecacheSounds[i].MarkUsed();
 		}
 
+		TArray<int> lumps;
+		for (i = 1; i < S_sfx.Size(); ++i)
+		{
+			if (S_sfx[i].bUsed && S_sfx[i].lumpnum >= 0)
+			{
+				lumps.Push(S_sfx[i].lumpnum);
+			}
+		}
+		Wads.PrefetchLumps(lumps);
+
 		for (i = 1; i < S_sfx.Size(); ++i)
 		{
 			if (S_sfx[i].bUsed)
@@ -1917,6 +1928,7 @@ void S_RestoreEvictedChannels()
 
 void S_UpdateSounds (AActor *listenactor)
 {
+	PROFILE_ZONE("S_UpdateSounds");
 	FVector3 pos, vel;
 	SoundListener listener;
 
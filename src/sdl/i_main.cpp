@@ -264,6 +264,17 @@ int main (int argc, char **argv)
 	
 	setlocale (LC_ALL, "C");
 
+	// The benchmark never draws anything, so it doesn't need a window either.
+	// Args does not exist yet, so look for it by hand.
+	for (int i = 1; i < argc; ++i)
+	{
+		if (stricmp (argv[i], "-bench") == 0 || stricmp (argv[i], "-nodebench") == 0)
+		{
+			setenv ("SDL_VIDEODRIVER", "dummy", 0);
+			break;
+		}
+	}
+
 	if (SDL_Init (SDL_INIT_VIDEO|SDL_INIT_TIMER|SDL_INIT_NOPARACHUTE|SDL_INIT_JOYSTICK) == -1)
 	{
 		fprintf (stderr, "Could not initialize SDL:\n%s\n", SDL_GetError());
@@ -154,7 +154,7 @@ void I_InitMusic (void)
 
 	snd_musicvolume.Callback ();
 
-	nomusic = !!Args->CheckParm("-nomusic") || !!Args->CheckParm("-nosound");
+	nomusic = !!Args->CheckParm("-nomusic") || !!Args->CheckParm("-nosound") || !!Args->CheckParm("-bench") || !!Args->CheckParm("-nodebench");
 
 #ifdef _WIN32
 	I_InitMusicWin32 ();
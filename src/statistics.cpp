@@ -558,7 +558,7 @@ static void SerializeStatistics(FArchive &arc)
 
 #define STAT_ID			MAKE_ID('s','T','a','t')
 
-void STAT_Write(FILE *file)
+void STAT_Write(FileWriter *file)
 {
 	FPNGChunkArchive arc (file, STAT_ID);
 	SerializeStatistics(arc);
@@ -569,7 +569,7 @@ void STAT_Read(PNGHandle *png)
 	DWORD chunkLen = (DWORD)M_FindPNGChunk (png, STAT_ID);
 	if (chunkLen != 0)
 	{
-		FPNGChunkArchive arc (png->File->GetFile(), STAT_ID, chunkLen);
+		FPNGChunkArchive arc (png->File, STAT_ID, chunkLen);
 		SerializeStatistics(arc);
 	}
 }
@@ -268,7 +268,11 @@ public:
 
 	void ToggleStat ();
 
+	const char *GetName () const { return m_Name; }
+	FStat *GetNext () const { return m_Next; }
+
 	static void PrintStat ();
+	static FStat *GetFirstStat () { return FirstStat; }
 	static FStat *FindStat (const char *name);
 	static void ToggleStat (const char *name);
 	static void DumpRegisteredStats ();
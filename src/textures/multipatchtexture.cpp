@@ -163,6 +163,8 @@ public:
 
 	int CopyTrueColorPixels(FBitmap *bmp, int x, int y, int rotate, FCopyInfo *inf = NULL);
 	int GetSourceLump() { return DefinitionLump; }
+	void GetSourceLumps(TArray<int> &lumps);
+	void GetPNGSources(TArray<FTexture *> &pngs);
 	FTexture *GetRedirect(bool wantwarped);
 	FTexture *GetRawTexture();
 
@@ -795,6 +797,43 @@ FTexture *FMultiPatchTexture::GetRawTexture()
 	return NumParts == 1 ? Parts->Texture : this;
 }
 
+//==========================================================================
+//
+// FMultiPatchTexture :: GetSourceLumps
+//
+// The definition lump is not needed to build the texture, only the
+// patches are.
+//
+//==========================================================================
+
+void FMultiPatchTexture::GetSourceLumps(TArray<int> &lumps)
+{
+	for (int i = 0; i < NumParts; ++i)
+	{
+		if (Parts[i].Texture != NULL)
+		{
+			Parts[i].Texture->GetSourceLumps(lumps);
+		}
+	}
+}
+
+//==========================================================================
+//
+// FMultiPatchTexture :: GetPNGSources
+//
+//==========================================================================
+
+void FMultiPatchTexture::GetPNGSources(TArray<FTexture *> &pngs)
+{
+	for (int i = 0; i < NumParts; ++i)
+	{
+		if (Parts[i].Texture != NULL)
+		{
+			Parts[i].Texture->GetPNGSources(pngs);
+		}
+	}
+}
+
 //==========================================================================
 //
 // FMultiPatchTexture :: TexPart :: TexPart
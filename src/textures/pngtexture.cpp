@@ -40,6 +40,8 @@
 #include "m_png.h"
 #include "bitmap.h"
 #include "v_palette.h"
+#include "workerpool.h"
+#include "profiler.h"
 #include "textures/textures.h"
 
 //==========================================================================
@@ -60,12 +62,14 @@ public:
 	FTextureFormat GetFormat ();
 	int CopyTrueColorPixels(FBitmap *bmp, int x, int y, int rotate, FCopyInfo *inf = NULL);
 	bool UseBasePalette();
+	void GetPNGSources(TArray<FTexture *> &pngs);
 
 protected:
 
 	FString SourceFile;
 	BYTE *Pixels;
 	Span **Spans;
+	BYTE *DecodedIDAT;		// filled in by PNGTexture_Predecode
 
 	BYTE BitDepth;
 	BYTE ColorType;
@@ -76,8 +80,23 @@ protected:
 	DWORD StartOfIDAT;
 
 	void MakeTexture ();
+	int GetIDATPitch () const;
+	bool ReadIDAT (FileReader *lump, BYTE *buffer);
+	BYTE *GetIDAT (FileReader *lump);
 
 	friend class FTexture;
+	friend class FPNGDecodeBatch;
+	friend void PNGTexture_Predecode(const TArray<FTexture *> &pngs);
+	friend void PNGTexture_FreePredecoded(const TArray<FTexture *> &pngs);
+};
+
+struct FPNGDecodeJob
+{
+	FPNGTexture *Tex;
+	BYTE *Data;			// the whole lump
+	int Size;
+	BYTE *Output;
+	bool Success;
 };
 
 
@@ -194,7 +213,7 @@ FTexture *PNGTexture_CreateFromFile(PNGHandle *png, const FString &filename)
 
 FPNGTexture::FPNGTexture (FileReader &lump, int lumpnum, const FString &filename, int width, int height,
 						  BYTE depth, BYTE colortype, BYTE interlace)
-: FTexture(NULL, lumpnum), SourceFile(filename), Pixels(0), Spans(0),
+: FTexture(NULL, lumpnum), SourceFile(filename), Pixels(0), Spans(0), DecodedIDAT(0),
   BitDepth(depth), ColorType(colortype), Interlace(interlace),
   PaletteMap(0), PaletteSize(0), StartOfIDAT(0)
 {
@@ -365,6 +384,11 @@ void FPNGTexture::Unload ()
 		delete[] Pixels;
 		Pixels = NULL;
 	}
+	if (DecodedIDAT != NULL)
+	{
+		delete[] DecodedIDAT;
+		DecodedIDAT = NULL;
+	}
 }
 
 //==========================================================================
@@ -439,38 +463,92 @@ const BYTE *FPNGTexture::GetPixels ()
 
 //==========================================================================
 //
+// FPNGTexture :: GetIDATPitch
 //
+// Bytes per row of the image data M_ReadIDAT produces.
 //
 //==========================================================================
 
-void FPNGTexture::MakeTexture ()
+int FPNGTexture::GetIDATPitch () const
 {
-	FileReader *lump;
+	static const BYTE bpp[] = {1, 0, 3, 1, 2, 0, 4};
+	return Width * bpp[ColorType];
+}
 
-	if (SourceLump >= 0)
+//==========================================================================
+//
+// FPNGTexture :: ReadIDAT
+//
+// Reads the image data from the given file into the buffer, which must be
+// GetIDATPitch() * Height bytes long.
+//
+//==========================================================================
+
+bool FPNGTexture::ReadIDAT (FileReader *lump, BYTE *buffer)
+{
+	DWORD len, id;
+
+	lump->Seek (StartOfIDAT, SEEK_SET);
+	lump->Read(&len, 4);
+	lump->Read(&id, 4);
+	return M_ReadIDAT (lump, buffer, Width, Height, GetIDATPitch(), BitDepth, ColorType, Interlace, BigLong((unsigned int)len));
+}
+
+//==========================================================================
+//
+// FPNGTexture :: GetIDAT
+//
+// Returns the image data PNGTexture_Predecode decoded, or reads it now if
+// there is none. The caller owns the returned buffer. If lump is NULL,
+// the source is opened here.
+//
+//==========================================================================
+
+BYTE *FPNGTexture::GetIDAT (FileReader *lump)
+{
+	BYTE *buffer = DecodedIDAT;
+
+	if (buffer != NULL)
 	{
-		lump = new FWadLump(Wads.OpenLumpNum(SourceLump));
+		DecodedIDAT = NULL;
+		return buffer;
+	}
+	buffer = new BYTE[GetIDATPitch() * Height];
+	if (lump != NULL)
+	{
+		ReadIDAT (lump, buffer);
+	}
+	else if (SourceLump >= 0)
+	{
+		FWadLump wadlump = Wads.OpenLumpNum(SourceLump);
+		ReadIDAT (&wadlump, buffer);
 	}
 	else
 	{
-		lump = new FileReader(SourceFile.GetChars());
+		FileReader file(SourceFile.GetChars());
+		ReadIDAT (&file, buffer);
 	}
+	return buffer;
+}
 
-	Pixels = new BYTE[Width*Height];
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+void FPNGTexture::MakeTexture ()
+{
 	if (StartOfIDAT == 0)
 	{
+		Pixels = new BYTE[Width*Height];
 		memset (Pixels, 0x99, Width*Height);
 	}
 	else
 	{
-		DWORD len, id;
-		lump->Seek (StartOfIDAT, SEEK_SET);
-		lump->Read(&len, 4);
-		lump->Read(&id, 4);
-
 		if (ColorType == 0 || ColorType == 3)	/* Grayscale and paletted */
 		{
-			M_ReadIDAT (lump, Pixels, Width, Height, Width, BitDepth, ColorType, Interlace, BigLong((unsigned int)len));
+			Pixels = GetIDAT (NULL);
 
 			if (Width == Height)
 			{
@@ -501,12 +579,11 @@ void FPNGTexture::MakeTexture ()
 		}
 		else		/* RGB and/or Alpha present */
 		{
-			int bytesPerPixel = ColorType == 2 ? 3 : ColorType == 4 ? 2 : 4;
-			BYTE *tempix = new BYTE[Width * Height * bytesPerPixel];
+			BYTE *tempix = GetIDAT (NULL);
 			BYTE *in, *out;
 			int x, y, pitch, backstep;
 
-			M_ReadIDAT (lump, tempix, Width, Height, Width*bytesPerPixel, BitDepth, ColorType, Interlace, BigLong((unsigned int)len));
+			Pixels = new BYTE[Width*Height];
 			in = tempix;
 			out = Pixels;
 
@@ -574,7 +651,6 @@ void FPNGTexture::MakeTexture ()
 			delete[] tempix;
 		}
 	}
-	delete lump;
 }
 
 //===========================================================================
@@ -589,8 +665,7 @@ int FPNGTexture::CopyTrueColorPixels(FBitmap *bmp, int x, int y, int rotate, FCo
 	PalEntry pe[256];
 	DWORD len, id;
 	FileReader *lump;
-	static char bpp[] = {1, 0, 3, 1, 2, 0, 4};
-	int pixwidth = Width * bpp[ColorType];
+	int pixwidth = GetIDATPitch();
 	int transpal = false;
 
 	if (SourceLump >= 0)
@@ -639,12 +714,7 @@ int FPNGTexture::CopyTrueColorPixels(FBitmap *bmp, int x, int y, int rotate, FCo
 		lump->Read(&id, 4);
 	}
 
-	BYTE * Pixels = new BYTE[pixwidth * Height];
-
-	lump->Seek (StartOfIDAT, SEEK_SET);
-	lump->Read(&len, 4);
-	lump->Read(&id, 4);
-	M_ReadIDAT (lump, Pixels, Width, Height, pixwidth, BitDepth, ColorType, Interlace, BigLong((unsigned int)len));
+	BYTE * Pixels = GetIDAT (lump);
 	delete lump;
 
 	switch (ColorType)
@@ -689,3 +759,128 @@ bool FPNGTexture::UseBasePalette()
 { 
 	return false; 
 }
+
+//===========================================================================
+//
+// FPNGTexture :: GetPNGSources
+//
+//===========================================================================
+
+void FPNGTexture::GetPNGSources(TArray<FTexture *> &pngs)
+{
+	pngs.Push(this);
+}
+
+//===========================================================================
+//
+// FPNGDecodeBatch
+//
+// Each item decodes one PNG from a copy of its lump in memory, so the
+// threads never touch the texture or the lump.
+//
+//===========================================================================
+
+class FPNGDecodeBatch : public FWorkerBatch
+{
+public:
+	FPNGDecodeBatch (TArray<FPNGDecodeJob> &jobs) : Jobs(jobs) {}
+
+	void Execute (int index, int thread)
+	{
+		FPNGDecodeJob &job = Jobs[index];
+		MemoryReader reader((const char *)job.Data, job.Size);
+
+		PROFILE_ZONE("PNGDecode");
+		job.Success = job.Tex->ReadIDAT (&reader, job.Output);
+	}
+
+private:
+	TArray<FPNGDecodeJob> &Jobs;
+};
+
+//===========================================================================
+//
+// PNGTexture_Predecode
+//
+// Decodes the image data of the given PNG textures on the worker pool.
+// When they are built later, they use that instead of decoding it
+// themselves. pngs may contain other textures than those PNGTexture
+// creates, and the same texture more than once.
+//
+//===========================================================================
+
+void PNGTexture_Predecode(const TArray<FTexture *> &pngs)
+{
+	TArray<FPNGDecodeJob> jobs;
+	TMap<FPNGTexture *, bool> queued;
+	unsigned int i;
+
+	if (WorkerPool.GetNumThreads() <= 1)
+	{
+		return;
+	}
+	for (i = 0; i < pngs.Size(); ++i)
+	{
+		FPNGTexture *tex = static_cast<FPNGTexture *>(pngs[i]);
+
+		if (tex->Pixels != NULL || tex->DecodedIDAT != NULL || tex->StartOfIDAT == 0 ||
+			tex->SourceLump < 0 || queued.CheckKey(tex) != NULL)
+		{
+			continue;
+		}
+		queued[tex] = true;
+
+		// The lump is read here, because only the main thread may do that.
+		FPNGDecodeJob &job = jobs[jobs.Reserve(1)];
+		job.Tex = tex;
+		job.Size = Wads.LumpLength(tex->SourceLump);
+		job.Data = new BYTE[job.Size];
+		Wads.ReadLump(tex->SourceLump, job.Data);
+		job.Output = new BYTE[tex->GetIDATPitch() * tex->Height];
+		job.Success = false;
+	}
+	if (jobs.Size() == 0)
+	{
+		return;
+	}
+
+	FPNGDecodeBatch batch(jobs);
+	WorkerPool.Run(&batch, jobs.Size());
+
+	for (i = 0; i < jobs.Size(); ++i)
+	{
+		delete[] jobs[i].Data;
+		if (jobs[i].Success)
+		{
+			jobs[i].Tex->DecodedIDAT = jobs[i].Output;
+		}
+		else
+		{
+			// Let the texture try again when it is built, so that it
+			// behaves the same as without predecoding.
+			delete[] jobs[i].Output;
+		}
+	}
+}
+
+//===========================================================================
+//
+// PNGTexture_FreePredecoded
+//
+// Frees the decoded image data of textures that did not use it.
+//
+//===========================================================================
+
+void PNGTexture_FreePredecoded(const TArray<FTexture *> &pngs)
+{
+	for (unsigned int i = 0; i < pngs.Size(); ++i)
+	{
+		FPNGTexture *tex = static_cast<FPNGTexture *>(pngs[i]);
+
+		if (tex->DecodedIDAT != NULL)
+		{
+			delete[] tex->DecodedIDAT;
+			tex->DecodedIDAT = NULL;
+		}
+	}
+}
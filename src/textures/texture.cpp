@@ -555,6 +555,20 @@ FTexture *FTexture::GetRawTexture()
 	return this;
 }
 
+void FTexture::GetSourceLumps(TArray<int> &lumps)
+{
+	int lump = GetSourceLump();
+
+	if (lump >= 0)
+	{
+		lumps.Push(lump);
+	}
+}
+
+void FTexture::GetPNGSources(TArray<FTexture *> &pngs)
+{
+}
+
 void FTexture::SetScaledSize(int fitwidth, int fitheight)
 {
 	xScale = FLOAT2FIXED(float(Width) / fitwidth);
@@ -52,8 +52,12 @@
 #include "v_video.h"
 #include "r_renderer.h"
 #include "r_sky.h"
+#include "m_png.h"
 #include "textures/textures.h"
 
+// How many bytes of PNG image data PrecacheLevel decodes at once
+#define PNG_PREDECODE_BATCH		(64*1024*1024)
+
 FTextureManager TexMan;
 
 CUSTOM_CVAR(Bool, vid_nopalsubstitutions, false, CVAR_ARCHIVE)
@@ -1235,9 +1239,47 @@ void FTextureManager::PrecacheLevel (void)
 	memset (hitlist, 0, cnt);
 
 	screen->GetHitlist(hitlist);
+
+	// Let the lumps be decompressed in the background while the textures
+	// are being built.
+	TArray<int> lumps;
+	for (int i = cnt - 1; i >= 0; i--)
+	{
+		if (hitlist[i])
+		{
+			ByIndex(i)->GetSourceLumps(lumps);
+		}
+	}
+	Wads.PrefetchLumps(lumps);
+
+	// PNGs are decoded on the worker pool in batches, right before the
+	// textures that need them are precached, so that not too much decoded
+	// data is around at once.
+	TArray<FTexture *> pngs;
+	int batchsize = 0;
+	int next = cnt - 1;
 	for (int i = cnt - 1; i >= 0; i--)
 	{
-		Renderer->PrecacheTexture(ByIndex(i), hitlist[i]);
+		if (hitlist[i])
+		{
+			unsigned int first = pngs.Size();
+			ByIndex(i)->GetPNGSources(pngs);
+			for (unsigned int j = first; j < pngs.Size(); ++j)
+			{
+				batchsize += pngs[j]->GetWidth() * pngs[j]->GetHeight() * 4;
+			}
+		}
+		if (i == 0 || batchsize >= PNG_PREDECODE_BATCH)
+		{
+			PNGTexture_Predecode(pngs);
+			for (; next >= i; next--)
+			{
+				Renderer->PrecacheTexture(ByIndex(next), hitlist[next]);
+			}
+			PNGTexture_FreePredecoded(pngs);
+			pngs.Clear();
+			batchsize = 0;
+		}
 	}
 
 	delete[] hitlist;
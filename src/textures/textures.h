@@ -239,6 +239,8 @@ public:
 	int CopyTrueColorTranslated(FBitmap *bmp, int x, int y, int rotate, FRemapTable *remap, FCopyInfo *inf = NULL);
 	virtual bool UseBasePalette();
 	virtual int GetSourceLump() { return SourceLump; }
+	virtual void GetSourceLumps(TArray<int> &lumps);	// all lumps needed to build the texture
+	virtual void GetPNGSources(TArray<FTexture *> &pngs);	// all PNG textures needed to build it
 	virtual FTexture *GetRedirect(bool wantwarped);
 	virtual FTexture *GetRawTexture();		// for FMultiPatchTexture to override
 	FTextureID GetID() const { return id; }
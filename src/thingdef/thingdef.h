@@ -41,6 +41,7 @@ INTBOOL CheckActorFlag(const AActor *actor, FFlagDef *fd);
 //
 //==========================================================================
 class FxExpression;
+class FxProgram;
 
 struct FStateLabels;
 
@@ -120,9 +121,11 @@ public:
 struct FStateExpression
 {
 	FxExpression *expr;
+	FxProgram *program;		// created by ResolveAll, or by Set afterwards
 	const PClass *owner;
 	bool constant;
 	bool cloned;
+	bool sharedprogram;		// program belongs to the expression this one was copied from
 };
 
 class FStateExpressions
@@ -138,6 +141,7 @@ public:
 	void Copy(int dest, int src, int cnt);
 	int ResolveAll();
 	FxExpression *Get(int no);
+	FxProgram *GetProgram(int no);
 	unsigned int Size() { return expressions.Size(); }
 };
 
@@ -190,6 +194,7 @@ struct AFuncDesc
 };
 
 AFuncDesc *FindFunction(const char * string);
+const char *FindFunctionName(actionf_p func);
 
 
 void ParseStates(FScanner &sc, FActorInfo *actor, AActor *defaults, Baggage &bag);
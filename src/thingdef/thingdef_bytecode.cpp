@@ -0,0 +1,596 @@
+/*
+** thingdef_bytecode.cpp
+**
+** Lowers resolved DECORATE expressions to flat code for a stack machine
+**
+**---------------------------------------------------------------------------
+**
+** Every instruction does exactly what the EvalExpression of the node it
+** was emitted for does, in the same order, so the results (including the
+** order in which random numbers are drawn) are the same as walking the
+** tree. Values on the stack are still ExpVals, and operators still
+** convert their operands with GetInt, GetFloat and GetBool. The savings
+** come from not making a virtual call and a recursive return of an ExpVal
+** for every node.
+**
+*/
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "actor.h"
+#include "sc_man.h"
+#include "tarray.h"
+#include "templates.h"
+#include "i_system.h"
+#include "m_random.h"
+#include "thingdef.h"
+#include "thingdef_exp.h"
+
+//==========================================================================
+//
+// FxProgram :: Compile
+//
+//==========================================================================
+
+FxProgram *FxProgram::Compile(FxExpression *x)
+{
+	FxProgram *prog = new FxProgram;
+
+	if (x->isConstant())
+	{
+		prog->Constant = true;
+		prog->Value = x->EvalExpression(NULL);
+		return prog;
+	}
+	x->Emit(*prog);
+	prog->Emit(FXOP_Return, -1);
+
+	if (prog->MaxDepth > MAX_STACK)
+	{ // Too deep for Execute's stack. Let the tree do all the work.
+		prog->Code.Clear();
+		prog->Constants.Clear();
+		prog->Depth = prog->MaxDepth = 0;
+		prog->Emit(FXOP_Tree, 1, 0, x);
+		prog->Emit(FXOP_Return, -1);
+	}
+	prog->Code.ShrinkToFit();
+	prog->Constants.ShrinkToFit();
+	return prog;
+}
+
+//==========================================================================
+//
+// FxProgram :: Emit
+//
+// Appends an instruction and returns its index. stackchange is how many
+// values it leaves on the stack minus how many it takes.
+//
+//==========================================================================
+
+int FxProgram::Emit(int op, int stackchange, int arg, void *ptr)
+{
+	FxInstruction instr;
+
+	instr.Op = op;
+	instr.Arg = arg;
+	instr.Ptr = ptr;
+	Depth += stackchange;
+	if (Depth > MaxDepth)
+	{
+		MaxDepth = Depth;
+	}
+	return Code.Push(instr);
+}
+
+//==========================================================================
+//
+// FxProgram :: EmitConstant
+//
+//==========================================================================
+
+int FxProgram::EmitConstant(const ExpVal &val)
+{
+	return Emit(FXOP_Const, 1, Constants.Push(val));
+}
+
+//==========================================================================
+//
+// FxProgram :: Execute
+//
+//==========================================================================
+
+#define INTOP(expr) \
+	{ int v2 = sp[-1].GetInt(); int v1 = sp[-2].GetInt(); --sp; \
+	  sp[-1].Type = VAL_Int; sp[-1].Int = (expr); break; }
+#define FLOATOP(expr) \
+	{ double v2 = sp[-1].GetFloat(); double v1 = sp[-2].GetFloat(); --sp; \
+	  sp[-1].Type = VAL_Float; sp[-1].Float = (expr); break; }
+#define FLOATCMP(expr) \
+	{ double v2 = sp[-1].GetFloat(); double v1 = sp[-2].GetFloat(); --sp; \
+	  sp[-1].Type = VAL_Int; sp[-1].Int = (expr); break; }
+
+ExpVal FxProgram::Execute(AActor *self) const
+{
+	ExpVal stack[MAX_STACK];
+	ExpVal *sp = stack;
+	const FxInstruction *code = &Code[0];
+	const FxInstruction *pc = code;
+
+	for (;; ++pc)
+	{
+		switch (pc->Op)
+		{
+		default:
+		case FXOP_Return:
+			return sp[-1];
+
+		case FXOP_Const:
+			*sp++ = Constants[pc->Arg];
+			break;
+
+		case FXOP_Tree:
+			*sp++ = ((FxExpression *)pc->Ptr)->EvalExpression(self);
+			break;
+
+		case FXOP_Self:
+			sp->Type = VAL_Object;
+			sp->pointer = self;
+			sp++;
+			break;
+
+		case FXOP_Global:
+		{
+			PSymbolVariable *var = (PSymbolVariable *)pc->Ptr;
+			*sp++ = GetVariableValue((void *)var->offset, var->ValueType);
+			break;
+		}
+
+		case FXOP_Member:
+		case FXOP_MemberAddr:
+		{
+			PSymbolVariable *var = (PSymbolVariable *)pc->Ptr;
+			char *object = sp[-1].GetPointer<char>();
+
+			if (object == NULL)
+			{
+				I_Error("Accessing member variable without valid object");
+			}
+			if (pc->Op == FXOP_Member)
+			{
+				sp[-1] = GetVariableValue(object + var->offset, var->ValueType);
+			}
+			else
+			{
+				sp[-1].pointer = object + var->offset;
+				sp[-1].Type = VAL_Pointer;
+			}
+			break;
+		}
+
+		case FXOP_Element:
+		{
+			int indexval = sp[-1].GetInt();
+			int *arraystart = sp[-2].GetPointer<int>();
+
+			if (indexval < 0 || indexval >= pc->Arg)
+			{
+				I_Error("Array index out of bounds");
+			}
+			--sp;
+			sp[-1].Int = arraystart[indexval];
+			sp[-1].Type = VAL_Int;
+			break;
+		}
+
+		case FXOP_IntCast:
+			sp[-1].Int = sp[-1].GetInt();
+			sp[-1].Type = VAL_Int;
+			break;
+
+		case FXOP_Abs:
+			if (sp[-1].Type == VAL_Float)
+			{
+				sp[-1].Float = fabs(sp[-1].Float);
+			}
+			else
+			{
+				sp[-1].Int = abs(sp[-1].Int);
+			}
+			break;
+
+		case FXOP_Bool:
+			sp[-1].Int = sp[-1].GetBool();
+			sp[-1].Type = VAL_Int;
+			break;
+
+		case FXOP_NegI:
+			sp[-1].Int = -sp[-1].GetInt();
+			sp[-1].Type = VAL_Int;
+			break;
+
+		case FXOP_NegF:
+			sp[-1].Float = -sp[-1].GetFloat();
+			sp[-1].Type = VAL_Float;
+			break;
+
+		case FXOP_BitNot:
+			sp[-1].Int = ~sp[-1].GetInt();
+			sp[-1].Type = VAL_Int;
+			break;
+
+		case FXOP_Not:
+			sp[-1].Int = !sp[-1].GetBool();
+			sp[-1].Type = VAL_Int;
+			break;
+
+		case FXOP_AddI:		INTOP(v1 + v2)
+		case FXOP_SubI:		INTOP(v1 - v2)
+		case FXOP_MulI:		INTOP(v1 * v2)
+		case FXOP_DivI:		if (sp[-1].GetInt() == 0) I_Error("Division by 0");
+							INTOP(v1 / v2)
+		case FXOP_ModI:		if (sp[-1].GetInt() == 0) I_Error("Division by 0");
+							INTOP(v1 % v2)
+		case FXOP_AddF:		FLOATOP(v1 + v2)
+		case FXOP_SubF:		FLOATOP(v1 - v2)
+		case FXOP_MulF:		FLOATOP(v1 * v2)
+		case FXOP_DivF:		if (sp[-1].GetFloat() == 0) I_Error("Division by 0");
+							FLOATOP(v1 / v2)
+		case FXOP_ModF:		if (sp[-1].GetFloat() == 0) I_Error("Division by 0");
+							FLOATOP(fmod(v1, v2))
+		case FXOP_LtI:		INTOP(v1 < v2)
+		case FXOP_GtI:		INTOP(v1 > v2)
+		case FXOP_GeI:		INTOP(v1 >= v2)
+		case FXOP_LeI:		INTOP(v1 <= v2)
+		case FXOP_EqI:		INTOP(v1 == v2)
+		case FXOP_NeI:		INTOP(v1 != v2)
+		case FXOP_LtF:		FLOATCMP(v1 < v2)
+		case FXOP_GtF:		FLOATCMP(v1 > v2)
+		case FXOP_GeF:		FLOATCMP(v1 >= v2)
+		case FXOP_LeF:		FLOATCMP(v1 <= v2)
+		case FXOP_EqF:		FLOATCMP(v1 == v2)
+		case FXOP_NeF:		FLOATCMP(v1 != v2)
+		case FXOP_Shl:		INTOP(v1 << v2)
+		case FXOP_Shr:		INTOP(v1 >> v2)
+		case FXOP_UShr:		INTOP(int((unsigned int)(v1) >> v2))
+		case FXOP_And:		INTOP(v1 & v2)
+		case FXOP_Or:		INTOP(v1 | v2)
+		case FXOP_Xor:		INTOP(v1 ^ v2)
+
+		case FXOP_Jump:
+			pc = code + pc->Arg - 1;
+			break;
+
+		case FXOP_JumpFalse:
+			if (!(--sp)->GetBool())
+			{
+				pc = code + pc->Arg - 1;
+			}
+			break;
+
+		case FXOP_AndJump:
+			if (!sp[-1].GetBool())
+			{
+				sp[-1].Type = VAL_Int;
+				sp[-1].Int = false;
+				pc = code + pc->Arg - 1;
+			}
+			else
+			{
+				--sp;
+			}
+			break;
+
+		case FXOP_OrJump:
+			if (sp[-1].GetBool())
+			{
+				sp[-1].Type = VAL_Int;
+				sp[-1].Int = true;
+				pc = code + pc->Arg - 1;
+			}
+			else
+			{
+				--sp;
+			}
+			break;
+
+		case FXOP_Random:
+			sp->Type = VAL_Int;
+			sp->Int = (*(FRandom *)pc->Ptr)();
+			sp++;
+			break;
+
+		case FXOP_RandomRange:
+		{
+			int maxval = sp[-1].GetInt();
+			int minval = sp[-2].GetInt();
+
+			if (maxval < minval)
+			{
+				swapvalues (maxval, minval);
+			}
+			--sp;
+			sp[-1].Type = VAL_Int;
+			sp[-1].Int = (*(FRandom *)pc->Ptr)(maxval - minval + 1) + minval;
+			break;
+		}
+
+		case FXOP_FRandom:
+			sp->Type = VAL_Float;
+			sp->Float = (*(FRandom *)pc->Ptr)(0x40000000) / double(0x40000000);
+			sp++;
+			break;
+
+		case FXOP_FRandomRange:
+		{
+			// The random number was drawn before the range was evaluated.
+			double maxval = sp[-1].GetFloat();
+			double minval = sp[-2].GetFloat();
+
+			if (maxval < minval)
+			{
+				swapvalues (maxval, minval);
+			}
+			sp -= 2;
+			sp[-1].Float = sp[-1].Float * (maxval - minval) + minval;
+			break;
+		}
+
+		case FXOP_Random2:
+			sp[-1].Int = ((FRandom *)pc->Ptr)->Random2(sp[-1].GetInt());
+			sp[-1].Type = VAL_Int;
+			break;
+		}
+	}
+}
+
+#undef INTOP
+#undef FLOATOP
+#undef FLOATCMP
+
+//==========================================================================
+//
+// Emit functions
+//
+// The default runs the node as a whole. Everything else mirrors the
+// node's EvalExpression.
+//
+//==========================================================================
+
+void FxExpression::Emit(FxProgram &prog)
+{
+	prog.Emit(FXOP_Tree, 1, 0, this);
+}
+
+void FxConstant::Emit(FxProgram &prog)
+{
+	prog.EmitConstant(value);
+}
+
+void FxIntCast::Emit(FxProgram &prog)
+{
+	basex->Emit(prog);
+	prog.Emit(FXOP_IntCast, 0);
+}
+
+void FxMinusSign::Emit(FxProgram &prog)
+{
+	Operand->Emit(prog);
+	prog.Emit(ValueType == VAL_Int ? FXOP_NegI : FXOP_NegF, 0);
+}
+
+void FxUnaryNotBitwise::Emit(FxProgram &prog)
+{
+	Operand->Emit(prog);
+	prog.Emit(FXOP_BitNot, 0);
+}
+
+void FxUnaryNotBoolean::Emit(FxProgram &prog)
+{
+	Operand->Emit(prog);
+	prog.Emit(FXOP_Not, 0);
+}
+
+void FxAddSub::Emit(FxProgram &prog)
+{
+	bool isfloat = ValueType == VAL_Float;
+	int op;
+
+	switch (Operator)
+	{
+	case '+':	op = isfloat ? FXOP_AddF : FXOP_AddI;	break;
+	case '-':	op = isfloat ? FXOP_SubF : FXOP_SubI;	break;
+	default:	FxExpression::Emit(prog);				return;
+	}
+	left->Emit(prog);
+	right->Emit(prog);
+	prog.Emit(op, -1);
+}
+
+void FxMulDiv::Emit(FxProgram &prog)
+{
+	bool isfloat = ValueType == VAL_Float;
+	int op;
+
+	switch (Operator)
+	{
+	case '*':	op = isfloat ? FXOP_MulF : FXOP_MulI;	break;
+	case '/':	op = isfloat ? FXOP_DivF : FXOP_DivI;	break;
+	case '%':	op = isfloat ? FXOP_ModF : FXOP_ModI;	break;
+	default:	FxExpression::Emit(prog);				return;
+	}
+	left->Emit(prog);
+	right->Emit(prog);
+	prog.Emit(op, -1);
+}
+
+void FxCompareRel::Emit(FxProgram &prog)
+{
+	bool isfloat = left->ValueType == VAL_Float || right->ValueType == VAL_Float;
+	int op;
+
+	switch (Operator)
+	{
+	case '<':		op = isfloat ? FXOP_LtF : FXOP_LtI;		break;
+	case '>':		op = isfloat ? FXOP_GtF : FXOP_GtI;		break;
+	case TK_Geq:	op = isfloat ? FXOP_GeF : FXOP_GeI;		break;
+	case TK_Leq:	op = isfloat ? FXOP_LeF : FXOP_LeI;		break;
+	default:		FxExpression::Emit(prog);				return;
+	}
+	left->Emit(prog);
+	right->Emit(prog);
+	prog.Emit(op, -1);
+}
+
+void FxCompareEq::Emit(FxProgram &prog)
+{
+	int op;
+
+	if (left->ValueType == VAL_Float || right->ValueType == VAL_Float)
+	{
+		op = Operator == TK_Eq ? FXOP_EqF : FXOP_NeF;
+	}
+	else if (ValueType == VAL_Int)
+	{
+		op = Operator == TK_Eq ? FXOP_EqI : FXOP_NeI;
+	}
+	else
+	{ // Pointer comparisons are not implemented and evaluate nothing.
+		FxExpression::Emit(prog);
+		return;
+	}
+	left->Emit(prog);
+	right->Emit(prog);
+	prog.Emit(op, -1);
+}
+
+void FxBinaryInt::Emit(FxProgram &prog)
+{
+	int op;
+
+	switch (Operator)
+	{
+	case TK_LShift:		op = FXOP_Shl;	break;
+	case TK_RShift:		op = FXOP_Shr;	break;
+	case TK_URShift:	op = FXOP_UShr;	break;
+	case '&':			op = FXOP_And;	break;
+	case '|':			op = FXOP_Or;	break;
+	case '^':			op = FXOP_Xor;	break;
+	default:			FxExpression::Emit(prog);	return;
+	}
+	left->Emit(prog);
+	right->Emit(prog);
+	prog.Emit(op, -1);
+}
+
+void FxBinaryLogical::Emit(FxProgram &prog)
+{
+	int jump;
+
+	if (Operator != TK_AndAnd && Operator != TK_OrOr)
+	{
+		FxExpression::Emit(prog);
+		return;
+	}
+	left->Emit(prog);
+	jump = prog.Emit(Operator == TK_AndAnd ? FXOP_AndJump : FXOP_OrJump, -1);
+	right->Emit(prog);
+	prog.Emit(FXOP_Bool, 0);
+	prog.SetJumpTarget(jump);
+}
+
+void FxConditional::Emit(FxProgram &prog)
+{
+	if (condition->isConstant())
+	{
+		(condition->EvalExpression(NULL).GetBool() ? truex : falsex)->Emit(prog);
+		return;
+	}
+
+	int jumpfalse, jumpend;
+
+	condition->Emit(prog);
+	jumpfalse = prog.Emit(FXOP_JumpFalse, -1);
+	truex->Emit(prog);
+	jumpend = prog.Emit(FXOP_Jump, 0);
+	prog.SetJumpTarget(jumpfalse);
+	prog.Pop();		// only one of the branches leaves a value
+	falsex->Emit(prog);
+	prog.SetJumpTarget(jumpend);
+}
+
+void FxAbs::Emit(FxProgram &prog)
+{
+	val->Emit(prog);
+	prog.Emit(FXOP_Abs, 0);
+}
+
+void FxRandom::Emit(FxProgram &prog)
+{
+	if (min != NULL && max != NULL)
+	{
+		min->Emit(prog);
+		max->Emit(prog);
+		prog.Emit(FXOP_RandomRange, -1, 0, rng);
+	}
+	else
+	{
+		prog.Emit(FXOP_Random, 1, 0, rng);
+	}
+}
+
+void FxFRandom::Emit(FxProgram &prog)
+{
+	prog.Emit(FXOP_FRandom, 1, 0, rng);
+	if (min != NULL && max != NULL)
+	{
+		min->Emit(prog);
+		max->Emit(prog);
+		prog.Emit(FXOP_FRandomRange, -2);
+	}
+}
+
+void FxRandom2::Emit(FxProgram &prog)
+{
+	mask->Emit(prog);
+	prog.Emit(FXOP_Random2, 0, 0, rng);
+}
+
+void FxGlobalVariable::Emit(FxProgram &prog)
+{
+	if (!AddressRequested)
+	{
+		prog.Emit(FXOP_Global, 1, 0, var);
+	}
+	else
+	{
+		ExpVal address;
+
+		address.pointer = (void*)var->offset;
+		address.Type = VAL_Pointer;
+		prog.EmitConstant(address);
+	}
+}
+
+void FxClassMember::Emit(FxProgram &prog)
+{
+	if (classx->ValueType == VAL_Class)
+	{ // Not implemented; EvalExpression reports the error.
+		FxExpression::Emit(prog);
+		return;
+	}
+	classx->Emit(prog);
+	prog.Emit(AddressRequested ? FXOP_MemberAddr : FXOP_Member, 0, 0, membervar);
+}
+
+void FxSelf::Emit(FxProgram &prog)
+{
+	prog.Emit(FXOP_Self, 1);
+}
+
+void FxArrayElement::Emit(FxProgram &prog)
+{
+	Array->Emit(prog);
+	index->Emit(prog);
+	prog.Emit(FXOP_Element, -1, Array->ValueType.size);
+}
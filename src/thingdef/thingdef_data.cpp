@@ -385,6 +385,25 @@ static FFlagDef *FindFlag (FFlagDef *flags, int numflags, const char *flag)
 	return NULL;
 }
 
+//==========================================================================
+//
+// Find the name of a native action function. This is a linear search
+// and only meant for diagnostics.
+//
+//==========================================================================
+
+const char *FindFunctionName(actionf_p func)
+{
+	for (unsigned int i = 0; i < AFTable.Size(); ++i)
+	{
+		if (AFTable[i].Function == func)
+		{
+			return AFTable[i].Name;
+		}
+	}
+	return NULL;
+}
+
 //==========================================================================
 //
 // Finds a flag that may have a qualified name
@@ -149,6 +149,8 @@ struct ExpVal
 //
 //==========================================================================
 
+class FxProgram;
+
 class FxExpression
 {
 protected:
@@ -165,6 +167,7 @@ public:
 	virtual ExpVal EvalExpression (AActor *self);
 	virtual bool isConstant() const;
 	virtual void RequestAddress();
+	virtual void Emit(FxProgram &prog);
 
 	FScriptPosition ScriptPosition;
 	FExpressionType ValueType;
@@ -290,6 +293,7 @@ public:
 		return true;
 	}
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 
@@ -310,6 +314,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 
@@ -344,6 +349,7 @@ public:
 	~FxMinusSign();
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -361,6 +367,7 @@ public:
 	~FxUnaryNotBitwise();
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -378,6 +385,7 @@ public:
 	~FxUnaryNotBoolean();
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -411,6 +419,7 @@ public:
 	FxAddSub(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -426,6 +435,7 @@ public:
 	FxMulDiv(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -441,6 +451,7 @@ public:
 	FxCompareRel(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -456,6 +467,7 @@ public:
 	FxCompareEq(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -471,6 +483,7 @@ public:
 	FxBinaryInt(int, FxExpression*, FxExpression*);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -491,6 +504,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -511,6 +525,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -530,6 +545,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -551,6 +567,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -564,6 +581,7 @@ class FxFRandom : public FxRandom
 public:
 	FxFRandom(FRandom *, FxExpression *mi, FxExpression *ma, const FScriptPosition &pos);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -584,6 +602,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 
@@ -603,6 +622,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 	void RequestAddress();
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -623,6 +643,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 	void RequestAddress();
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -637,6 +658,7 @@ public:
 	FxSelf(const FScriptPosition&);
 	FxExpression *Resolve(FCompileContext&);
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 //==========================================================================
@@ -657,6 +679,7 @@ public:
 	FxExpression *Resolve(FCompileContext&);
 	//void RequestAddress();
 	ExpVal EvalExpression (AActor *self);
+	void Emit(FxProgram &prog);
 };
 
 
@@ -803,6 +826,86 @@ public:
 
 
 
+//==========================================================================
+//
+// FxProgram
+//
+// A resolved expression lowered to a flat list of instructions for a small
+// stack machine, so that evaluating it takes neither recursion nor a
+// virtual call per node. Nodes without instructions of their own become a
+// single FXOP_Tree instruction that calls their EvalExpression. Constant
+// expressions are evaluated once, when they are compiled.
+//
+//==========================================================================
+
+enum EFxOpcode
+{
+	FXOP_Return,
+	FXOP_Const,				// Arg = constant index
+	FXOP_Tree,				// Ptr = FxExpression
+	FXOP_Self,
+	FXOP_Global,			// Ptr = PSymbolVariable
+	FXOP_Member,			// Ptr = PSymbolVariable
+	FXOP_MemberAddr,		// Ptr = PSymbolVariable
+	FXOP_Element,			// Arg = array size
+	FXOP_IntCast,
+	FXOP_Abs,
+	FXOP_Bool,
+	FXOP_NegI, FXOP_NegF,
+	FXOP_BitNot,
+	FXOP_Not,
+	FXOP_AddI, FXOP_SubI, FXOP_MulI, FXOP_DivI, FXOP_ModI,
+	FXOP_AddF, FXOP_SubF, FXOP_MulF, FXOP_DivF, FXOP_ModF,
+	FXOP_LtI, FXOP_GtI, FXOP_GeI, FXOP_LeI, FXOP_EqI, FXOP_NeI,
+	FXOP_LtF, FXOP_GtF, FXOP_GeF, FXOP_LeF, FXOP_EqF, FXOP_NeF,
+	FXOP_Shl, FXOP_Shr, FXOP_UShr, FXOP_And, FXOP_Or, FXOP_Xor,
+	FXOP_Jump,				// Arg = target
+	FXOP_JumpFalse,			// Arg = target
+	FXOP_AndJump,			// Arg = target; pops, jumps with 0 pushed if false
+	FXOP_OrJump,			// Arg = target; pops, jumps with 1 pushed if true
+	FXOP_Random,			// Ptr = FRandom
+	FXOP_RandomRange,		// Ptr = FRandom
+	FXOP_FRandom,			// Ptr = FRandom
+	FXOP_FRandomRange,
+	FXOP_Random2,			// Ptr = FRandom
+};
+
+struct FxInstruction
+{
+	int Op;
+	int Arg;
+	void *Ptr;
+};
+
+class FxProgram
+{
+public:
+	enum { MAX_STACK = 32 };
+
+	static FxProgram *Compile(FxExpression *x);
+
+	ExpVal Run(AActor *self) const
+	{
+		return Constant ? Value : Execute(self);
+	}
+
+	int Emit(int op, int stackchange, int arg = 0, void *ptr = NULL);
+	int EmitConstant(const ExpVal &val);
+	void SetJumpTarget(int instr) { Code[instr].Arg = Code.Size(); }
+	void Pop() { Depth--; }
+
+private:
+	TArray<FxInstruction> Code;
+	TArray<ExpVal> Constants;
+	int Depth, MaxDepth;
+	bool Constant;
+	ExpVal Value;
+
+	FxProgram() : Depth(0), MaxDepth(0), Constant(false) {}
+	ExpVal Execute(AActor *self) const;
+};
+
+ExpVal GetVariableValue (void *address, FExpressionType &type);
 FxExpression *ParseExpression (FScanner &sc, PClass *cls);
 
 
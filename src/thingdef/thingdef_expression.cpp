@@ -100,42 +100,42 @@ DEFINE_MEMBER_VARIABLE(meleerange, AActor)
 
 int EvalExpressionI (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
+	FxProgram *x = StateParams.GetProgram(xi);
 	if (x == NULL) return 0;
 
-	return x->EvalExpression (self).GetInt();
+	return x->Run(self).GetInt();
 }
 
 int EvalExpressionCol (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
+	FxProgram *x = StateParams.GetProgram(xi);
 	if (x == NULL) return 0;
 
-	return x->EvalExpression (self).GetColor();
+	return x->Run(self).GetColor();
 }
 
 FSoundID EvalExpressionSnd (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
+	FxProgram *x = StateParams.GetProgram(xi);
 	if (x == NULL) return 0;
 
-	return x->EvalExpression (self).GetSoundID();
+	return x->Run(self).GetSoundID();
 }
 
 double EvalExpressionF (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
+	FxProgram *x = StateParams.GetProgram(xi);
 	if (x == NULL) return 0;
 
-	return x->EvalExpression (self).GetFloat();
+	return x->Run(self).GetFloat();
 }
 
 fixed_t EvalExpressionFix (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
+	FxProgram *x = StateParams.GetProgram(xi);
 	if (x == NULL) return 0;
 
-	ExpVal val = x->EvalExpression (self);
+	ExpVal val = x->Run(self);
 
 	switch (val.Type)
 	{
@@ -150,26 +150,26 @@ fixed_t EvalExpressionFix (DWORD xi, AActor *self)
 
 FName EvalExpressionName (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
+	FxProgram *x = StateParams.GetProgram(xi);
 	if (x == NULL) return 0;
 
-	return x->EvalExpression (self).GetName();
+	return x->Run(self).GetName();
 }
 
 const PClass * EvalExpressionClass (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
+	FxProgram *x = StateParams.GetProgram(xi);
 	if (x == NULL) return 0;
 
-	return x->EvalExpression (self).GetClass();
+	return x->Run(self).GetClass();
 }
 
 FState *EvalExpressionState (DWORD xi, AActor *self)
 {
-	FxExpression *x = StateParams.Get(xi);
+	FxProgram *x = StateParams.GetProgram(xi);
 	if (x == NULL) return 0;
 
-	return x->EvalExpression (self).GetState();
+	return x->Run(self).GetState();
 }
 
 
@@ -179,7 +179,7 @@ FState *EvalExpressionState (DWORD xi, AActor *self)
 //
 //==========================================================================
 
-static ExpVal GetVariableValue (void *address, FExpressionType &type)
+ExpVal GetVariableValue (void *address, FExpressionType &type)
 {
 	// NOTE: This cannot access native variables of types
 	// char, short and float. These need to be redefined if necessary!
@@ -2754,6 +2754,10 @@ void FStateExpressions::Clear()
 		{
 			delete expressions[i].expr;
 		}
+		if (expressions[i].program != NULL && !expressions[i].sharedprogram)
+		{
+			delete expressions[i].program;
+		}
 	}
 	expressions.Clear();
 }
@@ -2769,9 +2773,11 @@ int FStateExpressions::Add(FxExpression *x, const PClass *o, bool c)
 	int idx = expressions.Reserve(1);
 	FStateExpression &exp = expressions[idx];
 	exp.expr = x;
+	exp.program = NULL;
 	exp.owner = o;
 	exp.constant = c;
 	exp.cloned = false;
+	exp.sharedprogram = false;
 	return idx;
 }
 
@@ -2788,9 +2794,11 @@ int FStateExpressions::Reserve(int num, const PClass *cls)
 	for(int i=0; i<num; i++)
 	{
 		exp[i].expr = NULL;
+		exp[i].program = NULL;
 		exp[i].owner = cls;
 		exp[i].constant = false;
 		exp[i].cloned = false;
+		exp[i].sharedprogram = false;
 	}
 	return idx;
 }
@@ -2805,9 +2813,20 @@ void FStateExpressions::Set(int num, FxExpression *x, bool cloned)
 {
 	if (num >= 0 && num < int(Size()))
 	{
-		assert(expressions[num].expr == NULL || expressions[num].cloned);
-		expressions[num].expr = x;
-		expressions[num].cloned = cloned;
+		FStateExpression &exp = expressions[num];
+
+		assert(exp.expr == NULL || exp.cloned);
+		exp.expr = x;
+		exp.cloned = cloned;
+
+		// DEHACKED sets parameters after ResolveAll has compiled everything,
+		// so already resolved expressions need their program made here.
+		if (exp.program != NULL && !exp.sharedprogram)
+		{
+			delete exp.program;
+		}
+		exp.program = (x != NULL && x->isresolved) ? FxProgram::Compile(x) : NULL;
+		exp.sharedprogram = false;
 	}
 }
 
@@ -2846,6 +2865,8 @@ int FStateExpressions::ResolveAll()
 			// Now that everything coming before has been resolved we may copy the actual pointer.
 			unsigned ii = unsigned((intptr_t)expressions[i].expr);
 			expressions[i].expr = expressions[ii].expr;
+			expressions[i].program = expressions[ii].program;
+			expressions[i].sharedprogram = true;
 		}
 		else if (expressions[i].expr != NULL)
 		{
@@ -2861,6 +2882,10 @@ int FStateExpressions::ResolveAll()
 				expressions[i].expr->ScriptPosition.Message(MSG_ERROR, "Constant expression expected");
 				errorcount++;
 			}
+			else
+			{
+				expressions[i].program = FxProgram::Compile(expressions[i].expr);
+			}
 		}
 	}
 
@@ -2892,3 +2917,16 @@ FxExpression *FStateExpressions::Get(int num)
 	return NULL;
 }
 
+//==========================================================================
+//
+//
+//
+//==========================================================================
+
+FxProgram *FStateExpressions::GetProgram(int num)
+{
+	if (num >= 0 && num < int(Size()))
+		return expressions[num].program;
+	return NULL;
+}
+
@@ -0,0 +1,377 @@
+/*
+** w_prefetch.cpp
+** Decompresses lumps on background threads before they are needed
+**
+**---------------------------------------------------------------------------
+**
+** When a level is set up, the lumps it is going to need are queued with
+** FWadCollection::PrefetchLumps. A few background threads take lumps from
+** the queue in order and decompress each into a buffer of its own. They
+** never touch the lump itself. When the main thread caches a queued lump,
+** FResourceLump::CacheLump calls TakePrefetchedLump:
+**
+** - If the lump is finished, its buffer becomes the lump's cache.
+** - If a thread is working on it, the main thread waits for that lump only.
+** - If no thread has started it, the main thread loads it itself, and the
+**   threads skip it.
+**
+** Buffers that nobody takes are freed when the next level starts.
+**
+** Only compressed lumps are queued, and only those that can be read
+** without the file's reader (see FResourceLump::CanPrefetch). Lumps of one
+** file are sorted the way they are stored in it. For 7z archives, this
+** means every solid block is normally decoded only once.
+**
+*/
+
+#include <stdlib.h>
+
+#include "doomtype.h"
+#include "templates.h"
+#include "tarray.h"
+#include "c_cvars.h"
+#include "stats.h"
+#include "critsec.h"
+#include "workerpool.h"
+#include "profiler.h"
+#include "w_wad.h"
+#include "resourcefiles/resourcefile.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define MAX_PREFETCH_THREADS	4
+
+// TYPES -------------------------------------------------------------------
+
+enum
+{
+	PF_Pending,
+	PF_Working,
+	PF_Done,
+	PF_Taken
+};
+
+struct FPrefetchItem
+{
+	FResourceLump *Lump;
+	char *Data;
+	int SortKey;
+	BYTE State;
+	bool Waited;		// the main thread waits for this item
+};
+
+class FPrefetchJob : public FBackgroundJob
+{
+public:
+	FPrefetchJob() : FBackgroundJob("Prefetch") {}
+	bool Finished;		// the thread ran out of items and is about to exit
+	void Run();
+};
+
+struct FPrefetcher
+{
+	// Everything but Pending is shared with the threads and guarded by Lock.
+	FCriticalSection Lock;
+	TArray<FPrefetchItem> Items;
+	unsigned int NextItem;
+	bool Cancel;
+	FSemaphore ItemDone;	// posted when an item the main thread waits for is done
+	FPrefetchJob Jobs[MAX_PREFETCH_THREADS];
+	int NumJobs;
+
+	// Maps queued lumps to their item. Only used by the main thread.
+	TMap<FResourceLump *, unsigned int> Pending;
+
+	int Queued, Used, Waits, Unused;
+};
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+CVAR (Bool, w_prefetch, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+// This is allocated on first use, so that it is never destroyed before
+// Wads, which flushes it when it is deleted.
+static FPrefetcher *Prefetcher;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// FPrefetchJob :: Run
+//
+//==========================================================================
+
+void FPrefetchJob::Run()
+{
+	FPrefetcher *pf = Prefetcher;
+
+	for (;;)
+	{
+		unsigned int index;
+		FResourceLump *lump;
+
+		pf->Lock.Enter();
+		while (pf->NextItem < pf->Items.Size() && pf->Items[pf->NextItem].State != PF_Pending)
+		{
+			pf->NextItem++;
+		}
+		if (pf->Cancel || pf->NextItem >= pf->Items.Size())
+		{
+			Finished = true;
+			pf->Lock.Leave();
+			break;
+		}
+		index = pf->NextItem++;
+		lump = pf->Items[index].Lump;
+		pf->Items[index].State = PF_Working;
+		pf->Lock.Leave();
+
+		char *data;
+		{
+			PROFILE_ZONE("PrefetchLump");
+			data = new char[lump->LumpSize];
+			try
+			{
+				if (!lump->Prefetch(data))
+				{
+					delete[] data;
+					data = NULL;
+				}
+			}
+			catch (...)
+			{
+				// Leave it to the main thread, which will report the error
+				// when it loads the lump itself.
+				delete[] data;
+				data = NULL;
+			}
+		}
+
+		pf->Lock.Enter();
+		FPrefetchItem &item = pf->Items[index];
+		item.Data = data;
+		item.State = PF_Done;
+		if (item.Waited)
+		{
+			pf->ItemDone.Post();
+		}
+		pf->Lock.Leave();
+	}
+}
+
+//==========================================================================
+//
+// SortItems
+//
+//==========================================================================
+
+static int STACK_ARGS SortItems(const void *a, const void *b)
+{
+	const FPrefetchItem *ia = (const FPrefetchItem *)a;
+	const FPrefetchItem *ib = (const FPrefetchItem *)b;
+
+	if (ia->Lump->Owner != ib->Lump->Owner)
+	{
+		return ia->Lump->Owner < ib->Lump->Owner ? -1 : 1;
+	}
+	return ia->SortKey - ib->SortKey;
+}
+
+//==========================================================================
+//
+// FWadCollection :: PrefetchLumps
+//
+// Adds lumps to the queue and makes sure there are threads working on it.
+//
+//==========================================================================
+
+void FWadCollection::PrefetchLumps(const TArray<int> &lumps)
+{
+	TArray<FPrefetchItem> items;
+	FPrefetcher *pf;
+
+	if (!w_prefetch)
+	{
+		return;
+	}
+	if (Prefetcher == NULL)
+	{
+		Prefetcher = pf = new FPrefetcher;
+		pf->NextItem = 0;
+		pf->Cancel = false;
+		pf->NumJobs = clamp(WorkerPool.GetNumThreads() - 1, 1, MAX_PREFETCH_THREADS);
+		pf->Queued = pf->Used = pf->Waits = pf->Unused = 0;
+	}
+	pf = Prefetcher;
+
+	for (unsigned int i = 0; i < lumps.Size(); ++i)
+	{
+		if ((unsigned)lumps[i] >= LumpInfo.Size())
+		{
+			continue;
+		}
+		FResourceLump *lump = LumpInfo[lumps[i]].lump;
+		int key;
+
+		if (lump->Cache != NULL || lump->LumpSize <= 0 || pf->Pending.CheckKey(lump) != NULL ||
+			(key = lump->CanPrefetch()) < 0)
+		{
+			continue;
+		}
+		FPrefetchItem &item = items[items.Reserve(1)];
+		item.Lump = lump;
+		item.Data = NULL;
+		item.SortKey = key;
+		item.State = PF_Pending;
+		item.Waited = false;
+		pf->Pending[lump] = 0;	// filled in below; this only weeds out duplicates
+	}
+	if (items.Size() == 0)
+	{
+		return;
+	}
+	qsort(&items[0], items.Size(), sizeof(items[0]), SortItems);
+
+	pf->Lock.Enter();
+	for (unsigned int i = 0; i < items.Size(); ++i)
+	{
+		pf->Pending[items[i].Lump] = pf->Items.Push(items[i]);
+	}
+	pf->Lock.Leave();
+	pf->Queued += items.Size();
+
+	for (int i = 0; i < pf->NumJobs; ++i)
+	{
+		FPrefetchJob &job = pf->Jobs[i];
+
+		if (job.IsStarted())
+		{
+			pf->Lock.Enter();
+			bool finished = job.Finished;
+			pf->Lock.Leave();
+			if (!finished)
+			{
+				continue;
+			}
+			job.Wait();
+		}
+		job.Finished = false;
+		job.Start();
+	}
+}
+
+//==========================================================================
+//
+// FWadCollection :: TakePrefetchedLump
+//
+// Returns the data for a queued lump, or NULL if the caller has to load it
+// itself.
+//
+//==========================================================================
+
+char *FWadCollection::TakePrefetchedLump(FResourceLump *lump)
+{
+	FPrefetcher *pf = Prefetcher;
+
+	if (pf == NULL || pf->Pending.CountUsed() == 0)
+	{
+		return NULL;
+	}
+	unsigned int *pindex = pf->Pending.CheckKey(lump);
+	if (pindex == NULL)
+	{
+		return NULL;
+	}
+	unsigned int index = *pindex;
+	char *data = NULL;
+
+	pf->Pending.Remove(lump);
+	pf->Lock.Enter();
+	if (pf->Items[index].State == PF_Working)
+	{
+		PROFILE_ZONE("PrefetchWait");
+		pf->Items[index].Waited = true;
+		pf->Lock.Leave();
+		pf->ItemDone.Wait();
+		pf->Lock.Enter();
+		pf->Waits++;
+	}
+	FPrefetchItem &item = pf->Items[index];
+	if (item.State == PF_Done)
+	{
+		data = item.Data;
+		item.Data = NULL;
+		if (data != NULL)
+		{
+			pf->Used++;
+		}
+	}
+	item.State = PF_Taken;
+	pf->Lock.Leave();
+	return data;
+}
+
+//==========================================================================
+//
+// FWadCollection :: FlushPrefetch
+//
+// Stops the threads and frees everything that has not been taken.
+//
+//==========================================================================
+
+void FWadCollection::FlushPrefetch()
+{
+	FPrefetcher *pf = Prefetcher;
+
+	if (pf == NULL)
+	{
+		return;
+	}
+	pf->Lock.Enter();
+	pf->Cancel = true;
+	pf->Lock.Leave();
+	for (int i = 0; i < pf->NumJobs; ++i)
+	{
+		if (pf->Jobs[i].IsStarted())
+		{
+			pf->Jobs[i].Wait();
+		}
+	}
+	for (unsigned int i = 0; i < pf->Items.Size(); ++i)
+	{
+		if (pf->Items[i].Data != NULL)
+		{
+			delete[] pf->Items[i].Data;
+			pf->Unused++;
+		}
+	}
+	pf->Items.Clear();
+	pf->Pending.Clear();
+	pf->NextItem = 0;
+	pf->Cancel = false;
+}
+
+//==========================================================================
+//
+// STAT prefetch
+//
+//==========================================================================
+
+ADD_STAT(prefetch)
+{
+	FString out;
+	FPrefetcher *pf = Prefetcher;
+
+	if (pf == NULL)
+	{
+		out = "No lumps prefetched";
+	}
+	else
+	{
+		out.Format("Queued: %d  Used: %d (waited for %d)  Unused: %d  Pending: %d  Threads: %d",
+			pf->Queued, pf->Used, pf->Waits, pf->Unused, pf->Pending.CountUsed(), pf->NumJobs);
+	}
+	return out;
+}
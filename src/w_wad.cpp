@@ -64,12 +64,6 @@
 //
 // WADFILE I/O related stuff.
 //
-struct FWadCollection::LumpRecord
-{
-	int			wadnum;
-	FResourceLump *lump;
-};
-
 // EXTERNAL FUNCTION PROTOTYPES --------------------------------------------
 extern bool nospriterename;
 
@@ -118,6 +112,7 @@ FWadCollection::~FWadCollection ()
 
 void FWadCollection::DeleteAll ()
 {
+	FlushPrefetch();
 	if (FirstLumpIndex != NULL)
 	{
 		delete[] FirstLumpIndex;
@@ -243,7 +238,16 @@ void FWadCollection::AddFile (const char *filename, FileReader *wadinfo)
 		{
 			try
 			{
-				wadinfo = new FileReader(filename);
+				// Mapping the file lets uncompressed lumps be used without
+				// copying them to the heap.
+				if (!Args->CheckParm("-nommap"))
+				{
+					wadinfo = new MappedFileReader(filename);
+				}
+				else
+				{
+					wadinfo = new FileReader(filename);
+				}
 			}
 			catch (CRecoverableError &err)
 			{ // Didn't find file
@@ -1310,9 +1314,9 @@ FWadLump::FWadLump(FResourceLump *lump, bool alwayscache)
 {
 	FileReader *f = lump->GetReader();
 
-	if (f != NULL && f->GetFile() != NULL && !alwayscache)
+	if (f != NULL && f->GetFile() != NULL && f->GetBuffer() == NULL && !alwayscache)
 	{
-		// Uncompressed lump in a file
+		// Uncompressed lump in a file that is not mapped
 		File = f->GetFile();
 		Length = lump->LumpSize;
 		StartPos = FilePos = lump->GetFileOffset();
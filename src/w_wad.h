@@ -207,9 +207,19 @@ public:
 
 	int AddExternalFile(const char *filename);
 
+	// Decompresses lumps in the background before they are needed. See
+	// w_prefetch.cpp.
+	void PrefetchLumps(const TArray<int> &lumps);
+	void FlushPrefetch();
+	static char *TakePrefetchedLump(FResourceLump *lump);
+
 protected:
 
-	struct LumpRecord;
+	struct LumpRecord
+	{
+		int			wadnum;
+		FResourceLump *lump;
+	};
 
 	TArray<FResourceFile *> Files;
 	TArray<LumpRecord> LumpInfo;
@@ -152,7 +152,8 @@ static void I_DeleteRenderer()
 
 void I_CreateRenderer()
 {
-	currentrenderer = vid_renderer;
+	// The benchmark does not draw anything, so it doesn't need OpenGL.
+	currentrenderer = (Args->CheckParm ("-bench") || Args->CheckParm ("-nodebench")) ? 0 : *vid_renderer;
 	if (Renderer == NULL)
 	{
 		if (currentrenderer==1) Renderer = gl_CreateInterface();
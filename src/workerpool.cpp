@@ -0,0 +1,500 @@
+/*
+** workerpool.cpp
+** A small pool of helper threads for batches of independent work items
+**
+**---------------------------------------------------------------------------
+**
+** Every helper thread owns a pair of semaphores: one to wake it up when a
+** batch is started and one it signals when it has run out of items. Items
+** are handed out in chunks of <granularity> under a critical section,
+** which is cheap enough for the coarse items this is meant for.
+**
+*/
+
+#ifdef _WIN32
+#ifndef _WINNT_
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+#else
+#include <unistd.h>
+#include "SDL.h"
+#include "SDL_thread.h"
+#endif
+
+#include <assert.h>
+
+#include "doomtype.h"
+#include "templates.h"
+#include "i_system.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "critsec.h"
+#include "profiler.h"
+#include "workerpool.h"
+
+// Total number of threads used for a batch, including the calling one.
+// 0 means one per CPU, 1 disables the helper threads.
+CUSTOM_CVAR (Int, sys_workerthreads, 0, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0)
+	{
+		self = 0;
+	}
+	else if (self > MAX_WORKER_THREADS)
+	{
+		self = MAX_WORKER_THREADS;
+	}
+	else
+	{
+		// The threads will be recreated with the new count by the next batch.
+		WorkerPool.Shutdown();
+	}
+}
+
+FWorkerPool WorkerPool;
+
+static FCriticalSection *PoolLock;
+
+static void ShutdownWorkerPool()
+{
+	WorkerPool.Shutdown();
+}
+
+//==========================================================================
+//
+// Platform specific thread and semaphore wrappers
+//
+//==========================================================================
+
+#ifdef _WIN32
+
+typedef HANDLE FSemaphoreHandle;
+typedef HANDLE FThreadHandle;
+
+static FSemaphoreHandle CreateSem()
+{
+	return CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+}
+
+static void DestroySem(FSemaphoreHandle sem)
+{
+	CloseHandle(sem);
+}
+
+static void WaitSem(FSemaphoreHandle sem)
+{
+	WaitForSingleObject(sem, INFINITE);
+}
+
+static void PostSem(FSemaphoreHandle sem)
+{
+	ReleaseSemaphore(sem, 1, NULL);
+}
+
+static DWORD WINAPI WorkerThreadProc(LPVOID param);
+
+static FThreadHandle StartThread(FWorkerThread *thread)
+{
+	DWORD id;
+	return CreateThread(NULL, 0, WorkerThreadProc, thread, 0, &id);
+}
+
+static void JoinThread(FThreadHandle handle)
+{
+	WaitForSingleObject(handle, INFINITE);
+	CloseHandle(handle);
+}
+
+#else
+
+typedef SDL_sem *FSemaphoreHandle;
+typedef SDL_Thread *FThreadHandle;
+
+static FSemaphoreHandle CreateSem()
+{
+	return SDL_CreateSemaphore(0);
+}
+
+static void DestroySem(FSemaphoreHandle sem)
+{
+	SDL_DestroySemaphore(sem);
+}
+
+static void WaitSem(FSemaphoreHandle sem)
+{
+	SDL_SemWait(sem);
+}
+
+static void PostSem(FSemaphoreHandle sem)
+{
+	SDL_SemPost(sem);
+}
+
+static int WorkerThreadProc(void *param);
+
+static FThreadHandle StartThread(FWorkerThread *thread)
+{
+	return SDL_CreateThread(WorkerThreadProc, thread);
+}
+
+static void JoinThread(FThreadHandle handle)
+{
+	SDL_WaitThread(handle, NULL);
+}
+
+#endif
+
+struct FWorkerThread
+{
+	FWorkerPool *Pool;
+	int Index;
+	bool Quit;
+	FSemaphoreHandle Wake;
+	FSemaphoreHandle Done;
+	FThreadHandle Handle;
+
+	void Loop()
+	{
+		FString name;
+
+		name.Format("Worker %d", Index);
+		Profile_SetThreadName(name);
+		for (;;)
+		{
+			WaitSem(Wake);
+			if (Quit)
+			{
+				break;
+			}
+			Pool->ProcessItems(Index);
+			PostSem(Done);
+		}
+		Profile_ReleaseThread();
+	}
+};
+
+#ifdef _WIN32
+static DWORD WINAPI WorkerThreadProc(LPVOID param)
+#else
+static int WorkerThreadProc(void *param)
+#endif
+{
+	static_cast<FWorkerThread *>(param)->Loop();
+	return 0;
+}
+
+//==========================================================================
+//
+// FWorkerPool :: GetNumCPUs
+//
+//==========================================================================
+
+int FWorkerPool::GetNumCPUs()
+{
+	int count;
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	count = (int)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	count = 1;
+#endif
+	return count < 1 ? 1 : count;
+}
+
+//==========================================================================
+//
+// FWorkerPool constructor
+//
+//==========================================================================
+
+FWorkerPool::FWorkerPool()
+{
+	Batch = NULL;
+	NextItem = NumItems = 0;
+	Granularity = 1;
+	Busy = false;
+}
+
+//==========================================================================
+//
+// FWorkerPool destructor
+//
+//==========================================================================
+
+FWorkerPool::~FWorkerPool()
+{
+	Shutdown();
+}
+
+//==========================================================================
+//
+// FWorkerPool :: GetNumThreads
+//
+// Returns the number of threads that may work on a batch, so callers can
+// size their per-thread scratch data before starting one.
+//
+//==========================================================================
+
+int FWorkerPool::GetNumThreads() const
+{
+	int count = sys_workerthreads;
+	if (count == 0)
+	{
+		count = GetNumCPUs();
+	}
+	return clamp<int>(count, 1, MAX_WORKER_THREADS);
+}
+
+//==========================================================================
+//
+// FWorkerPool :: StartThreads
+//
+//==========================================================================
+
+void FWorkerPool::StartThreads(int count)
+{
+	if (PoolLock == NULL)
+	{
+		PoolLock = new FCriticalSection;
+		atterm (ShutdownWorkerPool);
+	}
+	for (int i = Threads.Size() + 1; i < count; ++i)
+	{
+		FWorkerThread *thread = new FWorkerThread;
+		thread->Pool = this;
+		thread->Index = i;
+		thread->Quit = false;
+		thread->Wake = CreateSem();
+		thread->Done = CreateSem();
+		Profile_ReserveThreads(1);
+		thread->Handle = StartThread(thread);
+		if (thread->Handle == NULL)
+		{
+			Profile_ReserveThreads(-1);
+			DestroySem(thread->Wake);
+			DestroySem(thread->Done);
+			delete thread;
+			break;
+		}
+		Threads.Push(thread);
+	}
+}
+
+//==========================================================================
+//
+// FWorkerPool :: Shutdown
+//
+//==========================================================================
+
+void FWorkerPool::Shutdown()
+{
+	assert(!Busy);
+	for (unsigned i = 0; i < Threads.Size(); ++i)
+	{
+		FWorkerThread *thread = Threads[i];
+		thread->Quit = true;
+		PostSem(thread->Wake);
+		JoinThread(thread->Handle);
+		DestroySem(thread->Wake);
+		DestroySem(thread->Done);
+		delete thread;
+	}
+	Threads.Clear();
+}
+
+//==========================================================================
+//
+// FWorkerPool :: GrabItems
+//
+//==========================================================================
+
+bool FWorkerPool::GrabItems(int &start, int &end)
+{
+	PoolLock->Enter();
+	start = NextItem;
+	end = MIN(start + Granularity, NumItems);
+	NextItem = end;
+	PoolLock->Leave();
+	return start < end;
+}
+
+//==========================================================================
+//
+// FWorkerPool :: ProcessItems
+//
+//==========================================================================
+
+void FWorkerPool::ProcessItems(int thread)
+{
+	PROFILE_ZONE("ProcessItems");
+	int start, end;
+
+	while (GrabItems(start, end))
+	{
+		for (int i = start; i < end; ++i)
+		{
+			Batch->Execute(i, thread);
+		}
+	}
+}
+
+//==========================================================================
+//
+// FWorkerPool :: Run
+//
+// Processes <count> items of <batch> and returns when all of them are done.
+//
+//==========================================================================
+
+void FWorkerPool::Run(FWorkerBatch *batch, int count, int granularity)
+{
+	int numthreads;
+
+	if (granularity < 1)
+	{
+		granularity = 1;
+	}
+	if (Busy || count <= granularity || (numthreads = GetNumThreads()) == 1)
+	{
+		// Nested batches and tiny ones are run right here.
+		for (int i = 0; i < count; ++i)
+		{
+			batch->Execute(i, 0);
+		}
+		return;
+	}
+	if ((int)Threads.Size() + 1 < numthreads)
+	{
+		StartThreads(numthreads);
+	}
+	numthreads = MIN<int>(numthreads - 1, Threads.Size());
+	numthreads = MIN<int>(numthreads, (count + granularity - 1) / granularity - 1);
+
+	Busy = true;
+	Batch = batch;
+	NextItem = 0;
+	NumItems = count;
+	Granularity = granularity;
+
+	for (int i = 0; i < numthreads; ++i)
+	{
+		PostSem(Threads[i]->Wake);
+	}
+	ProcessItems(0);
+	for (int i = 0; i < numthreads; ++i)
+	{
+		WaitSem(Threads[i]->Done);
+	}
+
+	Batch = NULL;
+	Busy = false;
+}
+
+//==========================================================================
+//
+// FBackgroundJob
+//
+//==========================================================================
+
+#ifdef _WIN32
+static DWORD WINAPI BackgroundJobProc(LPVOID param)
+#else
+static int BackgroundJobProc(void *param)
+#endif
+{
+	FBackgroundJob *job = static_cast<FBackgroundJob *>(param);
+
+	// Take the buffer reserved by Start, whether the job records zones
+	// or not, so the reservation does not linger.
+	Profile_SetThreadName(job->GetName());
+	job->Run();
+	Profile_ReleaseThread();
+	return 0;
+}
+
+FBackgroundJob::FBackgroundJob(const char *name)
+{
+	Name = name;
+	Handle = NULL;
+	Started = false;
+}
+
+FBackgroundJob::~FBackgroundJob()
+{
+	assert(!Started);
+}
+
+void FBackgroundJob::Start()
+{
+	assert(!Started);
+	Started = true;
+	Profile_ReserveThreads(1);
+#ifdef _WIN32
+	DWORD id;
+	Handle = CreateThread(NULL, 0, BackgroundJobProc, this, 0, &id);
+#else
+	Handle = SDL_CreateThread(BackgroundJobProc, this);
+#endif
+	if (Handle == NULL)
+	{
+		// No thread, so do it right now.
+		Profile_ReserveThreads(-1);
+		Run();
+	}
+}
+
+void FBackgroundJob::Wait()
+{
+	if (Handle != NULL)
+	{
+		JoinThread((FThreadHandle)Handle);
+		Handle = NULL;
+	}
+	Started = false;
+}
+
+//==========================================================================
+//
+// FSemaphore
+//
+//==========================================================================
+
+FSemaphore::FSemaphore()
+{
+	Handle = (void *)CreateSem();
+	if (Handle == NULL)
+	{
+		I_FatalError("Failed to create a semaphore.");
+	}
+}
+
+FSemaphore::~FSemaphore()
+{
+	DestroySem((FSemaphoreHandle)Handle);
+}
+
+void FSemaphore::Wait()
+{
+	WaitSem((FSemaphoreHandle)Handle);
+}
+
+void FSemaphore::Post()
+{
+	PostSem((FSemaphoreHandle)Handle);
+}
+
+//==========================================================================
+//
+// CCMD workerthreads
+//
+//==========================================================================
+
+CCMD (workerthreads)
+{
+	Printf ("%d CPUs, %d worker threads\n",
+		FWorkerPool::GetNumCPUs(), WorkerPool.GetNumThreads());
+}
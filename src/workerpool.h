@@ -0,0 +1,105 @@
+/*
+** workerpool.h
+** A small pool of helper threads for batches of independent work items
+**
+**---------------------------------------------------------------------------
+**
+** The pool is deliberately simple: a batch is a fixed number of items that
+** do not depend on each other. The calling thread always works on the batch
+** as well and Run() does not return before every item has been processed,
+** so callers never have to deal with asynchronous completion. With no
+** helper threads (or while another batch is running) Run() degenerates to
+** a plain serial loop on the calling thread.
+**
+*/
+
+#ifndef __WORKERPOOL_H__
+#define __WORKERPOOL_H__
+
+#include "tarray.h"
+
+enum
+{
+	MAX_WORKER_THREADS = 16		// including the calling thread
+};
+
+class FWorkerBatch
+{
+public:
+	virtual ~FWorkerBatch() {}
+
+	// Processes item <index>. <thread> is in [0, FWorkerPool::GetNumThreads())
+	// and identifies the worker, so per-thread scratch data can be used
+	// without locking. Thread 0 is always the thread that called Run().
+	virtual void Execute(int index, int thread) = 0;
+};
+
+struct FWorkerThread;
+
+class FWorkerPool
+{
+public:
+	FWorkerPool();
+	~FWorkerPool();
+
+	void Run(FWorkerBatch *batch, int count, int granularity = 1);
+	int GetNumThreads() const;
+	bool IsRunning() const { return Busy; }
+	void Shutdown();
+
+	static int GetNumCPUs();
+
+private:
+	friend struct FWorkerThread;
+
+	void StartThreads(int count);
+	bool GrabItems(int &start, int &end);
+	void ProcessItems(int thread);
+
+	TArray<FWorkerThread *> Threads;
+	FWorkerBatch *Batch;
+	int NextItem, NumItems, Granularity;
+	bool Busy;
+};
+
+extern FWorkerPool WorkerPool;
+
+// A single job that runs on a thread of its own, for work that can overlap
+// with whatever the game thread does in the meantime. Wait() must be called
+// before the job's results are used or the job is destroyed.
+class FBackgroundJob
+{
+public:
+	// name is what the profiler calls the job's thread.
+	FBackgroundJob(const char *name = "Background job");
+	virtual ~FBackgroundJob();
+
+	void Start();
+	void Wait();
+	bool IsStarted() const { return Started; }
+	const char *GetName() const { return Name; }
+
+	virtual void Run() = 0;
+
+private:
+	const char *Name;
+	void *Handle;
+	bool Started;
+};
+
+// A counting semaphore, for threads that have to wait on each other
+// outside of a batch.
+class FSemaphore
+{
+public:
+	FSemaphore();
+	~FSemaphore();
+
+	void Wait();
+	void Post();
+
+private:
+	void *Handle;
+};
+
+#endif //__WORKERPOOL_H__